@@ -0,0 +1,370 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/*
+ * micenergy reports the energy a batch job used on each coprocessor. It
+ * is meant to be run from the prolog and epilog scripts of a resource
+ * manager: "begin" asks micmgmtd to start charging the job, and "end"
+ * stops it and prints what the job used. The daemon does the sampling
+ * and the integration, so nothing has to keep running between the two.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_SOCKET          "/var/run/micmgmtd.sock"
+#define MAX_JOB                 (256)
+#define MAX_LINE                (1024)
+
+/* Quantities reported by the daemon for each device of a job */
+enum {
+    Q_DURATION,
+    Q_ENERGY,
+    Q_AVG_POWER,
+    Q_PEAK_POWER,
+    Q_UNMEASURED,
+    Q_OUT_OF_RANGE,
+    NQUANTITIES
+};
+
+static const char *quantities[NQUANTITIES] = {
+    "duration_ms", "energy_uj", "avg_power_uw", "peak_power_uw",
+    "unmeasured_ms", "out_of_range"
+};
+
+struct device_energy {
+    unsigned int device_num;
+    unsigned long long value[NQUANTITIES];
+};
+
+/* Variables that resource managers set to the id of the running job */
+static const char *job_vars[] = {
+    "SLURM_JOB_ID", "PBS_JOBID", "LSB_JOBID", "JOB_ID"
+};
+
+static char *progname;
+
+static const struct option options[] = {
+    { "socket",  required_argument, NULL, 's' },
+    { "devices", required_argument, NULL, 'd' },
+    { "raw",     no_argument,       NULL, 'r' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      0,                 NULL, 0   }
+};
+
+static void usage(FILE *fp)
+{
+    fprintf(fp,
+            "Usage: %s [options] begin|read|end [<job>]\n\n"
+            "Accounts for the energy used by a job on each coprocessor.\n\n"
+            "  begin                   start accounting for the job\n"
+            "  read                    report the energy used so far\n"
+            "  end                     report it and stop accounting\n\n"
+            "  -s, --socket <path>     micmgmtd query socket "
+            "(default %s)\n"
+            "  -d, --devices <list>    devices used by the job, such as "
+            "0,2-3 (default all)\n"
+            "  -r, --raw               print the daemon's reply as is\n"
+            "  -h, --help              show this message\n\n"
+            "Without <job>, the id is taken from the first of SLURM_JOB_ID,"
+            "\nPBS_JOBID, LSB_JOBID and JOB_ID that is set.\n",
+            progname, DEFAULT_SOCKET);
+}
+
+static int connect_daemon(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: %s: socket path too long\n", progname, path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) ||
+        (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_request(int fd, const char *req)
+{
+    size_t len = strlen(req);
+    ssize_t n;
+
+    while (len > 0) {
+        n = send(fd, req, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "%s: send: %s\n", progname, strerror(errno));
+            return -1;
+        }
+        req += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Adds one "<device> <quantity> <value>" line to the table */
+static int add_line(const char *line, struct device_energy **rows,
+                    int *nrows)
+{
+    char name[32];
+    unsigned int device;
+    unsigned long long value;
+    struct device_energy *u;
+    int i, q;
+
+    if (sscanf(line, "%u %31s %llu", &device, name, &value) != 3)
+        return -1;
+
+    for (q = 0; q < NQUANTITIES; q++) {
+        if (strcmp(name, quantities[q]) == 0)
+            break;
+    }
+    /* Quantities added by a newer daemon are ignored */
+    if (q == NQUANTITIES)
+        return 0;
+
+    for (i = 0; i < *nrows; i++) {
+        if ((*rows)[i].device_num == device)
+            break;
+    }
+    if (i == *nrows) {
+        if ((u = realloc(*rows, (i + 1) * sizeof(*u))) == NULL)
+            return -1;
+        memset(&u[i], 0, sizeof(u[i]));
+        u[i].device_num = device;
+        *rows = u;
+        (*nrows)++;
+    }
+    (*rows)[i].value[q] = value;
+    return 0;
+}
+
+static void print_table(const struct device_energy *rows, int nrows)
+{
+    unsigned long long energy = 0, duration = 0, unmeasured = 0;
+    unsigned long long flagged = 0;
+    int i;
+
+    printf("%-8s %12s %14s %9s %9s %14s\n", "Device", "Duration(s)",
+           "Energy(J)", "Avg(W)", "Peak(W)", "Unmeasured(s)");
+    for (i = 0; i < nrows; i++) {
+        const unsigned long long *v = rows[i].value;
+
+        printf("mic%-5u %12.1f %14.3f %9.2f %9.2f %14.1f\n",
+               rows[i].device_num, v[Q_DURATION] / 1e3, v[Q_ENERGY] / 1e6,
+               v[Q_AVG_POWER] / 1e6, v[Q_PEAK_POWER] / 1e6,
+               v[Q_UNMEASURED] / 1e3);
+        energy += v[Q_ENERGY];
+        if (v[Q_DURATION] > duration)
+            duration = v[Q_DURATION];
+        unmeasured += v[Q_UNMEASURED];
+        flagged += v[Q_OUT_OF_RANGE];
+    }
+    if (nrows > 1)
+        printf("%-8s %12.1f %14.3f\n", "Total", duration / 1e3,
+               energy / 1e6);
+
+    if (unmeasured > 0)
+        printf("\nNo usable power reading covered %.1f s; the energy of "
+               "that time is not included.\n", unmeasured / 1e3);
+    if (flagged > 0)
+        printf("\n%llu reading(s) were flagged out of range by the SMC.\n",
+               flagged);
+}
+
+/*
+ * Reads the reply up to "END", printing it as is when raw or collecting
+ * it into a table otherwise. Returns 0 on "END" and -1 on "ERR" or a
+ * broken connection.
+ */
+static int read_reply(int fd, int raw, struct device_energy **rows,
+                      int *nrows)
+{
+    char line[MAX_LINE];
+    FILE *fp;
+    size_t len;
+    int ret = -1;
+
+    if ((fp = fdopen(fd, "r")) == NULL) {
+        fprintf(stderr, "%s: fdopen: %s\n", progname, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        len = strlen(line);
+        while ((len > 0) &&
+               ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+            line[--len] = '\0';
+
+        if (strcmp(line, "END") == 0) {
+            ret = 0;
+            break;
+        }
+        if (strncmp(line, "ERR ", 4) == 0) {
+            fprintf(stderr, "%s: %s\n", progname, line + 4);
+            break;
+        }
+
+        if (raw) {
+            printf("%s\n", line);
+        } else if (add_line(line, rows, nrows) < 0) {
+            fprintf(stderr, "%s: unexpected reply '%s'\n", progname, line);
+            break;
+        }
+    }
+    if ((ret < 0) && ferror(fp))
+        fprintf(stderr, "%s: %s\n", progname, strerror(errno));
+    else if ((ret < 0) && feof(fp))
+        fprintf(stderr, "%s: connection closed\n", progname);
+
+    fclose(fp);
+    return ret;
+}
+
+static const char *default_job(void)
+{
+    const char *job;
+    size_t i;
+
+    for (i = 0; i < sizeof(job_vars) / sizeof(job_vars[0]); i++) {
+        if (((job = getenv(job_vars[i])) != NULL) && (*job != '\0'))
+            return job;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = DEFAULT_SOCKET;
+    const char *devices = "all";
+    const char *cmd, *job;
+    char req[MAX_LINE];
+    struct device_energy *rows = NULL;
+    int nrows = 0;
+    int raw = 0;
+    int c, fd;
+
+    progname = argv[0];
+
+    while ((c = getopt_long(argc, argv, "s:d:rh", options, NULL)) != -1) {
+        switch (c) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'd':
+            devices = optarg;
+            break;
+        case 'r':
+            raw = 1;
+            break;
+        case 'h':
+            usage(stdout);
+            return 0;
+        default:
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if ((optind == argc) || (argc - optind > 2)) {
+        usage(stderr);
+        return 1;
+    }
+    cmd = argv[optind];
+    job = (argc - optind == 2) ? argv[optind + 1] : default_job();
+
+    if ((strcasecmp(cmd, "begin") != 0) && (strcasecmp(cmd, "read") != 0) &&
+        (strcasecmp(cmd, "end") != 0)) {
+        fprintf(stderr, "%s: unknown command '%s'\n", progname, cmd);
+        return 1;
+    }
+    if (job == NULL) {
+        fprintf(stderr, "%s: no job id given and none in the environment\n",
+                progname);
+        return 1;
+    }
+    if ((*job == '\0') || (strlen(job) >= MAX_JOB) ||
+        (strpbrk(job, " \t\r\n") != NULL)) {
+        fprintf(stderr, "%s: invalid job id '%s'\n", progname, job);
+        return 1;
+    }
+    if (strpbrk(devices, " \t\r\n") != NULL) {
+        fprintf(stderr, "%s: invalid device list '%s'\n", progname, devices);
+        return 1;
+    }
+
+    if (strcasecmp(cmd, "begin") == 0)
+        snprintf(req, sizeof(req), "JOB BEGIN %s %s\nQUIT\n", job, devices);
+    else
+        snprintf(req, sizeof(req), "JOB %s %s\nQUIT\n",
+                 strcasecmp(cmd, "end") == 0 ? "END" : "READ", job);
+
+    if ((fd = connect_daemon(socket_path)) < 0)
+        return 1;
+    if (send_request(fd, req) < 0) {
+        close(fd);
+        return 1;
+    }
+    if (read_reply(fd, raw, &rows, &nrows) < 0) {
+        free(rows);
+        return 1;
+    }
+
+    if (!raw && (nrows > 0))
+        print_table(rows, nrows);
+
+    free(rows);
+    return 0;
+}
@@ -0,0 +1,693 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/*
+ * micexporter writes the state of every coprocessor to a file in the
+ * Prometheus text exposition format, for the textfile collector of
+ * node_exporter to pick up. Device handles stay open between updates and
+ * each feature of a card is read with a single RAS request, whose reply
+ * carries all of that feature's sensors. The file is written under a
+ * temporary name and renamed over the previous one, so a scrape never
+ * sees a partial file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <miclib.h>
+
+#define DEFAULT_INTERVAL_MS     (15000)
+
+/* Sensor status reported by the SMC when a sensor cannot be read */
+#define SENSOR_UNAVAILABLE      (3)
+
+/* One coprocessor and the replies of its last update */
+struct card {
+    int                             device_num;
+    struct mic_device              *mdh;
+    double                          duration;   /* Of the last update, s */
+    struct mic_thermal_info        *thermal;
+    struct mic_power_util_info     *power;
+    struct mic_memory_util_info    *memory;
+    struct mic_throttle_state_info *ttl;
+    struct mic_turbo_info          *turbo;
+    struct mic_core_util           *cutil;
+    int                             cutil_ok;   /* Updated by the last one */
+    uint16_t                        ncores;
+    uint16_t                        size;       /* Cores counters hold */
+    uint64_t                       *counters;   /* User, nice, sys, idle */
+};
+
+struct temp_sensor {
+    const char *sensor;
+    int (*get)(struct mic_thermal_info *, uint16_t *);
+    int (*valid)(struct mic_thermal_info *, int *);
+};
+
+struct power_sensor {
+    const char *sensor;
+    const char *quantity;   /* power, current or voltage */
+    int (*get)(struct mic_power_util_info *, uint32_t *);
+    int (*status)(struct mic_power_util_info *, uint32_t *);
+};
+
+static const struct temp_sensor temp_sensors[] = {
+    { "gddr",   mic_get_gddr_temp,   mic_is_gddr_temp_valid   },
+    { "fanin",  mic_get_fanin_temp,  mic_is_fanin_temp_valid  },
+    { "fanout", mic_get_fanout_temp, mic_is_fanout_temp_valid },
+    { "vccp",   mic_get_vccp_temp,   mic_is_vccp_temp_valid   },
+    { "vddg",   mic_get_vddg_temp,   mic_is_vddg_temp_valid   },
+    { "vddq",   mic_get_vddq_temp,   mic_is_vddq_temp_valid   },
+};
+
+static const struct power_sensor power_sensors[] = {
+    { "total0",   "power",   mic_get_total_power_readings_w0,
+      mic_get_total_power_sensor_sts_w0 },
+    { "total1",   "power",   mic_get_total_power_readings_w1,
+      mic_get_total_power_sensor_sts_w1 },
+    { "inst",     "power",   mic_get_inst_power_readings,
+      mic_get_inst_power_sensor_sts },
+    { "max_inst", "power",   mic_get_max_inst_power_readings,
+      mic_get_max_inst_power_sensor_sts },
+    { "pcie",     "power",   mic_get_pcie_power_readings,
+      mic_get_pcie_power_sensor_sts },
+    { "c2x3",     "power",   mic_get_c2x3_power_readings,
+      mic_get_c2x3_power_sensor_sts },
+    { "c2x4",     "power",   mic_get_c2x4_power_readings,
+      mic_get_c2x4_power_sensor_sts },
+    { "vccp",     "power",   mic_get_vccp_power_readings,
+      mic_get_vccp_power_sensor_sts },
+    { "vccp",     "current", mic_get_vccp_current_readings,
+      mic_get_vccp_current_sensor_sts },
+    { "vccp",     "voltage", mic_get_vccp_voltage_readings,
+      mic_get_vccp_voltage_sensor_sts },
+    { "vddg",     "power",   mic_get_vddg_power_readings,
+      mic_get_vddg_power_sensor_sts },
+    { "vddg",     "current", mic_get_vddg_current_readings,
+      mic_get_vddg_current_sensor_sts },
+    { "vddg",     "voltage", mic_get_vddg_voltage_readings,
+      mic_get_vddg_voltage_sensor_sts },
+    { "vddq",     "power",   mic_get_vddq_power_readings,
+      mic_get_vddq_power_sensor_sts },
+    { "vddq",     "current", mic_get_vddq_current_readings,
+      mic_get_vddq_current_sensor_sts },
+    { "vddq",     "voltage", mic_get_vddq_voltage_readings,
+      mic_get_vddq_voltage_sensor_sts },
+};
+
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
+
+static const char *const core_modes[] = { "user", "nice", "sys", "idle" };
+
+static char *progname;
+static volatile sig_atomic_t stop_requested;
+
+static const struct option options[] = {
+    { "interval",    required_argument, NULL, 'i' },
+    { "once",        no_argument,       NULL, '1' },
+    { "no-per-core", no_argument,       NULL, 'C' },
+    { "help",        no_argument,       NULL, 'h' },
+    { NULL,          0,                 NULL, 0   }
+};
+
+static void usage(FILE *fp)
+{
+    fprintf(fp,
+            "Usage: %s [options] <file>\n\n"
+            "Writes coprocessor metrics to <file> for the node_exporter "
+            "textfile collector.\n\n"
+            "  -i, --interval <ms>     update interval (default %d)\n"
+            "  -1, --once              write the file once and exit\n"
+            "  -C, --no-per-core       leave out per-core utilization\n"
+            "  -h, --help              show this message\n",
+            progname, DEFAULT_INTERVAL_MS);
+}
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void free_replies(struct card *card)
+{
+    if (card->thermal != NULL)
+        (void)mic_free_thermal_info(card->thermal);
+    if (card->power != NULL)
+        (void)mic_free_power_utilization_info(card->power);
+    if (card->memory != NULL)
+        (void)mic_free_memory_utilization_info(card->memory);
+    if (card->ttl != NULL)
+        (void)mic_free_throttle_state_info(card->ttl);
+    if (card->turbo != NULL)
+        (void)mic_free_turbo_info(card->turbo);
+    card->thermal = NULL;
+    card->power = NULL;
+    card->memory = NULL;
+    card->ttl = NULL;
+    card->turbo = NULL;
+    card->cutil_ok = 0;
+    card->ncores = 0;
+}
+
+static void close_cards(struct card *cards, int ncards)
+{
+    int i;
+
+    for (i = 0; i < ncards; i++) {
+        free_replies(&cards[i]);
+        if (cards[i].cutil != NULL)
+            (void)mic_free_core_util(cards[i].cutil);
+        if (cards[i].mdh != NULL)
+            (void)mic_close_device(cards[i].mdh);
+        free(cards[i].counters);
+    }
+    free(cards);
+}
+
+static int read_counters(struct card *card)
+{
+    uint16_t n = 0;
+    uint64_t *c;
+
+    (void)mic_get_core_counters_soa(card->cutil, &n, NULL, NULL, NULL, NULL);
+    if (n > card->size) {
+        if ((c = realloc(card->counters, 4 * n * sizeof(*c))) == NULL)
+            return -1;
+        card->counters = c;
+        card->size = n;
+    }
+    n = card->size;
+    c = card->counters;
+    if (mic_get_core_counters_soa(card->cutil, &n, c, c + n, c + 2 * n,
+                                  c + 3 * n) != E_MIC_SUCCESS)
+        return -1;
+    card->ncores = n;
+    return 0;
+}
+
+/*
+ * Replaces the replies of a card with fresh ones. A card whose handle
+ * cannot be opened, or which fails to answer at all, is reported down and
+ * its handle reopened on the next update, in case it was reset.
+ */
+static void update_card(struct card *card, int per_core)
+{
+    double start = now();
+
+    free_replies(card);
+
+    if ((card->mdh == NULL) &&
+        (mic_open_device(&card->mdh, card->device_num) != E_MIC_SUCCESS)) {
+        card->mdh = NULL;
+        return;
+    }
+
+    if (mic_get_thermal_info(card->mdh, &card->thermal) != E_MIC_SUCCESS) {
+        fprintf(stderr, "%s: mic%d: %s\n", progname, card->device_num,
+                mic_get_error_string());
+        card->thermal = NULL;
+        (void)mic_close_device(card->mdh);
+        card->mdh = NULL;
+        return;
+    }
+
+    if (mic_get_power_utilization_info(card->mdh, &card->power) !=
+        E_MIC_SUCCESS)
+        card->power = NULL;
+    if (mic_get_memory_utilization_info(card->mdh, &card->memory) !=
+        E_MIC_SUCCESS)
+        card->memory = NULL;
+    if (mic_get_throttle_state_info(card->mdh, &card->ttl) != E_MIC_SUCCESS)
+        card->ttl = NULL;
+    if (mic_get_turbo_state_info(card->mdh, &card->turbo) != E_MIC_SUCCESS)
+        card->turbo = NULL;
+
+    if (((card->cutil != NULL) ||
+         (mic_alloc_core_util(&card->cutil) == E_MIC_SUCCESS)) &&
+        (mic_update_core_util(card->mdh, card->cutil) == E_MIC_SUCCESS)) {
+        card->cutil_ok = 1;
+        if (per_core && (read_counters(card) < 0))
+            card->ncores = 0;
+    }
+
+    card->duration = now() - start;
+}
+
+static void family(FILE *fp, const char *name, const char *type,
+                   const char *help)
+{
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_thermal(FILE *fp, struct card *cards, int ncards)
+{
+    uint32_t die, rpm, pwm;
+    uint16_t temp;
+    int i, valid;
+    size_t s;
+
+    family(fp, "mic_temperature_celsius", "gauge",
+           "Temperature of a coprocessor sensor.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].thermal == NULL)
+            continue;
+        if ((mic_is_die_temp_valid(cards[i].thermal, &valid) ==
+             E_MIC_SUCCESS) && valid &&
+            (mic_get_die_temp(cards[i].thermal, &die) == E_MIC_SUCCESS))
+            fprintf(fp, "mic_temperature_celsius{device=\"mic%d\","
+                    "sensor=\"die\"} %u\n", cards[i].device_num, die);
+        for (s = 0; s < ARRAY_SIZE(temp_sensors); s++) {
+            if ((temp_sensors[s].valid(cards[i].thermal, &valid) ==
+                 E_MIC_SUCCESS) && valid &&
+                (temp_sensors[s].get(cards[i].thermal, &temp) ==
+                 E_MIC_SUCCESS))
+                fprintf(fp, "mic_temperature_celsius{device=\"mic%d\","
+                        "sensor=\"%s\"} %u\n", cards[i].device_num,
+                        temp_sensors[s].sensor, temp);
+        }
+    }
+
+    family(fp, "mic_fan_rpm", "gauge", "Fan speed.");
+    for (i = 0; i < ncards; i++) {
+        if ((cards[i].thermal != NULL) &&
+            (mic_get_fan_rpm(cards[i].thermal, &rpm) == E_MIC_SUCCESS))
+            fprintf(fp, "mic_fan_rpm{device=\"mic%d\"} %u\n",
+                    cards[i].device_num, rpm);
+    }
+
+    family(fp, "mic_fan_pwm_percent", "gauge", "Fan duty cycle.");
+    for (i = 0; i < ncards; i++) {
+        if ((cards[i].thermal != NULL) &&
+            (mic_get_fan_pwm(cards[i].thermal, &pwm) == E_MIC_SUCCESS))
+            fprintf(fp, "mic_fan_pwm_percent{device=\"mic%d\"} %u\n",
+                    cards[i].device_num, pwm);
+    }
+}
+
+/* Readings are in micro-units; those of unavailable sensors are left out */
+static void write_power(FILE *fp, struct card *cards, int ncards)
+{
+    static const struct {
+        const char *quantity;
+        const char *name;
+        const char *help;
+    } families[] = {
+        { "power",   "mic_power_watts",    "Power drawn, by sensor." },
+        { "current", "mic_current_amperes", "Current drawn, by rail." },
+        { "voltage", "mic_voltage_volts",  "Voltage, by rail." },
+    };
+    uint32_t value, sts;
+    size_t f, s;
+    int i;
+
+    for (f = 0; f < ARRAY_SIZE(families); f++) {
+        family(fp, families[f].name, "gauge", families[f].help);
+        for (i = 0; i < ncards; i++) {
+            if (cards[i].power == NULL)
+                continue;
+            for (s = 0; s < ARRAY_SIZE(power_sensors); s++) {
+                if ((strcmp(power_sensors[s].quantity,
+                            families[f].quantity) != 0) ||
+                    (power_sensors[s].status(cards[i].power, &sts) !=
+                     E_MIC_SUCCESS) || (sts == SENSOR_UNAVAILABLE) ||
+                    (power_sensors[s].get(cards[i].power, &value) !=
+                     E_MIC_SUCCESS))
+                    continue;
+                fprintf(fp, "%s{device=\"mic%d\",sensor=\"%s\"} %.6f\n",
+                        families[f].name, cards[i].device_num,
+                        power_sensors[s].sensor, value / 1e6);
+            }
+        }
+    }
+
+    family(fp, "mic_power_sensor_status", "gauge",
+           "SMC status of a power sensor: 0 ok, 1 and 2 out of range, "
+           "3 unavailable.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].power == NULL)
+            continue;
+        for (s = 0; s < ARRAY_SIZE(power_sensors); s++) {
+            if (power_sensors[s].status(cards[i].power, &sts) ==
+                E_MIC_SUCCESS)
+                fprintf(fp, "mic_power_sensor_status{device=\"mic%d\","
+                        "sensor=\"%s\",quantity=\"%s\"} %u\n",
+                        cards[i].device_num, power_sensors[s].sensor,
+                        power_sensors[s].quantity, sts);
+        }
+    }
+}
+
+static void write_memory(FILE *fp, struct card *cards, int ncards)
+{
+    static const struct {
+        const char *name;
+        const char *help;
+        int (*get)(struct mic_memory_util_info *, uint32_t *);
+    } families[] = {
+        { "mic_memory_total_bytes", "Total coprocessor memory.",
+          mic_get_total_memory_size },
+        { "mic_memory_free_bytes", "Free coprocessor memory.",
+          mic_get_available_memory_size },
+        { "mic_memory_buffers_bytes", "Coprocessor memory in buffers.",
+          mic_get_memory_buffers_size },
+    };
+    uint32_t kb;
+    size_t f;
+    int i;
+
+    for (f = 0; f < ARRAY_SIZE(families); f++) {
+        family(fp, families[f].name, "gauge", families[f].help);
+        for (i = 0; i < ncards; i++) {
+            if ((cards[i].memory != NULL) &&
+                (families[f].get(cards[i].memory, &kb) == E_MIC_SUCCESS))
+                fprintf(fp, "%s{device=\"mic%d\"} %llu\n", families[f].name,
+                        cards[i].device_num, (unsigned long long)kb * 1024);
+        }
+    }
+}
+
+static void write_throttle(FILE *fp, struct card *cards, int ncards)
+{
+    uint32_t count, time;
+    int i, active;
+
+    family(fp, "mic_throttle_active", "gauge",
+           "Whether the coprocessor is being throttled, by cause.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].ttl == NULL)
+            continue;
+        if (mic_get_thermal_ttl_active(cards[i].ttl, &active) ==
+            E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_active{device=\"mic%d\","
+                    "cause=\"thermal\"} %d\n", cards[i].device_num,
+                    active != 0);
+        if (mic_get_power_ttl_active(cards[i].ttl, &active) == E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_active{device=\"mic%d\","
+                    "cause=\"power\"} %d\n", cards[i].device_num,
+                    active != 0);
+    }
+
+    family(fp, "mic_throttle_events_total", "counter",
+           "Throttling events since boot, by cause.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].ttl == NULL)
+            continue;
+        if (mic_get_thermal_ttl_count(cards[i].ttl, &count) == E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_events_total{device=\"mic%d\","
+                    "cause=\"thermal\"} %u\n", cards[i].device_num, count);
+        if (mic_get_power_ttl_count(cards[i].ttl, &count) == E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_events_total{device=\"mic%d\","
+                    "cause=\"power\"} %u\n", cards[i].device_num, count);
+    }
+
+    family(fp, "mic_throttle_seconds_total", "counter",
+           "Time spent throttled since boot, by cause.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].ttl == NULL)
+            continue;
+        if (mic_get_thermal_ttl_time(cards[i].ttl, &time) == E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_seconds_total{device=\"mic%d\","
+                    "cause=\"thermal\"} %.3f\n", cards[i].device_num,
+                    time / 1e3);
+        if (mic_get_power_ttl_time(cards[i].ttl, &time) == E_MIC_SUCCESS)
+            fprintf(fp, "mic_throttle_seconds_total{device=\"mic%d\","
+                    "cause=\"power\"} %.3f\n", cards[i].device_num,
+                    time / 1e3);
+    }
+}
+
+static void write_turbo(FILE *fp, struct card *cards, int ncards)
+{
+    uint32_t valid, mode, state;
+    int i;
+
+    family(fp, "mic_turbo_enabled", "gauge", "Whether turbo mode is enabled.");
+    for (i = 0; i < ncards; i++) {
+        if ((cards[i].turbo != NULL) &&
+            (mic_get_turbo_state_valid(cards[i].turbo, &valid) ==
+             E_MIC_SUCCESS) && valid &&
+            (mic_get_turbo_mode(cards[i].turbo, &mode) == E_MIC_SUCCESS))
+            fprintf(fp, "mic_turbo_enabled{device=\"mic%d\"} %d\n",
+                    cards[i].device_num, mode != 0);
+    }
+
+    family(fp, "mic_turbo_active", "gauge", "Whether turbo is in effect.");
+    for (i = 0; i < ncards; i++) {
+        if ((cards[i].turbo != NULL) &&
+            (mic_get_turbo_state_valid(cards[i].turbo, &valid) ==
+             E_MIC_SUCCESS) && valid &&
+            (mic_get_turbo_state(cards[i].turbo, &state) == E_MIC_SUCCESS))
+            fprintf(fp, "mic_turbo_active{device=\"mic%d\"} %d\n",
+                    cards[i].device_num, state != 0);
+    }
+}
+
+/*
+ * Counters are in jiffies. The utilization of a core in a mode is
+ * rate(mic_cpu_jiffies_total) / (rate(mic_elapsed_jiffies_total) *
+ * mic_threads_per_core), since each core counts the jiffies of all its
+ * threads.
+ */
+static void write_core_util(FILE *fp, struct card *cards, int ncards)
+{
+    uint64_t jiffies;
+    uint16_t threads;
+    int i, m, c;
+
+    family(fp, "mic_elapsed_jiffies_total", "counter",
+           "Jiffies elapsed on the coprocessor since boot.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].cutil_ok &&
+            (mic_get_jiffy_counter(cards[i].cutil, &jiffies) ==
+             E_MIC_SUCCESS))
+            fprintf(fp, "mic_elapsed_jiffies_total{device=\"mic%d\"} %llu\n",
+                    cards[i].device_num, (unsigned long long)jiffies);
+    }
+
+    family(fp, "mic_threads_per_core", "gauge",
+           "Hardware threads of each core.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].cutil_ok &&
+            (mic_get_threads_core(cards[i].cutil, &threads) ==
+             E_MIC_SUCCESS))
+            fprintf(fp, "mic_threads_per_core{device=\"mic%d\"} %u\n",
+                    cards[i].device_num, threads);
+    }
+
+    family(fp, "mic_cpu_jiffies_total", "counter",
+           "Jiffies the threads of a core spent in each mode.");
+    for (i = 0; i < ncards; i++) {
+        uint16_t n = cards[i].ncores;
+
+        for (c = 0; c < n; c++) {
+            for (m = 0; m < 4; m++)
+                fprintf(fp, "mic_cpu_jiffies_total{device=\"mic%d\","
+                        "core=\"%d\",mode=\"%s\"} %llu\n",
+                        cards[i].device_num, c, core_modes[m],
+                        (unsigned long long)cards[i].counters[m * n + c]);
+        }
+    }
+}
+
+static int write_metrics(const char *path, struct card *cards, int ncards)
+{
+    char tmp[4096];
+    FILE *fp;
+    int i, err;
+
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+        fprintf(stderr, "%s: %s: path too long\n", progname, path);
+        return -1;
+    }
+
+    /* The textfile collector only reads *.prom, so the partial file is
+     * never scraped */
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        fprintf(stderr, "%s: %s: %s\n", progname, tmp, strerror(errno));
+        return -1;
+    }
+
+    family(fp, "mic_up", "gauge", "Whether the coprocessor answered.");
+    for (i = 0; i < ncards; i++)
+        fprintf(fp, "mic_up{device=\"mic%d\"} %d\n", cards[i].device_num,
+                cards[i].thermal != NULL);
+
+    family(fp, "mic_update_duration_seconds", "gauge",
+           "Time taken to read the coprocessor.");
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].thermal != NULL)
+            fprintf(fp, "mic_update_duration_seconds{device=\"mic%d\"} "
+                    "%.6f\n", cards[i].device_num, cards[i].duration);
+    }
+
+    write_thermal(fp, cards, ncards);
+    write_power(fp, cards, ncards);
+    write_memory(fp, cards, ncards);
+    write_throttle(fp, cards, ncards);
+    write_turbo(fp, cards, ncards);
+    write_core_util(fp, cards, ncards);
+
+    if ((fchmod(fileno(fp), 0644) < 0) || ferror(fp)) {
+        err = errno;
+        (void)fclose(fp);
+        goto fail;
+    }
+    if (fclose(fp) != 0) {
+        err = errno;
+        goto fail;
+    }
+    if (rename(tmp, path) < 0) {
+        err = errno;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    fprintf(stderr, "%s: %s: %s\n", progname, tmp, strerror(err));
+    (void)unlink(tmp);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct mic_devices_list *devices = NULL;
+    struct card *cards = NULL;
+    struct sigaction sa;
+    struct timespec ts;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    int once = 0, per_core = 1;
+    int ncards = 0;
+    int c, i, ret = 1;
+    unsigned long val;
+    char *end;
+
+    progname = argv[0];
+
+    while ((c = getopt_long(argc, argv, "i:1Ch", options, NULL)) != -1) {
+        switch (c) {
+        case 'i':
+            errno = 0;
+            val = strtoul(optarg, &end, 10);
+            if ((errno != 0) || (end == optarg) || (*end != '\0') ||
+                (val == 0) || (val > UINT32_MAX)) {
+                fprintf(stderr, "%s: invalid interval '%s'\n", progname,
+                        optarg);
+                return 1;
+            }
+            interval_ms = (uint32_t)val;
+            break;
+        case '1':
+            once = 1;
+            break;
+        case 'C':
+            per_core = 0;
+            break;
+        case 'h':
+            usage(stdout);
+            return 0;
+        default:
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(stderr);
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGHUP, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+
+    if ((mic_get_devices(&devices) != E_MIC_SUCCESS) ||
+        (mic_get_ndevices(devices, &ncards) != E_MIC_SUCCESS)) {
+        fprintf(stderr, "%s: %s\n", progname, mic_get_error_string());
+        goto out;
+    }
+
+    if ((cards = calloc(ncards ? ncards : 1, sizeof(*cards))) == NULL) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        goto out;
+    }
+    for (i = 0; i < ncards; i++) {
+        if (mic_get_device_at_index(devices, i, &cards[i].device_num) !=
+            E_MIC_SUCCESS) {
+            fprintf(stderr, "%s: %s\n", progname, mic_get_error_string());
+            goto out;
+        }
+    }
+
+    ts.tv_sec = interval_ms / 1000;
+    ts.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    while (!stop_requested) {
+        for (i = 0; i < ncards; i++)
+            update_card(&cards[i], per_core);
+        if ((write_metrics(argv[optind], cards, ncards) < 0) && once)
+            goto out;
+        if (once)
+            break;
+        (void)nanosleep(&ts, NULL);
+    }
+    ret = 0;
+
+out:
+    if (cards != NULL)
+        close_cards(cards, ncards);
+    if (devices != NULL)
+        (void)mic_free_devices(devices);
+    return ret;
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * micmgmtd samples every coprocessor on the host through a single set of
+ * miclib collectors and publishes the snapshots into the shared memory
+ * telemetry segment, so that any number of tools can read them without
+ * talking to the cards themselves. The same snapshots are served over a
+ * local socket to clients that cannot map the segment; with --serve-only
+ * the daemon serves the segment of another instance instead of sampling.
+ * With --energy, an energy meter on each card accounts for the jobs
+ * started and ended over the socket.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "micmgmtd.h"
+#include "server.h"
+
+#define DEFAULT_SOCKET          "/var/run/micmgmtd.sock"
+#define DEFAULT_INTERVAL_MS     (100)
+#define DEFAULT_THERMAL_MS      (1000)
+#define DEFAULT_POWER_MS        (1000)
+#define DEFAULT_MEMORY_MS       (5000)
+#define DEFAULT_CORE_UTIL_MS    (1000)
+#define DEFAULT_ENERGY_US       (0)
+
+char *progname;
+
+static int foreground;
+static volatile sig_atomic_t stop_requested;
+
+static const struct option options[] = {
+    { "name",       required_argument, NULL, 'n' },
+    { "interval",   required_argument, NULL, 'i' },
+    { "thermal",    required_argument, NULL, 't' },
+    { "power",      required_argument, NULL, 'p' },
+    { "memory",     required_argument, NULL, 'm' },
+    { "core-util",  required_argument, NULL, 'c' },
+    { "energy",     required_argument, NULL, 'e' },
+    { "socket",     required_argument, NULL, 's' },
+    { "serve-only", no_argument,       NULL, 'S' },
+    { "foreground", no_argument,       NULL, 'f' },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL,         0,                 NULL, 0   }
+};
+
+static void usage(FILE *fp)
+{
+    fprintf(fp,
+            "Usage: %s [options]\n\n"
+            "Samples every coprocessor and publishes the results in "
+            "shared memory.\n\n"
+            "  -n, --name <name>       shared memory segment name "
+            "(default %s)\n"
+            "  -i, --interval <ms>     publish interval (default %d)\n"
+            "  -t, --thermal <ms>      thermal sample period (default %d)\n"
+            "  -p, --power <ms>        power sample period (default %d)\n"
+            "  -m, --memory <ms>       memory sample period (default %d)\n"
+            "  -c, --core-util <ms>    core utilization sample period "
+            "(default %d)\n"
+            "  -e, --energy <us>       energy accounting sample period, "
+            "e.g. 20000 (default off)\n"
+            "  -s, --socket <path>     query socket, \"\" for none "
+            "(default %s)\n"
+            "  -S, --serve-only        serve the segment of another "
+            "instance\n"
+            "  -f, --foreground        do not detach, log to stderr\n"
+            "  -h, --help              show this message\n\n"
+            "A sample period of 0 disables that feature.\n",
+            progname, MIC_TELEMETRY_NAME, DEFAULT_INTERVAL_MS,
+            DEFAULT_THERMAL_MS, DEFAULT_POWER_MS, DEFAULT_MEMORY_MS,
+            DEFAULT_CORE_UTIL_MS, DEFAULT_SOCKET);
+}
+
+void log_msg(int priority, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    if (foreground) {
+        fprintf(stderr, "%s: ", progname);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+    } else {
+        vsyslog(priority, fmt, args);
+    }
+    va_end(args);
+}
+
+static int parse_ms(const char *arg, uint32_t *ms)
+{
+    char *end;
+    unsigned long val;
+
+    errno = 0;
+    val = strtoul(arg, &end, 10);
+    if ((errno != 0) || (end == arg) || (*end != '\0') ||
+        (val > UINT32_MAX)) {
+        fprintf(stderr, "%s: invalid period '%s'\n", progname, arg);
+        return -1;
+    }
+    *ms = (uint32_t)val;
+    return 0;
+}
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void set_signals(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGHUP, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+
+    sa.sa_handler = SIG_IGN;
+    (void)sigaction(SIGPIPE, &sa, NULL);
+}
+
+static void close_cards(struct card *cards, int ncards)
+{
+    int i;
+
+    for (i = 0; i < ncards; i++) {
+        if (cards[i].em != NULL)
+            (void)mic_free_energy_meter(cards[i].em);
+        if (cards[i].coll != NULL)
+            (void)mic_free_collector(cards[i].coll);
+        if (cards[i].mdh != NULL)
+            (void)mic_close_device(cards[i].mdh);
+        if (cards[i].snap != NULL)
+            (void)mic_free_snapshot(cards[i].snap);
+    }
+    free(cards);
+}
+
+/*
+ * Opens every coprocessor and starts a collector on it, and an energy
+ * meter unless energy_us is 0. A card that cannot be sampled is still
+ * given a record, with no features in it, so that readers can tell it
+ * exists.
+ */
+static int open_cards(struct mic_devices_list *devices,
+                      const uint32_t *period_ms, uint32_t energy_us,
+                      struct card **cardsp, int *ncardsp)
+{
+    struct card *cards;
+    int ncards, i, j, ret;
+
+    if ((ret = mic_get_ndevices(devices, &ncards)) != E_MIC_SUCCESS)
+        return ret;
+
+    if ((cards = calloc(ncards, sizeof(*cards))) == NULL)
+        return E_MIC_NOMEM;
+
+    for (i = 0; i < ncards; i++) {
+        int device;
+
+        if ((ret = mic_get_device_at_index(devices, i, &device)) !=
+            E_MIC_SUCCESS) {
+            close_cards(cards, i);
+            return ret;
+        }
+        cards[i].device_num = device;
+
+        if ((ret = mic_alloc_snapshot(&cards[i].snap)) != E_MIC_SUCCESS) {
+            close_cards(cards, i + 1);
+            return ret;
+        }
+
+        if (((ret = mic_open_device(&cards[i].mdh, device)) !=
+             E_MIC_SUCCESS) ||
+            ((ret = mic_collector_create(cards[i].mdh, &cards[i].coll)) !=
+             E_MIC_SUCCESS)) {
+            log_msg(LOG_WARNING, "mic%d: %s", device,
+                    mic_get_error_string());
+            continue;
+        }
+
+        for (j = 0; j < MIC_COLLECT_NFEATURES; j++)
+            (void)mic_collector_set_period(cards[i].coll, 1U << j,
+                                           period_ms[j]);
+
+        if (mic_collector_start(cards[i].coll) != E_MIC_SUCCESS)
+            log_msg(LOG_WARNING, "mic%d: %s", device,
+                    mic_get_error_string());
+
+        if ((energy_us != 0) &&
+            (mic_energy_meter_create(cards[i].mdh, energy_us,
+                                     &cards[i].em) != E_MIC_SUCCESS))
+            log_msg(LOG_WARNING, "mic%d: energy accounting: %s", device,
+                    mic_get_error_string());
+    }
+
+    *cardsp = cards;
+    *ncardsp = ncards;
+    return E_MIC_SUCCESS;
+}
+
+/* Takes the cards, and their snapshots, from a segment being published */
+static int attach_cards(struct mic_telemetry *tel, struct card **cardsp,
+                        int *ncardsp)
+{
+    struct card *cards;
+    int ncards, i, device, ret;
+
+    (void)mic_telemetry_get_ndevices(tel, &ncards);
+    if ((cards = calloc(ncards, sizeof(*cards))) == NULL)
+        return E_MIC_NOMEM;
+
+    for (i = 0; i < ncards; i++) {
+        (void)mic_telemetry_get_device_at_index(tel, i, &device);
+        cards[i].device_num = device;
+        if ((ret = mic_alloc_snapshot(&cards[i].snap)) != E_MIC_SUCCESS) {
+            close_cards(cards, i + 1);
+            return ret;
+        }
+    }
+
+    *cardsp = cards;
+    *ncardsp = ncards;
+    return E_MIC_SUCCESS;
+}
+
+/*
+ * Brings every card's snapshot up to date, from its collector or from
+ * the segment, and publishes those that changed when the segment is
+ * ours.
+ */
+static int refresh_cards(struct mic_telemetry *tel, int serve_only,
+                         struct card *cards, int ncards)
+{
+    uint64_t seq;
+    int i, ret;
+
+    for (i = 0; i < ncards; i++) {
+        if (serve_only) {
+            ret = mic_telemetry_read(tel, cards[i].device_num,
+                                     cards[i].snap);
+            if (ret != E_MIC_SUCCESS) {
+                log_msg(LOG_ERR, "mic%u: %s", cards[i].device_num,
+                        mic_get_error_string());
+                return -1;
+            }
+            continue;
+        }
+
+        if (cards[i].em != NULL)
+            (void)mic_energy_meter_update(cards[i].em);
+
+        if (cards[i].coll == NULL)
+            continue;
+
+        (void)mic_collector_read(cards[i].coll, cards[i].snap);
+        (void)mic_get_snapshot_seq(cards[i].snap, &seq);
+        if (seq == cards[i].seq)
+            continue;
+
+        if (mic_telemetry_publish(tel, cards[i].device_num, cards[i].snap) ==
+            E_MIC_SUCCESS)
+            cards[i].seq = seq;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = MIC_TELEMETRY_NAME;
+    const char *socket_path = DEFAULT_SOCKET;
+    int serve_only = 0;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    uint32_t energy_us = DEFAULT_ENERGY_US;
+    uint32_t period_ms[MIC_COLLECT_NFEATURES] = {
+        DEFAULT_THERMAL_MS, DEFAULT_POWER_MS, DEFAULT_MEMORY_MS,
+        DEFAULT_CORE_UTIL_MS
+    };
+    struct mic_devices_list *devices = NULL;
+    struct mic_telemetry *tel = NULL;
+    struct server *srv = NULL;
+    struct card *cards = NULL;
+    struct timespec ts;
+    int ncards = 0;
+    int c, ret = 1;
+
+    progname = argv[0];
+
+    while ((c = getopt_long(argc, argv, "n:i:t:p:m:c:e:s:Sfh", options,
+                            NULL)) != -1) {
+        switch (c) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            if (parse_ms(optarg, &interval_ms) < 0)
+                return 1;
+            break;
+        case 't':
+            if (parse_ms(optarg, &period_ms[0]) < 0)
+                return 1;
+            break;
+        case 'p':
+            if (parse_ms(optarg, &period_ms[1]) < 0)
+                return 1;
+            break;
+        case 'm':
+            if (parse_ms(optarg, &period_ms[2]) < 0)
+                return 1;
+            break;
+        case 'c':
+            if (parse_ms(optarg, &period_ms[3]) < 0)
+                return 1;
+            break;
+        case 'e':
+            if (parse_ms(optarg, &energy_us) < 0)
+                return 1;
+            break;
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'S':
+            serve_only = 1;
+            break;
+        case 'f':
+            foreground = 1;
+            break;
+        case 'h':
+            usage(stdout);
+            return 0;
+        default:
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if ((optind < argc) || (interval_ms == 0)) {
+        usage(stderr);
+        return 1;
+    }
+
+    if (!foreground) {
+        if (daemon(0, 0) < 0) {
+            fprintf(stderr, "%s: daemon: %s\n", progname, strerror(errno));
+            return 1;
+        }
+        openlog("micmgmtd", LOG_PID, LOG_DAEMON);
+    }
+    set_signals();
+
+    if (serve_only) {
+        if ((mic_telemetry_open(name, &tel) != E_MIC_SUCCESS) ||
+            (attach_cards(tel, &cards, &ncards) != E_MIC_SUCCESS)) {
+            log_msg(LOG_ERR, "%s: %s", name, mic_get_error_string());
+            goto out;
+        }
+    } else {
+        if (mic_get_devices(&devices) != E_MIC_SUCCESS) {
+            log_msg(LOG_ERR, "%s", mic_get_error_string());
+            goto out;
+        }
+
+        if (open_cards(devices, period_ms, energy_us, &cards, &ncards) !=
+            E_MIC_SUCCESS) {
+            log_msg(LOG_ERR, "%s", mic_get_error_string());
+            goto out;
+        }
+
+        if (mic_telemetry_create(name, devices, &tel) != E_MIC_SUCCESS) {
+            log_msg(LOG_ERR, "%s: %s", name, mic_get_error_string());
+            goto out;
+        }
+    }
+
+    if ((*socket_path != '\0') && (server_open(socket_path, &srv) < 0))
+        goto out;
+
+    log_msg(LOG_INFO, "%s %d device(s) in %s", serve_only ? "serving" :
+            "publishing", ncards, name);
+
+    ts.tv_sec = interval_ms / 1000;
+    ts.tv_nsec = (interval_ms % 1000) * 1000000L;
+    while (!stop_requested) {
+        if (refresh_cards(tel, serve_only, cards, ncards) < 0)
+            goto out;
+
+        if (srv != NULL)
+            server_run(srv, cards, ncards, interval_ms);
+        else
+            (void)nanosleep(&ts, NULL);
+    }
+
+    log_msg(LOG_INFO, "exiting");
+    ret = 0;
+
+out:
+    if (srv != NULL)
+        server_close(srv);
+    if (tel != NULL)
+        (void)mic_telemetry_close(tel);
+    if (cards != NULL)
+        close_cards(cards, ncards);
+    if (devices != NULL)
+        (void)mic_free_devices(devices);
+    if (!foreground)
+        closelog();
+
+    return ret;
+}
@@ -0,0 +1,753 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Local query server. Clients connect to an AF_UNIX stream socket and
+ * send one request per line; every answer comes from the snapshots the
+ * daemon already holds, so no request reaches a coprocessor.
+ *
+ *   GET <fields> <devices>
+ *       Reply with one "<device> <field> <value>" line for each selected
+ *       field of each selected device, then "END". A value of "-" means
+ *       the field is not available.
+ *   SUBSCRIBE <fields> <devices> <ms>
+ *       Reply as for GET, then every <ms> milliseconds send the lines
+ *       whose value changed since they were last sent, followed by "END".
+ *       Nothing is sent for an interval in which nothing changed.
+ *   UNSUBSCRIBE
+ *       Cancel the subscription; reply "END".
+ *   FIELDS
+ *       Reply with one "<field> <unit>" line per field, then "END".
+ *   DEVICES
+ *       Reply with one line per device number, then "END".
+ *   JOB BEGIN <job> <devices>
+ *       Start charging the energy used by the selected devices to <job>;
+ *       reply "END". JOB requests are refused unless the client runs as
+ *       root or as the user the daemon runs as.
+ *   JOB READ <job>
+ *   JOB END <job>
+ *       Reply with "<device> <quantity> <value>" lines giving the energy
+ *       used by each device of <job> so far, then "END". JOB END also
+ *       stops accounting for the job.
+ *   QUIT
+ *       Close the connection.
+ *
+ * <fields> is a comma separated list of field names, feature names such
+ * as "thermal" or "power" that select all of their fields, or "all".
+ * <devices> is a comma separated list of device numbers and ranges such
+ * as "0-3", or "all". A request that cannot be parsed is answered with a
+ * single "ERR <reason>" line.
+ */
+
+#define _GNU_SOURCE                 /* struct ucred */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+#define MAX_CLIENTS         (64)
+#define MAX_REQUEST         (1024)
+/* A client that lets this much output pile up is disconnected */
+#define MAX_PENDING         (1024 * 1024)
+#define MIN_SUBSCRIBE_MS    (10)
+
+struct client {
+    int       fd;
+    char      in[MAX_REQUEST];
+    size_t    in_len;
+    int       overlong;         /* Discarding the rest of a long line */
+    int       may_job;          /* Peer is root or the daemon's user */
+    char     *out;
+    size_t    out_len;
+    size_t    out_size;
+    uint32_t  interval_ms;      /* Non-zero while subscribed */
+    uint64_t  next_ms;
+    uint8_t  *fields;           /* Selected fields */
+    uint8_t  *devices;          /* Selected cards, by index */
+    int64_t  *last;             /* Values sent, per card and field */
+    uint8_t  *sent;             /* 1 if last[] holds a value, 2 if "-" */
+};
+
+struct server {
+    int            fd;
+    char          *path;
+    uint32_t       nfields;
+    struct client *clients[MAX_CLIENTS];
+    int            nclients;
+};
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void client_free(struct client *c)
+{
+    close(c->fd);
+    free(c->out);
+    free(c->fields);
+    free(c->devices);
+    free(c->last);
+    free(c->sent);
+    free(c);
+}
+
+static void client_unsubscribe(struct client *c)
+{
+    c->interval_ms = 0;
+    free(c->fields);
+    free(c->devices);
+    free(c->last);
+    free(c->sent);
+    c->fields = c->devices = c->sent = NULL;
+    c->last = NULL;
+}
+
+/* Returns -1 if the client is to be dropped */
+static int client_flush(struct client *c)
+{
+    ssize_t n;
+
+    /* Marked for dropping; out_len is past the buffer */
+    if (c->out_len > c->out_size)
+        return -1;
+
+    while (c->out_len > 0) {
+        n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+        memmove(c->out, c->out + n, c->out_len - n);
+        c->out_len -= n;
+    }
+    return 0;
+}
+
+static void client_printf(struct client *c, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void client_printf(struct client *c, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    /* Already marked for dropping */
+    if (c->out_len > c->out_size)
+        return;
+
+    for (;;) {
+        va_start(args, fmt);
+        n = vsnprintf(c->out + c->out_len, c->out_size - c->out_len, fmt,
+                      args);
+        va_end(args);
+        if ((n < 0) || ((size_t)n < c->out_size - c->out_len))
+            break;
+
+        if (c->out_size > MAX_PENDING) {
+            /* Dropped on the next flush */
+            c->out_len = c->out_size + 1;
+            return;
+        }
+        {
+            size_t size = c->out_size ? c->out_size * 2 : 4096;
+            char *out = realloc(c->out, size);
+
+            if (out == NULL) {
+                c->out_len = c->out_size + 1;
+                return;
+            }
+            c->out = out;
+            c->out_size = size;
+        }
+    }
+    if (n > 0)
+        c->out_len += n;
+}
+
+static int parse_fields(struct server *srv, char *spec, uint8_t *sel,
+                        const char **err)
+{
+    char *tok, *save = NULL;
+    const char *name;
+    size_t len;
+    uint32_t i;
+    int any;
+
+    memset(sel, 0, srv->nfields);
+    for (tok = strtok_r(spec, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        len = strlen(tok);
+        any = 0;
+        for (i = 0; i < srv->nfields; i++) {
+            (void)mic_get_snapshot_field_info(i, &name, NULL, NULL);
+            if ((strcasecmp(tok, "all") == 0) ||
+                (strcmp(name, tok) == 0) ||
+                ((strncmp(name, tok, len) == 0) && (name[len] == '.'))) {
+                sel[i] = 1;
+                any = 1;
+            }
+        }
+        if (!any) {
+            *err = "unknown field";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_devices(char *spec, struct card *cards, int ncards,
+                         uint8_t *sel, const char **err)
+{
+    char *tok, *save = NULL, *end;
+    unsigned long lo, hi;
+    int i, any = 0;
+
+    memset(sel, 0, ncards);
+    for (tok = strtok_r(spec, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (strcasecmp(tok, "all") == 0) {
+            lo = 0;
+            hi = UINT32_MAX;
+        } else {
+            lo = hi = strtoul(tok, &end, 10);
+            if ((end != tok) && (*end == '-'))
+                hi = strtoul(end + 1, &end, 10);
+            if ((end == tok) || (*end != '\0') || (hi < lo)) {
+                *err = "bad device list";
+                return -1;
+            }
+        }
+        for (i = 0; i < ncards; i++) {
+            if ((cards[i].device_num >= lo) && (cards[i].device_num <= hi)) {
+                sel[i] = 1;
+                any = 1;
+            }
+        }
+    }
+    if (!any) {
+        *err = "no such device";
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sends the selected fields. With last/sent, only those that differ from
+ * what the client was sent before are included, and the record is
+ * updated. Returns the number of lines sent.
+ */
+static int send_fields(struct server *srv, struct client *c,
+                       struct card *cards, int ncards, const uint8_t *fields,
+                       const uint8_t *devices, int64_t *last, uint8_t *sent)
+{
+    const char *name;
+    int64_t value;
+    uint8_t state;
+    uint32_t f;
+    size_t k;
+    int i, lines = 0;
+
+    for (i = 0; i < ncards; i++) {
+        if (!devices[i])
+            continue;
+        for (f = 0; f < srv->nfields; f++) {
+            if (!fields[f])
+                continue;
+
+            state = (mic_get_snapshot_field(cards[i].snap, f, &value) ==
+                     E_MIC_SUCCESS) ? 1 : 2;
+            if (last != NULL) {
+                k = (size_t)i * srv->nfields + f;
+                if ((sent[k] == state) &&
+                    ((state == 2) || (last[k] == value)))
+                    continue;
+                sent[k] = state;
+                last[k] = value;
+            }
+
+            (void)mic_get_snapshot_field_info(f, &name, NULL, NULL);
+            if (state == 1)
+                client_printf(c, "%u %s %lld\n", cards[i].device_num, name,
+                              (long long)value);
+            else
+                client_printf(c, "%u %s -\n", cards[i].device_num, name);
+            lines++;
+        }
+    }
+    return lines;
+}
+
+static void send_energy(struct client *c, uint32_t device_num,
+                        struct mic_energy_info *info)
+{
+    uint64_t duration, energy, unmeasured;
+    uint32_t avg, peak, out_of_range;
+
+    (void)mic_get_energy_duration(info, &duration);
+    (void)mic_get_energy_consumed(info, &energy);
+    (void)mic_get_energy_avg_power(info, &avg);
+    (void)mic_get_energy_peak_power(info, &peak);
+    (void)mic_get_energy_unmeasured_time(info, &unmeasured);
+    (void)mic_get_energy_out_of_range(info, &out_of_range);
+
+    client_printf(c, "%u duration_ms %llu\n", device_num,
+                  (unsigned long long)duration);
+    client_printf(c, "%u energy_uj %llu\n", device_num,
+                  (unsigned long long)energy);
+    client_printf(c, "%u avg_power_uw %u\n", device_num, avg);
+    client_printf(c, "%u peak_power_uw %u\n", device_num, peak);
+    client_printf(c, "%u unmeasured_ms %llu\n", device_num,
+                  (unsigned long long)unmeasured);
+    client_printf(c, "%u out_of_range %u\n", device_num, out_of_range);
+}
+
+/* Serves JOB BEGIN, JOB READ and JOB END */
+static void handle_job(struct client *c, int argc, char **argv,
+                       struct card *cards, int ncards)
+{
+    struct mic_energy_info *info;
+    uint8_t *devices = NULL;
+    const char *err = NULL;
+    int i, ret, found = 0, end = 0;
+
+    if ((argc == 4) && (strcasecmp(argv[1], "BEGIN") == 0)) {
+        if ((devices = malloc(ncards ? ncards : 1)) == NULL) {
+            client_printf(c, "ERR out of memory\n");
+            return;
+        }
+        if (parse_devices(argv[3], cards, ncards, devices, &err) < 0) {
+            client_printf(c, "ERR %s\n", err);
+            free(devices);
+            return;
+        }
+
+        for (i = 0; i < ncards; i++) {
+            if (!devices[i])
+                continue;
+            if (cards[i].em == NULL) {
+                err = "energy accounting not available";
+                break;
+            }
+            if ((ret = mic_energy_begin(cards[i].em, argv[2])) !=
+                E_MIC_SUCCESS) {
+                err = (ret == E_MIC_INVAL) ? "job already running" :
+                    mic_get_error_string();
+                break;
+            }
+        }
+        if (err != NULL) {
+            /* A job is started on all of its devices or none */
+            while (i-- > 0) {
+                if (devices[i])
+                    (void)mic_energy_end(cards[i].em, argv[2], NULL);
+            }
+            client_printf(c, "ERR %s\n", err);
+        } else {
+            client_printf(c, "END\n");
+        }
+        free(devices);
+        return;
+    }
+
+    if ((argc == 3) && ((strcasecmp(argv[1], "READ") == 0) ||
+                        ((end = (strcasecmp(argv[1], "END") == 0))))) {
+        for (i = 0; i < ncards; i++) {
+            if (cards[i].em == NULL)
+                continue;
+            ret = end ? mic_energy_end(cards[i].em, argv[2], &info) :
+                mic_energy_read(cards[i].em, argv[2], &info);
+            if (ret != E_MIC_SUCCESS)
+                continue;
+            send_energy(c, cards[i].device_num, info);
+            (void)mic_free_energy_info(info);
+            found = 1;
+        }
+        client_printf(c, found ? "END\n" : "ERR no such job\n");
+        return;
+    }
+
+    client_printf(c, "ERR usage: JOB BEGIN <job> <devices> | "
+                  "JOB READ <job> | JOB END <job>\n");
+}
+
+static int handle_request(struct server *srv, struct client *c, char *line,
+                          struct card *cards, int ncards)
+{
+    char *argv[4], *save = NULL;
+    const char *err = NULL;
+    uint8_t *fields = NULL, *devices = NULL;
+    unsigned long interval = 0;
+    char *end;
+    const char *name, *unit;
+    uint32_t f;
+    int argc, i;
+
+    for (argc = 0; argc < 4; argc++) {
+        if ((argv[argc] = strtok_r(argc ? NULL : line, " \t", &save)) ==
+            NULL)
+            break;
+    }
+    if (argc == 0)
+        return 0;
+
+    if (strcasecmp(argv[0], "QUIT") == 0) {
+        /* Best effort for replies still queued */
+        (void)client_flush(c);
+        return -1;
+    }
+
+    if (strcasecmp(argv[0], "FIELDS") == 0) {
+        for (f = 0; f < srv->nfields; f++) {
+            (void)mic_get_snapshot_field_info(f, &name, &unit, NULL);
+            client_printf(c, "%s %s\n", name, *unit ? unit : "-");
+        }
+        client_printf(c, "END\n");
+        return 0;
+    }
+
+    if (strcasecmp(argv[0], "DEVICES") == 0) {
+        for (i = 0; i < ncards; i++)
+            client_printf(c, "%u\n", cards[i].device_num);
+        client_printf(c, "END\n");
+        return 0;
+    }
+
+    if (strcasecmp(argv[0], "JOB") == 0) {
+        /* The socket is open to all users; jobs belong to the resource
+         * manager */
+        if (!c->may_job)
+            client_printf(c, "ERR permission denied\n");
+        else
+            handle_job(c, argc, argv, cards, ncards);
+        return 0;
+    }
+
+    if (strcasecmp(argv[0], "UNSUBSCRIBE") == 0) {
+        client_unsubscribe(c);
+        client_printf(c, "END\n");
+        return 0;
+    }
+
+    if (strcasecmp(argv[0], "GET") == 0) {
+        if (argc != 3)
+            err = "usage: GET <fields> <devices>";
+    } else if (strcasecmp(argv[0], "SUBSCRIBE") == 0) {
+        if (argc != 4) {
+            err = "usage: SUBSCRIBE <fields> <devices> <ms>";
+        } else {
+            interval = strtoul(argv[3], &end, 10);
+            if ((*end != '\0') || (interval < MIN_SUBSCRIBE_MS) ||
+                (interval > UINT32_MAX))
+                err = "bad interval";
+        }
+    } else {
+        err = "unknown request";
+    }
+
+    if ((err == NULL) &&
+        (((fields = malloc(srv->nfields)) == NULL) ||
+         ((devices = malloc(ncards ? ncards : 1)) == NULL)))
+        err = "out of memory";
+
+    if ((err == NULL) &&
+        (parse_fields(srv, argv[1], fields, &err) == 0) &&
+        (parse_devices(argv[2], cards, ncards, devices, &err) == 0)) {
+        if (interval == 0) {
+            (void)send_fields(srv, c, cards, ncards, fields, devices, NULL,
+                              NULL);
+            client_printf(c, "END\n");
+        } else {
+            client_unsubscribe(c);
+            c->last = calloc((size_t)ncards * srv->nfields,
+                             sizeof(*c->last));
+            c->sent = calloc((size_t)ncards * srv->nfields, 1);
+            if ((c->last == NULL) || (c->sent == NULL)) {
+                client_unsubscribe(c);
+                err = "out of memory";
+            } else {
+                c->fields = fields;
+                c->devices = devices;
+                fields = devices = NULL;
+                c->interval_ms = interval;
+                /* Everything is new to the subscriber, so the first
+                 * update doubles as the reply. */
+                c->next_ms = monotonic_ms();
+            }
+        }
+    }
+
+    if (err != NULL)
+        client_printf(c, "ERR %s\n", err);
+
+    free(fields);
+    free(devices);
+    return 0;
+}
+
+/* Returns -1 if the client is to be dropped */
+static int client_read(struct server *srv, struct client *c,
+                       struct card *cards, int ncards)
+{
+    char *nl, *line;
+    ssize_t n;
+
+    n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+    if (n < 0)
+        return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1;
+    if (n == 0)
+        return -1;
+    c->in_len += n;
+
+    line = c->in;
+    while ((nl = memchr(line, '\n', c->in_len - (line - c->in))) != NULL) {
+        *nl = '\0';
+        if ((nl > line) && (nl[-1] == '\r'))
+            nl[-1] = '\0';
+
+        if (c->overlong)
+            c->overlong = 0;
+        else if (handle_request(srv, c, line, cards, ncards) < 0)
+            return -1;
+        line = nl + 1;
+    }
+
+    c->in_len -= line - c->in;
+    memmove(c->in, line, c->in_len);
+
+    if (c->in_len == sizeof(c->in)) {
+        if (!c->overlong)
+            client_printf(c, "ERR request too long\n");
+        c->overlong = 1;
+        c->in_len = 0;
+    }
+    return 0;
+}
+
+/* Sends due subscription updates and returns when the next one is due */
+static uint64_t run_subscriptions(struct server *srv, struct card *cards,
+                                  int ncards, uint64_t now)
+{
+    uint64_t next = UINT64_MAX;
+    struct client *c;
+    int i;
+
+    for (i = 0; i < srv->nclients; i++) {
+        c = srv->clients[i];
+        if (c->interval_ms == 0)
+            continue;
+
+        if (c->next_ms <= now) {
+            if (send_fields(srv, c, cards, ncards, c->fields, c->devices,
+                            c->last, c->sent) > 0)
+                client_printf(c, "END\n");
+            c->next_ms += c->interval_ms;
+            if (c->next_ms <= now)
+                c->next_ms = now + c->interval_ms;
+        }
+        if (c->next_ms < next)
+            next = c->next_ms;
+    }
+    return next;
+}
+
+static void server_accept(struct server *srv)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    struct client *c;
+    int fd;
+
+    if ((fd = accept(srv->fd, NULL, NULL)) < 0)
+        return;
+
+    if ((srv->nclients == MAX_CLIENTS) ||
+        (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) ||
+        ((c = calloc(1, sizeof(*c))) == NULL)) {
+        log_msg(LOG_WARNING, "%s: refusing connection", srv->path);
+        close(fd);
+        return;
+    }
+
+    c->fd = fd;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+        c->may_job = (cred.uid == 0) || (cred.uid == geteuid());
+    srv->clients[srv->nclients++] = c;
+}
+
+static void server_drop(struct server *srv, int i)
+{
+    client_free(srv->clients[i]);
+    srv->clients[i] = srv->clients[--srv->nclients];
+}
+
+/*
+ * Serves clients for ms milliseconds, or until interrupted by a signal.
+ */
+void server_run(struct server *srv, struct card *cards, int ncards,
+                uint32_t ms)
+{
+    struct pollfd pfd[MAX_CLIENTS + 1];
+    struct client *owner[MAX_CLIENTS];
+    uint64_t now, deadline, next;
+    int n, i, npfd;
+
+    now = monotonic_ms();
+    deadline = now + ms;
+    for (;;) {
+        next = run_subscriptions(srv, cards, ncards, now);
+
+        /* Flush, and drop clients that fell too far behind or failed */
+        for (i = srv->nclients - 1; i >= 0; i--) {
+            if (client_flush(srv->clients[i]) < 0)
+                server_drop(srv, i);
+        }
+
+        if (now >= deadline)
+            return;
+        if (next > deadline)
+            next = deadline;
+
+        pfd[0].fd = srv->fd;
+        pfd[0].events = POLLIN;
+        for (i = 0; i < srv->nclients; i++) {
+            owner[i] = srv->clients[i];
+            pfd[i + 1].fd = owner[i]->fd;
+            pfd[i + 1].events = POLLIN | (owner[i]->out_len ? POLLOUT : 0);
+        }
+        npfd = srv->nclients + 1;
+
+        n = poll(pfd, npfd, (int)(next > now ? next - now : 0));
+        if (n < 0) {
+            if (errno != EINTR)
+                log_msg(LOG_ERR, "poll: %s", strerror(errno));
+            return;
+        }
+
+        for (i = npfd - 1; i > 0; i--) {
+            if (pfd[i].revents == 0)
+                continue;
+            if ((pfd[i].revents & (POLLERR | POLLNVAL)) ||
+                ((pfd[i].revents & (POLLIN | POLLHUP)) &&
+                 (client_read(srv, owner[i - 1], cards, ncards) < 0))) {
+                /* Dropping moves the last client into the freed slot,
+                 * and walking down keeps that one already handled. */
+                server_drop(srv, i - 1);
+            }
+        }
+        if (pfd[0].revents & POLLIN)
+            server_accept(srv);
+
+        now = monotonic_ms();
+    }
+}
+
+int server_open(const char *path, struct server **srvp)
+{
+    struct sockaddr_un addr;
+    struct server *srv;
+    int fd, err;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_msg(LOG_ERR, "%s: socket path too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        log_msg(LOG_ERR, "socket: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Take over a socket left by a daemon that died, but not a live one */
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        log_msg(LOG_ERR, "%s: already in use", path);
+        close(fd);
+        return -1;
+    }
+    (void)unlink(path);
+
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (chmod(path, 0666) < 0) || (listen(fd, MAX_CLIENTS) < 0) ||
+        (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)) {
+        err = errno;
+        log_msg(LOG_ERR, "%s: %s", path, strerror(err));
+        close(fd);
+        return -1;
+    }
+
+    if (((srv = calloc(1, sizeof(*srv))) == NULL) ||
+        ((srv->path = strdup(path)) == NULL)) {
+        log_msg(LOG_ERR, "%s: %s", path, strerror(ENOMEM));
+        free(srv);
+        close(fd);
+        (void)unlink(path);
+        return -1;
+    }
+
+    srv->fd = fd;
+    (void)mic_get_snapshot_nfields(&srv->nfields);
+    *srvp = srv;
+    return 0;
+}
+
+void server_close(struct server *srv)
+{
+    while (srv->nclients > 0)
+        server_drop(srv, srv->nclients - 1);
+
+    close(srv->fd);
+    (void)unlink(srv->path);
+    free(srv->path);
+    free(srv);
+}
@@ -0,0 +1,501 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/*
+ * micrec keeps the history of the snapshots micmgmtd publishes in a
+ * compact recording file, prints back any part of it, and aggregates
+ * series over time windows across many recordings. Recording reads the
+ * shared memory segment only, so it adds no load on the cards.
+ */
+
+#define _GNU_SOURCE                 /* strptime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <getopt.h>
+
+#include "micrec.h"
+
+#define DEFAULT_INTERVAL_MS     (1000)
+#define MAX_PERCENTILES         (16)
+
+char *progname;
+static volatile sig_atomic_t stop_requested;
+
+static const struct option options[] = {
+    { "name",       required_argument, NULL, 'n' },
+    { "interval",   required_argument, NULL, 'i' },
+    { "block",      required_argument, NULL, 'b' },
+    { "per-core",   no_argument,       NULL, 'P' },
+    { "device",     required_argument, NULL, 'd' },
+    { "series",     required_argument, NULL, 's' },
+    { "from",       required_argument, NULL, 'f' },
+    { "to",         required_argument, NULL, 't' },
+    { "window",     required_argument, NULL, 'w' },
+    { "percentiles", required_argument, NULL, 'p' },
+    { "jobs",       required_argument, NULL, 'j' },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL,         0,                 NULL, 0   }
+};
+
+static void usage(FILE *fp)
+{
+    fprintf(fp,
+            "Usage: %s record [options] <file>\n"
+            "       %s info <file>\n"
+            "       %s dump [options] <file>\n"
+            "       %s query [options] <file>...\n\n"
+            "Records the snapshots published by micmgmtd, and prints "
+            "them back.\n\n"
+            "record options:\n"
+            "  -n, --name <name>       shared memory segment name "
+            "(default %s)\n"
+            "  -i, --interval <ms>     sample interval (default %d)\n"
+            "  -b, --block <samples>   samples per block (default 600)\n"
+            "  -P, --per-core          also record each core's counters\n\n"
+            "dump and query options:\n"
+            "  -d, --device <list>     only these coprocessors, such as "
+            "0,2-3\n"
+            "  -s, --series <pattern>  only series matching this shell "
+            "pattern\n"
+            "  -f, --from <time>       start of the time range\n"
+            "  -t, --to <time>         end of the time range\n\n"
+            "query options:\n"
+            "  -w, --window <period>   aggregate over windows of this "
+            "length\n"
+            "  -p, --percentiles <list> also report these percentiles, "
+            "such as 50,99\n"
+            "  -j, --jobs <n>          files read at once (default: "
+            "one per CPU)\n\n"
+            "A time is either milliseconds since the epoch or local time "
+            "as\n\"YYYY-MM-DD HH:MM:SS\". A period is in milliseconds, "
+            "or in seconds,\nminutes, hours or days with an s, m, h or d "
+            "suffix.\n",
+            progname, progname, progname, progname, MIC_TELEMETRY_NAME,
+            DEFAULT_INTERVAL_MS);
+}
+
+static int parse_uint(const char *arg, uint32_t *val)
+{
+    char *end;
+    unsigned long v;
+
+    errno = 0;
+    v = strtoul(arg, &end, 10);
+    if ((errno != 0) || (end == arg) || (*end != '\0') || (v > UINT32_MAX)) {
+        fprintf(stderr, "%s: invalid number '%s'\n", progname, arg);
+        return -1;
+    }
+    *val = (uint32_t)v;
+    return 0;
+}
+
+static int parse_time(const char *arg, int64_t *ms)
+{
+    struct tm tm;
+    char *end;
+    long long v;
+
+    errno = 0;
+    v = strtoll(arg, &end, 10);
+    if ((errno == 0) && (end != arg) && (*end == '\0')) {
+        *ms = v;
+        return 0;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(arg, "%Y-%m-%d %H:%M:%S", &tm);
+    if ((end == NULL) || (*end != '\0')) {
+        fprintf(stderr, "%s: invalid time '%s'\n", progname, arg);
+        return -1;
+    }
+    tm.tm_isdst = -1;
+    *ms = (int64_t)mktime(&tm) * 1000;
+    return 0;
+}
+
+static int parse_period(const char *arg, int64_t *ms)
+{
+    char *end;
+    long long v;
+    int64_t unit = 1;
+
+    errno = 0;
+    v = strtoll(arg, &end, 10);
+    switch (*end) {
+    case 's':
+        unit = 1000;
+        break;
+    case 'm':
+        unit = 60 * 1000;
+        break;
+    case 'h':
+        unit = 60 * 60 * 1000;
+        break;
+    case 'd':
+        unit = 24 * 60 * 60 * 1000;
+        break;
+    }
+    if (unit != 1)
+        end++;
+    if ((errno != 0) || (end == arg) || (*end != '\0') || (v <= 0) ||
+        (v > INT64_MAX / unit)) {
+        fprintf(stderr, "%s: invalid period '%s'\n", progname, arg);
+        return -1;
+    }
+    *ms = v * unit;
+    return 0;
+}
+
+static int parse_devices(char *arg, uint8_t *devices)
+{
+    char *tok, *save = NULL, *end;
+    unsigned long lo, hi;
+
+    memset(devices, 0, MAX_DEVICES);
+    for (tok = strtok_r(arg, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        lo = hi = strtoul(tok, &end, 10);
+        if ((end != tok) && (*end == '-'))
+            hi = strtoul(end + 1, &end, 10);
+        if ((end == tok) || (*end != '\0') || (hi < lo) ||
+            (hi >= MAX_DEVICES)) {
+            fprintf(stderr, "%s: invalid device list '%s'\n", progname,
+                    tok);
+            return -1;
+        }
+        while (lo <= hi)
+            devices[lo++] = 1;
+    }
+    return 0;
+}
+
+static int parse_percentiles(char *arg, double *percentiles, int *n)
+{
+    char *tok, *save = NULL, *end;
+    double p;
+
+    *n = 0;
+    for (tok = strtok_r(arg, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        p = strtod(tok, &end);
+        if ((end == tok) || (*end != '\0') || (p < 0) || (p > 100) ||
+            (*n == MAX_PERCENTILES)) {
+            fprintf(stderr, "%s: invalid percentile '%s'\n", progname, tok);
+            return -1;
+        }
+        percentiles[(*n)++] = p;
+    }
+    return 0;
+}
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int record(const char *path, const char *name, uint32_t interval_ms,
+                  uint32_t block_samples, uint32_t flags)
+{
+    struct mic_telemetry *tel = NULL;
+    struct mic_recorder *rec = NULL;
+    struct mic_snapshot *snap = NULL;
+    struct sigaction sa;
+    struct timespec ts;
+    int ndevices, device, i, ret = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGHUP, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+
+    if (mic_telemetry_open(name, &tel) != E_MIC_SUCCESS) {
+        fprintf(stderr, "%s: %s: %s (is micmgmtd running?)\n", progname,
+                name, mic_get_error_string());
+        return 1;
+    }
+
+    if ((mic_alloc_snapshot(&snap) != E_MIC_SUCCESS) ||
+        (mic_recorder_open(path, block_samples, flags, &rec) !=
+         E_MIC_SUCCESS)) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path,
+                mic_get_error_string());
+        goto out;
+    }
+
+    (void)mic_telemetry_get_ndevices(tel, &ndevices);
+    ts.tv_sec = interval_ms / 1000;
+    ts.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    while (!stop_requested) {
+        for (i = 0; i < ndevices; i++) {
+            (void)mic_telemetry_get_device_at_index(tel, i, &device);
+            if (mic_telemetry_read(tel, device, snap) != E_MIC_SUCCESS) {
+                fprintf(stderr, "%s: mic%d: %s\n", progname, device,
+                        mic_get_error_string());
+                goto out;
+            }
+            if (mic_recorder_append(rec, device, snap) != E_MIC_SUCCESS) {
+                fprintf(stderr, "%s: %s: %s\n", progname, path,
+                        mic_get_error_string());
+                goto out;
+            }
+        }
+        (void)nanosleep(&ts, NULL);
+    }
+    ret = 0;
+
+out:
+    if ((rec != NULL) && (mic_recorder_close(rec) != E_MIC_SUCCESS)) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path,
+                mic_get_error_string());
+        ret = 1;
+    }
+    if (snap != NULL)
+        (void)mic_free_snapshot(snap);
+    (void)mic_telemetry_close(tel);
+    return ret;
+}
+
+static int info(const char *path)
+{
+    struct mic_recording *rec;
+    uint32_t nseries, series, device;
+    const char *name, *unit;
+    int64_t first, last;
+    size_t count;
+
+    if (mic_recording_open(path, &rec) != E_MIC_SUCCESS) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path,
+                mic_get_error_string());
+        return 1;
+    }
+
+    if (mic_recording_get_time_range(rec, &first, &last) == E_MIC_SUCCESS)
+        printf("time range: %lld - %lld ms\n", (long long)first,
+               (long long)last);
+    else
+        printf("time range: empty\n");
+
+    (void)mic_recording_get_nseries(rec, &nseries);
+    for (series = 0; series < nseries; series++) {
+        (void)mic_recording_get_series_info(rec, series, &device, &name,
+                                            &unit);
+        count = 0;
+        (void)mic_recording_read(rec, series, INT64_MIN, INT64_MAX, NULL,
+                                 NULL, &count);
+        printf("mic%u %s %s %lu samples\n", device, name, unit,
+               (unsigned long)count);
+    }
+
+    (void)mic_recording_close(rec);
+    return 0;
+}
+
+static int dump(const char *path, const uint8_t *devices, const char *pattern,
+                int64_t from_ms, int64_t to_ms)
+{
+    struct mic_recording *rec;
+    uint32_t nseries, series, device;
+    const char *name;
+    int64_t *times = NULL, *values = NULL;
+    size_t count, size = 0, i;
+    int ret = 1;
+
+    if (mic_recording_open(path, &rec) != E_MIC_SUCCESS) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path,
+                mic_get_error_string());
+        return 1;
+    }
+
+    (void)mic_recording_get_nseries(rec, &nseries);
+    for (series = 0; series < nseries; series++) {
+        (void)mic_recording_get_series_info(rec, series, &device, &name,
+                                            NULL);
+        if (((devices != NULL) &&
+             ((device >= MAX_DEVICES) || !devices[device])) ||
+            ((pattern != NULL) && (fnmatch(pattern, name, 0) != 0)))
+            continue;
+
+        count = 0;
+        if (mic_recording_read(rec, series, from_ms, to_ms, NULL, NULL,
+                               &count) != E_MIC_SUCCESS)
+            goto read_error;
+
+        if (count > size) {
+            free(times);
+            free(values);
+            times = malloc(count * sizeof(*times));
+            values = malloc(count * sizeof(*values));
+            if ((times == NULL) || (values == NULL)) {
+                fprintf(stderr, "%s: out of memory\n", progname);
+                goto out;
+            }
+            size = count;
+        }
+
+        if ((count > 0) &&
+            (mic_recording_read(rec, series, from_ms, to_ms, times, values,
+                                &count) != E_MIC_SUCCESS))
+            goto read_error;
+
+        for (i = 0; i < count; i++)
+            printf("%lld mic%u %s %lld\n", (long long)times[i], device,
+                   name, (long long)values[i]);
+    }
+    ret = 0;
+    goto out;
+
+read_error:
+    fprintf(stderr, "%s: %s: %s\n", progname, path, mic_get_error_string());
+out:
+    free(times);
+    free(values);
+    (void)mic_recording_close(rec);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = MIC_TELEMETRY_NAME;
+    const char *cmd;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    uint32_t block_samples = 0;
+    uint32_t flags = 0;
+    uint32_t jobs;
+    uint8_t devices[MAX_DEVICES];
+    double percentiles[MAX_PERCENTILES];
+    struct query q;
+    int c;
+
+    progname = argv[0];
+
+    if ((argc < 2) || (strcmp(argv[1], "-h") == 0) ||
+        (strcmp(argv[1], "--help") == 0)) {
+        usage((argc < 2) ? stderr : stdout);
+        return (argc < 2) ? 1 : 0;
+    }
+    cmd = argv[1];
+    optind = 2;
+
+    memset(&q, 0, sizeof(q));
+    q.from_ms = INT64_MIN;
+    q.to_ms = INT64_MAX;
+    q.percentiles = percentiles;
+    q.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((c = getopt_long(argc, argv, "n:i:b:Pd:s:f:t:w:p:j:h", options,
+                            NULL)) != -1) {
+        switch (c) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            if (parse_uint(optarg, &interval_ms) < 0)
+                return 1;
+            break;
+        case 'b':
+            if (parse_uint(optarg, &block_samples) < 0)
+                return 1;
+            break;
+        case 'P':
+            flags |= MIC_RECORD_PER_CORE;
+            break;
+        case 'd':
+            if (parse_devices(optarg, devices) < 0)
+                return 1;
+            q.devices = devices;
+            break;
+        case 's':
+            q.pattern = optarg;
+            break;
+        case 'f':
+            if (parse_time(optarg, &q.from_ms) < 0)
+                return 1;
+            break;
+        case 't':
+            if (parse_time(optarg, &q.to_ms) < 0)
+                return 1;
+            break;
+        case 'w':
+            if (parse_period(optarg, &q.window_ms) < 0)
+                return 1;
+            break;
+        case 'p':
+            if (parse_percentiles(optarg, percentiles, &q.npercentiles) < 0)
+                return 1;
+            break;
+        case 'j':
+            if (parse_uint(optarg, &jobs) < 0)
+                return 1;
+            q.jobs = jobs;
+            break;
+        case 'h':
+            usage(stdout);
+            return 0;
+        default:
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if ((strcmp(cmd, "query") == 0) && (optind < argc))
+        return run_query(&q, &argv[optind], argc - optind);
+
+    if (optind != argc - 1) {
+        usage(stderr);
+        return 1;
+    }
+
+    if ((strcmp(cmd, "record") == 0) && (interval_ms > 0))
+        return record(argv[optind], name, interval_ms, block_samples, flags);
+    if (strcmp(cmd, "info") == 0)
+        return info(argv[optind]);
+    if (strcmp(cmd, "dump") == 0)
+        return dump(argv[optind], q.devices, q.pattern, q.from_ms, q.to_ms);
+
+    usage(stderr);
+    return 1;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+#ifndef __MICREC_H__
+#define __MICREC_H__
+
+#include <stdint.h>
+#include <miclib.h>
+
+/* Coprocessors beyond this cannot be selected by number */
+#define MAX_DEVICES     (256)
+
+struct query {
+    const uint8_t *devices;     /* MAX_DEVICES flags, or NULL for all */
+    const char    *pattern;     /* Shell pattern of series, or NULL */
+    int64_t        from_ms;
+    int64_t        to_ms;
+    int64_t        window_ms;   /* 0 for the whole time range */
+    const double  *percentiles;
+    int            npercentiles;
+    int            jobs;        /* Files read at once */
+};
+
+extern char *progname;
+
+int run_query(const struct query *q, char **files, int nfiles);
+
+#endif  /* __MICREC_H__ */
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/*
+ * Aggregates series over time windows across any number of recordings.
+ * Each file is read by one of a pool of threads into its own list of
+ * groups, so the threads share nothing but the next file to take; the
+ * lists are merged once all files are read. Minimum, maximum and average
+ * come from the block summaries in the recordings' index records, so only
+ * the blocks at the edges of a window are decoded, unless percentiles are
+ * asked for, which need every sample.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <pthread.h>
+
+#include "micrec.h"
+
+#define WHOLE_RANGE     INT64_MIN       /* Window start of an unwindowed query */
+
+/* The samples of one series of one device in one window */
+struct group {
+    int64_t   start;
+    uint32_t  device;
+    char     *name;
+    size_t    count;
+    int64_t   min;
+    int64_t   max;
+    double    sum;
+    int64_t  *values;       /* Only kept for percentiles */
+};
+
+struct file_result {
+    struct group *groups;
+    size_t        ngroups;
+    size_t        size;
+    char          error[256];
+};
+
+struct pool {
+    const struct query *q;
+    char              **files;
+    struct file_result *results;
+    int                 nfiles;
+    int                 next;       /* Next file to read */
+};
+
+static struct group *add_group(struct file_result *res)
+{
+    struct group *g;
+
+    if (res->ngroups == res->size) {
+        size_t size = res->size ? 2 * res->size : 64;
+
+        g = realloc(res->groups, size * sizeof(*g));
+        if (g == NULL)
+            return NULL;
+        res->groups = g;
+        res->size = size;
+    }
+    g = &res->groups[res->ngroups++];
+    memset(g, 0, sizeof(*g));
+    return g;
+}
+
+static int read_window(struct mic_recording *rec, uint32_t series,
+                       uint32_t device, const char *name, int64_t start,
+                       int64_t from_ms, int64_t to_ms, int keep_values,
+                       struct file_result *res)
+{
+    struct group *g;
+    size_t count, n;
+    int64_t min, max;
+    double sum;
+    int64_t *times;
+
+    if (mic_recording_get_summary(rec, series, from_ms, to_ms, &count, &min,
+                                  &max, &sum) != E_MIC_SUCCESS)
+        return -1;
+    if (count == 0)
+        return 0;
+
+    if ((g = add_group(res)) == NULL)
+        return -1;
+    g->start = start;
+    g->device = device;
+    g->count = count;
+    g->min = min;
+    g->max = max;
+    g->sum = sum;
+    if ((g->name = strdup(name)) == NULL)
+        return -1;
+    if (!keep_values)
+        return 0;
+
+    n = count;
+    g->values = malloc(count * sizeof(*g->values));
+    times = malloc(count * sizeof(*times));
+    if ((g->values == NULL) || (times == NULL) ||
+        (mic_recording_read(rec, series, from_ms, to_ms, times, g->values,
+                            &n) != E_MIC_SUCCESS) || (n != count)) {
+        free(times);
+        return -1;
+    }
+    free(times);
+    return 0;
+}
+
+static void read_file(const struct query *q, const char *path,
+                      struct file_result *res)
+{
+    struct mic_recording *rec;
+    uint32_t nseries, series, device;
+    const char *name;
+    int64_t first, last, from, to, start, lo, hi;
+    int ret;
+
+    if (mic_recording_open(path, &rec) != E_MIC_SUCCESS) {
+        snprintf(res->error, sizeof(res->error), "%s: %s", path,
+                 mic_get_error_string());
+        return;
+    }
+
+    if ((ret = mic_recording_get_time_range(rec, &first, &last)) !=
+        E_MIC_SUCCESS) {
+        if (ret != E_MIC_NOENT)
+            snprintf(res->error, sizeof(res->error), "%s: %s", path,
+                     mic_get_error_string());
+        (void)mic_recording_close(rec);
+        return;
+    }
+    from = (q->from_ms > first) ? q->from_ms : first;
+    to = (q->to_ms < last) ? q->to_ms : last;
+
+    (void)mic_recording_get_nseries(rec, &nseries);
+    for (series = 0; (series < nseries) && (from <= to); series++) {
+        (void)mic_recording_get_series_info(rec, series, &device, &name,
+                                            NULL);
+        if (((q->devices != NULL) &&
+             ((device >= MAX_DEVICES) || !q->devices[device])) ||
+            ((q->pattern != NULL) && (fnmatch(q->pattern, name, 0) != 0)))
+            continue;
+
+        if (q->window_ms == 0) {
+            ret = read_window(rec, series, device, name, WHOLE_RANGE, from,
+                              to, q->npercentiles > 0, res);
+        } else {
+            /* Windows are aligned on the epoch, so files line up */
+            ret = 0;
+            for (start = from - from % q->window_ms;
+                 (start <= to) && (ret == 0); start += q->window_ms) {
+                lo = (start > from) ? start : from;
+                hi = start + q->window_ms - 1;
+                hi = (hi < to) ? hi : to;
+                ret = read_window(rec, series, device, name, start, lo, hi,
+                                  q->npercentiles > 0, res);
+            }
+        }
+
+        if (ret < 0) {
+            snprintf(res->error, sizeof(res->error), "%s: %s", path,
+                     mic_get_error_string());
+            break;
+        }
+    }
+
+    (void)mic_recording_close(rec);
+}
+
+static void *read_files(void *arg)
+{
+    struct pool *pool = arg;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&pool->next, 1)) < pool->nfiles)
+        read_file(pool->q, pool->files[i], &pool->results[i]);
+
+    return NULL;
+}
+
+static int compare_groups(const void *a, const void *b)
+{
+    const struct group *ga = a, *gb = b;
+
+    if (ga->start != gb->start)
+        return (ga->start < gb->start) ? -1 : 1;
+    if (ga->device != gb->device)
+        return (ga->device < gb->device) ? -1 : 1;
+    return strcmp(ga->name, gb->name);
+}
+
+static int compare_values(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *)a, vb = *(const int64_t *)b;
+
+    return (va < vb) ? -1 : (va > vb);
+}
+
+/* Folds the groups of the same window, device and series together */
+static int merge_groups(struct group *groups, size_t n, size_t *merged,
+                        int keep_values)
+{
+    size_t i, out = 0;
+    int64_t *values;
+
+    qsort(groups, n, sizeof(*groups), compare_groups);
+
+    for (i = 0; i < n; i++) {
+        struct group *g = &groups[out];
+
+        if ((i == 0) || (compare_groups(g, &groups[i]) != 0)) {
+            if (i > 0)
+                g = &groups[++out];
+            if (g != &groups[i]) {
+                *g = groups[i];
+                groups[i].name = NULL;
+                groups[i].values = NULL;
+            }
+            continue;
+        }
+
+        if (keep_values) {
+            values = realloc(g->values, (g->count + groups[i].count) *
+                             sizeof(*values));
+            if (values == NULL)
+                return -1;
+            memcpy(values + g->count, groups[i].values,
+                   groups[i].count * sizeof(*values));
+            g->values = values;
+            free(groups[i].values);
+            groups[i].values = NULL;
+        }
+        g->count += groups[i].count;
+        g->min = (groups[i].min < g->min) ? groups[i].min : g->min;
+        g->max = (groups[i].max > g->max) ? groups[i].max : g->max;
+        g->sum += groups[i].sum;
+        free(groups[i].name);
+        groups[i].name = NULL;
+    }
+
+    *merged = (n > 0) ? out + 1 : 0;
+    return 0;
+}
+
+static void print_groups(const struct query *q, struct group *groups,
+                         size_t n)
+{
+    size_t i, rank;
+    int j;
+
+    printf("# window device series count min max avg");
+    for (j = 0; j < q->npercentiles; j++)
+        printf(" p%g", q->percentiles[j]);
+    printf("\n");
+
+    for (i = 0; i < n; i++) {
+        struct group *g = &groups[i];
+
+        if (g->start == WHOLE_RANGE)
+            printf("all");
+        else
+            printf("%lld", (long long)g->start);
+        printf(" mic%u %s %lu %lld %lld %.2f", g->device, g->name,
+               (unsigned long)g->count, (long long)g->min,
+               (long long)g->max, g->sum / g->count);
+
+        if (q->npercentiles > 0)
+            qsort(g->values, g->count, sizeof(*g->values), compare_values);
+        for (j = 0; j < q->npercentiles; j++) {
+            /* Nearest rank */
+            rank = (size_t)(q->percentiles[j] / 100.0 * g->count + 0.999999);
+            rank = (rank == 0) ? 0 : rank - 1;
+            rank = (rank >= g->count) ? g->count - 1 : rank;
+            printf(" %lld", (long long)g->values[rank]);
+        }
+        printf("\n");
+    }
+}
+
+int run_query(const struct query *q, char **files, int nfiles)
+{
+    struct pool pool;
+    pthread_t *threads;
+    struct group *groups = NULL;
+    size_t ngroups = 0, i;
+    int nthreads, started, f, ret = 1;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.q = q;
+    pool.files = files;
+    pool.nfiles = nfiles;
+    pool.results = calloc(nfiles, sizeof(*pool.results));
+    /* The calling thread is one of the jobs */
+    nthreads = ((q->jobs < nfiles) ? q->jobs : nfiles) - 1;
+    threads = calloc(nthreads + 1, sizeof(*threads));
+    if ((pool.results == NULL) || (threads == NULL)) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        goto out;
+    }
+
+    for (started = 0; started < nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, read_files, &pool) != 0)
+            break;
+    }
+    /* If no thread could be started, the files are read by this one */
+    (void)read_files(&pool);
+    for (f = 0; f < started; f++)
+        (void)pthread_join(threads[f], NULL);
+
+    for (f = 0; f < nfiles; f++) {
+        if (pool.results[f].error[0] != '\0') {
+            fprintf(stderr, "%s: %s\n", progname, pool.results[f].error);
+            goto out;
+        }
+        ngroups += pool.results[f].ngroups;
+    }
+
+    if ((ngroups > 0) &&
+        ((groups = malloc(ngroups * sizeof(*groups))) == NULL)) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        goto out;
+    }
+    for (f = 0, ngroups = 0; f < nfiles; f++) {
+        memcpy(groups + ngroups, pool.results[f].groups,
+               pool.results[f].ngroups * sizeof(*groups));
+        ngroups += pool.results[f].ngroups;
+        pool.results[f].ngroups = 0;
+    }
+
+    if (merge_groups(groups, ngroups, &ngroups, q->npercentiles > 0) < 0) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        goto out;
+    }
+    print_groups(q, groups, ngroups);
+    ret = 0;
+
+out:
+    for (i = 0; i < ngroups; i++) {
+        free(groups[i].name);
+        free(groups[i].values);
+    }
+    free(groups);
+    if (pool.results != NULL) {
+        for (f = 0; f < nfiles; f++) {
+            for (i = 0; i < pool.results[f].ngroups; i++) {
+                free(pool.results[f].groups[i].name);
+                free(pool.results[f].groups[i].values);
+            }
+            free(pool.results[f].groups);
+        }
+    }
+    free(pool.results);
+    free(threads);
+    return ret;
+}
@@ -445,15 +445,23 @@ void mic_device_class::get_idle_counters(vector<uint64_t> *counters)
 void mic_device_class::get_core_util_info(
     struct mic_device_class::core_util_info *info)
 {
-    info->jiffy_counter = get_jiffy_counter();
-    info->user_sum = get_user_sum();
-    info->nice_sum = get_nice_sum();
-    info->sys_sum = get_sys_sum();
-    info->idle_sum = get_idle_sum();
-    get_user_counters(&info->user_counters);
-    get_nice_counters(&info->nice_counters);
-    get_sys_counters(&info->sys_counters);
-    get_idle_counters(&info->idle_counters);
+    int ret;
+
+    // Allocated once, then refreshed in place on later samples
+    if (!info->sample) {
+        struct mic_core_util *cutil = NULL;
+
+        errno = 0;
+        ret = mic_alloc_core_util(&cutil);
+        if (ret != E_MIC_SUCCESS)
+            throw micmgmt_exception("core utilization info", ret);
+        info->sample.reset(cutil, &mic_free_core_util);
+    }
+
+    errno = 0;
+    ret = mic_update_core_util(mdh_, info->sample.get());
+    if (ret != E_MIC_SUCCESS)
+        throw micmgmt_exception("core utilization info", ret);
 }
 
 // Memory info
@@ -632,6 +640,25 @@ void mic_device_class::get_flash_status_info(
     mic_free_flash_status_info(status_info);
 }
 
+void mic_device_class::wait_flash_op(
+    shared_ptr<struct mic_flash_op> &flash_op, int timeout_ms,
+    int *percent_complete, int *cmd_status, int *ext_status)
+{
+    struct mic_flash_status_info *status_info = NULL;
+    uint32_t progress = 0;
+    errno = 0;
+    int ret = mic_flash_wait(flash_op.get(), timeout_ms, NULL, NULL,
+                             &status_info);
+
+    if (ret != E_MIC_SUCCESS)
+        throw micmgmt_exception("wait for flash operation", ret);
+    mic_get_progress(status_info, &progress);
+    *percent_complete = progress;
+    mic_get_status(status_info, cmd_status);
+    mic_get_ext_status(status_info, ext_status);
+    mic_free_flash_status_info(status_info);
+}
+
 void mic_device_class::set_ecc_mode_done(
     shared_ptr<struct mic_flash_op> &flash_op)
 {
@@ -183,24 +183,15 @@ public:
     void get_flash_status_info(shared_ptr<struct mic_flash_op> &flash_op,
                                int *percent_complete, int *cmd_status,
                                int *ext_status);
+    void wait_flash_op(shared_ptr<struct mic_flash_op> &flash_op,
+                       int timeout_ms, int *percent_complete,
+                       int *cmd_status, int *ext_status);
     void set_ecc_mode_done(shared_ptr<struct mic_flash_op> &flash_op);
 
+    // A core utilization sample of its own, for use with
+    // mic_get_core_util_delta()
     struct core_util_info {
-        uint64_t         jiffy_counter;
-        uint64_t         user_sum;
-        uint64_t         nice_sum;
-        uint64_t         sys_sum;
-        uint64_t         idle_sum;
-        vector<uint64_t> user_counters;
-        vector<uint64_t> nice_counters;
-        vector<uint64_t> sys_counters;
-        vector<uint64_t> idle_counters;
-
-        core_util_info() :
-            jiffy_counter(0), user_sum(0), nice_sum(0), sys_sum(0),
-            idle_sum(0)
-        {
-        }
+        shared_ptr<struct mic_core_util> sample;
     };
 
 private:
@@ -42,24 +42,28 @@ using std::stringstream;
 using std::shared_ptr;
 
 mic_device_features::mic_device_features() :
-    thermal_info_(&mdh_, "thermal info", &mic_get_thermal_info,
-                  &mic_free_thermal_info),
-    cores_info_(&mdh_, "cores info", &mic_get_cores_info, &mic_free_cores_info),
+    thermal_info_(&mdh_, "thermal info", &mic_alloc_thermal_info,
+                  &mic_update_thermal_info, &mic_free_thermal_info),
+    cores_info_(&mdh_, "cores info", &mic_alloc_cores_info,
+                &mic_update_cores_info, &mic_free_cores_info),
     power_util_info_(&mdh_, "power utilization info",
-                     &mic_get_power_utilization_info,
+                     &mic_alloc_power_utilization_info,
+                     &mic_update_power_utilization_info,
                      &mic_free_power_utilization_info),
-    power_limit_info_(&mdh_, "power limits info", &mic_get_power_limit,
-                      &mic_free_power_limit),
+    power_limit_info_(&mdh_, "power limits info", &mic_alloc_power_limit,
+                      &mic_update_power_limit, &mic_free_power_limit),
     mem_util_info_(&mdh_, "memory utilization info",
-                   &mic_get_memory_utilization_info,
+                   &mic_alloc_memory_utilization_info,
+                   &mic_update_memory_utilization_info,
                    &mic_free_memory_utilization_info),
     throttle_info_(&mdh_, "throttle state info",
-                   &mic_get_throttle_state_info,
+                   &mic_alloc_throttle_state_info,
+                   &mic_update_throttle_state_info,
                    &mic_free_throttle_state_info),
     pci_config_info_(&mdh_, "PCI configuration", &mic_get_pci_config,
                      &mic_free_pci_config),
-    version_info_(&mdh_, "version info", &mic_get_version_info,
-                  &mic_free_version_info),
+    version_info_(&mdh_, "version info", &mic_alloc_version_info,
+                  &mic_update_version_info, &mic_free_version_info),
     proc_info_(&mdh_, "processor info", &mic_get_processor_info,
                &mic_free_processor_info),
     core_util_info_(&mdh_, "core utilization info", &mic_alloc_core_util,
@@ -68,9 +72,10 @@ mic_device_features::mic_device_features() :
     mem_info_(&mdh_, "memory info", &mic_get_memory_info,
               &mic_free_memory_info),
     pm_config_info_(&mdh_, "coprocessor OS power management configuration",
-                    &mic_get_uos_pm_config, &mic_free_uos_pm_config),
-    turbo_info_(&mdh_, "turbo mode info", &mic_get_turbo_state_info,
-                &mic_free_turbo_info)
+                    &mic_alloc_uos_pm_config, &mic_update_uos_pm_config,
+                    &mic_free_uos_pm_config),
+    turbo_info_(&mdh_, "turbo mode info", &mic_alloc_turbo_info,
+                &mic_update_turbo_info, &mic_free_turbo_info)
 {
     mdh_ = NULL;
     features_[THERMAL_INFO] = &thermal_info_;
@@ -191,21 +191,24 @@ protected:
 
             int ret;
 
-            if (obj_)
-                free_info_(obj_);
-
             if (alloc_info_) {
-                errno = 0;
-                ret = alloc_info_(&obj_);
-                if (ret != E_MIC_SUCCESS) {
-                    obj_ = NULL;
-                    throw micmgmt_exception(description_, ret);
+                /* Allocate once, then refresh the same object in place */
+                if (!obj_) {
+                    errno = 0;
+                    ret = alloc_info_(&obj_);
+                    if (ret != E_MIC_SUCCESS) {
+                        obj_ = NULL;
+                        throw micmgmt_exception(description_, ret);
+                    }
                 }
                 errno = 0;
                 ret = update_info_(*mdh_, obj_);
                 if (ret != E_MIC_SUCCESS)
                     throw micmgmt_exception(description_, ret);
             } else {
+                if (obj_)
+                    free_info_(obj_);
+
                 errno = 0;
                 ret = get_info_(*mdh_, &obj_);
                 if (ret != E_MIC_SUCCESS) {
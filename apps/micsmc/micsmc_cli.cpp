@@ -259,10 +259,8 @@ void micsmc_cli::perform_cores_opt(const vector<unsigned int> &device_nums,
             device->get_num_cores();
             device->get_core_util_info(&sample1);
             os->sleep_ms(CORE_UTIL_SAMPLE_INTERVAL);
-            device->update_info(mic_device_class::CORE_UTIL_INFO);
             device->get_core_util_info(&sample2);
-            micsmc_helper::compute_dev_utilization(*device, sample1, sample2,
-                                                   &util);
+            micsmc_helper::compute_dev_utilization(sample1, sample2, &util);
 
             // Save cout config
             ios save(NULL);
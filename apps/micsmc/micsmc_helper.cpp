@@ -39,7 +39,6 @@
 using std::stringstream;
 
 #include <algorithm>
-using std::min;
 using std::max;
 
 #include <exception>
@@ -59,7 +58,6 @@ const char *const micsmc_helper::DEVICE_STATUS_NAMES[] = {
 };
 
 const unsigned int micsmc_helper::DEV_STATE_POLL_INTERVAL = 5;
-const unsigned int micsmc_helper::ECC_MODE_OP_POLL_INTERVAL = 1;
 const unsigned int micsmc_helper::ECC_MODE_OP_TIMEOUT = 10;
 
 micsmc_helper::micsmc_helper()
@@ -195,8 +193,7 @@ void micsmc_helper::set_ecc_mode(mic_device_class &device, bool enabled)
     try {
         shared_ptr<struct mic_flash_op> flash_op =
             device.set_ecc_mode_start(enabled);
-        if (!wait_for_flash_op(device, flash_op, ECC_MODE_OP_POLL_INTERVAL,
-                               ECC_MODE_OP_TIMEOUT)) {
+        if (!wait_for_flash_op(device, flash_op, ECC_MODE_OP_TIMEOUT)) {
             throw micsmc_exception("unable to set ECC mode: operation "
                                    "timed out");
         }
@@ -210,110 +207,68 @@ void micsmc_helper::set_ecc_mode(mic_device_class &device, bool enabled)
 
 bool micsmc_helper::wait_for_flash_op(mic_device_class &device,
                                       shared_ptr<struct mic_flash_op> &flash_op,
-                                      unsigned int poll_interval,
                                       unsigned int timeout)
 {
     int percent = 0;
     int cmd_status;
     int ext_status;
-    unsigned int time_left = timeout;
-    host_platform::os_utils *os = host_platform::os_utils::get_instance();
 
     try {
-        while (time_left > 0) {
-            device.get_flash_status_info(flash_op, &percent, &cmd_status,
-                                         &ext_status);
-
-            if (percent >= 100)
-                return true;
-
-            if (time_left >= poll_interval) {
-                os->sleep_sec(poll_interval);
-                time_left -= poll_interval;
-            } else {
-                os->sleep_sec(time_left);
-                time_left = 0;
-            }
-        }
-
-        device.get_flash_status_info(flash_op, &percent, &cmd_status,
-                                     &ext_status);
-        if (percent >= 100)
-            return true;
+        device.wait_flash_op(flash_op, timeout * 1000, &percent, &cmd_status,
+                             &ext_status);
     } catch (const micmgmt_exception &e) {
         throw micsmc_exception("error while querying flash operation status",
                                e);
     }
 
-    return false;
+    return percent >= 100;
 }
 
 void micsmc_helper::compute_dev_utilization(
-    mic_device_class &device,
     const mic_device_class::core_util_info &sample1,
     const mic_device_class::core_util_info &sample2,
     struct device_util_info *util)
 {
     try {
-        double jiffy_delta = sample2.jiffy_counter - sample1.jiffy_counter;
-        double thr_core = device.get_threads_per_core();
-        uint16_t num_cores = device.get_num_cores();
-
-        double user_delta = sample2.user_sum - sample1.user_sum;
-        double sys_delta = sample2.sys_sum - sample1.sys_sum;
-
-        if (jiffy_delta == 0.0 || thr_core == 0.0 || num_cores == 0)
-            throw micsmc_exception("unable to compute device utilization: "
-                                   "bad samples");
+        uint16_t num_cores = 0;
+        double device[MIC_CUTIL_NSTATS];
+        vector<double> core_nice_util;
+        int ret;
 
-        // Device user utilization
-        double user_util = (user_delta * 100.0 / (thr_core * jiffy_delta)) /
-                           (double)num_cores;
-        // Normalize device utilization
-        user_util = min<double>(user_util, 100.0);
-
-        // System device utilization
-        double sys_util = ((sys_delta * 100.0) / (thr_core * jiffy_delta)) /
-                          (double)num_cores;
-        // Normalize
-        sys_util = min<double>(sys_util, 100.0);
-
-        // Device idle time
-        double idle_time = 100.0 - (user_util + sys_util);
-        // Normalize
-        idle_time = max<double>(idle_time, 0.0);
-
-        util->user_util = user_util;
-        util->sys_util = sys_util;
-        util->idle_util = idle_time;
+        errno = 0;
+        ret = mic_get_num_cores(sample2.sample.get(), &num_cores);
+        if (ret != E_MIC_SUCCESS)
+            throw micmgmt_exception("get number of cores", ret);
 
         util->core_user_util.resize(num_cores);
         util->core_sys_util.resize(num_cores);
         util->core_idle_util.resize(num_cores);
+        core_nice_util.resize(num_cores);
+
+        errno = 0;
+        ret = mic_get_core_util_delta(sample1.sample.get(),
+                                      sample2.sample.get(),
+                                      util->core_user_util.data(),
+                                      core_nice_util.data(),
+                                      util->core_sys_util.data(),
+                                      util->core_idle_util.data(), device);
+        if (ret == E_MIC_INVAL)
+            throw micsmc_exception("unable to compute device utilization: "
+                                   "bad samples");
+        if (ret != E_MIC_SUCCESS)
+            throw micmgmt_exception("compute core utilization", ret);
+
+        // Idle time is what is left over from user and system time, so
+        // that the three always add up to 100%
+        util->user_util = device[MIC_CUTIL_USER];
+        util->sys_util = device[MIC_CUTIL_SYS];
+        util->idle_util = max<double>(100.0 - (util->user_util +
+                                               util->sys_util), 0.0);
 
         for (uint16_t i = 0; i < num_cores; i++) {
-            double core_user_delta = sample2.user_counters[i]
-                                     - sample1.user_counters[i];
-            double core_sys_delta = sample2.sys_counters[i]
-                                    - sample1.sys_counters[i];
-
-            // Core user utilization
-            double core_user_util = (core_user_delta * 100.0) /
-                                    (thr_core * jiffy_delta);
-            core_user_util = min<double>(core_user_util, 100.0);
-            util->core_user_util[i] = core_user_util;
-
-            // Core system utilization
-            double core_sys_util = (core_sys_delta * 100.00) /
-                                   (thr_core * jiffy_delta);
-            core_sys_util = min<double>(core_sys_util, 100.0);
-            util->core_sys_util[i] = core_sys_util;
-
-            // Core idle time
-            double core_idle_time = 100.0 -
-                                    (core_user_util + core_sys_util);
-            core_idle_time = max<double>(core_idle_time, 0.0);
-            util->core_idle_util[i] = core_idle_time;
+            util->core_idle_util[i] =
+                max<double>(100.0 - (util->core_user_util[i] +
+                                     util->core_sys_util[i]), 0.0);
         }
     } catch (const micsmc_exception &e) {
         throw;
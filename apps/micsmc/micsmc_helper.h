@@ -74,11 +74,10 @@ public:
     static void set_ecc_mode(mic_device_class &device, bool enabled);
     static bool wait_for_flash_op(mic_device_class &device,
                                   shared_ptr<struct mic_flash_op> &flash_op,
-                                  unsigned int poll_interval,
                                   unsigned int timeout);
 
     struct device_util_info;
-    static void compute_dev_utilization(mic_device_class &device, const
+    static void compute_dev_utilization(const
                                         mic_device_class::core_util_info &
                                         sample1, const
                                         mic_device_class::core_util_info &
@@ -105,7 +104,6 @@ public:
 
 private:
     static const unsigned int DEV_STATE_POLL_INTERVAL; // Seconds
-    static const unsigned int ECC_MODE_OP_POLL_INTERVAL; // Seconds
     static const unsigned int ECC_MODE_OP_TIMEOUT; // Seconds
 };
 
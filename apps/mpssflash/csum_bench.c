@@ -0,0 +1,187 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Benchmark and cross-check of the image_csum32() kernels. image.c is
+ * included so that its static kernels can be called directly. Every
+ * kernel the host supports is first checked against the scalar one on
+ * all lengths up to a few vector loop iterations and at every word offset
+ * into a 32-byte line, which covers the vector loops and all of their
+ * tails, and then timed on a synthetic image of the size of a flash
+ * update. Built with "make bench"; not installed.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "image.c"
+
+#define BENCH_IMAGE_WORDS       (16 * 1024 * 1024 / sizeof(uint32_t))
+#define BENCH_CHECK_WORDS       (4 * 32 + 7)
+#define BENCH_MIN_NS            (500 * 1000 * 1000ULL)
+
+struct csum_kernel {
+    const char *name;
+    const char *cpu;            /* NULL if always available */
+    uint32_t (*fn)(const uint32_t *, size_t);
+};
+
+static const struct csum_kernel kernels[] = {
+    { "scalar", NULL,   csum32_scalar },
+#ifdef IMAGE_CSUM_X86
+    { "sse2",   "sse2", csum32_sse2 },
+    { "avx2",   "avx2", csum32_avx2 },
+#endif
+};
+
+#define N_KERNELS       (sizeof(kernels) / sizeof(kernels[0]))
+
+static int kernel_supported(const struct csum_kernel *k)
+{
+    if (k->cpu == NULL)
+        return 1;
+#ifdef IMAGE_CSUM_X86
+    if (strcmp(k->cpu, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+    if (strcmp(k->cpu, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 0;
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Compares k against the scalar kernel; returns the number of mismatches */
+static int check_kernel(const struct csum_kernel *k, const uint32_t *buf)
+{
+    size_t offs, n;
+    uint32_t want, got;
+    int bad = 0;
+
+    for (offs = 0; offs < 8; offs++) {
+        for (n = 0; n <= BENCH_CHECK_WORDS; n++) {
+            want = csum32_scalar(buf + offs, n);
+            got = k->fn(buf + offs, n);
+            if (got != want) {
+                if (bad++ < 10)
+                    fprintf(stderr, "%s: offset %lu length %lu: "
+                            "0x%08x, expected 0x%08x\n", k->name,
+                            (unsigned long)offs, (unsigned long)n,
+                            got, want);
+            }
+        }
+    }
+
+    /* Whole image, odd length and misaligned */
+    want = csum32_scalar(buf + 1, BENCH_IMAGE_WORDS - 3);
+    got = k->fn(buf + 1, BENCH_IMAGE_WORDS - 3);
+    if (got != want) {
+        fprintf(stderr, "%s: image: 0x%08x, expected 0x%08x\n", k->name,
+                got, want);
+        bad++;
+    }
+
+    return bad;
+}
+
+static void time_kernel(const struct csum_kernel *k, const uint32_t *buf)
+{
+    unsigned long long start, elapsed;
+    unsigned long runs = 0;
+    volatile uint32_t sink = 0;
+
+    start = now_ns();
+    do {
+        sink += k->fn(buf, BENCH_IMAGE_WORDS);
+        runs++;
+        elapsed = now_ns() - start;
+    } while (elapsed < BENCH_MIN_NS);
+    (void)sink;
+
+    printf("%-8s %10.3f ms/image %10.2f GB/s\n", k->name,
+           elapsed / 1e6 / runs,
+           (double)BENCH_IMAGE_WORDS * sizeof(uint32_t) * runs / elapsed);
+}
+
+int main(void)
+{
+    uint32_t *buf;
+    uint32_t x = 2463534242U;
+    size_t i;
+    int bad = 0;
+
+    /* One spare word on each side for the misaligned checks */
+    if ((buf = malloc((BENCH_IMAGE_WORDS + 8) * sizeof(uint32_t))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* xorshift32, so that carries out of every lane are exercised */
+    for (i = 0; i < BENCH_IMAGE_WORDS + 8; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = x;
+    }
+
+#ifdef IMAGE_CSUM_X86
+    __builtin_cpu_init();
+#endif
+    printf("image_csum32: 0x%08x over %lu words\n",
+           image_csum32(buf, BENCH_IMAGE_WORDS),
+           (unsigned long)BENCH_IMAGE_WORDS);
+
+    for (i = 0; i < N_KERNELS; i++) {
+        if (!kernel_supported(&kernels[i])) {
+            printf("%-8s not supported by this CPU\n", kernels[i].name);
+            continue;
+        }
+        bad += check_kernel(&kernels[i], buf);
+        time_kernel(&kernels[i], buf);
+    }
+
+    free(buf);
+
+    if (bad != 0) {
+        fprintf(stderr, "%d mismatches\n", bad);
+        return 1;
+    }
+    return 0;
+}
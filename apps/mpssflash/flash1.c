@@ -46,6 +46,8 @@
 #include <limits.h>
 #include <time.h>
 #include "helper.h"
+#include "sparse.h"
+#include "store.h"
 #include <miclib.h>
 
 #define TEST_MODE         (1)
@@ -53,10 +55,13 @@
 #define MAINT_MODE        (3)
 #define NO_RESET          (4)
 #define SMC_OK            (5)
+#define SPARSE            (6)
+#define STORE             (7)
 
 static struct option options[] = {
     { "device",        1, NULL, 'd'            },
     { "file",          1, NULL, 'f'            },
+    { "output",        1, NULL, 'o'            },
     { "read",          1, NULL, 'r'            },
     { "help",          0, NULL, 'h'            },
     { "oldimage",      0, NULL, 'm'            },
@@ -67,6 +72,8 @@ static struct option options[] = {
     { "maintmode",     0, NULL, MAINT_MODE     },
     { "noreset",       0, NULL, NO_RESET       },
     { "smcok",         0, NULL, SMC_OK         },
+    { "sparse",        0, NULL, SPARSE         },
+    { "store",         1, NULL, STORE          },
     { NULL,            0, 0,    0              }
 };
 
@@ -77,6 +84,8 @@ static action_func flash_version;
 static action_func flash_read;
 static action_func flash_device;
 static action_func flash_check;
+static action_func flash_expand;
+static action_func flash_backup;
 static int flash_help(struct cmd_actions *);
 
 static struct cmd_actions actions[] = {
@@ -93,7 +102,7 @@ static struct cmd_actions actions[] = {
     },
     {
         "read", flash_read,
-        "[{--device|-d} <device>] {--file|-f} <file> read",
+        "[{--device|-d} <device>] {--file|-f} <file> [--sparse] read",
         "read contents of flash into the specified file"
     },
     {
@@ -106,6 +115,17 @@ static struct cmd_actions actions[] = {
         "--file|-f <file> [{--device|-d} <device>] check",
         "check if specified file is compatible with the card"
     },
+    {
+        "expand", flash_expand,
+        "{--file|-f} <file> {--output|-o} <file> expand",
+        "convert a sparse flash image or a backup manifest into a "
+        "regular image file"
+    },
+    {
+        "backup", flash_backup,
+        "[{--device|-d} <device>] --store <dir> backup",
+        "save flash into a deduplicating backup store"
+    },
     { NULL, NULL, NULL, NULL }
 };
 
@@ -131,7 +151,7 @@ int flash1_start(int argc, char *argv[])
     optind = 1;
 
     for (;; ) {
-        c = getopt_long(argc, argv, "d:f:hmv", options, &option_index);
+        c = getopt_long(argc, argv, "d:f:ho:mv", options, &option_index);
 
         if (c == -1)
             break;
@@ -158,6 +178,18 @@ int flash1_start(int argc, char *argv[])
             cmdopts.smc_ok++;
             break;
 
+        case SPARSE:
+            cmdopts.sparse++;
+            break;
+
+        case 'o':
+            cmdopts.output = optarg;
+            break;
+
+        case STORE:
+            cmdopts.store = optarg;
+            break;
+
         case 'd':
             cmdopts.device_flag++;
             cmdopts.device = optarg;
@@ -258,6 +290,26 @@ int flash1_start(int argc, char *argv[])
             return CMD_LINE_ERR;
         }
 
+        if (cmdopts.sparse && (strcmp(ca->cmd_name, "read") != 0)) {
+            error_msg_start("'sparse' may only be specified with "
+                            "read command\n");
+            return CMD_LINE_ERR;
+        }
+
+        if ((cmdopts.store != NULL) &&
+            (strcmp(ca->cmd_name, "backup") != 0)) {
+            error_msg_start("'--store <dir>' may only be specified "
+                            "with backup command\n");
+            return CMD_LINE_ERR;
+        }
+
+        if ((cmdopts.output != NULL) &&
+            (strcmp(ca->cmd_name, "expand") != 0)) {
+            error_msg_start("'{--output|-o} <file>' may only be "
+                            "specified with expand command\n");
+            return CMD_LINE_ERR;
+        }
+
         return (*ca->cmd_func)((void *)&cmdopts, &option_index,
                                argc, argv);
     }
@@ -372,6 +424,56 @@ static int read_flash_file(const char *fname, void **rbuf, size_t *size)
     }
 
     close(fd);
+
+    if (store_is_manifest(buf, sbuf.st_size)) {
+        void *raw, *image;
+        size_t raw_size, image_size;
+        off_t active;
+
+        free(buf);
+        if ((ret = store_load(fname, &raw, &raw_size, &active)) != 0)
+            return ret;
+
+        ret = flash_buf_to_file_image(fname, raw, raw_size, active, &image,
+                                      &image_size);
+        free(raw);
+        if (ret != 0)
+            return ret;
+
+        *rbuf = image;
+        *size = image_size;
+        return 0;
+    }
+
+    if (sparse_is_image(buf, sbuf.st_size)) {
+        void *image;
+        size_t image_size;
+
+        ret = sparse_expand(buf, sbuf.st_size, &image, &image_size);
+        free(buf);
+
+        switch (ret) {
+        case 0:
+            break;
+
+        case SPARSE_ERR_NOMEM:
+            error_msg_start("malloc: %s\n", strerror(ENOMEM));
+            return MEM_ERR;
+
+        case SPARSE_ERR_HASH:
+            error_msg_start("%s: Sparse image hash mismatch\n", fname);
+            return FILE_ERR;
+
+        default:
+            error_msg_start("%s: Malformed sparse image\n", fname);
+            return FILE_ERR;
+        }
+
+        *rbuf = image;
+        *size = image_size;
+        return 0;
+    }
+
     *rbuf = buf;
     *size = sbuf.st_size;
 
@@ -506,9 +608,8 @@ static int flash_update(void *in, int *index, int argc, char *argv[])
         goto reset_card;
     }
 
-    interval = cmdopts.line_mode_flag ? 0 : FLASH_READ_POLL_INTERVAL;
-    if ((ret = poll_flash_op(device, desc, interval,
-                             FLASH_UPDATE_TIMEOUT, 1, flash_image)) != 0) {
+    if ((ret = poll_flash_op(device, desc, FLASH_UPDATE_TIMEOUT, 1,
+                             flash_image)) != 0) {
         ret = (ret < 0) ? OTHER_ERR : FLASH_UPDATED;
         (void)mic_flash_update_done(desc);
         goto reset_card;
@@ -586,7 +687,7 @@ static int flash_version(void *in, int *index, int argc, char *argv[])
         if ((ret = read_flash_file(copts->file, &buf, &size)) != 0)
             return ret;
 
-        if ((ret = flash_file_version(copts->file, buf,
+        if ((ret = flash_file_version(copts->file, buf, size,
                                       flash, sizeof(flash))) != 0) {
             free(buf);
             return ret;
@@ -730,9 +831,7 @@ static int flash_read(void *in, int *index, int argc, char *argv[])
         goto reset_card;
     }
 
-    interval = cmdopts.line_mode_flag ? 0 : FLASH_READ_POLL_INTERVAL;
-    if (poll_flash_op(device, desc, interval,
-                      FLASH_READ_TIMEOUT, 0, 0) != 0) {
+    if (poll_flash_op(device, desc, FLASH_READ_TIMEOUT, 0, 0) != 0) {
         ret = 5;
         goto reset_card;
     }
@@ -751,7 +850,15 @@ static int flash_read(void *in, int *index, int argc, char *argv[])
                                    &outbuf_size)) != 0)
         goto reset_card;
 
-    if (write(fd, outbuf, outbuf_size) != (int)outbuf_size) {
+    if (cmdopts.sparse) {
+        if (sparse_write(fd, outbuf, outbuf_size) < 0) {
+            error_msg_start("%s: %s: write: %s\n",
+                            mic_get_device_name(device),
+                            copts->file, strerror(errno));
+            ret = 4;
+            goto reset_card;
+        }
+    } else if (write(fd, outbuf, outbuf_size) != (int)outbuf_size) {
         error_msg_start("%s: %s: write: %s\n",
                         mic_get_device_name(device),
                         copts->file, strerror(errno));
@@ -932,3 +1039,153 @@ static int flash_check(void *in, int *index, int argc, char *argv[])
     (void)mic_close_device(device);
     return ret;
 }
+
+static int flash_expand(void *in, int *index, int argc, char *argv[])
+{
+    struct cmdopts *copts = (struct cmdopts *)in;
+    void *buf;
+    size_t size;
+    int fd, ret;
+
+    ARG_USED(argv);
+
+    if (*index < argc) {
+        error_msg_start("Extra args at the end of expand command\n");
+        return CMD_LINE_ERR;
+    }
+
+    if (copts->file == NULL) {
+        error_msg_start("Missing '{--file|-f} <file>' arg\n");
+        return CMD_LINE_ERR;
+    }
+
+    if (copts->output == NULL) {
+        error_msg_start("Missing '{--output|-o} <file>' arg\n");
+        return CMD_LINE_ERR;
+    }
+
+    /*
+     * read_flash_file() converts sparse images and backup manifests as
+     * it reads them.
+     */
+    if ((ret = read_flash_file(copts->file, &buf, &size)) != 0)
+        return ret;
+
+    if ((fd = open(copts->output, O_WRONLY | O_TRUNC | O_CREAT,
+                   0644)) < 0) {
+        error_msg_start("%s: %s\n", copts->output, strerror(errno));
+        free(buf);
+        return FILE_ERR;
+    }
+
+    ret = 0;
+    if (write(fd, buf, size) != (int)size) {
+        error_msg_start("%s: write: %s\n", copts->output,
+                        strerror(errno));
+        ret = FILE_ERR;
+    }
+
+    close(fd);
+    free(buf);
+    return ret;
+}
+
+static int flash_backup(void *in, int *index, int argc, char *argv[])
+{
+    struct cmdopts *copts = (struct cmdopts *)in;
+    int selected_card;
+    struct mic_device *device;
+    char flash[NAME_MAX];
+    void *buf = NULL;
+    size_t size;
+    off_t active;
+    int ret, n_new, n_blocks;
+    uint32_t interval;
+
+    ARG_USED(argv);
+
+    if (*index < argc) {
+        error_msg_start("Extra args at the end of backup command\n");
+        return CMD_LINE_ERR;
+    }
+
+    if (copts->store == NULL) {
+        error_msg_start("Missing '--store <dir>' arg\n");
+        return CMD_LINE_ERR;
+    }
+
+    if (copts->file != NULL) {
+        error_msg_start("'{--file|-f} <file>' may not be used with "
+                        "backup command\n");
+        return CMD_LINE_ERR;
+    }
+
+    if ((selected_card = get_card_from_cmdline(copts)) < 0)
+        return CARD_NUM_ERR;
+
+    if (mic_open_device(&device, selected_card) != 0) {
+        error_msg_start("Failed to open card '%d': %s: %s\n",
+                        selected_card, mic_get_error_string(),
+                        strerror(errno));
+        return errno == ENOENT ?  NODEV_ERR : DEVOPEN_ERR;
+    }
+
+    set_signals(SIG_IGN);
+
+    if (set_maint_mode(device) != 0) {
+        mic_close_device(device);
+        set_signals(SIG_DFL);
+        return MODE_ERR;
+    }
+
+    ret = 0;
+    if ((ret = read_flash_device_maint_mode(device, &buf, &size)) != 0)
+        goto reset_card;
+
+    if (mic_flash_active_offs(device, &active) != E_MIC_SUCCESS) {
+        error_msg_start("%s: Failed to read active offs: "
+                        "%s: %s\n", mic_get_device_name(device),
+                        mic_get_error_string(), strerror(errno));
+        ret = OTHER_ERR;
+        goto reset_card;
+    }
+
+    if (mic_flash_version(device, buf, flash, sizeof(flash))
+        != E_MIC_SUCCESS) {
+        error_msg_start("%s: Failed to retrieve version: "
+                        "%s: %s\n", mic_get_device_name(device),
+                        mic_get_error_string(), strerror(errno));
+        ret = OTHER_ERR;
+        goto reset_card;
+    }
+
+    if ((ret = store_save(copts->store, mic_get_device_name(device), buf,
+                          size, active, flash, &n_new, &n_blocks)) != 0)
+        goto reset_card;
+
+    if (!cmdopts.line_mode_flag)
+        printf("%s: Backup: %s: %d of %d blocks written\n",
+               mic_get_device_name(device), copts->store, n_new,
+               n_blocks);
+    else
+        printf("Backup: %d of %d blocks written\n", n_new, n_blocks);
+
+reset_card:
+    if (exit_maint_mode(device, ret) != E_MIC_SUCCESS) {
+        error_msg_start(
+            "%s: Failed to reset: %s: %s\n",
+            mic_get_device_name(device),
+            mic_get_error_string(),
+            strerror(errno));
+        ret = OTHER_ERR;
+    } else {
+        interval = cmdopts.line_mode_flag ? 0 :
+                   READY_MODE_POLL_INTERVAL;
+        (void)poll_ready_state(device, interval, MODE_CHANGE_TIMEOUT);
+    }
+    (void)mic_close_device(device);
+    if (buf != NULL)
+        free(buf);
+    set_signals(SIG_DFL);
+    return ret;
+}
@@ -44,6 +44,7 @@
 #include <regex.h>
 #include <ctype.h>
 #include "helper.h"
+#include "image.h"
 
 #define ASSERT    assert
 
@@ -101,140 +102,11 @@ long get_numl(char *s, char **more)
     return strtol(s, more, base);
 }
 
-/* The following should be read from flash repo */
-#pragma pack(push, 1)
-
-struct failsafe_info {
-    uint32_t fsi_magic1;
-    uint32_t fsi_offset;
-    uint32_t fsi_offset_copy;
-    uint32_t fsi_magic2;
-};
-
-struct flash_desc {
-    uint32_t fd_type;
-    uint32_t fd_size;
-    uint32_t fd_data[1];
-};
-
-/* Index into fd_data */
-#define CSS_HEADER_SIZE_AT    (4)
-
-/* Valid fdh_type values */
-#define DESC_DEVID_SSID       (0)
-#define DESC_ADDR_MAP         (3)
-#define DESC_CSS              (6)
-
-struct flash_header {
-    uint16_t          fh_version : 3;
-    uint16_t          fh_size    : 13;
-    uint16_t          fh_odm_rev;
-    uint32_t          fh_image_type;
-    uint32_t          fh_checksum1;
-    uint32_t          fh_checksum2;
-    struct flash_desc fh_desc[1];
-};
-
-/* Valid fh_image_type */
-#define FHI_INTERNAL    (0)
-#define FHI_UPDATE      (1)
-#define FHI_RELEASE     (2)
-#define FHI_CUSTOM      (3)
-
-struct addrmap_desc {
-    uint32_t ad_id    : 24;
-    uint32_t ad_flags : 8;
-    uint32_t ad_size;
-    uint32_t ad_offs;
-    uint32_t ad_alt;
-};
-
-/* An ad_id that's used */
-#define ID_RPR           (0x525052)
-
-/* Used ad_flags values */
-#define FL_BLOCKED       (0x04)
-#define FL_SEL_TYPE      (0x60)
-#define FL_SEL_REPAIR    (0x20)
-
-struct desc_id {
-    uint32_t di_dev_id;
-    uint32_t di_ssid;
-    uint16_t di_rev_id_low;
-    uint16_t di_rev_id_high;
-};
-
-static struct flash_desc *find_desc(struct flash_header *, uint32_t);
-
-#pragma pack(pop)
-
-#define FLASH_HEADER_OFFSET     (sizeof(struct failsafe_info))
-#define FILE_CSS_HEADER_OFFS    (0x38000)
-#define CSS_HEADER_SIZE         (0x284)
-
-#define FS_MAGIC1               (0x00ffaa55)
-#define FS_MAGIC2               (0xff0055aa)
-
-#define OFFS_IMAGE_A            (0x10000)
-#define OFFS_IMAGE_B            (0x90000)
-
-#define CSS_HEADER_OFFS         (0x28000)
-
-#define BUF_OFFS(buf, offs)    ((void *)((char *)(buf) + (offs)))
-
-static struct flash_desc *find_desc(struct flash_header *flash_hdr,
-                                    uint32_t type)
-{
-    uint32_t hdr_size, desc_offs;
-    struct flash_desc *desc = NULL;
-
-    hdr_size = flash_hdr->fh_size;
-    desc_offs = (uint32_t)OFFSET_OF(fh_desc[0], flash_hdr);
-
-    while (desc_offs < hdr_size) {
-        desc = (struct flash_desc *)((uint8_t *)flash_hdr + desc_offs);
-
-        if (desc->fd_type == type)
-            break;
-
-        desc_offs += (sizeof(struct flash_desc) +
-                      (desc->fd_size - 1) * sizeof(desc->fd_data[0]));
-    }
-
-    if (desc != NULL && desc->fd_type != type)
-        return NULL;
-
-    return desc;
-}
-
 int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
                         void **outbuf, size_t *outbuf_size)
 {
     size_t flash_size;
-    struct failsafe_info *fs, fsi;
-    off_t active, other;
-    struct flash_desc *hd, *desc;
-    struct flash_header *flash_hdr, *flash_hdr2;
-    void *p;
-    uint32_t n_entries, block_size;
-    struct addrmap_desc *ad;
-
-/* Check the names of all these #define identifiers. */
-#define PAGE_SIZE                (0x1000)
-#define FILE_ACTIVE_OFFS         (0x10000)
-#define FILE_INACTIVE_OFFS       (0x90000)
-#define IMAGE_SIZE               (0x70000)
-#define FILL_FF_OFFS             (0x38000)
-#define EXTENDED_FW_OFFS         (0xf0000)
-#define FILE_EXTENDED_FW_OFFS    (0x100000)
-#define COMPRESSED_FW_OFFS       (0x90000)
-#define EXTENDED_FW_SIZE         (0x80000)
-#define FIXED_DATA_OFFS          (0x1000)
-#define FIXED_DATA_SIZE          (0xf000)
-#define R_SIZE                   (0x1000)
-#define S_SIZE                   (0x1000)
-#define BOOT_LOADER_OFFS         (0x80000)
-#define BOOT_LOADER_SIZE         (0x10000)
+    off_t active;
 
     if (mic_flash_size(mdh, &flash_size) != E_MIC_SUCCESS) {
         error_msg_start("%s: Failed to read flash header information: "
@@ -253,21 +125,46 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
         return OTHER_ERR;
     }
 
+    if (mic_flash_active_offs(mdh, &active) != E_MIC_SUCCESS) {
+        error_msg_start("%s: Failed to read active offs: "
+                        "%s: %s\n", mic_get_device_name(mdh),
+                        mic_get_error_string(), strerror(errno));
+        return OTHER_ERR;
+    }
+
+    return flash_buf_to_file_image(mic_get_device_name(mdh), buf, buf_size,
+                                   active, outbuf, outbuf_size);
+}
+
+/*
+ * Convert a raw flash read of buf_size bytes into the file image layout,
+ * given the offset of the active image. 'name' is only used in error
+ * messages, so this may be used on backups without a card present.
+ */
+int flash_buf_to_file_image(const char *name, void *buf, size_t buf_size,
+                            off_t active, void **outbuf, size_t *outbuf_size)
+{
+    struct failsafe_info *fs, fsi;
+    off_t other;
+    struct flash_desc *hd, *desc;
+    struct flash_header *flash_hdr, *flash_hdr2;
+    void *p;
+    uint32_t n_entries, block_size;
+    struct addrmap_desc *ad;
+
+    if (buf_size < FLASH_LAYOUT_SIZE) {
+        error_msg_start("%s: Unexpected flash size: 0x%lx\n", name,
+                        (unsigned long)buf_size);
+        return OTHER_ERR;
+    }
+
     fs = (struct failsafe_info *)buf;
 
     UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_FLASH_TO_IMAGE_1",
                         fs->fsi_magic1 = 0);
     if ((fs->fsi_magic1 != FS_MAGIC1) || (fs->fsi_magic2 != FS_MAGIC2)) {
         error_msg_start("%s: Corrupted flash image: magic 0x%x, 0x%x\n",
-                        mic_get_device_name(mdh),
-                        fs->fsi_magic1, fs->fsi_magic2);
-        return OTHER_ERR;
-    }
-
-    if (mic_flash_active_offs(mdh, &active) != E_MIC_SUCCESS) {
-        error_msg_start("%s: Failed to read active offs: "
-                        "%s: %s\n", mic_get_device_name(mdh),
-                        mic_get_error_string(), strerror(errno));
+                        name, fs->fsi_magic1, fs->fsi_magic2);
         return OTHER_ERR;
     }
 
@@ -275,7 +172,7 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
                         active = 0);
     if ((active != OFFS_IMAGE_A) && (active != OFFS_IMAGE_B)) {
         error_msg_start("%s: Corrupted flash image: Active offset: "
-                        "0x%lx\n", mic_get_device_name(mdh), active);
+                        "0x%lx\n", name, active);
         return OTHER_ERR;
     }
 
@@ -286,7 +183,7 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
                         hd->fd_type = DESC_CSS + 1);
     if (hd->fd_type != DESC_CSS) {
         error_msg_start("%s: Malformed image: Bad descriptor: 0x%x\n",
-                        mic_get_device_name(mdh), hd->fd_type);
+                        name, hd->fd_type);
         return OTHER_ERR;
     }
 
@@ -319,8 +216,7 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
                        sizeof(uint32_t);
         p = *outbuf = calloc(*outbuf_size, 1);
         if (p == NULL) {
-            error_msg_start("%s: malloc: %s\n",
-                            mic_get_device_name(mdh),
+            error_msg_start("%s: malloc: %s\n", name,
                             strerror(errno));
             return MEM_ERR;
         }
@@ -353,7 +249,7 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
         (void)memcpy(BUF_OFFS(p, CSS_HEADER_SIZE + FIXED_DATA_OFFS),
                      BUF_OFFS(buf, FIXED_DATA_OFFS), FIXED_DATA_SIZE);
 
-        desc = find_desc(flash_hdr, DESC_ADDR_MAP);
+        desc = image_find_desc(flash_hdr, DESC_ADDR_MAP);
         if (desc == NULL)
             break;
 
@@ -389,8 +285,7 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
                        sizeof(uint32_t) - CSS_HEADER_SIZE;
         p = *outbuf = calloc(*outbuf_size, 1);
         if (p == NULL) {
-            error_msg_start("%s: malloc: %s\n",
-                            mic_get_device_name(mdh),
+            error_msg_start("%s: malloc: %s\n", name,
                             strerror(errno));
             return MEM_ERR;
         }
@@ -427,116 +322,6 @@ int flash_to_file_image(struct mic_device *mdh, void *buf, size_t buf_size,
     return 0;
 }
 
-/*
- * Get flash image start offs and size. Returns -1 if no image exists, 0
- * if flash image exists, and 1 if SMC only.
- */
-static int get_flash_block_start_size(struct mic_device *mdh, const char *file,
-                                      void *buf,
-                                      size_t buf_size, off_t *offs,
-                                      size_t *size)
-{
-    struct failsafe_info *fs;
-    struct flash_desc *hd;
-    size_t image_size;
-
-    fs = (struct failsafe_info *)buf;
-
-    if ((fs->fsi_magic1 == FS_MAGIC1) && (fs->fsi_magic2 == FS_MAGIC2)) {
-        /*
-         * Magic numbers are right at the beginning of the file -
-         * It's an internal or a development image.
-         */
-        struct flash_header *fh;
-
-        /*
-         * Make sure that we'll be able to read at least the CSS
-         * header.
-         */
-        if (buf_size < (FILE_CSS_HEADER_OFFS + CSS_HEADER_SIZE)) {
-            error_msg_start("%s: %s: Malformed file: "
-                            "No CSS header\n",
-                            mic_get_device_name(mdh), file);
-            return -1;
-        }
-
-        hd = (struct flash_desc *)
-             (((unsigned char *)buf) + FILE_CSS_HEADER_OFFS);
-
-        if (hd->fd_type != DESC_CSS) {
-            error_msg_start("%s: %s: Malformed file: Bad header\n",
-                            mic_get_device_name(mdh), file);
-            return -1;
-        }
-
-        fh = (struct flash_header *)
-             (((unsigned char *)buf) + FLASH_HEADER_OFFSET);
-
-        image_size = hd->fd_data[CSS_HEADER_SIZE_AT] *
-                     sizeof(uint32_t);
-
-        switch (fh->fh_image_type) {
-        case FHI_RELEASE:
-            *size = buf_size;
-            break;
-
-        case FHI_INTERNAL:
-            if (image_size < buf_size)
-                *size = image_size - CSS_HEADER_SIZE;
-            else
-                *size = buf_size;
-            break;
-
-        default:
-            error_msg_start("%s: %s: Malformed file: "
-                            "Unexpected image type: 0x%x\n",
-                            mic_get_device_name(mdh), file,
-                            fh->fh_image_type);
-            return -1;
-        }
-        *offs = 0;
-    } else {
-        if (buf_size < CSS_HEADER_SIZE) {
-            error_msg_start("%s: %s: Malformed file: "
-                            "No CSS header\n",
-                            mic_get_device_name(mdh), file);
-            return -1;
-        }
-
-        fs = (struct failsafe_info *)BUF_OFFS(buf, CSS_HEADER_SIZE);
-        if ((fs->fsi_magic1 != FS_MAGIC1) ||
-            (fs->fsi_magic2 != FS_MAGIC2)) {
-            /* Likely, SMC with CSS header */
-            *offs = 0;
-            *size = 0;
-            return 1;
-        }
-
-        hd = (struct flash_desc *)buf;
-
-        if (hd->fd_type != DESC_CSS) {
-            error_msg_start("%s: %s: Malformed file: Bad header\n",
-                            mic_get_device_name(mdh), file);
-            return -1;
-        }
-
-        image_size = hd->fd_data[CSS_HEADER_SIZE_AT] * sizeof(uint32_t);
-
-        if (image_size <= buf_size) {
-            /* Flash + SMC image or Flash only */
-            *offs = CSS_HEADER_SIZE;
-            *size = image_size - CSS_HEADER_SIZE;
-        } else {
-            /* SMC only */
-            *offs = 0;
-            *size = 0;
-            return 1;
-        }
-    }
-
-    return 0;
-}
-
 /* Versions string is of the form: v1.v2.v3.v4 */
 #define N_VERSION    (4)
 
@@ -593,7 +378,6 @@ int read_flash_device_maint_mode(struct mic_device *device, void **rbuf,
 {
     struct mic_flash_op *desc = NULL;
     void *buf = NULL;
-    uint32_t interval;
 
     if (mic_flash_size(device, size) != E_MIC_SUCCESS) {
         error_msg_start(
@@ -618,9 +402,7 @@ int read_flash_device_maint_mode(struct mic_device *device, void **rbuf,
         return OTHER_ERR;
     }
 
-    interval = cmdopts.line_mode_flag ? 0 : FLASH_READ_POLL_INTERVAL;
-    if (poll_flash_op(device, desc, interval,
-                      FLASH_READ_TIMEOUT, 0, 0) != 0) {
+    if (poll_flash_op(device, desc, FLASH_READ_TIMEOUT, 0, 0) != 0) {
         (void)mic_flash_read_done(desc);
         free(buf);
         return OTHER_ERR;
@@ -638,6 +420,53 @@ int read_flash_device_maint_mode(struct mic_device *device, void **rbuf,
     return 0;
 }
 
+static void image_parse_error(struct mic_device *mdh, const char *file,
+                              struct image_layout *il, int err)
+{
+    switch (err) {
+    case IMAGE_ERR_NO_CSS:
+        error_msg_start("%s: %s: Malformed file: No CSS header\n",
+                        mic_get_device_name(mdh), file);
+        break;
+
+    case IMAGE_ERR_BAD_HEADER:
+        error_msg_start("%s: %s: Malformed file: Bad header\n",
+                        mic_get_device_name(mdh), file);
+        break;
+
+    case IMAGE_ERR_BAD_TYPE:
+        error_msg_start("%s: %s: Malformed file: "
+                        "Unexpected image type: 0x%x\n",
+                        mic_get_device_name(mdh), file,
+                        il->il_image_type);
+        break;
+    }
+}
+
+/*
+ * Copy the version string of an already parsed image into 'flash'.
+ */
+static int image_version(const char *fname, struct image_layout *il,
+                         void *buf, size_t buf_size, char *flash,
+                         size_t size)
+{
+    size_t avail;
+
+    if (il->il_version == NULL) {
+        error_msg_start("%s: Not valid flash image\n", fname);
+        return OTHER_ERR;
+    }
+
+    avail = buf_size - (il->il_version - (const char *)buf);
+    if (avail < size)
+        size = avail + 1;
+
+    strncpy(flash, il->il_version, size - 1);
+    flash[size - 1] = '\0';
+
+    return 0;
+}
+
 /*
  * Verify if the given file image is compatible with the given device. Returns
  * 0 if it is (*flash_image is set zero if possibly an SMC image, it's set to
@@ -647,10 +476,8 @@ int read_flash_device_maint_mode(struct mic_device *device, void **rbuf,
 int verify_image(const char *file, struct mic_device *mdh, void *fbuf,
                  size_t fbufsize, int *flash_image, int oldimage_ok)
 {
-    uint32_t i, csum;
-    off_t first_block, start, last;
-    size_t size;
-    uint32_t *ubuf;
+    uint32_t i;
+    struct image_layout il;
     uint16_t vendor_id, dev_id, subsys_id;
     uint8_t rev_id;
     struct flash_header *flash_hdr;
@@ -665,41 +492,33 @@ int verify_image(const char *file, struct mic_device *mdh, void *fbuf,
     size_t dsize;
 
     /* Checksum the image */
-    if ((ret = get_flash_block_start_size(mdh, file, fbuf, fbufsize,
-                                          &first_block, &size)) < 0)
+    if ((ret = image_parse(fbuf, fbufsize, &il)) < 0) {
+        image_parse_error(mdh, file, &il, ret);
         return -OTHER_ERR;
+    }
 
-    if (ret == 1) {
+    if (ret == IMAGE_SMC) {
         /* SMC only */
         *flash_image = 0;
         return 0;
     }
 
     *flash_image = 1;
-    if (size < (size_t)first_block) {
+    if (il.il_size < (size_t)il.il_offs) {
         error_msg_start("%s: %s: Image too small\n",
                         mic_get_device_name(mdh), file);
         return -OTHER_ERR;
     }
 
-    if (size & 3) {
+    if (il.il_size & 3) {
         error_msg_start("%s: %s: Image size is not a multiple of 4\n",
                         mic_get_device_name(mdh), file);
         return -OTHER_ERR;
     }
 
-    flash_hdr = (struct flash_header *)((uint8_t *)fbuf + first_block
-                                        + FLASH_HEADER_OFFSET);
+    flash_hdr = il.il_flash_hdr;
 
-    start = first_block >>= 2;
-    last = start + (size >> 2);
-
-    ubuf = (uint32_t *)fbuf;
-    csum = 0;
-    for (i = start; i < last; i++)
-        csum += ubuf[i];
-
-    if (csum != 0) {
+    if (image_csum32(BUF_OFFS(fbuf, il.il_offs), il.il_size >> 2) != 0) {
         error_msg_start("%s: %s: Checksum verification failed\n",
                         mic_get_device_name(mdh), file);
         return -OTHER_ERR;
@@ -729,7 +548,7 @@ int verify_image(const char *file, struct mic_device *mdh, void *fbuf,
     dev_id_vendor = (((uint32_t)dev_id) << 16) | vendor_id;
     ssid_vendor = (((uint32_t)subsys_id) << 16) | vendor_id;
 
-    desc = find_desc(flash_hdr, DESC_DEVID_SSID);
+    desc = image_find_desc(flash_hdr, DESC_DEVID_SSID);
     if (desc == NULL) {
         error_msg_start("%s: %s: Corrupted image: "
                         "No dev-id/ssid section",
@@ -766,8 +585,8 @@ int verify_image(const char *file, struct mic_device *mdh, void *fbuf,
             return -OTHER_ERR;
         }
 
-        if ((ret = flash_file_version(file, fbuf, fver, sizeof(fver)))
-            != 0) {
+        if ((ret = image_version(file, &il, fbuf, fbufsize, fver,
+                                 sizeof(fver))) != 0) {
             free(dbuf);
             return -ret;
         }
@@ -863,35 +682,103 @@ static int check_flash_op(struct mic_flash_op *desc, uint32_t *percent,
     return 0;
 }
 
+#ifdef DEBUG
+/* Wait for an operation whose failure was injected by an instrumentation
+ * event so that the flash is not left busy. */
+static void drain_flash_op(struct mic_flash_op *desc)
+{
+    struct mic_flash_status_info *stat;
+
+    if (mic_flash_wait(desc, -1, NULL, NULL, &stat) == E_MIC_SUCCESS)
+        (void)mic_free_flash_status_info(stat);
+}
+#endif
+
+struct flash_progress {
+    struct mic_device *device;
+    const char        *op;
+    uint32_t           prev_percent;
+    int                flash_update;
+    int                ret;
+};
+
+/*
+ * Progress callback for mic_flash_wait(). Reports every percent change
+ * and, if we started with a flash update and SMC update is now in
+ * progress, switches to reporting SMC update status.
+ */
+static void report_flash_progress(struct mic_flash_status_info *stat,
+                                  void *arg)
+{
+    struct flash_progress *fp = arg;
+    uint32_t percent;
+    int status;
+
+    (void)mic_get_progress(stat, &percent);
+    (void)mic_get_status(stat, &status);
+
+    if (fp->flash_update && SMC_OP(status)) {
+        fp->ret = FLASH_UPDATED;
+        if (fp->prev_percent != 100) {
+            if (cmdopts.line_mode_flag) {
+                printf("100\n");
+            } else {
+                printf("%s: Flash update successful\n",
+                       mic_get_device_name(fp->device));
+            }
+        }
+        fp->flash_update = 0;
+        if (cmdopts.line_mode_flag) {
+            printf("SMC update:\n");
+        } else {
+            printf("%s: SMC update in progress\n",
+                   mic_get_device_name(fp->device));
+        }
+        fp->op = "SMC update";
+    }
+
+    if ((status != FLASH_OP_IN_PROGRESS) && (status != SMC_OP_IN_PROGRESS))
+        return;
+
+    if (percent != fp->prev_percent) {
+        if (cmdopts.line_mode_flag) {
+            printf("%u\n", percent);
+        } else if (cmdopts.verbose_flag) {
+            printf("%s: %s: %u%%\n", mic_get_device_name(fp->device),
+                   fp->op, percent);
+        }
+        fflush(stdout);
+        fp->prev_percent = percent;
+    }
+}
+
 /*
- * Poll for given flash operation. update_op is true if polling for an
+ * Wait for given flash operation. update_op is true if waiting for an
  * update operation. Note that update operation may be SMC only in which
- * case flash_update is set to false.
+ * case flash_update is set to false. timeout is in seconds and restarts
+ * when the update moves on to the SMC.
  */
 int poll_flash_op(struct mic_device *device, struct mic_flash_op *desc,
-                  uint32_t delay, int timeout, int update_op, int flash_update)
+                  int timeout, int update_op, int flash_update)
 {
-    uint32_t percent_complete, prev_percent_complete;
-    int status, ext_status, done;
-    time_t start_time;
+    struct mic_flash_status_info *stat;
+    struct flash_progress fp;
+    uint32_t percent_complete;
+    int status, ext_status;
     char *str;
-    int ret = -1;
-    char *op;
 
-    prev_percent_complete = UINT_MAX;
+    fp.device = device;
+    fp.prev_percent = UINT_MAX;
+    fp.flash_update = flash_update;
+    fp.ret = -1;
     if (check_flash_op(desc, &percent_complete, &status, &ext_status)
         != 0) {
         error_msg_start("%s: Failed to read flash status: %s: %s\n",
                         mic_get_device_name(device),
                         mic_get_error_string(), strerror(errno));
-        return ret;
+        return fp.ret;
     }
 
-#define WAIT_FOR_OP()    {                                      \
-        int s, e;                                               \
-        while (check_flash_op(desc, &percent_complete, &s, &e), \
-               s != FLASH_OP_COMPLETED) ;                       \
-}
     if (update_op) {
         if (flash_update) {
             if (cmdopts.line_mode_flag) {
@@ -900,24 +787,24 @@ int poll_flash_op(struct mic_device *device, struct mic_flash_op *desc,
                 printf("%s: Flash update in progress\n",
                        mic_get_device_name(device));
             }
-            op = "Flash update";
+            fp.op = "Flash update";
             UT_INSTRUMENT_EVENT(
                 "FLASH1_INSTRUMENT_UPDATE_FAILURE_0",
                 error_msg_start("Instrumented "
                                 "Flash update error\n"));
             UT_INSTRUMENT_EVENT(
                 "FLASH1_INSTRUMENT_UPDATE_FAILURE_0",
-                WAIT_FOR_OP());
+                drain_flash_op(desc));
             UT_INSTRUMENT_EVENT(
                 "FLASH1_INSTRUMENT_UPDATE_FAILURE_0",
                 return -1);
         } else {
             if (cmdopts.smc_bootloader) {
                 str = "boot-loader ";
-                op = "SMC boot-loader update";
+                fp.op = "SMC boot-loader update";
             } else {
                 str = "";
-                op = "SMC update";
+                fp.op = "SMC update";
             }
             if (cmdopts.line_mode_flag) {
                 printf("SMC %supdate:\n", str);
@@ -933,261 +820,129 @@ int poll_flash_op(struct mic_device *device, struct mic_flash_op *desc,
             printf("%s: Flash read in progress\n",
                    mic_get_device_name(device));
         }
-        op = "Flash read";
+        fp.op = "Flash read";
         UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_READ_FAILURE_0",
                             error_msg_start(
                                 "Instrumented Flash read error\n"));
         UT_INSTRUMENT_EVENT(
-            "FLASH1_INSTRUMENT_READ_FAILURE_0", WAIT_FOR_OP());
+            "FLASH1_INSTRUMENT_READ_FAILURE_0", drain_flash_op(desc));
         UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_READ_FAILURE_0",
                             return -1);
     }
 
-    done = 0;
-    start_time = time(NULL);
-    for (;; ) {
-        /* If we started with flash update and now SMC update is in
-         * progress then flash update is complete. Therefore switch
-         * to SMC update status.
-         */
-        if (flash_update && SMC_OP(status)) {
-            ret = FLASH_UPDATED;
-            if (prev_percent_complete != 100) {
-                if (cmdopts.line_mode_flag) {
-                    printf("100\n");
-                } else {
-                    printf("%s: Flash update successful\n",
-                           mic_get_device_name(device));
-                }
-            }
-            flash_update = 0;
-            if (cmdopts.line_mode_flag) {
-                printf("SMC update:\n");
-            } else {
-                printf("%s: SMC update in progress\n",
-                       mic_get_device_name(device));
-            }
-            op = "SMC update";
-            start_time = time(NULL);
-        }
-
-
-        {
-#define SET_STAT_ON_COMPLETION(stat)    {                       \
-        int s, e;                                               \
-        while (check_flash_op(desc, &percent_complete, &s, &e), \
-               (s != FLASH_OP_COMPLETED) &&                     \
-               (s != SMC_OP_COMPLETED)) ;                       \
-        status = stat;                                          \
-}
-
-
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_1",
-                                SET_STAT_ON_COMPLETION(
-                                    FLASH_OP_IDLE));
-
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_2",
-                                SET_STAT_ON_COMPLETION(
-                                    FLASH_OP_INVALID));
-
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_3",
-                                SET_STAT_ON_COMPLETION(
-                                    FLASH_OP_FAILED));
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_3",
-                                ext_status = 0);
-
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_4",
-                                SET_STAT_ON_COMPLETION(
-                                    FLASH_OP_AUTH_FAILED));
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_4",
-                                ext_status = 2);
-
-            UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_5",
-                                SET_STAT_ON_COMPLETION(
-                                    SMC_OP_AUTH_FAILED + 128));
-            /*
-             * TODO(eamaro): re-enable. uncrustify cannot parse this.
-             * UT_INSTRUMENT_EVENT ("FLASH1_INSTRUMENT_POLL_FAILURE_7",
-             *                   if (status ==
-             *                       SMC_OP_IN_PROGRESS &&
-             *                       percent_complete > 50)
-             *                           SET_STAT_ON_COMPLETION(
-             *                           SMC_OP_AUTH_FAILED));
-             */
-        }
+    if (mic_flash_wait(desc, (timeout == -1) ? -1 : timeout * 1000,
+                       report_flash_progress, &fp, &stat) != E_MIC_SUCCESS) {
+        error_msg_start("%s: Failed to read flash status: %s: %s\n",
+                        mic_get_device_name(device),
+                        mic_get_error_string(), strerror(errno));
+        return fp.ret;
+    }
+    (void)mic_get_progress(stat, &percent_complete);
+    (void)mic_get_status(stat, &status);
+    (void)mic_get_ext_status(stat, &ext_status);
+    (void)mic_free_flash_status_info(stat);
 
-        switch (status) {
-        case FLASH_OP_IDLE:
-            printf("\n");
-            error_msg_start(
-                "%s: Internal Error: No flash "
-                "operation in progress\n",
-                mic_get_device_name(
-                    device));
-            return ret;
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_1",
+                        status = FLASH_OP_IDLE);
 
-        case FLASH_OP_INVALID:
-            printf("\n");
-            error_msg_start(
-                "%s: Internal Error: Invalid "
-                "flash operation requested\n",
-                mic_get_device_name(
-                    device));
-            return ret;
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_2",
+                        status = FLASH_OP_INVALID);
 
-        case FLASH_OP_IN_PROGRESS:
-            break;
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_3",
+                        status = FLASH_OP_FAILED);
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_3",
+                        ext_status = 0);
 
-        case FLASH_OP_COMPLETED:
-            percent_complete = 100;
-            done++;
-            break;
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_4",
+                        status = FLASH_OP_AUTH_FAILED);
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_4",
+                        ext_status = 2);
 
-        case FLASH_OP_FAILED:
-            printf("\n");
-            error_msg_start(
-                "%s: Flash operation failed: %s\n",
-                mic_get_device_name(
-                    device),
-                flash_status_str(
-                    ext_status));
-            return ret;
+    UT_INSTRUMENT_EVENT("FLASH1_INSTRUMENT_POLL_FAILURE_5",
+                        status = SMC_OP_AUTH_FAILED + 128);
 
-        case FLASH_OP_AUTH_FAILED:
-            printf("\n");
-            error_msg_start(
-                "%s: Flash operation not permitted: "
-                "%s\n",
-                mic_get_device_name(
-                    device),
-                flash_status_str(
-                    ext_status));
-            return ret;
+    switch (status) {
+    case FLASH_OP_IDLE:
+        printf("\n");
+        error_msg_start("%s: Internal Error: No flash "
+                        "operation in progress\n",
+                        mic_get_device_name(device));
+        return fp.ret;
 
-        case SMC_OP_IN_PROGRESS:
-            break;
+    case FLASH_OP_INVALID:
+        printf("\n");
+        error_msg_start("%s: Internal Error: Invalid "
+                        "flash operation requested\n",
+                        mic_get_device_name(device));
+        return fp.ret;
+
+    case FLASH_OP_IN_PROGRESS:
+    case SMC_OP_IN_PROGRESS:
+        error_msg_start("%s: Flash operation timed out due to a corrupted "
+                        "image file or an internal error.\n",
+                        mic_get_device_name(device));
+        return fp.ret;
+
+    case FLASH_OP_COMPLETED:
+    case SMC_OP_COMPLETED:
+        break;
 
-        case SMC_OP_COMPLETED:
-            percent_complete = 100;
-            done++;
-            break;
+    case FLASH_OP_FAILED:
+        printf("\n");
+        error_msg_start("%s: Flash operation failed: %s\n",
+                        mic_get_device_name(device),
+                        flash_status_str(ext_status));
+        return fp.ret;
 
-        case SMC_OP_FAILED:
-            printf("\n");
-            error_msg_start(
-                "%s: SMC update failed: %s\n",
-                mic_get_device_name(
-                    device),
-                smc_status_str(
-                    ext_status));
-            return ret;
+    case FLASH_OP_AUTH_FAILED:
+        printf("\n");
+        error_msg_start("%s: Flash operation not permitted: %s\n",
+                        mic_get_device_name(device),
+                        flash_status_str(ext_status));
+        return fp.ret;
 
-        case SMC_OP_AUTH_FAILED:
-            printf("\n");
-            error_msg_start(
-                "%s: SMC update not permitted: %s\n",
-                mic_get_device_name(
-                    device),
-                smc_status_str(ext_status));
-            return ret;
+    case SMC_OP_FAILED:
+        printf("\n");
+        error_msg_start("%s: SMC update failed: %s\n",
+                        mic_get_device_name(device),
+                        smc_status_str(ext_status));
+        return fp.ret;
 
-        default:
-            error_msg_start(
-                "%s: Unknown flash op status: %d\n",
-                mic_get_device_name(
-                    device),
-                status);
-            return ret;
-        }
-        if (percent_complete !=
-            (prev_percent_complete)) {
-            if (cmdopts.line_mode_flag) {
-                printf("%u\n",
-                       percent_complete);
-            } else if (cmdopts.
-                       verbose_flag) {
-                printf(
-                    "%s: %s: %u%%\n",
-                    mic_get_device_name(
-                        device),
-                    op,
-                    percent_complete);
-            }
-            fflush(stdout);
-            prev_percent_complete =
-                percent_complete;
-        }
-        if (done)
-            break;
+    case SMC_OP_AUTH_FAILED:
+        printf("\n");
+        error_msg_start("%s: SMC update not permitted: %s\n",
+                        mic_get_device_name(device),
+                        smc_status_str(ext_status));
+        return fp.ret;
 
-        sleep(delay);
-        if (check_flash_op(desc,
-                           &
-                           percent_complete,
-                           &status,
-                           &ext_status) !=
-            0) {
-            error_msg_start(
-                "%s: Failed to read flash "
-                "status: %s: %s\n",
-                mic_get_device_name(
-                    device),
-                mic_get_error_string(),
-                strerror(
-                    errno));
-            return ret;
-        }
-        if (timeout != -1) {
-            if ((start_time +
-                 timeout) <= time(NULL))
-                break;
-        }
+    default:
+        error_msg_start("%s: Unknown flash op status: %d\n",
+                        mic_get_device_name(device), status);
+        return fp.ret;
     }
 
-    if (percent_complete !=
-        (prev_percent_complete)) {
-        if (cmdopts.line_mode_flag)
-            printf("%u\n",
-                   percent_complete);
-        prev_percent_complete =
-            percent_complete;
+    if (fp.prev_percent != 100) {
+        if (cmdopts.line_mode_flag) {
+            printf("100\n");
+        } else if (cmdopts.verbose_flag) {
+            printf("%s: %s: 100%%\n", mic_get_device_name(device), fp.op);
+        }
+        fflush(stdout);
     }
 
-    if (percent_complete < 100) {
-        error_msg_start(
-            "%s: Flash operation timed out due to a corrupted image file or an internal error.\n",
-            mic_get_device_name(
-                device));
-        return ret;
-    } else {
-        if (!cmdopts.
-            line_mode_flag) {
-            if (update_op) {
-                if (
-                    flash_update) {
-                    printf(
-                        "%s: Flash update successful\n",
-                        mic_get_device_name(
-                            device));
-                } else {
-                    printf(
-                        "%s: SMC %supdate successful\n",
-                        mic_get_device_name(
-                            device),
-                        cmdopts
-                        .
-                        smc_bootloader
-                        ?
-                        "boot-loader "
-                        :
-                        "");
-                }
+    if (!cmdopts.line_mode_flag) {
+        if (update_op) {
+            if (fp.flash_update) {
+                printf("%s: Flash update successful\n",
+                       mic_get_device_name(device));
             } else {
-                printf(
-                    "%s: Flash read successful\n",
-                    mic_get_device_name(
-                        device));
+                printf("%s: SMC %supdate successful\n",
+                       mic_get_device_name(device),
+                       cmdopts.smc_bootloader ? "boot-loader " : "");
             }
+        } else {
+            printf("%s: Flash read successful\n",
+                   mic_get_device_name(device));
         }
     }
 
@@ -1465,73 +1220,14 @@ int poll_ready_state(struct
     return 0;
 }
 
-int flash_file_version(const char
-                       *fname,
-                       void *buf,
-                       char *flash,
-                       size_t size)
+int flash_file_version(const char *fname, void *buf, size_t buf_size,
+                       char *flash, size_t size)
 {
-    struct failsafe_info *fs;
-    struct flash_desc *hd;
-    off_t offs;
-
-    fs =
-        (struct
-         failsafe_info *)
-        buf;
-    if ((fs->fsi_magic1 ==
-         FS_MAGIC1) &&
-        (fs->fsi_magic2 ==
-         FS_MAGIC2)) {
-        /* Make sure that it's a valid internal image */
-        hd =
-            (struct
-             flash_desc
-             *)
-            (((
-                  unsigned
-                  char
-                  *)
-              buf) +
-             FILE_CSS_HEADER_OFFS);
-
-        if (hd->fd_type !=
-            DESC_CSS) {
-            error_msg_start(
-                "%s: Not valid flash image\n",
-                fname);
-            return
-                OTHER_ERR;
-        }
-        offs = 0;
-    } else {
-        /* Check the validity of external image */
-        hd =
-            (struct
-             flash_desc
-             *)buf;
-        if (hd->fd_type !=
-            DESC_CSS) {
-            error_msg_start(
-                "%s: Not valid flash image\n",
-                fname);
-            return
-                OTHER_ERR;
-        }
-        offs =
-            CSS_HEADER_SIZE;
-    }
-
-#define VERSION_OFFS    (0xff0)
-    offs += VERSION_OFFS;
+    struct image_layout il;
 
-    strncpy(flash,
-            BUF_OFFS(buf,
-                     offs),
-            size);
-    flash[size - 1] = '\0';
+    (void)image_parse(buf, buf_size, &il);
 
-    return 0;
+    return image_version(fname, &il, buf, buf_size, flash, size);
 }
 
 int check_smc_bootloader_image(char* image_path,
@@ -73,8 +73,11 @@ struct cmdopts {
     int   maint_mode;
     int   no_reset;
     int   smc_ok;
+    int   sparse;
     char *device;
     char *file;
+    char *output;
+    char *store;
 };
 
 extern struct cmdopts cmdopts;
@@ -88,9 +91,8 @@ long get_numl(char *, char **);
 
 int verify_image(const char *, struct mic_device *, void *, size_t, int *, int);
 
-int poll_flash_op(struct    mic_device *, struct    mic_flash_op *, uint32_t,
-                  int, int,
-                  int);
+int poll_flash_op(struct    mic_device *, struct    mic_flash_op *, int,
+                  int, int);
 
 int poll_maint_mode(struct mic_device *, uint32_t, int);
 
@@ -98,7 +100,10 @@ int poll_ready_state(struct mic_device *, uint32_t, int);
 
 int flash_to_file_image(struct mic_device *, void *, size_t, void **, size_t *);
 
-int flash_file_version(const char *, void *, char *, size_t);
+int flash_buf_to_file_image(const char *, void *, size_t, off_t, void **,
+                            size_t *);
+
+int flash_file_version(const char *, void *, size_t, char *, size_t);
 
 int show_flash_info(struct mic_device *, void *, size_t);
 
@@ -111,8 +116,6 @@ inline void error_msg_cont(char *, ...);
 
 #define MAINT_MODE_POLL_INTERVAL      (1)       /* seconds */
 #define READY_MODE_POLL_INTERVAL      (1)       /* seconds */
-#define FLASH_UPDATE_POLL_INTERVAL    (1)       /* seconds */
-#define FLASH_READ_POLL_INTERVAL      (1)       /* seconds */
 
 #define MODE_CHANGE_TIMEOUT           (120)     /* seconds */
 #define FLASH_READ_TIMEOUT            (120)     /* seconds */
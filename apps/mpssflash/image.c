@@ -0,0 +1,276 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "helper.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_CSUM_X86
+#include <immintrin.h>
+#endif
+
+struct flash_desc *image_find_desc(struct flash_header *flash_hdr,
+                                   uint32_t type)
+{
+    uint32_t hdr_size, desc_offs;
+    struct flash_desc *desc = NULL;
+
+    hdr_size = flash_hdr->fh_size;
+    desc_offs = (uint32_t)OFFSET_OF(fh_desc[0], flash_hdr);
+
+    while (desc_offs < hdr_size) {
+        desc = (struct flash_desc *)((uint8_t *)flash_hdr + desc_offs);
+
+        if (desc->fd_type == type)
+            break;
+
+        desc_offs += (sizeof(struct flash_desc) +
+                      (desc->fd_size - 1) * sizeof(desc->fd_data[0]));
+    }
+
+    if (desc != NULL && desc->fd_type != type)
+        return NULL;
+
+    return desc;
+}
+
+/*
+ * Work out where the flash image lives in a file buffer, how much of it
+ * is covered by the checksum, and where its headers and version string
+ * are. Returns IMAGE_FLASH, IMAGE_SMC (no flash image present) or one
+ * of the IMAGE_ERR_* values. il_version is filled in whenever a CSS
+ * descriptor was found, even if an error is returned afterwards.
+ */
+int image_parse(void *buf, size_t buf_size, struct image_layout *il)
+{
+    struct failsafe_info *fs;
+    struct flash_desc *hd;
+    struct flash_header *fh;
+    size_t image_size;
+
+    memset(il, 0, sizeof(*il));
+    il->il_kind = IMAGE_SMC;
+
+    if (buf_size < sizeof(struct failsafe_info))
+        return IMAGE_ERR_NO_CSS;
+
+    fs = (struct failsafe_info *)buf;
+
+    if ((fs->fsi_magic1 == FS_MAGIC1) && (fs->fsi_magic2 == FS_MAGIC2)) {
+        /*
+         * Magic numbers are right at the beginning of the file -
+         * It's an internal or a development image.
+         */
+        if (buf_size < (FILE_CSS_HEADER_OFFS + CSS_HEADER_SIZE))
+            return IMAGE_ERR_NO_CSS;
+
+        hd = (struct flash_desc *)BUF_OFFS(buf, FILE_CSS_HEADER_OFFS);
+        if (hd->fd_type != DESC_CSS)
+            return IMAGE_ERR_BAD_HEADER;
+
+        fh = (struct flash_header *)BUF_OFFS(buf, FLASH_HEADER_OFFSET);
+        image_size = hd->fd_data[CSS_HEADER_SIZE_AT] * sizeof(uint32_t);
+
+        il->il_version = (const char *)BUF_OFFS(buf, VERSION_OFFS);
+        il->il_image_type = fh->fh_image_type;
+
+        switch (fh->fh_image_type) {
+        case FHI_RELEASE:
+            il->il_size = buf_size;
+            break;
+
+        case FHI_INTERNAL:
+            if (image_size < buf_size)
+                il->il_size = image_size - CSS_HEADER_SIZE;
+            else
+                il->il_size = buf_size;
+            break;
+
+        default:
+            return IMAGE_ERR_BAD_TYPE;
+        }
+
+        il->il_offs = 0;
+        il->il_flash_hdr = fh;
+        il->il_kind = IMAGE_FLASH;
+        return IMAGE_FLASH;
+    }
+
+    if (buf_size < CSS_HEADER_SIZE)
+        return IMAGE_ERR_NO_CSS;
+
+    hd = (struct flash_desc *)buf;
+    if ((hd->fd_type == DESC_CSS) &&
+        (buf_size > (CSS_HEADER_SIZE + VERSION_OFFS)))
+        il->il_version = (const char *)BUF_OFFS(buf, CSS_HEADER_SIZE +
+                                                VERSION_OFFS);
+
+    fs = (struct failsafe_info *)BUF_OFFS(buf, CSS_HEADER_SIZE);
+    if ((buf_size < (CSS_HEADER_SIZE + sizeof(struct failsafe_info))) ||
+        (fs->fsi_magic1 != FS_MAGIC1) || (fs->fsi_magic2 != FS_MAGIC2)) {
+        /* Likely, SMC with CSS header */
+        return IMAGE_SMC;
+    }
+
+    if (hd->fd_type != DESC_CSS)
+        return IMAGE_ERR_BAD_HEADER;
+
+    image_size = hd->fd_data[CSS_HEADER_SIZE_AT] * sizeof(uint32_t);
+    if (image_size > buf_size) {
+        /* SMC only */
+        return IMAGE_SMC;
+    }
+
+    /* Flash + SMC image or Flash only */
+    fh = (struct flash_header *)BUF_OFFS(buf, CSS_HEADER_SIZE +
+                                         FLASH_HEADER_OFFSET);
+    il->il_offs = CSS_HEADER_SIZE;
+    il->il_size = image_size - CSS_HEADER_SIZE;
+    il->il_image_type = fh->fh_image_type;
+    il->il_flash_hdr = fh;
+    il->il_kind = IMAGE_FLASH;
+    return IMAGE_FLASH;
+}
+
+/*
+ * 32-bit word sum of the image. Images are summed as a whole on every
+ * update and on every file that is validated, so the sum is done with the
+ * widest vector unit the host has. All variants use unaligned loads; the
+ * flash image starts at CSS_HEADER_SIZE into a file buffer.
+ */
+static uint32_t csum32_scalar(const uint32_t *p, size_t n)
+{
+    uint32_t csum = 0;
+
+    while (n--)
+        csum += *p++;
+
+    return csum;
+}
+
+#ifdef IMAGE_CSUM_X86
+__attribute__((target("sse2")))
+static uint32_t csum32_sse2(const uint32_t *p, size_t n)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    uint32_t lane[4];
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_epi32(acc0,
+                             _mm_loadu_si128((const __m128i *)(p + i)));
+        acc1 = _mm_add_epi32(acc1,
+                             _mm_loadu_si128((const __m128i *)(p + i + 4)));
+    }
+
+    acc0 = _mm_add_epi32(acc0, acc1);
+    _mm_storeu_si128((__m128i *)lane, acc0);
+
+    return lane[0] + lane[1] + lane[2] + lane[3] +
+           csum32_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static uint32_t csum32_avx2(const uint32_t *p, size_t n)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+    uint32_t lane[8];
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        acc0 = _mm256_add_epi32(acc0,
+                    _mm256_loadu_si256((const __m256i *)(p + i)));
+        acc1 = _mm256_add_epi32(acc1,
+                    _mm256_loadu_si256((const __m256i *)(p + i + 8)));
+        acc2 = _mm256_add_epi32(acc2,
+                    _mm256_loadu_si256((const __m256i *)(p + i + 16)));
+        acc3 = _mm256_add_epi32(acc3,
+                    _mm256_loadu_si256((const __m256i *)(p + i + 24)));
+    }
+
+    acc0 = _mm256_add_epi32(_mm256_add_epi32(acc0, acc1),
+                            _mm256_add_epi32(acc2, acc3));
+    _mm256_storeu_si256((__m256i *)lane, acc0);
+
+    return lane[0] + lane[1] + lane[2] + lane[3] +
+           lane[4] + lane[5] + lane[6] + lane[7] +
+           csum32_scalar(p + i, n - i);
+}
+#endif
+
+uint32_t image_csum32(const void *buf, size_t n_words)
+{
+    static uint32_t (*csum32)(const uint32_t *, size_t) = NULL;
+
+    if (csum32 == NULL) {
+#ifdef IMAGE_CSUM_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            csum32 = csum32_avx2;
+        else if (__builtin_cpu_supports("sse2"))
+            csum32 = csum32_sse2;
+        else
+#endif
+        csum32 = csum32_scalar;
+    }
+
+    return csum32((const uint32_t *)buf, n_words);
+}
+
+/*
+ * 64-bit FNV-1a content hash. Used to tag backups so that a saved image
+ * can be checked after it has been expanded or reassembled.
+ */
+#define FNV64_OFFSET    (0xcbf29ce484222325ULL)
+#define FNV64_PRIME     (0x100000001b3ULL)
+
+uint64_t image_hash64(const void *buf, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint64_t hash = FNV64_OFFSET;
+
+    while (size--) {
+        hash ^= *p++;
+        hash *= FNV64_PRIME;
+    }
+
+    return hash;
+}
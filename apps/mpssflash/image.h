@@ -0,0 +1,179 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#ifndef MIC_TOOLS_IMAGE_H
+#define MIC_TOOLS_IMAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* The following should be read from flash repo */
+#pragma pack(push, 1)
+
+struct failsafe_info {
+    uint32_t fsi_magic1;
+    uint32_t fsi_offset;
+    uint32_t fsi_offset_copy;
+    uint32_t fsi_magic2;
+};
+
+struct flash_desc {
+    uint32_t fd_type;
+    uint32_t fd_size;
+    uint32_t fd_data[1];
+};
+
+/* Index into fd_data */
+#define CSS_HEADER_SIZE_AT    (4)
+
+/* Valid fdh_type values */
+#define DESC_DEVID_SSID       (0)
+#define DESC_ADDR_MAP         (3)
+#define DESC_CSS              (6)
+
+struct flash_header {
+    uint16_t          fh_version : 3;
+    uint16_t          fh_size    : 13;
+    uint16_t          fh_odm_rev;
+    uint32_t          fh_image_type;
+    uint32_t          fh_checksum1;
+    uint32_t          fh_checksum2;
+    struct flash_desc fh_desc[1];
+};
+
+/* Valid fh_image_type */
+#define FHI_INTERNAL    (0)
+#define FHI_UPDATE      (1)
+#define FHI_RELEASE     (2)
+#define FHI_CUSTOM      (3)
+
+struct addrmap_desc {
+    uint32_t ad_id    : 24;
+    uint32_t ad_flags : 8;
+    uint32_t ad_size;
+    uint32_t ad_offs;
+    uint32_t ad_alt;
+};
+
+/* An ad_id that's used */
+#define ID_RPR           (0x525052)
+
+/* Used ad_flags values */
+#define FL_BLOCKED       (0x04)
+#define FL_SEL_TYPE      (0x60)
+#define FL_SEL_REPAIR    (0x20)
+
+struct desc_id {
+    uint32_t di_dev_id;
+    uint32_t di_ssid;
+    uint16_t di_rev_id_low;
+    uint16_t di_rev_id_high;
+};
+
+#pragma pack(pop)
+
+#define FLASH_HEADER_OFFSET     (sizeof(struct failsafe_info))
+#define FILE_CSS_HEADER_OFFS    (0x38000)
+#define CSS_HEADER_SIZE         (0x284)
+
+#define FS_MAGIC1               (0x00ffaa55)
+#define FS_MAGIC2               (0xff0055aa)
+
+#define OFFS_IMAGE_A            (0x10000)
+#define OFFS_IMAGE_B            (0x90000)
+
+#define CSS_HEADER_OFFS         (0x28000)
+
+/*
+ * Layout of the raw flash and of the file image built from it.
+ * Check the names of all these #define identifiers.
+ */
+#define PAGE_SIZE                (0x1000)
+#define FILE_ACTIVE_OFFS         (0x10000)
+#define FILE_INACTIVE_OFFS       (0x90000)
+#define IMAGE_SIZE               (0x70000)
+#define FILL_FF_OFFS             (0x38000)
+#define EXTENDED_FW_OFFS         (0xf0000)
+#define FILE_EXTENDED_FW_OFFS    (0x100000)
+#define COMPRESSED_FW_OFFS       (0x90000)
+#define EXTENDED_FW_SIZE         (0x80000)
+#define FIXED_DATA_OFFS          (0x1000)
+#define FIXED_DATA_SIZE          (0xf000)
+#define R_SIZE                   (0x1000)
+#define S_SIZE                   (0x1000)
+#define BOOT_LOADER_OFFS         (0x80000)
+#define BOOT_LOADER_SIZE         (0x10000)
+
+/* Extent of the raw flash that the file image is built from */
+#define FLASH_LAYOUT_SIZE        (OFFS_IMAGE_B + EXTENDED_FW_OFFS + \
+                                  EXTENDED_FW_SIZE)
+
+/* Offset of the version string from the start of the flash image */
+#define VERSION_OFFS            (0xff0)
+
+#define BUF_OFFS(buf, offs)    ((void *)((char *)(buf) + (offs)))
+
+/*
+ * What image_parse() found in a file buffer. Everything is worked out in
+ * a single pass over the headers so that the checksum, the device id
+ * check and the version lookup don't need to rescan the buffer.
+ */
+struct image_layout {
+    int                  il_kind;         /* IMAGE_FLASH or IMAGE_SMC */
+    off_t                il_offs;         /* Start of the flash image */
+    size_t               il_size;         /* Bytes to checksum/write */
+    uint32_t             il_image_type;   /* FHI_* */
+    struct flash_header *il_flash_hdr;    /* NULL for SMC images */
+    const char *         il_version;      /* NULL if no CSS descriptor */
+};
+
+/* Values of il_kind, also returned by image_parse() */
+#define IMAGE_FLASH               (0)
+#define IMAGE_SMC                 (1)
+
+/* Errors returned by image_parse() */
+#define IMAGE_ERR_NO_CSS          (-1)
+#define IMAGE_ERR_BAD_HEADER      (-2)
+#define IMAGE_ERR_BAD_TYPE        (-3)
+
+int image_parse(void *, size_t, struct image_layout *);
+
+struct flash_desc *image_find_desc(struct flash_header *, uint32_t);
+
+uint32_t image_csum32(const void *, size_t);
+
+uint64_t image_hash64(const void *, size_t);
+
+#endif  /* MIC_TOOLS_IMAGE_H */
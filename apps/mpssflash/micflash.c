@@ -34,11 +34,13 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <wait.h>
@@ -145,6 +147,7 @@ static int opt_rotating_bar = 0;
 static int smc_bootloader = 0;
 static int verbose = 0;
 static int test_arg = 0;
+static int sparse = 0;
 static int cmd_update = 0;
 static int cmd_version = 0;
 static int cmd_save = 0;
@@ -166,6 +169,7 @@ static struct opt_actions oa[] = {
       (intptr_t)&opt_rotating_bar },
     { "-v",             proc_opt,        (intptr_t)&verbose        },
     { "-test",          proc_opt,        (intptr_t)&test_arg       },
+    { "-sparse",        proc_opt,        (intptr_t)&sparse         },
     { "-update",        proc_cmd,        (intptr_t)&cmd_update     },
     { "-getversion",    proc_cmd,        (intptr_t)&cmd_version    },
     { "-save",          proc_cmd,        (intptr_t)&cmd_save       },
@@ -228,13 +232,18 @@ static init_cmd_func init_devinfo;
     ""                                                            \
     "<file>: Name of the image file.\n\n"
 
-#define SAVE_USAGE \
-    "-save <file> [{-device|-d} <device_id>] [-silent] [-log <logfile>]"
+#define SAVE_USAGE                                              \
+    "-save <file> [{-device|-d} <device_id>] [-sparse] [-silent] " \
+    "[-log <logfile>]"
 
-#define SAVE_HELP                                                     \
-    "Save flash image from given device into the specified file.\n\n" \
-    ""                                                                \
-    "<file>: Name of the file where image should be saved.\n\n"
+#define SAVE_HELP                                                       \
+    "Save flash image from given device into the specified file.\n\n"   \
+    ""                                                                  \
+    "<file>: Name of the file where image should be saved.\n\n"         \
+    ""                                                                  \
+    "-sparse: Save only the parts of the image that are not erased.\n" \
+    "Sparse files may be used for update and converted back with\n"    \
+    "'flash1 --file <file> --output <file> expand'.\n\n"
 
 #define COMPAT_USAGE                                           \
     "-compatible <file> [{-device|-d} <device_id>] [-silent] " \
@@ -371,6 +380,7 @@ struct proc_state *procinfo;
                  ## args);                                                        \
         if ((verbose || opt_rotating_bar)) {                                      \
              PRINT_LOG_ERR("%s\n", procinfo->proc_i[(i)].stat_msg);               \
+             frame_forget();                                                      \
         } else {                                                                  \
              ERROR_MSG_START("%s\n", procinfo->proc_i[(i)].stat_msg);             \
         }                                                                         \
@@ -378,6 +388,8 @@ struct proc_state *procinfo;
 
 static struct miccmd_actions *selected_cmd;
 
+static void frame_forget(void);
+
 FILE *log_fp = NULL;
 
 extern char *flash_dir;
@@ -705,9 +717,119 @@ static char *find_image(int proc_slot, char *path)
     return NULL;
 }
 
-static void clear_screen(void)
+/*
+ * Progress view renderer. A frame is built line by line with frame_add()
+ * and compared with the frame on screen by frame_draw(). On a terminal
+ * only the changed lines are rewritten, using ANSI cursor control, and
+ * the whole screen is redrawn only if the frame does not fit. Otherwise
+ * each new line is printed once, so logs get one line per state change.
+ */
+#define FRAME_LINE_LEN    (256)
+
+struct frame {
+    char (*line)[FRAME_LINE_LEN];
+    int  n_lines;
+    int  n_alloc;
+};
+
+static struct frame frame_new, frame_shown;
+static int frame_tty = -1;
+static int frame_rows, frame_cols;
+
+static int frame_is_tty(void)
+{
+    struct winsize ws;
+
+    if (frame_tty >= 0)
+        return frame_tty;
+
+    frame_tty = isatty(STDOUT_FILENO);
+    frame_rows = INT_MAX;
+    frame_cols = FRAME_LINE_LEN - 1;
+    if (frame_tty && (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)) {
+        if (ws.ws_row > 0)
+            frame_rows = ws.ws_row;
+        /* Stay clear of the last column so lines never wrap. */
+        if ((ws.ws_col > 0) && (ws.ws_col - 1 < frame_cols))
+            frame_cols = ws.ws_col - 1;
+    }
+
+    return frame_tty;
+}
+
+static void frame_add(const char *format, ...)
 {
-    system("clear");
+    va_list ap;
+
+    if (frame_new.n_lines == frame_new.n_alloc) {
+        int n_alloc = frame_new.n_alloc ? 2 * frame_new.n_alloc : 32;
+        char (*line)[FRAME_LINE_LEN];
+
+        line = realloc(frame_new.line, n_alloc * sizeof(*line));
+        if (line == NULL)
+            return;
+        frame_new.line = line;
+        frame_new.n_alloc = n_alloc;
+    }
+
+    va_start(ap, format);
+    vsnprintf(frame_new.line[frame_new.n_lines], FRAME_LINE_LEN, format, ap);
+    va_end(ap);
+    frame_new.n_lines++;
+}
+
+static int frame_line_shown(const char *line)
+{
+    int i;
+
+    for (i = 0; i < frame_shown.n_lines; i++)
+        if (strcmp(frame_shown.line[i], line) == 0)
+            return 1;
+
+    return 0;
+}
+
+static void frame_draw(void)
+{
+    struct frame tmp;
+    int i;
+
+    if (!frame_is_tty()) {
+        for (i = 0; i < frame_new.n_lines; i++) {
+            if ((frame_new.line[i][0] != '\0') &&
+                !frame_line_shown(frame_new.line[i]))
+                printf("%s\n", frame_new.line[i]);
+        }
+    } else if ((frame_new.n_lines >= frame_rows) ||
+               (frame_shown.n_lines >= frame_rows)) {
+        printf("\033[H\033[2J");
+        for (i = 0; i < frame_new.n_lines; i++)
+            printf("%.*s\n", frame_cols, frame_new.line[i]);
+    } else {
+        if (frame_shown.n_lines > 0)
+            printf("\033[%dA", frame_shown.n_lines);
+        for (i = 0; i < frame_new.n_lines; i++) {
+            if ((i < frame_shown.n_lines) &&
+                (strcmp(frame_new.line[i], frame_shown.line[i]) == 0))
+                printf("\n");
+            else
+                printf("\r\033[K%.*s\n", frame_cols, frame_new.line[i]);
+        }
+        if (frame_new.n_lines < frame_shown.n_lines)
+            printf("\033[J");
+    }
+    fflush(stdout);
+
+    tmp = frame_shown;
+    frame_shown = frame_new;
+    frame_new = tmp;
+    frame_new.n_lines = 0;
+}
+
+/* Something else was printed below the frame; start over beneath it. */
+static void frame_forget(void)
+{
+    frame_shown.n_lines = 0;
 }
 
 static void show_all_errors(void)
@@ -819,68 +941,69 @@ static int rotating_bar(void)
     bar_num++;
     if (bar_num == (sizeof(bar_chars) / sizeof(char)))
         bar_num = 0;
-    clear_screen();
-    printf("%c\n", bar_chars[bar_num]);
+    if (frame_is_tty())
+        frame_add("%c", bar_chars[bar_num]);
 
     done = 0;
     for (i = 0; i < procinfo->n_procs; i++) {
         if (procinfo->proc_i[i].pid == 0) {
-            printf("%s\n\n", procinfo->proc_i[i].stat_msg);
+            frame_add("%s", procinfo->proc_i[i].stat_msg);
+            frame_add("%s", "");
             done++;
             continue;
         }
 
-        printf("mic%d: Read Flash: %d%%\n",
-               procinfo->proc_i[i].devnum,
-               procinfo->proc_i[i].percent_read);
+        frame_add("mic%d: Read Flash: %d%%",
+                  procinfo->proc_i[i].devnum,
+                  procinfo->proc_i[i].percent_read);
 
         if (cmd_update) {
-            printf("mic%d: Update Flash: %d%%\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].percent_update);
+            frame_add("mic%d: Update Flash: %d%%",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].percent_update);
 
-            printf("mic%d: Update SMC: %d%%\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].percent_smc_update);
+            frame_add("mic%d: Update SMC: %d%%",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].percent_smc_update);
 
-            printf("mic%d: Update SMC boot-loader: %d%%\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].percent_smc_bl_update);
+            frame_add("mic%d: Update SMC boot-loader: %d%%",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].percent_smc_bl_update);
         }
 
         if (procinfo->proc_i[i].output[0] != '\0') {
-            printf("mic%d: %s\n", procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].output);
+            frame_add("mic%d: %s", procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].output);
         }
 
         if (procinfo->proc_i[i].state == RESET_STATE) {
-            printf("mic%d: Transitioning to ready state: "
-                   "POST code: %s\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].reset_status);
+            frame_add("mic%d: Transitioning to ready state: "
+                      "POST code: %s",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].reset_status);
         }
 
         if (procinfo->proc_i[i].stat_msg[0] != '\0') {
-            printf("mic%d: Status: %s\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].stat_msg);
+            frame_add("mic%d: Status: %s",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].stat_msg);
         }
 
         if (procinfo->proc_i[i].state == EXIT_STATE) {
-            printf("mic%d: Done: Exit Status: %d\n\n",
-                   procinfo->proc_i[i].devnum,
-                   procinfo->proc_i[i].exit_status);
+            frame_add("mic%d: Done: Exit Status: %d",
+                      procinfo->proc_i[i].devnum,
+                      procinfo->proc_i[i].exit_status);
             done++;
-        } else {
-            printf("\n\n");
         }
+        frame_add("%s", "");
     }
+    frame_draw();
 
     if (done == procinfo->n_procs) {
         show_all_errors();
         return 1;
     }
-#define ROTATING_BAR_DELAY    ((long)5000000000)
+#define ROTATING_BAR_DELAY    ((long)500000000)
     sreq.tv_sec = 0;
     sreq.tv_nsec = ROTATING_BAR_DELAY;
     (void)nanosleep(&sreq, NULL);
@@ -1348,6 +1471,18 @@ static char file_opt[] = "--file";
 static char device_opt[] = "--device";
 static char line_opt[] = "--line";
 static char test_opt[] = "--test";
+static char sparse_opt[] = "--sparse";
+
+static int check_for_save_options(void)
+{
+    if (sparse) {
+        ERROR_MSG_START("'sparse' may be specified only with "
+                        "save command\n");
+        return -1;
+    }
+
+    return 0;
+}
 
 static int init_update(void)
 {
@@ -1374,6 +1509,9 @@ static int init_update(void)
         return 1;
     }
 
+    if (check_for_save_options() < 0)
+        return 1;
+
     return 0;
 }
 
@@ -1536,6 +1674,9 @@ static int init_version(void)
     if ((ret = check_for_update_options()) < 0)
         return ret;
 
+    if ((ret = check_for_save_options()) < 0)
+        return ret;
+
     if ((device_arg != NULL) && image_path != NULL) {
         ERROR_MSG_START("Only one of -device or image-file "
                         "may be specified\n");
@@ -1620,11 +1761,13 @@ static char **build_save_args(int proc_slot, char *image, int *nargs)
     devnum = procinfo->proc_i[proc_slot].devnum;
 
     /*
-     * flash1 --file <file> --device <device> --line save
+     * flash1 --file <file> --device <device> --line [--sparse] save
      */
     *nargs = 7;
     if (test_arg)
         (*nargs)++;
+    if (sparse)
+        (*nargs)++;
 
     save_args = (char **)malloc(sizeof(char *) * *nargs);
     if (save_args == NULL) {
@@ -1642,6 +1785,8 @@ static char **build_save_args(int proc_slot, char *image, int *nargs)
     if (test_arg) {
         save_args[argnum++] = test_opt;;
     }
+    if (sparse)
+        save_args[argnum++] = sparse_opt;
     save_args[argnum] = save_cmd;
 
     return save_args;
@@ -1654,6 +1799,9 @@ static int init_compat(void)
     if ((ret = check_for_update_options()) < 0)
         return ret;
 
+    if ((ret = check_for_save_options()) < 0)
+        return ret;
+
     if (image_path == NULL) {
         ERROR_MSG_START("Please specify a filename\n");
         return 1;
@@ -1706,6 +1854,9 @@ static int init_devinfo(void)
     if ((ret = check_for_update_options()) < 0)
         return ret;
 
+    if ((ret = check_for_save_options()) < 0)
+        return ret;
+
     if (image_path != NULL) {
         ERROR_MSG_START("<file-name> not needed\n");
         return 1;
@@ -67,6 +67,8 @@ extern int flash1_start(int, char *[]);
 
 #define TEST_OPTION       (1)
 #define SMC_BOOTLOADER    (2)
+#define SPARSE            (3)
+#define STORE             (4)
 
 static struct option options[] = {
     { "device",        1, NULL, 'd'            },
@@ -77,6 +79,8 @@ static struct option options[] = {
     { "verbose",       0, NULL, 'v'            },
     { "test",          0, NULL, TEST_OPTION    },
     { "smcbootloader", 0, NULL, SMC_BOOTLOADER },
+    { "sparse",        0, NULL, SPARSE         },
+    { "store",         1, NULL, STORE          },
     { NULL,            0, 0,    0              }
 };
 
@@ -89,8 +93,10 @@ struct flashopts {
     int   test_mode_flag;
     int   verbose;
     int   smc_bootloader;
+    int   sparse;
     char *device;
     char *file;
+    char *store;
 } flashopts;
 
 typedef int (exec_func (int, char *[]));
@@ -110,12 +116,14 @@ static build_cmd_func build_version_args;
 static build_cmd_func build_read_args;
 static build_cmd_func build_check_args;
 static build_cmd_func build_device_args;
+static build_cmd_func build_backup_args;
 
 static init_cmd_func init_update;
 static init_cmd_func init_version;
 static init_cmd_func init_read;
 static init_cmd_func init_check;
 static init_cmd_func init_device;
+static init_cmd_func init_backup;
 
 static setup_cmd_func get_update_image;
 static done_cmd_func free_update_image;
@@ -153,7 +161,7 @@ static struct miccmd_actions actions[] = {
         "read", common_flash_cmd, init_read,
         build_read_args, NULL, NULL,
         "[{--device|-d} <device>] "
-        "{--file|-f} <file> read",
+        "{--file|-f} <file> [--sparse] read",
         "read contents of flash into the specified file"
     },
     {
@@ -169,6 +177,13 @@ static struct miccmd_actions actions[] = {
         "{--file|-f} <file> check",
         "check if specified file is compatible with the card"
     },
+    {
+        "backup", common_flash_cmd, init_backup,
+        build_backup_args, NULL, NULL,
+        "[{--device|-d} {<device>|<device-list>|all}] "
+        "--store <dir> backup",
+        "save flash into a backup store shared by all cards"
+    },
     { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -459,6 +474,8 @@ static struct proc_state *get_devices_list(char *arg, int device_flag)
 static char file_opt[] = "--file";
 static char device_opt[] = "--device";
 static char test_opt[] = "--test";
+static char sparse_opt[] = "--sparse";
+static char store_opt[] = "--store";
 
 static int init_update(int *index, int argc, char *argv[])
 {
@@ -789,11 +806,13 @@ static char **build_read_args(int device, char *image, int *nargs)
     }
 
     /*
-     * flash1 --file <file> --device <device> read
+     * flash1 --file <file> --device <device> [--sparse] read
      */
     *nargs = 6;
     if (flashopts.test_mode_flag)
         (*nargs)++;
+    if (flashopts.sparse)
+        (*nargs)++;
 
     read_args = (char **)malloc(sizeof(char *) * *nargs);
     if (read_args == NULL) {
@@ -810,6 +829,8 @@ static char **build_read_args(int device, char *image, int *nargs)
     if (flashopts.test_mode_flag) {
         read_args[argnum++] = test_opt;;
     }
+    if (flashopts.sparse)
+        read_args[argnum++] = sparse_opt;
     read_args[argnum] = read_cmd;
 
     return read_args;
@@ -932,11 +953,74 @@ static char **build_device_args(int device, char *image, int *nargs)
     return device_args;
 }
 
+static int init_backup(int *index, int argc, char *argv[])
+{
+    int ret;
+
+    ARG_USED(argv);
+
+    if (*index < argc) {
+        error_msg_start("Extra args at the end of backup command\n");
+        return 1;
+    }
+
+    if ((ret = check_for_update_options()) < 0)
+        return ret;
+
+    if (flashopts.file != NULL) {
+        error_msg_start("<file-name> not needed\n");
+        return 1;
+    }
+
+    if (flashopts.store == NULL) {
+        error_msg_start("Please specify a backup store directory\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static char **build_backup_args(int device, char *image, int *nargs)
+{
+    char **backup_args;
+    static char backup_cmd[] = "backup";
+    int argnum;
+
+    ARG_USED(image);
+
+    /*
+     * flash1 --device <device> --store <dir> backup
+     */
+    *nargs = 6;
+    if (flashopts.test_mode_flag)
+        (*nargs)++;
+
+    backup_args = (char **)malloc(sizeof(char *) * *nargs);
+    if (backup_args == NULL) {
+        error_msg_start("Out of memory\n");
+        return NULL;
+    }
+
+    backup_args[0] = progname;
+    backup_args[1] = device_opt;
+    backup_args[2] = devnum_to_str(device);
+    backup_args[3] = store_opt;
+    backup_args[4] = flashopts.store;
+    argnum = 5;
+    if (flashopts.test_mode_flag) {
+        backup_args[argnum++] = test_opt;;
+    }
+    backup_args[argnum] = backup_cmd;
+
+    return backup_args;
+}
+
 static int process_common_opts(struct miccmd_actions *ca)
 {
     int cmd_version = !strcmp(ca->cmd_name, "version");
     int cmd_update  = !strcmp(ca->cmd_name, "update");
     int cmd_check   = !strcmp(ca->cmd_name, "check");
+    int cmd_backup  = !strcmp(ca->cmd_name, "backup");
     //device_flag is set to 1, get_devices_list() will look for all the installed MIC devices.
     //device_flag is set to 0, get_devices_list() will not search any MIC devices.
     //   Command     Image      device_flag
@@ -945,7 +1029,9 @@ static int process_common_opts(struct miccmd_actions *ca)
     //   version      YES        NOT SET
     //   version      NO           SET
     //   update      YES/NO        SET
-    int device_flag = ((cmd_version && !flashopts.file) || cmd_check || cmd_update);
+    //   backup        NO          SET
+    int device_flag = ((cmd_version && !flashopts.file) || cmd_check ||
+                       cmd_update || cmd_backup);
 
     if ((procinfo = get_devices_list(flashopts.device, device_flag)) == NULL)
         return errno == ENOMEM ? -3 : -1;
@@ -1050,6 +1136,14 @@ int main(int argc, char *argv[])
             flashopts.smc_bootloader++;
             break;
 
+        case SPARSE:
+            flashopts.sparse++;
+            break;
+
+        case STORE:
+            flashopts.store = optarg;
+            break;
+
         case 'd':
             flashopts.device_flag++;
             flashopts.device = optarg;
@@ -1126,5 +1220,18 @@ int main(int argc, char *argv[])
 
     if (flashopts.help_flag)
         return flash_help(ca);
+
+    if (flashopts.sparse && strcmp(ca->cmd_name, "read")) {
+        error_msg_start("'--sparse' may only be specified with "
+                        "read command\n");
+        return 1;
+    }
+
+    if ((flashopts.store != NULL) && strcmp(ca->cmd_name, "backup")) {
+        error_msg_start("'--store <dir>' may only be specified with "
+                        "backup command\n");
+        return 1;
+    }
+
     return (*ca->cmd_func)(ca, &option_index, argc, argv);
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "image.h"
+#include "sparse.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX    (1024)
+#endif
+
+int sparse_is_image(const void *buf, size_t size)
+{
+    const struct sparse_header *sh = (const struct sparse_header *)buf;
+
+    return (size >= sizeof(*sh)) && (sh->sh_magic == SPARSE_MAGIC);
+}
+
+static int is_erased(const uint8_t *p, size_t size)
+{
+    const uint64_t *w = (const uint64_t *)p;
+    size_t i;
+
+    for (i = 0; i < size / sizeof(*w); i++) {
+        if (w[i] != ~(uint64_t)0)
+            return 0;
+    }
+
+    for (i *= sizeof(*w); i < size; i++) {
+        if (p[i] != 0xff)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Write out all of iov, coping with short writes.
+ */
+static int write_iov(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t n;
+    int cnt;
+
+    while (iovcnt > 0) {
+        cnt = iovcnt > IOV_MAX ? IOV_MAX : iovcnt;
+        if ((n = writev(fd, iov, cnt)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while ((iovcnt > 0) && ((size_t)n >= iov->iov_len)) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Write the file image 'image' to fd in the sparse format. The extent data
+ * is handed to writev() straight out of the image buffer. Returns 0 on
+ * success and -1 with errno set otherwise.
+ */
+int sparse_write(int fd, void *image, size_t size)
+{
+    struct sparse_header sh;
+    struct sparse_extent *se;
+    struct iovec *iov;
+    uint8_t *p = (uint8_t *)image;
+    size_t offs, len, max_extents;
+    uint32_t n;
+    int ret;
+
+    if (size > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    max_extents = (size + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE / 2 + 1;
+    se = (struct sparse_extent *)malloc(max_extents * sizeof(*se));
+    iov = (struct iovec *)malloc((max_extents + 2) * sizeof(*iov));
+    if ((se == NULL) || (iov == NULL)) {
+        free(se);
+        free(iov);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    n = 0;
+    for (offs = 0; offs < size; offs += len) {
+        len = size - offs < SPARSE_BLOCK_SIZE ?
+              size - offs : SPARSE_BLOCK_SIZE;
+
+        if (is_erased(p + offs, len))
+            continue;
+
+        /* Extend the previous extent if it ends right here */
+        if ((n > 0) && (se[n - 1].se_offs + se[n - 1].se_size == offs)) {
+            se[n - 1].se_size += len;
+            iov[n + 1].iov_len += len;
+            continue;
+        }
+
+        se[n].se_offs = (uint32_t)offs;
+        se[n].se_size = (uint32_t)len;
+        iov[n + 2].iov_base = p + offs;
+        iov[n + 2].iov_len = len;
+        n++;
+    }
+
+    sh.sh_magic = SPARSE_MAGIC;
+    sh.sh_version = SPARSE_VERSION;
+    sh.sh_image_size = (uint32_t)size;
+    sh.sh_n_extents = n;
+    sh.sh_hash = image_hash64(image, size);
+
+    iov[0].iov_base = &sh;
+    iov[0].iov_len = sizeof(sh);
+    iov[1].iov_base = se;
+    iov[1].iov_len = n * sizeof(*se);
+
+    ret = write_iov(fd, iov, n + 2);
+
+    free(se);
+    free(iov);
+    return ret;
+}
+
+/*
+ * Convert a sparse image back to the regular file layout. On success
+ * *image is a malloc'd buffer of *size bytes.
+ */
+int sparse_expand(const void *buf, size_t buf_size, void **image,
+                  size_t *size)
+{
+    const struct sparse_header *sh = (const struct sparse_header *)buf;
+    const struct sparse_extent *se;
+    const uint8_t *data;
+    size_t avail;
+    uint8_t *p;
+    uint32_t i;
+
+    if (!sparse_is_image(buf, buf_size) ||
+        (sh->sh_version != SPARSE_VERSION))
+        return SPARSE_ERR_FORMAT;
+
+    avail = buf_size - sizeof(*sh);
+    if (sh->sh_n_extents > avail / sizeof(*se))
+        return SPARSE_ERR_FORMAT;
+
+    se = (const struct sparse_extent *)(sh + 1);
+    data = (const uint8_t *)(se + sh->sh_n_extents);
+    avail -= sh->sh_n_extents * sizeof(*se);
+
+    if ((p = (uint8_t *)malloc(sh->sh_image_size)) == NULL)
+        return SPARSE_ERR_NOMEM;
+
+    (void)memset(p, 0xff, sh->sh_image_size);
+
+    for (i = 0; i < sh->sh_n_extents; i++) {
+        if ((se[i].se_size > avail) ||
+            (se[i].se_offs > sh->sh_image_size) ||
+            (se[i].se_size > sh->sh_image_size - se[i].se_offs)) {
+            free(p);
+            return SPARSE_ERR_FORMAT;
+        }
+
+        (void)memcpy(p + se[i].se_offs, data, se[i].se_size);
+        data += se[i].se_size;
+        avail -= se[i].se_size;
+    }
+
+    if (image_hash64(p, sh->sh_image_size) != sh->sh_hash) {
+        free(p);
+        return SPARSE_ERR_HASH;
+    }
+
+    *image = p;
+    *size = sh->sh_image_size;
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#ifndef MIC_TOOLS_SPARSE_H
+#define MIC_TOOLS_SPARSE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Sparse flash image file. Only the extents of the file image that are not
+ * erased (all 0xff) are stored:
+ *
+ *    struct sparse_header
+ *    struct sparse_extent[sh_n_extents]
+ *    extent data, in the order of the extent table
+ *
+ * sh_hash is image_hash64() of the expanded image, so a backup can be
+ * checked when it's converted back to the regular file layout.
+ */
+#pragma pack(push, 1)
+
+struct sparse_header {
+    uint32_t sh_magic;
+    uint32_t sh_version;
+    uint32_t sh_image_size;
+    uint32_t sh_n_extents;
+    uint64_t sh_hash;
+};
+
+struct sparse_extent {
+    uint32_t se_offs;
+    uint32_t se_size;
+};
+
+#pragma pack(pop)
+
+#define SPARSE_MAGIC         (0x4d435053)      /* "SPCM" */
+#define SPARSE_VERSION       (1)
+
+/* Granularity at which erased regions are skipped */
+#define SPARSE_BLOCK_SIZE    (0x1000)
+
+/* Errors returned by sparse_expand() */
+#define SPARSE_ERR_FORMAT    (-1)
+#define SPARSE_ERR_NOMEM     (-2)
+#define SPARSE_ERR_HASH      (-3)
+
+int sparse_is_image(const void *, size_t);
+
+int sparse_write(int, void *, size_t);
+
+int sparse_expand(const void *, size_t, void **, size_t *);
+
+#endif  /* MIC_TOOLS_SPARSE_H */
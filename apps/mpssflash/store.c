@@ -0,0 +1,445 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "helper.h"
+#include "image.h"
+#include "store.h"
+
+struct store_block {
+    const char *sb_name;
+    off_t       sb_offs;
+    size_t      sb_size;
+};
+
+/*
+ * Split a raw flash read into blocks. The image and extended firmware
+ * blocks are named after the active image, so that manifests of cards
+ * that booted from different images still read naturally.
+ */
+static int get_blocks(off_t active, size_t flash_size,
+                      struct store_block *sb)
+{
+    int a = active == OFFS_IMAGE_A;
+    int n = 0;
+
+    sb[n].sb_name = "header";
+    sb[n].sb_offs = 0;
+    sb[n++].sb_size = FIXED_DATA_OFFS;
+
+    sb[n].sb_name = "fixed_data";
+    sb[n].sb_offs = FIXED_DATA_OFFS;
+    sb[n++].sb_size = FIXED_DATA_SIZE;
+
+    sb[n].sb_name = a ? "active_image" : "inactive_image";
+    sb[n].sb_offs = OFFS_IMAGE_A;
+    sb[n++].sb_size = IMAGE_SIZE;
+
+    sb[n].sb_name = "boot_loader";
+    sb[n].sb_offs = BOOT_LOADER_OFFS;
+    sb[n++].sb_size = BOOT_LOADER_SIZE;
+
+    sb[n].sb_name = a ? "inactive_image" : "active_image";
+    sb[n].sb_offs = OFFS_IMAGE_B;
+    sb[n++].sb_size = IMAGE_SIZE;
+
+    sb[n].sb_name = a ? "active_ext_fw" : "inactive_ext_fw";
+    sb[n].sb_offs = OFFS_IMAGE_A + EXTENDED_FW_OFFS;
+    sb[n++].sb_size = EXTENDED_FW_SIZE;
+
+    sb[n].sb_name = a ? "inactive_ext_fw" : "active_ext_fw";
+    sb[n].sb_offs = OFFS_IMAGE_B + EXTENDED_FW_OFFS;
+    sb[n++].sb_size = EXTENDED_FW_SIZE;
+
+    if (flash_size > FLASH_LAYOUT_SIZE) {
+        sb[n].sb_name = "tail";
+        sb[n].sb_offs = FLASH_LAYOUT_SIZE;
+        sb[n++].sb_size = flash_size - FLASH_LAYOUT_SIZE;
+    }
+
+    return n;
+}
+
+#define STORE_MAX_BLOCKS    (8)
+
+int store_is_manifest(const void *buf, size_t size)
+{
+    return (size >= sizeof(STORE_MANIFEST_MAGIC) - 1) &&
+           !memcmp(buf, STORE_MANIFEST_MAGIC,
+                   sizeof(STORE_MANIFEST_MAGIC) - 1);
+}
+
+static int read_exact(int fd, void *buf, size_t size)
+{
+    ssize_t n;
+
+    while (size > 0) {
+        if ((n = read(fd, buf, size)) <= 0) {
+            if ((n < 0) && (errno == EINTR))
+                continue;
+            if (n == 0)
+                errno = EIO;
+            return -1;
+        }
+        buf = (char *)buf + n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+static int write_exact(int fd, const void *buf, size_t size)
+{
+    ssize_t n;
+
+    while (size > 0) {
+        if ((n = write(fd, buf, size)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf = (const char *)buf + n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+static int make_dir(const char *path)
+{
+    if ((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+        error_msg_start("%s: mkdir: %s\n", path, strerror(errno));
+        return FILE_ERR;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns 1 if 'path' holds exactly 'size' bytes equal to 'p', 0 if the
+ * contents differ, and negative value on error.
+ */
+static int same_contents(const char *path, const void *p, size_t size)
+{
+    void *buf;
+    int fd, ret;
+
+    if ((buf = malloc(size)) == NULL) {
+        error_msg_start("malloc: %s\n", strerror(ENOMEM));
+        return -MEM_ERR;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        error_msg_start("%s: %s\n", path, strerror(errno));
+        free(buf);
+        return -FILE_ERR;
+    }
+
+    if (read_exact(fd, buf, size) < 0) {
+        error_msg_start("%s: read: %s\n", path, strerror(errno));
+        ret = -FILE_ERR;
+    } else {
+        ret = memcmp(buf, p, size) == 0;
+    }
+
+    close(fd);
+    free(buf);
+    return ret;
+}
+
+/*
+ * Atomically create 'path' with the given contents. The data is synced
+ * before the file is renamed into place.
+ */
+static int write_file(const char *path, const void *p, size_t size)
+{
+    char tmp[PATH_MAX];
+    int fd;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid()) >=
+        (int)sizeof(tmp)) {
+        error_msg_start("%s: Path too long\n", path);
+        return FILE_ERR;
+    }
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        error_msg_start("%s: %s\n", tmp, strerror(errno));
+        return FILE_ERR;
+    }
+
+    if ((write_exact(fd, p, size) < 0) || (fsync(fd) < 0)) {
+        error_msg_start("%s: write: %s\n", tmp, strerror(errno));
+        close(fd);
+        (void)unlink(tmp);
+        return FILE_ERR;
+    }
+    close(fd);
+
+    if (rename(tmp, path) < 0) {
+        error_msg_start("%s: rename: %s\n", path, strerror(errno));
+        (void)unlink(tmp);
+        return FILE_ERR;
+    }
+
+    return 0;
+}
+
+/*
+ * Store a block unless an identical one is already present. Returns 1 if
+ * the block was written, 0 if it was already in the store, and negative
+ * value on error.
+ */
+static int put_block(const char *path, const void *p, size_t size)
+{
+    struct stat sbuf;
+    int ret;
+
+    if (stat(path, &sbuf) == 0) {
+        if ((size_t)sbuf.st_size == size) {
+            if ((ret = same_contents(path, p, size)) != 0)
+                return ret < 0 ? ret : 0;
+        }
+        error_msg_start("%s: Block exists with different contents\n",
+                        path);
+        return -OTHER_ERR;
+    }
+
+    if (errno != ENOENT) {
+        error_msg_start("%s: %s\n", path, strerror(errno));
+        return -FILE_ERR;
+    }
+
+    if ((ret = write_file(path, p, size)) != 0)
+        return -ret;
+
+    return 1;
+}
+
+/*
+ * Save the raw flash contents 'buf' of card 'name' into the store at
+ * 'dir'. *n_new is set to the number of blocks that had to be written and
+ * *n_blocks to the number of blocks referenced by the manifest.
+ */
+int store_save(const char *dir, const char *name, void *buf, size_t size,
+               off_t active, const char *version, int *n_new, int *n_blocks)
+{
+    struct store_block sb[STORE_MAX_BLOCKS];
+    unsigned long long hash[STORE_MAX_BLOCKS];
+    char path[PATH_MAX], manifest[PATH_MAX];
+    char *text;
+    size_t text_size;
+    FILE *fp;
+    int i, n, ret;
+
+    if (size < FLASH_LAYOUT_SIZE) {
+        error_msg_start("%s: Unexpected flash size: 0x%lx\n", name,
+                        (unsigned long)size);
+        return OTHER_ERR;
+    }
+
+    if ((ret = make_dir(dir)) != 0)
+        return ret;
+
+    if ((snprintf(path, sizeof(path), "%s/%s", dir, STORE_BLOCKS_DIR) >=
+         (int)sizeof(path)) ||
+        (snprintf(manifest, sizeof(manifest), "%s/%s%s", dir, name,
+                  STORE_MANIFEST_EXT) >= (int)sizeof(manifest))) {
+        error_msg_start("%s: Path too long\n", dir);
+        return FILE_ERR;
+    }
+
+    if ((ret = make_dir(path)) != 0)
+        return ret;
+
+    *n_new = 0;
+    n = *n_blocks = get_blocks(active, size, sb);
+
+    for (i = 0; i < n; i++) {
+        hash[i] = image_hash64(BUF_OFFS(buf, sb[i].sb_offs),
+                               sb[i].sb_size);
+
+        (void)snprintf(path, sizeof(path), "%s/%s/%016llx", dir,
+                       STORE_BLOCKS_DIR, hash[i]);
+
+        if ((ret = put_block(path, BUF_OFFS(buf, sb[i].sb_offs),
+                             sb[i].sb_size)) < 0)
+            return -ret;
+        *n_new += ret;
+    }
+
+    /* Build the manifest in memory so it can be written atomically */
+    if ((fp = open_memstream(&text, &text_size)) == NULL) {
+        error_msg_start("open_memstream: %s\n", strerror(errno));
+        return MEM_ERR;
+    }
+
+    fprintf(fp, "%s\n", STORE_MANIFEST_MAGIC);
+    fprintf(fp, "device %s\n", name);
+    fprintf(fp, "flash_size 0x%lx\n", (unsigned long)size);
+    fprintf(fp, "active 0x%lx\n", (unsigned long)active);
+    if (version != NULL)
+        fprintf(fp, "version %s\n", version);
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "block %s 0x%lx 0x%lx %016llx\n", sb[i].sb_name,
+                (unsigned long)sb[i].sb_offs,
+                (unsigned long)sb[i].sb_size, hash[i]);
+    }
+
+    if (fclose(fp) != 0) {
+        error_msg_start("%s: %s\n", manifest, strerror(errno));
+        free(text);
+        return MEM_ERR;
+    }
+
+    ret = write_file(manifest, text, text_size);
+    free(text);
+    return ret;
+}
+
+/*
+ * Reassemble the raw flash contents described by a manifest. Every block
+ * is checked against its hash. On success *rbuf is a malloc'd buffer of
+ * *size bytes and *active is the offset of the active image.
+ */
+int store_load(const char *manifest, void **rbuf, size_t *size,
+               off_t *active)
+{
+    char line[PATH_MAX], path[PATH_MAX], name[64];
+    unsigned long flash_size = 0, offs, len, act = 0;
+    unsigned long long hash;
+    const char *slash;
+    int dir_len, fd, ret = 0;
+    uint8_t *buf = NULL;
+    FILE *fp;
+
+    slash = strrchr(manifest, '/');
+    dir_len = slash == NULL ? 1 : (int)(slash - manifest);
+
+    if ((fp = fopen(manifest, "r")) == NULL) {
+        error_msg_start("%s: %s\n", manifest, strerror(errno));
+        return FILE_ERR;
+    }
+
+    if ((fgets(line, sizeof(line), fp) == NULL) ||
+        !store_is_manifest(line, strlen(line))) {
+        error_msg_start("%s: Not a backup manifest\n", manifest);
+        fclose(fp);
+        return FILE_ERR;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "flash_size %lx", &flash_size) == 1) {
+            if ((buf != NULL) || (flash_size < FLASH_LAYOUT_SIZE)) {
+                error_msg_start("%s: Malformed backup manifest\n",
+                                manifest);
+                ret = FILE_ERR;
+                break;
+            }
+            if ((buf = malloc(flash_size)) == NULL) {
+                error_msg_start("malloc: %s\n", strerror(ENOMEM));
+                ret = MEM_ERR;
+                break;
+            }
+            (void)memset(buf, 0xff, flash_size);
+            continue;
+        }
+
+        if (sscanf(line, "active %lx", &act) == 1)
+            continue;
+
+        if (sscanf(line, "block %63s %lx %lx %llx", name, &offs, &len,
+                   &hash) != 4)
+            continue;
+
+        if ((buf == NULL) || (offs > flash_size) ||
+            (len > flash_size - offs)) {
+            error_msg_start("%s: Malformed backup manifest\n", manifest);
+            ret = FILE_ERR;
+            break;
+        }
+
+        (void)snprintf(path, sizeof(path), "%.*s/%s/%016llx", dir_len,
+                       slash == NULL ? "." : manifest, STORE_BLOCKS_DIR,
+                       hash);
+
+        if ((fd = open(path, O_RDONLY)) < 0) {
+            error_msg_start("%s: %s: %s\n", manifest, path,
+                            strerror(errno));
+            ret = FILE_ERR;
+            break;
+        }
+
+        if (read_exact(fd, buf + offs, len) < 0) {
+            error_msg_start("%s: %s: read: %s\n", manifest, path,
+                            strerror(errno));
+            close(fd);
+            ret = FILE_ERR;
+            break;
+        }
+        close(fd);
+
+        if (image_hash64(buf + offs, len) != hash) {
+            error_msg_start("%s: %s: Block '%s' is corrupted\n",
+                            manifest, path, name);
+            ret = FILE_ERR;
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    if ((ret == 0) && ((buf == NULL) || (act >= flash_size))) {
+        error_msg_start("%s: Malformed backup manifest\n", manifest);
+        ret = FILE_ERR;
+    }
+
+    if (ret != 0) {
+        free(buf);
+        return ret;
+    }
+
+    *rbuf = buf;
+    *size = flash_size;
+    *active = (off_t)act;
+    return 0;
+}
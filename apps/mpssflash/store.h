@@ -0,0 +1,67 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#ifndef MIC_TOOLS_STORE_H
+#define MIC_TOOLS_STORE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Deduplicating backup store. A raw flash read is split into the blocks
+ * of the flash layout and each block is kept once, named by its content
+ * hash, under <store>/blocks. A per-card text manifest in <store> lists
+ * the blocks that make up that card's flash:
+ *
+ *    # mpssflash backup manifest v1
+ *    device mic0
+ *    flash_size 0x200000
+ *    active 0x10000
+ *    version 2.1.02.0391
+ *    block fixed_data 0x1000 0xf000 0123456789abcdef
+ *    ...
+ */
+#define STORE_MANIFEST_MAGIC    "# mpssflash backup manifest v1"
+#define STORE_MANIFEST_EXT      ".manifest"
+#define STORE_BLOCKS_DIR        "blocks"
+
+int store_is_manifest(const void *, size_t);
+
+int store_save(const char *, const char *, void *, size_t, off_t,
+               const char *, int *, int *);
+
+int store_load(const char *, void **, size_t *, off_t *);
+
+#endif  /* MIC_TOOLS_STORE_H */
@@ -68,6 +68,15 @@ struct mic_flash_status_info;
 struct mic_turbo_info;
 struct mic_throttle_state_info;
 struct mic_uos_pm_config;
+struct mic_device_group;
+struct mic_collector;
+struct mic_power_sampler;
+struct mic_energy_meter;
+struct mic_energy_info;
+struct mic_snapshot;
+struct mic_telemetry;
+struct mic_recorder;
+struct mic_recording;
 #ifdef __cplusplus
 }
 #endif
@@ -119,6 +128,44 @@ typedef enum _flash_status {
 #define FLASH_OP(status)    ((status) & FLASH_OP_STATUS)
 #define SMC_OP(status)      ((status) & SMC_OP_STATUS)
 
+/* Features sampled by a mic_collector, as a bit mask */
+#define MIC_COLLECT_THERMAL      (0x1)
+#define MIC_COLLECT_POWER        (0x2)
+#define MIC_COLLECT_MEMORY       (0x4)
+#define MIC_COLLECT_CORE_UTIL    (0x8)
+#define MIC_COLLECT_NFEATURES    (4)
+
+/* Features whose RAS responses mic_set_cache_policy() may cache, as a
+ * bit mask */
+#define MIC_CACHE_CORES          (0x1)
+#define MIC_CACHE_THERMAL        (0x2)
+#define MIC_CACHE_MEMORY         (0x4)
+#define MIC_CACHE_VERSION        (0x8)
+#define MIC_CACHE_POWER          (0x10)
+#define MIC_CACHE_POWER_LIMIT    (0x20)
+#define MIC_CACHE_MEMORY_UTIL    (0x40)
+#define MIC_CACHE_CORE_UTIL      (0x80)
+#define MIC_CACHE_TURBO          (0x100)
+#define MIC_CACHE_THROTTLE       (0x200)
+#define MIC_CACHE_PM_CONFIG      (0x400)
+#define MIC_CACHE_ALL            (0x7ff)
+#define MIC_CACHE_NFEATURES      (11)
+#define MIC_CACHE_FOREVER        (0xffffffff)
+
+/* Shared memory segment published by the management daemon */
+#define MIC_TELEMETRY_NAME    "/micmgmt-telemetry"
+
+/* Flags of mic_recorder_open() */
+#define MIC_RECORD_PER_CORE    (0x1)
+
+/* Flags of mic_open_all_devices() */
+#define MIC_OPEN_SCIF         (0x1)
+#define MIC_OPEN_IO_THREAD    (0x2)
+
+/* Called by mic_flash_wait() whenever progress or status changes */
+typedef void (*mic_flash_progress_cb)(struct mic_flash_status_info *status,
+                                      void *arg);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -141,9 +188,15 @@ int mic_free_devices(struct mic_devices_list *devices);
 int mic_get_ndevices(struct mic_devices_list *devices, int *ndevices);
 int mic_get_device_at_index(struct mic_devices_list *devices, int
                             index, int *device);
+int mic_get_devices_generation(struct mic_devices_list *devices,
+                               uint64_t *generation);
+int mic_devices_changed(uint64_t generation, int *changed);
 int mic_open_device(struct mic_device **device, uint32_t
                     device_num);
+int mic_open_all_devices(struct mic_device **devices, int *status, int *n,
+                         uint32_t flags);
 int mic_close_device(struct mic_device *device);
+int mic_set_io_thread(struct mic_device *device, int enable);
 
 /* General device information */
 int mic_get_post_code(struct mic_device *mdh, char *postcode, size_t *bufsize);
@@ -173,6 +226,9 @@ int mic_get_status(struct mic_flash_status_info *status, int *cmd_status);
 int mic_get_ext_status(struct mic_flash_status_info *status, int *ext_status);
 int mic_free_flash_status_info(struct
                                mic_flash_status_info *status);
+int mic_flash_wait(struct mic_flash_op *desc, int timeout_ms,
+                   mic_flash_progress_cb callback, void *arg,
+                   struct mic_flash_status_info **status);
 int mic_get_flash_vendor_device(struct mic_device *mdh, char *buf,
                                 size_t *size);
 
@@ -203,6 +259,9 @@ int mic_free_pci_config(struct mic_pci_config *conf);
 /* Thermal info */
 int mic_get_thermal_info(struct mic_device *mdh, struct
                          mic_thermal_info **thermal);
+int mic_alloc_thermal_info(struct mic_thermal_info **thermal);
+int mic_update_thermal_info(struct mic_device *mdh,
+                            struct mic_thermal_info *thermal);
 int mic_get_smc_hwrevision(struct mic_thermal_info *thermal, char *rev,
                            size_t *size);
 int mic_get_smc_fwversion(struct mic_thermal_info *thermal, char *ver,
@@ -265,6 +324,9 @@ int mic_free_processor_info(struct mic_processor_info *processor);
 /* Uos core info */
 int mic_get_cores_info(struct mic_device *mdh, struct
                        mic_cores_info **cores);
+int mic_alloc_cores_info(struct mic_cores_info **cores);
+int mic_update_cores_info(struct mic_device *mdh,
+                          struct mic_cores_info *cores);
 int mic_get_cores_count(struct mic_cores_info *core, uint32_t *num_cores);
 int mic_get_cores_voltage(struct mic_cores_info *core, uint32_t *voltage);
 int mic_get_cores_frequency(struct mic_cores_info *core, uint32_t *frequency);
@@ -273,6 +335,9 @@ int mic_free_cores_info(struct mic_cores_info *cores);
 /* Version info*/
 int mic_get_version_info(struct mic_device *mdh, struct
                          mic_version_info **version);
+int mic_alloc_version_info(struct mic_version_info **version);
+int mic_update_version_info(struct mic_device *mdh,
+                            struct mic_version_info *version);
 int mic_get_uos_version(struct mic_version_info *version, char *uos,
                         size_t *size);
 int mic_get_flash_version(struct mic_version_info *version, char *flash,
@@ -284,6 +349,9 @@ int mic_free_version_info(struct mic_version_info *version);
 /* Power utilization info */
 int mic_get_power_utilization_info(struct mic_device *mdh,
                                    struct mic_power_util_info **power);
+int mic_alloc_power_utilization_info(struct mic_power_util_info **power);
+int mic_update_power_utilization_info(struct mic_device *mdh,
+                                      struct mic_power_util_info *power);
 int mic_get_total_power_readings_w0(struct mic_power_util_info *power,
                                     uint32_t *pwr);
 int mic_get_total_power_sensor_sts_w0(struct mic_power_util_info *power,
@@ -353,6 +421,9 @@ int mic_free_power_utilization_info(struct mic_power_util_info *power);
 /* Power limits */
 int mic_get_power_limit(struct mic_device *mdh, struct
                         mic_power_limit **limit);
+int mic_alloc_power_limit(struct mic_power_limit **limit);
+int mic_update_power_limit(struct mic_device *mdh,
+                           struct mic_power_limit *limit);
 int mic_get_power_phys_limit(struct mic_power_limit *limit, uint32_t *phys_lim);
 int mic_get_power_hmrk(struct mic_power_limit *limit, uint32_t *hmrk);
 int mic_get_power_lmrk(struct mic_power_limit *limit, uint32_t *lmrk);
@@ -369,6 +440,9 @@ int mic_set_power_limit1(struct mic_device *mdh,
 /* Memory utilization */
 int mic_get_memory_utilization_info(struct mic_device *mdh, struct
                                     mic_memory_util_info **memory);
+int mic_alloc_memory_utilization_info(struct mic_memory_util_info **memory);
+int mic_update_memory_utilization_info(struct mic_device *mdh,
+                                       struct mic_memory_util_info *memory);
 int mic_get_total_memory_size(struct mic_memory_util_info *memory,
                               uint32_t *total_size);
 int mic_get_available_memory_size(struct
@@ -387,6 +461,9 @@ int mic_get_idle_counters(struct mic_core_util *cutil, uint64_t *idle_counters);
 int mic_get_nice_counters(struct mic_core_util *cutil, uint64_t *nice_counters);
 int mic_get_sys_counters(struct mic_core_util *cutil, uint64_t *sys_counters);
 int mic_get_user_counters(struct mic_core_util *cutil, uint64_t *user_counters);
+int mic_get_core_counters_soa(struct mic_core_util *cutil, uint16_t
+                              *num_cores, uint64_t *user, uint64_t *nice,
+                              uint64_t *sys, uint64_t *idle);
 int mic_get_idle_sum(struct mic_core_util *cutil, uint64_t *idle_sum);
 int mic_get_sys_sum(struct mic_core_util *cutil, uint64_t *sys_sum);
 int mic_get_nice_sum(struct mic_core_util *cutil, uint64_t *nice_sum);
@@ -397,6 +474,16 @@ int mic_get_threads_core(struct mic_core_util *cutil, uint16_t *threads_core);
 int mic_get_tick_count(struct mic_core_util *cutil, uint32_t *tick_count);
 int mic_free_core_util(struct mic_core_util *cutil);
 
+/* Indexes into the device array of mic_get_core_util_delta() */
+#define MIC_CUTIL_USER      (0)
+#define MIC_CUTIL_NICE      (1)
+#define MIC_CUTIL_SYS       (2)
+#define MIC_CUTIL_IDLE      (3)
+#define MIC_CUTIL_NSTATS    (4)
+int mic_get_core_util_delta(struct mic_core_util *prev, struct
+                            mic_core_util *cur, double *user, double *nice,
+                            double *sys, double *idle, double *device);
+
 /* Led mode */
 int mic_get_led_alert(struct mic_device *mdh, uint32_t *led_alert);
 int mic_set_led_alert(struct mic_device *mdh, uint32_t *led_alert);
@@ -404,15 +491,24 @@ int mic_set_led_alert(struct mic_device *mdh, uint32_t *led_alert);
 /* Turbo info */
 int mic_get_turbo_state_info(struct mic_device *mdh, struct
                              mic_turbo_info **turbo);
+int mic_alloc_turbo_info(struct mic_turbo_info **turbo);
+int mic_update_turbo_info(struct mic_device *mdh,
+                          struct mic_turbo_info *turbo);
 int mic_get_turbo_state(struct mic_turbo_info *turbo, uint32_t *state);
 int mic_get_turbo_mode(struct mic_turbo_info *turbo, uint32_t *mode);
 int mic_get_turbo_state_valid(struct mic_turbo_info *turbo, uint32_t *valid);
 int mic_set_turbo_mode(struct mic_device *mdh, uint32_t *mode);
+int mic_set_turbo_mode_start(struct mic_device *mdh, uint32_t *mode);
+int mic_turbo_mode_wait(struct mic_device *mdh, int timeout_ms, int *done);
+int mic_set_turbo_timeout(struct mic_device *mdh, int timeout_ms);
 int mic_free_turbo_info(struct mic_turbo_info *turbo);
 
 /* Throttle state info */
 int mic_get_throttle_state_info(struct mic_device *mdh, struct
                                 mic_throttle_state_info **ttl_state);
+int mic_alloc_throttle_state_info(struct mic_throttle_state_info **ttl_state);
+int mic_update_throttle_state_info(struct mic_device *mdh,
+                                   struct mic_throttle_state_info *ttl_state);
 int mic_get_thermal_ttl_active(struct
                                mic_throttle_state_info *ttl_state, int *active);
 int mic_get_thermal_ttl_current_len(struct
@@ -440,6 +536,9 @@ int mic_free_throttle_state_info(struct
 /* Uos power management config */
 int mic_get_uos_pm_config(struct mic_device *mdh, struct
                           mic_uos_pm_config **pm_config);
+int mic_alloc_uos_pm_config(struct mic_uos_pm_config **pm_config);
+int mic_update_uos_pm_config(struct mic_device *mdh,
+                             struct mic_uos_pm_config *pm_config);
 int mic_get_cpufreq_mode(struct mic_uos_pm_config *pm_config, int *mode);
 int mic_get_corec6_mode(struct mic_uos_pm_config *pm_config, int *mode);
 int mic_get_pc3_mode(struct mic_uos_pm_config *pm_config, int *mode);
@@ -452,6 +551,135 @@ int mic_get_smc_persistence_flag(struct mic_device *mdh,
 int mic_set_smc_persistence_flag(struct mic_device *mdh,
                                  int persist_flag);
 
+/* Response cache */
+int mic_set_cache_policy(struct mic_device *mdh, uint32_t features,
+                         uint32_t ttl_ms);
+int mic_get_cache_age(struct mic_device *mdh, uint32_t feature,
+                      uint32_t *age_ms);
+
+/* Device groups */
+int mic_device_group_create(struct mic_device **devices, int n,
+                            struct mic_device_group **group);
+int mic_device_group_set_turbo_mode(struct mic_device_group *group,
+                                    uint32_t mode, int *status);
+int mic_device_group_set_led_alert(struct mic_device_group *group,
+                                   uint32_t led_alert, int *status);
+int mic_device_group_set_power_limit0(struct mic_device_group *group,
+                                      uint32_t power, uint32_t time_window,
+                                      int *status);
+int mic_device_group_set_power_limit1(struct mic_device_group *group,
+                                      uint32_t power, uint32_t time_window,
+                                      int *status);
+int mic_device_group_set_smc_persistence_flag(struct mic_device_group *group,
+                                              int persist_flag, int *status);
+int mic_device_group_wait(struct mic_device_group *group, int *status);
+int mic_free_device_group(struct mic_device_group *group);
+
+/* Background collection */
+int mic_collector_create(struct mic_device *mdh,
+                         struct mic_collector **coll);
+int mic_collector_set_period(struct mic_collector *coll, uint32_t feature,
+                             uint32_t period_ms);
+int mic_collector_start(struct mic_collector *coll);
+int mic_collector_stop(struct mic_collector *coll);
+int mic_collector_read(struct mic_collector *coll, struct mic_snapshot *snap);
+int mic_free_collector(struct mic_collector *coll);
+
+int mic_alloc_snapshot(struct mic_snapshot **snap);
+int mic_get_snapshot_seq(struct mic_snapshot *snap, uint64_t *seq);
+int mic_get_snapshot_features(struct mic_snapshot *snap, uint32_t *features);
+int mic_get_snapshot_time(struct mic_snapshot *snap, uint32_t feature,
+                          uint64_t *time_ms);
+int mic_get_snapshot_thermal_info(struct mic_snapshot *snap, struct
+                                  mic_thermal_info **thermal);
+int mic_get_snapshot_power_utilization_info(struct mic_snapshot *snap, struct
+                                            mic_power_util_info **power);
+int mic_get_snapshot_memory_utilization_info(struct mic_snapshot *snap, struct
+                                             mic_memory_util_info **memory);
+int mic_get_snapshot_core_util(struct mic_snapshot *snap, struct
+                               mic_core_util **cutil);
+int mic_get_snapshot_nfields(uint32_t *nfields);
+int mic_get_snapshot_field_info(uint32_t field, const char **name,
+                                const char **unit, uint32_t *feature);
+int mic_find_snapshot_field(const char *name, uint32_t *field);
+int mic_get_snapshot_field(struct mic_snapshot *snap, uint32_t field,
+                           int64_t *value);
+int mic_free_snapshot(struct mic_snapshot *snap);
+
+/* Power sampling */
+int mic_power_sampler_create(struct mic_device *mdh, uint32_t capacity,
+                             struct mic_power_sampler **ps);
+int mic_power_sampler_set_interval(struct mic_power_sampler *ps,
+                                   uint32_t interval_us);
+int mic_power_sampler_start(struct mic_power_sampler *ps);
+int mic_power_sampler_stop(struct mic_power_sampler *ps);
+int mic_power_sampler_read(struct mic_power_sampler *ps, uint64_t *times_ns,
+                           uint32_t *power, uint32_t *sts, size_t *count);
+int mic_power_sampler_get_dropped(struct mic_power_sampler *ps,
+                                  uint64_t *dropped);
+int mic_power_sampler_get_errors(struct mic_power_sampler *ps,
+                                 uint64_t *errors);
+int mic_free_power_sampler(struct mic_power_sampler *ps);
+
+/* Energy accounting */
+int mic_energy_meter_create(struct mic_device *mdh, uint32_t interval_us,
+                            struct mic_energy_meter **em);
+int mic_energy_meter_update(struct mic_energy_meter *em);
+int mic_energy_begin(struct mic_energy_meter *em, const char *job);
+int mic_energy_read(struct mic_energy_meter *em, const char *job,
+                    struct mic_energy_info **info);
+int mic_energy_end(struct mic_energy_meter *em, const char *job,
+                   struct mic_energy_info **info);
+int mic_free_energy_meter(struct mic_energy_meter *em);
+int mic_get_energy_duration(struct mic_energy_info *info,
+                            uint64_t *duration_ms);
+int mic_get_energy_consumed(struct mic_energy_info *info,
+                            uint64_t *energy_uj);
+int mic_get_energy_avg_power(struct mic_energy_info *info, uint32_t *power);
+int mic_get_energy_peak_power(struct mic_energy_info *info, uint32_t *power);
+int mic_get_energy_unmeasured_time(struct mic_energy_info *info,
+                                   uint64_t *unmeasured_ms);
+int mic_get_energy_out_of_range(struct mic_energy_info *info,
+                                uint32_t *count);
+int mic_free_energy_info(struct mic_energy_info *info);
+
+/* Shared memory telemetry */
+int mic_telemetry_create(const char *name, struct mic_devices_list *devices,
+                         struct mic_telemetry **tel);
+int mic_telemetry_publish(struct mic_telemetry *tel, uint32_t device_num,
+                          struct mic_snapshot *snap);
+int mic_telemetry_open(const char *name, struct mic_telemetry **tel);
+int mic_telemetry_get_ndevices(struct mic_telemetry *tel, int *ndevices);
+int mic_telemetry_get_device_at_index(struct mic_telemetry *tel, int index,
+                                      int *device);
+int mic_telemetry_read(struct mic_telemetry *tel, uint32_t device_num,
+                       struct mic_snapshot *snap);
+int mic_telemetry_close(struct mic_telemetry *tel);
+
+/* Telemetry recordings */
+int mic_recorder_open(const char *path, uint32_t block_samples,
+                      uint32_t flags, struct mic_recorder **rec);
+int mic_recorder_append(struct mic_recorder *rec, uint32_t device_num,
+                        struct mic_snapshot *snap);
+int mic_recorder_flush(struct mic_recorder *rec);
+int mic_recorder_close(struct mic_recorder *rec);
+int mic_recording_open(const char *path, struct mic_recording **rec);
+int mic_recording_get_nseries(struct mic_recording *rec, uint32_t *nseries);
+int mic_recording_get_series_info(struct mic_recording *rec, uint32_t series,
+                                  uint32_t *device_num, const char **name,
+                                  const char **unit);
+int mic_recording_find_series(struct mic_recording *rec, uint32_t device_num,
+                              const char *name, uint32_t *series);
+int mic_recording_get_time_range(struct mic_recording *rec,
+                                 int64_t *first_ms, int64_t *last_ms);
+int mic_recording_read(struct mic_recording *rec, uint32_t series,
+                       int64_t from_ms, int64_t to_ms, int64_t *times_ms,
+                       int64_t *values, size_t *count);
+int mic_recording_get_summary(struct mic_recording *rec, uint32_t series,
+                              int64_t from_ms, int64_t to_ms, size_t *count,
+                              int64_t *min, int64_t *max, double *sum);
+int mic_recording_close(struct mic_recording *rec);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file collector.cpp
+
+#include <string.h>
+#include <time.h>
+#include <new>
+#include "collector.h"
+#include "mic_device.h"
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+namespace {
+
+/* How long the sampling thread sleeps when no feature is enabled */
+const uint64_t COLLECT_IDLE_MS = 1000;
+
+uint64_t clock_ms(clockid_t clock)
+{
+    struct timespec ts;
+
+    /* Can only fail for an unsupported clock; the sampling thread relies
+     * on this not throwing while it holds the mutex. */
+    clock_gettime(clock, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int feature_index(uint32_t feature)
+{
+    for (int i = 0; i < MIC_COLLECT_NFEATURES; i++) {
+        if (feature == (1U << i))
+            return i;
+    }
+
+    throw mic_exception(E_MIC_INVAL, "unknown collector feature");
+}
+
+int sample_feature(struct mic_device *mdh, struct mic_snapshot *snap, int i)
+{
+    switch (1U << i) {
+    case MIC_COLLECT_THERMAL:
+        return mdh->update_thermal_info(&snap->thermal);
+    case MIC_COLLECT_POWER:
+        return mdh->update_power_utilization_info(&snap->power);
+    case MIC_COLLECT_MEMORY:
+        return mdh->update_memory_utilization_info(&snap->memory);
+    case MIC_COLLECT_CORE_UTIL:
+        return mdh->update_core_util(&snap->cutil);
+    }
+
+    return E_MIC_INVAL;
+}
+
+}
+
+mic_collector::mic_collector(struct mic_device *mdh) :
+    _mdh(mdh), _running(false), _stopping(false), _seq(0)
+{
+    pthread_condattr_t attr;
+
+    memset(_period_ms, 0, sizeof(_period_ms));
+    memset(_due_ms, 0, sizeof(_due_ms));
+    memset(&_work, 0, sizeof(_work));
+    memset(_buf, 0, sizeof(_buf));
+
+    if (pthread_mutex_init(&_mutex, NULL) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
+
+    /* Wake-ups are scheduled on the monotonic clock so that setting the
+     * system time neither stalls nor floods the sampling thread. */
+    if ((pthread_condattr_init(&attr) != 0) ||
+        (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+        (pthread_cond_init(&_cond, &attr) != 0)) {
+        pthread_mutex_destroy(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_cond_init");
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+mic_collector::~mic_collector()
+{
+    try {
+        stop();
+    } catch (...) {
+    }
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void mic_collector::set_period(uint32_t feature, uint32_t period_ms)
+{
+    int i = feature_index(feature);
+
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    _period_ms[i] = period_ms;
+    _due_ms[i] = 0;
+    pthread_cond_signal(&_cond);
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+}
+
+void mic_collector::start()
+{
+    int err;
+
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    if (_running) {
+        pthread_mutex_unlock(&_mutex);
+        throw mic_exception(E_MIC_INVAL, "collector already running");
+    }
+
+    _stopping = false;
+    if ((err = pthread_create(&_thread, NULL, run, this)) != 0) {
+        pthread_mutex_unlock(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_create", err);
+    }
+    _running = true;
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+}
+
+void mic_collector::stop()
+{
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    if (!_running) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    _stopping = true;
+    pthread_cond_signal(&_cond);
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+
+    pthread_join(_thread, NULL);
+    _running = false;
+}
+
+void mic_collector::read(struct mic_snapshot *snap) const
+{
+    uint64_t seq, now;
+
+    /*
+     * The writer only fills the buffer that is not current, so the copy
+     * below is torn only if two publications completed and a third
+     * started while it ran. That is detected by the sequence having
+     * moved three or more steps past the current publication.
+     */
+    do {
+        seq = __atomic_load_n(&_seq, __ATOMIC_ACQUIRE);
+        memcpy(snap, &_buf[(seq >> 1) & 1], sizeof(*snap));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        now = __atomic_load_n(&_seq, __ATOMIC_RELAXED);
+    } while (now - (seq & ~1ULL) >= 3);
+}
+
+void *mic_collector::run(void *arg)
+{
+    static_cast<mic_collector *>(arg)->sample_loop();
+    return NULL;
+}
+
+void mic_collector::sample_loop()
+{
+    uint32_t due;
+    uint64_t next;
+    struct timespec ts;
+
+    pthread_mutex_lock(&_mutex);
+    while (!_stopping) {
+        if ((due = due_features(clock_ms(CLOCK_MONOTONIC), &next)) != 0) {
+            /* Don't hold up set_period() and stop() on the card */
+            pthread_mutex_unlock(&_mutex);
+            sample(due);
+            publish();
+            pthread_mutex_lock(&_mutex);
+            continue;
+        }
+
+        ts.tv_sec = next / 1000;
+        ts.tv_nsec = (next % 1000) * 1000000;
+        pthread_cond_timedwait(&_cond, &_mutex, &ts);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+/*
+ * Called with _mutex held. Returns the features whose period has elapsed
+ * and advances their schedule, or 0 with *next set to the monotonic time
+ * at which the next one falls due.
+ */
+uint32_t mic_collector::due_features(uint64_t now, uint64_t *next)
+{
+    uint32_t due = 0;
+
+    *next = now + COLLECT_IDLE_MS;
+    for (int i = 0; i < MIC_COLLECT_NFEATURES; i++) {
+        if (_period_ms[i] == 0)
+            continue;
+
+        if (_due_ms[i] <= now) {
+            due |= 1U << i;
+            /* Keep to the schedule, but skip ticks that were missed */
+            _due_ms[i] += _period_ms[i];
+            if (_due_ms[i] <= now)
+                _due_ms[i] = now + _period_ms[i];
+        }
+        if (_due_ms[i] < *next)
+            *next = _due_ms[i];
+    }
+
+    return due;
+}
+
+void mic_collector::sample(uint32_t due)
+{
+    for (int i = 0; i < MIC_COLLECT_NFEATURES; i++) {
+        if ((due & (1U << i)) == 0)
+            continue;
+
+        /* A failed sample withdraws the feature rather than leaving
+         * readers with a stale or half-written copy of it. */
+        if (sample_feature(_mdh, &_work, i) == E_MIC_SUCCESS) {
+            _work.time_ms[i] = clock_ms(CLOCK_REALTIME);
+            _work.features |= 1U << i;
+        } else {
+            _work.features &= ~(1U << i);
+        }
+    }
+}
+
+void mic_collector::publish()
+{
+    uint64_t seq = _seq;
+
+    __atomic_store_n(&_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    _work.seq = (seq >> 1) + 1;
+    memcpy(&_buf[((seq >> 1) + 1) & 1], &_work, sizeof(_work));
+
+    __atomic_store_n(&_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void *snapshot_feature(struct mic_snapshot *snap, uint32_t feature,
+                       uint64_t *time_ms)
+{
+    int i = feature_index(feature);
+
+    if ((snap->features & feature) == 0)
+        throw mic_exception(E_MIC_NOENT, "feature not in snapshot");
+
+    if (time_ms != NULL)
+        *time_ms = snap->time_ms[i];
+
+    switch (feature) {
+    case MIC_COLLECT_THERMAL:
+        return &snap->thermal;
+    case MIC_COLLECT_POWER:
+        return &snap->power;
+    case MIC_COLLECT_MEMORY:
+        return &snap->memory;
+    default:
+        return &snap->cutil;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file collector.h
+/// \brief Background sampling of RAS features into lock-free snapshots.
+
+#ifndef MICLIB_SRC_COLLECTOR_H_
+#define MICLIB_SRC_COLLECTOR_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "miclib_int.h"
+
+/// \brief Samples a device on its own thread and publishes snapshots.
+///
+/// The sampling thread is the only writer. It fills a private working
+/// snapshot, then copies it into whichever of two published buffers
+/// readers are not using and bumps a sequence counter. Readers copy the
+/// current buffer and retry only if the writer came back around to that
+/// same buffer while they were copying, so a read never blocks, never
+/// takes a lock and never talks to the card.
+struct mic_collector {
+public:
+    mic_collector(struct mic_device *mdh);
+    ~mic_collector();
+
+    void set_period(uint32_t feature, uint32_t period_ms);
+    void start();
+    void stop();
+    void read(struct mic_snapshot *snap) const;
+
+private:
+    mic_collector(const mic_collector &);
+    mic_collector &operator=(const mic_collector &);
+
+    static void *run(void *arg);
+    void sample_loop();
+    uint32_t due_features(uint64_t now, uint64_t *next);
+    void sample(uint32_t due);
+    void publish();
+
+    struct mic_device *_mdh;
+    pthread_t _thread;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    bool _running;
+    bool _stopping;
+    uint32_t _period_ms[MIC_COLLECT_NFEATURES];
+    uint64_t _due_ms[MIC_COLLECT_NFEATURES];
+    struct mic_snapshot _work;
+    /* Bit 0 is set while a buffer is being written, the rest counts
+     * publications; buffer (_seq >> 1) & 1 holds the latest one. */
+    uint64_t _seq;
+    struct mic_snapshot _buf[2];
+};
+
+#endif /* MICLIB_SRC_COLLECTOR_H_ */
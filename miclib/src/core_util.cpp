@@ -0,0 +1,381 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file core_util.cpp
+
+#include <stddef.h>
+#include <sstream>
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CUTIL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct cutil_pct {
+    double *user;
+    double *nice;
+    double *sys;
+    double *idle;
+};
+
+struct cutil_counters {
+    uint64_t *user;
+    uint64_t *nice;
+    uint64_t *sys;
+    uint64_t *idle;
+};
+
+typedef void (cutil_func)(const MrRspCutl *, const MrRspCutl *, double,
+                          uint16_t, struct cutil_pct *);
+typedef void (counters_func)(const MrRspCutl *, uint16_t,
+                             struct cutil_counters *);
+
+/*
+ * The vector paths load each core's user, nice, sys and idle counters as
+ * one 256-bit row, which needs them to be consecutive 64-bit fields.
+ */
+const bool CPU_COUNTERS_PACKED =
+    (sizeof(((MrRspCutl *)0)->cpu[0].user) == 8) &&
+    (offsetof(MrRspCutl, cpu[0].nice) - offsetof(MrRspCutl, cpu[0].user) ==
+     8) &&
+    (offsetof(MrRspCutl, cpu[0].sys) - offsetof(MrRspCutl, cpu[0].user) ==
+     16) &&
+    (offsetof(MrRspCutl, cpu[0].idle) - offsetof(MrRspCutl, cpu[0].user) ==
+     24) &&
+    (offsetof(MrRspCutl, cpu[1].user) - offsetof(MrRspCutl, cpu[0].user) ==
+     32);
+
+/*
+ * A counter below 2^52 OR'ed into the mantissa of 2^52 reads as the
+ * double 2^52 + counter, so the difference of two such values is the
+ * exact counter delta without an integer conversion.
+ */
+const uint64_t DBL_2P52 = 0x4330000000000000ULL;
+
+inline double counter_pct(uint64_t cur, uint64_t prev, double scale)
+{
+    double pct = (cur > prev) ? (double)(cur - prev) * scale : 0.0;
+
+    return (pct > 100.0) ? 100.0 : pct;
+}
+
+void cutil_scalar_from(const MrRspCutl *prev, const MrRspCutl *cur,
+                       double scale, uint16_t from, uint16_t n,
+                       struct cutil_pct *out)
+{
+    for (uint16_t i = from; i < n; i++) {
+        out->user[i] = counter_pct(cur->cpu[i].user, prev->cpu[i].user, scale);
+        out->nice[i] = counter_pct(cur->cpu[i].nice, prev->cpu[i].nice, scale);
+        out->sys[i] = counter_pct(cur->cpu[i].sys, prev->cpu[i].sys, scale);
+        out->idle[i] = counter_pct(cur->cpu[i].idle, prev->cpu[i].idle, scale);
+    }
+}
+
+void cutil_scalar(const MrRspCutl *prev, const MrRspCutl *cur, double scale,
+                  uint16_t n, struct cutil_pct *out)
+{
+    cutil_scalar_from(prev, cur, scale, 0, n, out);
+}
+
+void counters_scalar_from(const MrRspCutl *cutil, uint16_t from, uint16_t n,
+                          struct cutil_counters *out)
+{
+    for (uint16_t i = from; i < n; i++) {
+        out->user[i] = cutil->cpu[i].user;
+        out->nice[i] = cutil->cpu[i].nice;
+        out->sys[i] = cutil->cpu[i].sys;
+        out->idle[i] = cutil->cpu[i].idle;
+    }
+}
+
+void counters_scalar(const MrRspCutl *cutil, uint16_t n,
+                     struct cutil_counters *out)
+{
+    counters_scalar_from(cutil, 0, n, out);
+}
+
+#ifdef CUTIL_X86
+/* Two cores per iteration, each as a (user, nice) and a (sys, idle) pair. */
+__attribute__((target("sse2")))
+void cutil_sse2(const MrRspCutl *prev, const MrRspCutl *cur, double scale,
+                uint16_t n, struct cutil_pct *out)
+{
+    const __m128d magic = _mm_castsi128_pd(_mm_set1_epi64x(DBL_2P52));
+    const __m128d vscale = _mm_set1_pd(scale);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d hundred = _mm_set1_pd(100.0);
+    __m128d r[4];
+    uint16_t i;
+    int j;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        for (j = 0; j < 4; j++) {
+            const double *c = (const double *)&cur->cpu[i + j / 2] +
+                              2 * (j % 2);
+            const double *p = (const double *)&prev->cpu[i + j / 2] +
+                              2 * (j % 2);
+            __m128d d = _mm_sub_pd(_mm_or_pd(_mm_loadu_pd(c), magic),
+                                   _mm_or_pd(_mm_loadu_pd(p), magic));
+
+            r[j] = _mm_min_pd(_mm_max_pd(_mm_mul_pd(d, vscale), zero),
+                              hundred);
+        }
+        _mm_storeu_pd(out->user + i, _mm_unpacklo_pd(r[0], r[2]));
+        _mm_storeu_pd(out->nice + i, _mm_unpackhi_pd(r[0], r[2]));
+        _mm_storeu_pd(out->sys + i, _mm_unpacklo_pd(r[1], r[3]));
+        _mm_storeu_pd(out->idle + i, _mm_unpackhi_pd(r[1], r[3]));
+    }
+
+    cutil_scalar_from(prev, cur, scale, i, n, out);
+}
+
+/*
+ * Four cores per iteration: one row of four counters per core, then a 4x4
+ * transpose so that each output array gets four consecutive cores.
+ */
+__attribute__((target("avx")))
+void cutil_avx(const MrRspCutl *prev, const MrRspCutl *cur, double scale,
+               uint16_t n, struct cutil_pct *out)
+{
+    const __m256d magic = _mm256_castsi256_pd(_mm256_set1_epi64x(DBL_2P52));
+    const __m256d vscale = _mm256_set1_pd(scale);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d hundred = _mm256_set1_pd(100.0);
+    __m256d r[4], t[4];
+    uint16_t i;
+    int j;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        for (j = 0; j < 4; j++) {
+            const double *c = (const double *)&cur->cpu[i + j];
+            const double *p = (const double *)&prev->cpu[i + j];
+            __m256d d = _mm256_sub_pd(_mm256_or_pd(_mm256_loadu_pd(c), magic),
+                                      _mm256_or_pd(_mm256_loadu_pd(p), magic));
+
+            r[j] = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(d, vscale), zero),
+                                 hundred);
+        }
+        t[0] = _mm256_unpacklo_pd(r[0], r[1]);
+        t[1] = _mm256_unpackhi_pd(r[0], r[1]);
+        t[2] = _mm256_unpacklo_pd(r[2], r[3]);
+        t[3] = _mm256_unpackhi_pd(r[2], r[3]);
+        _mm256_storeu_pd(out->user + i,
+                         _mm256_permute2f128_pd(t[0], t[2], 0x20));
+        _mm256_storeu_pd(out->nice + i,
+                         _mm256_permute2f128_pd(t[1], t[3], 0x20));
+        _mm256_storeu_pd(out->sys + i,
+                         _mm256_permute2f128_pd(t[0], t[2], 0x31));
+        _mm256_storeu_pd(out->idle + i,
+                         _mm256_permute2f128_pd(t[1], t[3], 0x31));
+    }
+
+    cutil_scalar_from(prev, cur, scale, i, n, out);
+}
+
+/* Two cores per iteration, as in the SSE2 path above. */
+__attribute__((target("sse2")))
+void counters_sse2(const MrRspCutl *cutil, uint16_t n,
+                   struct cutil_counters *out)
+{
+    __m128d r[4];
+    uint16_t i;
+    int j;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        for (j = 0; j < 4; j++)
+            r[j] = _mm_loadu_pd((const double *)&cutil->cpu[i + j / 2] +
+                                2 * (j % 2));
+        _mm_storeu_pd((double *)(out->user + i), _mm_unpacklo_pd(r[0], r[2]));
+        _mm_storeu_pd((double *)(out->nice + i), _mm_unpackhi_pd(r[0], r[2]));
+        _mm_storeu_pd((double *)(out->sys + i), _mm_unpacklo_pd(r[1], r[3]));
+        _mm_storeu_pd((double *)(out->idle + i), _mm_unpackhi_pd(r[1], r[3]));
+    }
+
+    counters_scalar_from(cutil, i, n, out);
+}
+
+/*
+ * Four cores per iteration: the 4x4 transpose of the AVX path above,
+ * applied to the raw counters.
+ */
+__attribute__((target("avx")))
+void counters_avx(const MrRspCutl *cutil, uint16_t n,
+                  struct cutil_counters *out)
+{
+    __m256d r[4], t[4];
+    uint16_t i;
+    int j;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        for (j = 0; j < 4; j++)
+            r[j] = _mm256_loadu_pd((const double *)&cutil->cpu[i + j]);
+        t[0] = _mm256_unpacklo_pd(r[0], r[1]);
+        t[1] = _mm256_unpackhi_pd(r[0], r[1]);
+        t[2] = _mm256_unpacklo_pd(r[2], r[3]);
+        t[3] = _mm256_unpackhi_pd(r[2], r[3]);
+        _mm256_storeu_pd((double *)(out->user + i),
+                         _mm256_permute2f128_pd(t[0], t[2], 0x20));
+        _mm256_storeu_pd((double *)(out->nice + i),
+                         _mm256_permute2f128_pd(t[1], t[3], 0x20));
+        _mm256_storeu_pd((double *)(out->sys + i),
+                         _mm256_permute2f128_pd(t[0], t[2], 0x31));
+        _mm256_storeu_pd((double *)(out->idle + i),
+                         _mm256_permute2f128_pd(t[1], t[3], 0x31));
+    }
+
+    counters_scalar_from(cutil, i, n, out);
+}
+#endif
+
+enum simd_level {
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX
+};
+
+simd_level get_simd_level()
+{
+#ifdef CUTIL_X86
+    if (CPU_COUNTERS_PACKED) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx"))
+            return SIMD_AVX;
+        if (__builtin_cpu_supports("sse2"))
+            return SIMD_SSE2;
+    }
+#endif
+    return SIMD_NONE;
+}
+
+cutil_func *select_cutil_func()
+{
+    switch (get_simd_level()) {
+#ifdef CUTIL_X86
+    case SIMD_AVX:
+        return cutil_avx;
+    case SIMD_SSE2:
+        return cutil_sse2;
+#endif
+    default:
+        return cutil_scalar;
+    }
+}
+
+counters_func *select_counters_func()
+{
+    switch (get_simd_level()) {
+#ifdef CUTIL_X86
+    case SIMD_AVX:
+        return counters_avx;
+    case SIMD_SSE2:
+        return counters_sse2;
+#endif
+    default:
+        return counters_scalar;
+    }
+}
+
+}
+
+/*
+ * Per-core and device utilization between two samples, as percentages of
+ * the time available in the sample interval (threads per core times the
+ * jiffy delta). Per-core values are clamped to [0, 100]; device values
+ * are the counter sums averaged over the cores.
+ */
+void core_util_delta(const struct mic_core_util *prev,
+                     const struct mic_core_util *cur, double *user,
+                     double *nice, double *sys, double *idle, double *device)
+{
+    static cutil_func *cutil = NULL;
+    const MrRspCutl *p = &prev->c_util;
+    const MrRspCutl *c = &cur->c_util;
+    struct cutil_pct out = { user, nice, sys, idle };
+    double scale;
+
+    if ((c->core == 0) || (c->core != p->core) || (c->thr == 0) ||
+        (c->jif <= p->jif))
+        throw mic_exception(E_MIC_INVAL, "invalid core utilization samples",
+                            EINVAL);
+
+    if (cutil == NULL)
+        cutil = select_cutil_func();
+
+    scale = 100.0 / ((double)c->thr * (double)(c->jif - p->jif));
+    cutil(p, c, scale, c->core, &out);
+
+    scale /= c->core;
+    device[MIC_CUTIL_USER] = counter_pct(c->sum.user, p->sum.user, scale);
+    device[MIC_CUTIL_NICE] = counter_pct(c->sum.nice, p->sum.nice, scale);
+    device[MIC_CUTIL_SYS] = counter_pct(c->sum.sys, p->sum.sys, scale);
+    device[MIC_CUTIL_IDLE] = counter_pct(c->sum.idle, p->sum.idle, scale);
+}
+
+/*
+ * Transpose the per-core counters into separate user, nice, sys and idle
+ * arrays of *num_cores entries. If user is NULL only the core count is
+ * returned.
+ */
+void core_util_counters(const struct mic_core_util *cutil,
+                        uint16_t *num_cores, uint64_t *user, uint64_t *nice,
+                        uint64_t *sys, uint64_t *idle)
+{
+    static counters_func *counters = NULL;
+    uint16_t n = cutil->c_util.core;
+    struct cutil_counters out = { user, nice, sys, idle };
+
+    if (user == NULL) {
+        *num_cores = n;
+        return;
+    }
+
+    if (*num_cores < n) {
+        std::stringstream ss;
+        ss << "counter arrays hold " << *num_cores << " cores, " << n <<
+            " needed";
+        *num_cores = n;
+        throw mic_exception(E_MIC_RANGE, ss.str(), ERANGE);
+    }
+
+    if (counters == NULL)
+        counters = select_counters_func();
+
+    counters(&cutil->c_util, n, &out);
+    *num_cores = n;
+}
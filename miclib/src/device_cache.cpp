@@ -0,0 +1,226 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file device_cache.cpp
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "device_cache.h"
+#include "host_platform.h"
+#include "miclib_exception.h"
+
+namespace {
+
+/* Longest a list is trusted without looking at the directory again */
+const uint64_t DEVICE_CACHE_MAX_AGE_MS = 1000;
+
+const uint32_t DEVICE_CACHE_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_DELETE_SELF |
+                                     IN_MOVE_SELF;
+
+uint64_t clock_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+class mutex_lock {
+public:
+    explicit mutex_lock(pthread_mutex_t *m) : _m(m)
+    {
+        if (pthread_mutex_lock(_m) != 0)
+            throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+    }
+    ~mutex_lock()
+    {
+        pthread_mutex_unlock(_m);
+    }
+
+private:
+    pthread_mutex_t *_m;
+};
+
+}
+
+device_cache &device_cache::instance()
+{
+    static device_cache cache;
+
+    return cache;
+}
+
+device_cache::device_cache() :
+    _inotify_fd(-1), _watch(-1), _valid(false), _scanned_ms(0),
+    _generation(0)
+{
+    memset(&_mtime, 0, sizeof(_mtime));
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+device_cache::~device_cache()
+{
+    if (_inotify_fd >= 0)
+        close(_inotify_fd);
+    pthread_mutex_destroy(&_mutex);
+}
+
+struct mic_devices_list *device_cache::get_devices()
+{
+    mutex_lock lock(&_mutex);
+    struct mic_devices_list *d;
+    size_t n;
+
+    refresh();
+
+    n = _devices.size();
+    d = (struct mic_devices_list *)
+        malloc(sizeof(struct mic_devices_list) +
+               (n > 0 ? n - 1 : 0) * sizeof(d->devices[0]));
+    if (d == NULL)
+        throw mic_exception(E_MIC_NOMEM, "malloc", ENOMEM);
+
+    d->n_devices = n;
+    d->generation = _generation;
+    if (n > 0)
+        memcpy(d->devices, &_devices[0], n * sizeof(d->devices[0]));
+
+    return d;
+}
+
+uint64_t device_cache::generation()
+{
+    mutex_lock lock(&_mutex);
+
+    refresh();
+
+    return _generation;
+}
+
+void device_cache::unwatch()
+{
+    if (_inotify_fd >= 0 && _watch >= 0)
+        inotify_rm_watch(_inotify_fd, _watch);
+    _watch = -1;
+}
+
+/*
+ * Drains pending inotify events and reports whether any arrived. Without
+ * a watch (no inotify, or the directory is missing) every call reports a
+ * change, leaving the decision to the mtime and age checks.
+ */
+bool device_cache::watch_changed()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    if (_inotify_fd < 0) {
+        _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify_fd < 0)
+            return true;
+    }
+
+    if (_watch < 0) {
+        _watch = inotify_add_watch(_inotify_fd, _path.c_str(),
+                                   DEVICE_CACHE_EVENTS);
+        return true;
+    }
+
+    while ((len = read(_inotify_fd, buf, sizeof(buf))) > 0) {
+        const struct inotify_event *ev;
+        char *p;
+
+        for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+                _watch = -1;
+        }
+        /* Any event, IN_Q_OVERFLOW included, means look again */
+        changed = true;
+    }
+
+    return changed;
+}
+
+void device_cache::refresh()
+{
+    std::string path = host_platform::get_sysfs_base_path();
+    std::vector<int> devices;
+    uint64_t now = clock_ms();
+    struct stat st;
+    bool rescan = !_valid;
+
+    if (path != _path) {
+        unwatch();
+        _path = path;
+        rescan = true;
+    }
+
+    if (watch_changed())
+        rescan = true;
+
+    if (stat(_path.c_str(), &st) == 0) {
+        if (st.st_mtim.tv_sec != _mtime.tv_sec ||
+            st.st_mtim.tv_nsec != _mtime.tv_nsec)
+            rescan = true;
+    } else {
+        memset(&st, 0, sizeof(st));
+        rescan = true;
+    }
+
+    if (now - _scanned_ms >= DEVICE_CACHE_MAX_AGE_MS)
+        rescan = true;
+
+    if (!rescan)
+        return;
+
+    _valid = false;
+    host_platform::get_devices(devices);
+
+    if (_generation == 0 || devices != _devices) {
+        _devices.swap(devices);
+        _generation++;
+    }
+    _valid = true;
+    _scanned_ms = now;
+    _mtime = st.st_mtim;
+}
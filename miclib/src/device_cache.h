@@ -0,0 +1,85 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file device_cache.h
+/// \brief Process wide cache of the coprocessors listed in sysfs.
+
+#ifndef MICLIB_SRC_DEVICE_CACHE_H_
+#define MICLIB_SRC_DEVICE_CACHE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "miclib_int.h"
+
+/// \brief Keeps the last enumeration of the sysfs class directory.
+///
+/// The directory is only read again when an inotify watch on it reports
+/// a change, when its mtime moves, or when the list is older than
+/// DEVICE_CACHE_MAX_AGE_MS: sysfs raises neither inotify events nor
+/// mtime changes for entries the driver creates, so the age bound is
+/// what catches a hot-plugged card there. The generation counter only
+/// moves when a scan finds a different set of devices.
+class device_cache {
+public:
+    static device_cache &instance();
+
+    struct mic_devices_list *get_devices();
+    uint64_t generation();
+
+private:
+    device_cache();
+    ~device_cache();
+    device_cache(const device_cache &);
+    device_cache &operator=(const device_cache &);
+
+    void refresh();
+    bool watch_changed();
+    void unwatch();
+
+    pthread_mutex_t _mutex;
+    std::string _path;
+    int _inotify_fd;
+    int _watch;
+    bool _valid;
+    uint64_t _scanned_ms;
+    struct timespec _mtime;
+    std::vector<int> _devices;
+    uint64_t _generation;
+};
+
+#endif /* MICLIB_SRC_DEVICE_CACHE_H_ */
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file device_group.cpp
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include "device_group.h"
+#include "knc_device.h"
+#include "mic_device.h"
+#include "miclib_exception.h"
+
+namespace {
+
+uint64_t clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct group_job {
+    struct mic_device *mdh;
+    const struct group_op *op;
+    int (*apply)(struct mic_device *, const struct group_op &);
+    int status;
+    pthread_t thread;
+    bool started;
+};
+
+}
+
+mic_device_group::mic_device_group(struct mic_device **devices, int n) :
+    _devices(devices, devices + n), _settle_ns(0)
+{
+}
+
+int mic_device_group::size() const
+{
+    return _devices.size();
+}
+
+int mic_device_group::apply(struct mic_device *mdh,
+                            const struct group_op &op)
+{
+    uint32_t value = op.arg0;
+
+    try {
+        switch (op.op) {
+        case group_op::TURBO_MODE:
+            mdh->write_turbo_mode(&value);
+            break;
+        case group_op::LED_ALERT:
+            mdh->set_led_alert(&value);
+            break;
+        case group_op::POWER_LIMIT0:
+            mdh->set_power_limit0(op.arg0, op.arg1);
+            break;
+        case group_op::POWER_LIMIT1:
+            mdh->set_power_limit1(op.arg0, op.arg1);
+            break;
+        case group_op::SMC_PERSISTENCE:
+            mdh->set_smc_persistence_flag(op.arg0);
+            break;
+        default:
+            return E_MIC_INVAL;
+        }
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+
+    return E_MIC_SUCCESS;
+}
+
+void *mic_device_group::run(void *arg)
+{
+    struct group_job *job = (struct group_job *)arg;
+
+    job->status = job->apply(job->mdh, *job->op);
+
+    return NULL;
+}
+
+/*
+ * Returns E_MIC_SUCCESS if the operation succeeded on every device, or
+ * else the error of the first device it failed on; status, if not NULL,
+ * gets the result of each device.
+ */
+int mic_device_group::broadcast(const struct group_op &op, int *status)
+{
+    std::vector<struct group_job> jobs(_devices.size());
+    bool settles = false;
+    int timeout_ms = 0;
+    int ret = E_MIC_SUCCESS;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        jobs[i].mdh = _devices[i];
+        jobs[i].op = &op;
+        jobs[i].apply = apply;
+        jobs[i].status = E_MIC_INTERNAL;
+        jobs[i].started = false;
+    }
+
+    /* The first device is handled on this thread */
+    for (size_t i = 1; i < jobs.size(); i++) {
+        if (pthread_create(&jobs[i].thread, NULL, run, &jobs[i]) == 0)
+            jobs[i].started = true;
+    }
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!jobs[i].started)
+            run(&jobs[i]);
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+        if (status != NULL)
+            status[i] = jobs[i].status;
+        if (jobs[i].status == E_MIC_SUCCESS) {
+            int t = _devices[i]->get_turbo_timeout();
+
+            /* Wait as long as the most patient device would alone */
+            if (!settles || (timeout_ms >= 0 && (t < 0 || t > timeout_ms)))
+                timeout_ms = t;
+            settles = true;
+        } else if (ret == E_MIC_SUCCESS) {
+            ret = jobs[i].status;
+        }
+    }
+
+    if (settles && op.op == group_op::TURBO_MODE) {
+        uint64_t until = timeout_ms < 0 ? UINT64_MAX : clock_ns() +
+                         (uint64_t)timeout_ms * 1000000;
+
+        if (until > _settle_ns)
+            _settle_ns = until;
+    }
+
+    return ret;
+}
+
+/*
+ * Polls every device until the turbo mode last broadcast is reflected by
+ * all of them or the settle deadline passes. Returns E_MIC_SUCCESS if all
+ * devices settled, or else the error of the first one that did not;
+ * status, if not NULL, gets the result of each device.
+ */
+int mic_device_group::wait(int *status)
+{
+    std::vector<int> result(_devices.size(), E_MIC_SUCCESS);
+    std::vector<bool> settled(_devices.size(), _settle_ns == 0);
+    int ret = E_MIC_SUCCESS;
+
+    while (_settle_ns != 0) {
+        bool all = true;
+
+        for (size_t i = 0; i < _devices.size(); i++) {
+            if (settled[i])
+                continue;
+            try {
+                settled[i] = _devices[i]->wait_turbo_mode(0);
+                if (!settled[i])
+                    all = false;
+            } catch (mic_exception const &e) {
+                result[i] = e.get_mic_errno();
+                settled[i] = true;
+            } catch (...) {
+                result[i] = E_MIC_INTERNAL;
+                settled[i] = true;
+            }
+        }
+        if (all)
+            break;
+
+        uint64_t now = clock_ns();
+        uint64_t poll = (uint64_t)knc_device::TURBO_POLL_MS * 1000000;
+
+        if (now >= _settle_ns)
+            break;
+        if (now + poll > _settle_ns)
+            poll = _settle_ns - now;
+        usleep(poll / 1000);
+    }
+    _settle_ns = 0;
+
+    for (size_t i = 0; i < _devices.size(); i++) {
+        if (!settled[i])
+            result[i] = E_MIC_SYSTEM;
+        if (status != NULL)
+            status[i] = result[i];
+        if ((result[i] != E_MIC_SUCCESS) && (ret == E_MIC_SUCCESS))
+            ret = result[i];
+    }
+
+    return ret;
+}
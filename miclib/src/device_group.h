@@ -0,0 +1,88 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file device_group.h
+/// \brief Control operations applied to several devices at once.
+
+#ifndef MICLIB_SRC_DEVICE_GROUP_H_
+#define MICLIB_SRC_DEVICE_GROUP_H_
+
+#include <stdint.h>
+#include <vector>
+#include "miclib_int.h"
+
+/// \brief One control operation, as applied to every device of a group.
+struct group_op {
+    enum kind {
+        TURBO_MODE,
+        LED_ALERT,
+        POWER_LIMIT0,
+        POWER_LIMIT1,
+        SMC_PERSISTENCE
+    };
+
+    kind op;
+    uint32_t arg0;
+    uint32_t arg1;
+};
+
+/// \brief A set of open devices that control operations are broadcast to.
+///
+/// Each broadcast runs the operation on every device concurrently, one
+/// thread per device, and returns once all of them have answered. The
+/// group does not own its devices. Operations whose effect takes time to
+/// settle, such as a turbo mode change, do not wait for it; they push
+/// back a deadline up to which wait() polls all the cards together, so a
+/// change across all of them settles in one wait instead of one per card.
+struct mic_device_group {
+public:
+    mic_device_group(struct mic_device **devices, int n);
+
+    int size() const;
+    int broadcast(const struct group_op &op, int *status);
+    int wait(int *status);
+
+private:
+    mic_device_group(const mic_device_group &);
+    mic_device_group &operator=(const mic_device_group &);
+
+    static void *run(void *arg);
+    static int apply(struct mic_device *mdh, const struct group_op &op);
+
+    std::vector<struct mic_device *> _devices;
+    uint64_t _settle_ns;
+};
+
+#endif /* MICLIB_SRC_DEVICE_GROUP_H_ */
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file energy.cpp
+
+#include <string.h>
+#include <time.h>
+#include <new>
+#include "energy.h"
+#include "host_platform.h"
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+namespace {
+
+/* Readings held between updates; at 50 Hz this is over 20 minutes */
+const uint32_t ENERGY_RING_SIZE = 65536;
+
+/* Readings further apart than this say nothing about the time between */
+const uint64_t ENERGY_MAX_GAP_NS = 1000000000ULL;
+
+uint64_t clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool usable(uint8_t sts)
+{
+    return sts != host_platform::SMC_SENSOR_UNAVAILABLE;
+}
+
+/*
+ * The power a reading stands for: the instantaneous sensor, or when that
+ * cannot be read the average over window 0, then window 1. Returns the
+ * status of the sensor used, or SMC_SENSOR_UNAVAILABLE if there is none.
+ */
+uint8_t reading_power(const struct power_sample &s, double *power)
+{
+    if (usable(s.inst_sts)) {
+        *power = s.inst;
+        return s.inst_sts;
+    }
+    if (usable(s.tot0_sts)) {
+        *power = s.tot0;
+        return s.tot0_sts;
+    }
+    if (usable(s.tot1_sts)) {
+        *power = s.tot1;
+        return s.tot1_sts;
+    }
+    return host_platform::SMC_SENSOR_UNAVAILABLE;
+}
+
+class mutex_lock {
+public:
+    explicit mutex_lock(pthread_mutex_t *m) : _m(m)
+    {
+        if (pthread_mutex_lock(_m) != 0)
+            throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+    }
+    ~mutex_lock()
+    {
+        pthread_mutex_unlock(_m);
+    }
+
+private:
+    pthread_mutex_t *_m;
+};
+
+}
+
+mic_energy_meter::mic_energy_meter(struct mic_device *mdh,
+                                   uint32_t interval_us) :
+    _sampler(mdh, ENERGY_RING_SIZE), _have_last(false)
+{
+    memset(&_last, 0, sizeof(_last));
+
+    if (pthread_mutex_init(&_mutex, NULL) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
+
+    try {
+        _sampler.set_interval(interval_us);
+        _sampler.start();
+    } catch (...) {
+        pthread_mutex_destroy(&_mutex);
+        throw;
+    }
+}
+
+mic_energy_meter::~mic_energy_meter()
+{
+    try {
+        _sampler.stop();
+    } catch (...) {
+    }
+    pthread_mutex_destroy(&_mutex);
+}
+
+void mic_energy_meter::update()
+{
+    mutex_lock lock(&_mutex);
+
+    drain();
+}
+
+void mic_energy_meter::begin(const std::string &job)
+{
+    mutex_lock lock(&_mutex);
+    struct job j;
+
+    if (job.empty())
+        throw mic_exception(E_MIC_INVAL, "empty job id");
+    if (_jobs.find(job) != _jobs.end())
+        throw mic_exception(E_MIC_INVAL, "job already running: " + job);
+
+    drain();
+
+    memset(&j, 0, sizeof(j));
+    j.begin_ns = clock_ns();
+    _jobs[job] = j;
+}
+
+void mic_energy_meter::read(const std::string &job,
+                            struct mic_energy_info *info)
+{
+    mutex_lock lock(&_mutex);
+    std::map<std::string, struct job>::iterator it = _jobs.find(job);
+
+    if (it == _jobs.end())
+        throw mic_exception(E_MIC_NOENT, "no such job: " + job);
+
+    drain();
+    report(it->second, info);
+}
+
+void mic_energy_meter::end(const std::string &job,
+                           struct mic_energy_info *info)
+{
+    mutex_lock lock(&_mutex);
+    std::map<std::string, struct job>::iterator it = _jobs.find(job);
+
+    if (it == _jobs.end())
+        throw mic_exception(E_MIC_NOENT, "no such job: " + job);
+
+    drain();
+    if (info != NULL)
+        report(it->second, info);
+    _jobs.erase(it);
+}
+
+/* Called with _mutex held */
+void mic_energy_meter::drain()
+{
+    struct power_sample buf[256];
+    size_t n, i;
+
+    do {
+        n = _sampler.read(buf, sizeof(buf) / sizeof(buf[0]));
+        for (i = 0; i < n; i++)
+            integrate(buf[i]);
+    } while (n == sizeof(buf) / sizeof(buf[0]));
+}
+
+/*
+ * Charges the interval that ends with reading s. Consecutive instantaneous
+ * readings are integrated by the trapezoid rule; when either could not be
+ * read the interval is charged at the window average of s. An interval
+ * with no usable reading, or longer than ENERGY_MAX_GAP_NS because the
+ * card did not answer or readings were dropped, is counted as unmeasured.
+ */
+void mic_energy_meter::integrate(const struct power_sample &s)
+{
+    std::map<std::string, struct job>::iterator it;
+    uint64_t from, dt;
+    double power = 0;
+    uint32_t peak;
+    uint8_t sts = host_platform::SMC_SENSOR_UNAVAILABLE;
+    bool measured;
+
+    if (!_have_last || (s.time_ns <= _last.time_ns)) {
+        _last = s;
+        _have_last = true;
+        return;
+    }
+
+    if (s.time_ns - _last.time_ns > ENERGY_MAX_GAP_NS) {
+        measured = false;
+    } else if (usable(_last.inst_sts) && usable(s.inst_sts)) {
+        power = ((double)_last.inst + s.inst) / 2;
+        sts = s.inst_sts;
+        measured = true;
+    } else {
+        sts = reading_power(s, &power);
+        measured = usable(sts);
+    }
+    peak = usable(s.inst_sts) ? s.inst : (uint32_t)power;
+
+    for (it = _jobs.begin(); it != _jobs.end(); ++it) {
+        struct job &j = it->second;
+
+        if (j.begin_ns >= s.time_ns)
+            continue;
+
+        from = j.begin_ns > _last.time_ns ? j.begin_ns : _last.time_ns;
+        dt = s.time_ns - from;
+        if (!measured) {
+            j.unmeasured_ns += dt;
+            continue;
+        }
+
+        j.energy_uj += power * dt / 1e9;
+        if (peak > j.peak_uw)
+            j.peak_uw = peak;
+        if (sts != 0)
+            j.out_of_range++;
+    }
+
+    _last = s;
+}
+
+/*
+ * Fills in info for a job as of now. The time since the last reading has
+ * not been integrated yet and is charged at that reading's power.
+ */
+void mic_energy_meter::report(const struct job &j,
+                              struct mic_energy_info *info) const
+{
+    uint64_t now = clock_ns();
+    uint64_t from;
+    double power;
+
+    info->duration_ns = now - j.begin_ns;
+    info->energy_uj = j.energy_uj;
+    info->unmeasured_ns = j.unmeasured_ns;
+    info->peak_uw = j.peak_uw;
+    info->out_of_range = j.out_of_range;
+
+    if (!_have_last) {
+        info->unmeasured_ns = info->duration_ns;
+        return;
+    }
+
+    from = j.begin_ns > _last.time_ns ? j.begin_ns : _last.time_ns;
+    if (now <= from)
+        return;
+
+    if ((now - _last.time_ns <= ENERGY_MAX_GAP_NS) &&
+        usable(reading_power(_last, &power)))
+        info->energy_uj += power * (now - from) / 1e9;
+    else
+        info->unmeasured_ns += now - from;
+}
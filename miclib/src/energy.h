@@ -0,0 +1,90 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file energy.h
+/// \brief Per job energy accounting from high rate power readings.
+
+#ifndef MICLIB_SRC_ENERGY_H_
+#define MICLIB_SRC_ENERGY_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include "miclib_int.h"
+#include "power_sampler.h"
+
+/// \brief Integrates the power of one device over the jobs running on it.
+///
+/// Readings come from a mic_power_sampler owned by the meter and are only
+/// consumed when the meter is updated, so the owner must call update()
+/// often enough for the ring not to fill; readings lost to a full ring
+/// show up as gaps. Each interval between two readings is charged to every
+/// job that was running during it, for the part of it that the job was.
+struct mic_energy_meter {
+public:
+    mic_energy_meter(struct mic_device *mdh, uint32_t interval_us);
+    ~mic_energy_meter();
+
+    void update();
+    void begin(const std::string &job);
+    void read(const std::string &job, struct mic_energy_info *info);
+    void end(const std::string &job, struct mic_energy_info *info);
+
+private:
+    mic_energy_meter(const mic_energy_meter &);
+    mic_energy_meter &operator=(const mic_energy_meter &);
+
+    struct job {
+        uint64_t begin_ns;
+        double   energy_uj;
+        uint64_t unmeasured_ns;
+        uint32_t peak_uw;
+        uint32_t out_of_range;
+    };
+
+    void drain();
+    void integrate(const struct power_sample &s);
+    void report(const struct job &j, struct mic_energy_info *info) const;
+
+    struct mic_power_sampler _sampler;
+    pthread_mutex_t _mutex;
+    bool _have_last;
+    struct power_sample _last;
+    std::map<std::string, struct job> _jobs;
+};
+
+#endif /* MICLIB_SRC_ENERGY_H_ */
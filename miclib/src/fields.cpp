@@ -0,0 +1,208 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file fields.cpp
+
+#include <stddef.h>
+#include <string.h>
+#include "miclib_exception.h"
+#include "miclib_int.h"
+#include "host_platform.h"
+
+namespace {
+
+/* Marks a field that has no sensor status byte */
+const size_t NO_STATUS = (size_t)-1;
+
+struct snapshot_field {
+    const char *name;
+    const char *unit;
+    uint32_t    feature;
+    size_t      offset;         /* Of the value in struct mic_snapshot */
+    size_t      size;           /* Of the value, in bytes */
+    size_t      status;         /* Of the SMC sensor status, or NO_STATUS */
+};
+
+#define SNAP_SIZE(member)    sizeof(((struct mic_snapshot *)0)->member)
+
+#define FIELD(name, unit, feature, member)                  \
+    { name, unit, feature, offsetof(struct mic_snapshot, member), \
+      SNAP_SIZE(member), NO_STATUS }
+
+#define SENSOR(name, unit, feature, member, status)         \
+    { name, unit, feature, offsetof(struct mic_snapshot, member), \
+      SNAP_SIZE(member), offsetof(struct mic_snapshot, status) }
+
+#define TEMP(name, sensor)                                  \
+    SENSOR("thermal." name, "C", MIC_COLLECT_THERMAL,       \
+           thermal.temp.sensor.cur, thermal.temp.sensor.c_val)
+
+#define POWER(name, sensor)                                 \
+    SENSOR("power." name, "uW", MIC_COLLECT_POWER,          \
+           power.pwr.sensor.prr, power.pwr.sensor.p_val)
+
+#define RAIL(name, sensor)                                  \
+    SENSOR("power." name "_power", "uW", MIC_COLLECT_POWER, \
+           power.pwr.sensor.pwr, power.pwr.sensor.p_val),   \
+    SENSOR("power." name "_current", "uA", MIC_COLLECT_POWER, \
+           power.pwr.sensor.cur, power.pwr.sensor.c_val),   \
+    SENSOR("power." name "_voltage", "uV", MIC_COLLECT_POWER, \
+           power.pwr.sensor.volt, power.pwr.sensor.v_val)
+
+/*
+ * Every scalar a snapshot holds, grouped by feature. Consumers that store
+ * or exchange values refer to fields by name, so entries may be added
+ * anywhere, but a name must never change meaning or unit.
+ */
+const struct snapshot_field FIELDS[] = {
+    TEMP("die_temp", die),
+    TEMP("gddr_temp", gddr),
+    TEMP("fanin_temp", fin),
+    TEMP("fanout_temp", fout),
+    TEMP("vccp_temp", vccp),
+    TEMP("vddg_temp", vddg),
+    TEMP("vddq_temp", vddq),
+    FIELD("thermal.fan_rpm", "rpm", MIC_COLLECT_THERMAL, thermal.fan_rpm),
+    FIELD("thermal.fan_pwm", "%", MIC_COLLECT_THERMAL, thermal.fan_pwm),
+    POWER("total0_power", tot0),
+    POWER("total1_power", tot1),
+    POWER("inst_power", inst),
+    POWER("max_inst_power", imax),
+    POWER("pcie_power", pcie),
+    POWER("c2x3_power", c2x3),
+    POWER("c2x4_power", c2x4),
+    RAIL("vccp", vccp),
+    RAIL("vddg", vddg),
+    RAIL("vddq", vddq),
+    FIELD("memory.total", "kB", MIC_COLLECT_MEMORY, memory.mem.total),
+    FIELD("memory.free", "kB", MIC_COLLECT_MEMORY, memory.mem.free),
+    FIELD("memory.buffers", "kB", MIC_COLLECT_MEMORY, memory.mem.bufs),
+    FIELD("core_util.user", "jiffies", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.sum.user),
+    FIELD("core_util.nice", "jiffies", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.sum.nice),
+    FIELD("core_util.sys", "jiffies", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.sum.sys),
+    FIELD("core_util.idle", "jiffies", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.sum.idle),
+    FIELD("core_util.jiffies", "jiffies", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.jif),
+    FIELD("core_util.cores", "", MIC_COLLECT_CORE_UTIL, cutil.c_util.core),
+    FIELD("core_util.threads_core", "", MIC_COLLECT_CORE_UTIL,
+          cutil.c_util.thr),
+};
+
+const uint32_t NFIELDS = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+const struct snapshot_field &field_at(uint32_t field)
+{
+    if (field >= NFIELDS)
+        throw mic_exception(E_MIC_RANGE, "Incorrect snapshot field", ERANGE);
+
+    return FIELDS[field];
+}
+
+uint64_t load(const char *p, size_t size)
+{
+    switch (size) {
+    case sizeof(uint8_t):
+        return *(const uint8_t *)p;
+    case sizeof(uint16_t):
+        return *(const uint16_t *)p;
+    case sizeof(uint32_t):
+        return *(const uint32_t *)p;
+    default:
+        return *(const uint64_t *)p;
+    }
+}
+
+}
+
+uint32_t snapshot_nfields()
+{
+    return NFIELDS;
+}
+
+void snapshot_field_info(uint32_t field, const char **name, const char **unit,
+                         uint32_t *feature)
+{
+    const struct snapshot_field &f = field_at(field);
+
+    if (name != NULL)
+        *name = f.name;
+    if (unit != NULL)
+        *unit = f.unit;
+    if (feature != NULL)
+        *feature = f.feature;
+}
+
+uint32_t snapshot_find_field(const char *name)
+{
+    for (uint32_t i = 0; i < NFIELDS; i++) {
+        if (strcmp(FIELDS[i].name, name) == 0)
+            return i;
+    }
+
+    throw mic_exception(E_MIC_NOENT, "Unknown snapshot field", ENOENT);
+}
+
+/*
+ * Returns a status rather than throwing, as the subscribers and the
+ * recorder walk every field of every snapshot and most are usually absent.
+ */
+int snapshot_field_value(const struct mic_snapshot *snap, uint32_t field,
+                         int64_t *value) throw()
+{
+    if (field >= NFIELDS)
+        return mic_exception::ts_set_error(E_MIC_RANGE, ERANGE, 0,
+                                           "Incorrect snapshot field");
+
+    const struct snapshot_field &f = FIELDS[field];
+    const char *base = (const char *)snap;
+
+    if ((snap->features & f.feature) == 0)
+        return mic_exception::ts_set_error(E_MIC_NOENT, ENOENT, 0,
+                                           "feature not in snapshot");
+
+    if ((f.status != NO_STATUS) &&
+        ((base[f.status] & host_platform::SMC_SENSOR_UNAVAILABLE) ==
+         host_platform::SMC_SENSOR_UNAVAILABLE))
+        return mic_exception::ts_set_error(E_MIC_NOENT, ENOENT, 0,
+                                           "sensor unavailable");
+
+    *value = (int64_t)load(base + f.offset, f.size);
+    return E_MIC_SUCCESS;
+}
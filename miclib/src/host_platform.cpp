@@ -33,11 +33,15 @@
  * intellectual property rights is granted herein.
  */
 
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <new>
 #include <algorithm>
 
 #include "host_platform.h"
+#include "scif_actor.h"
 #include "ut_instr_event.h"
 
 using namespace std;
@@ -57,6 +61,12 @@ const size_t PCI_CTRL_CAP_OFFS = 0x54;
 const size_t PCI_CTRL_CAP_SIZE = 2;
 };
 
+/* Reads a little endian 16 bit register out of PCI config space */
+static uint16_t config_u16(const char *config, size_t offs)
+{
+    return (uint8_t)config[offs] | ((uint8_t)config[offs + 1] << 8);
+}
+
 /* states and modes */
 const char *host_platform::STATE_ONLINE = "online";
 const char *host_platform::MODE_FLASH = "flash";
@@ -99,22 +109,51 @@ const std::string host_platform::KNC_IDENTIFIER = "x100";
 
 static const int SCIF_LISTEN_PORT = 100;
 
+/* A read request some thread is running on behalf of any other thread
+ * that asks for the same thing meanwhile */
+struct scif_flight {
+    struct scif_flight *next;
+    int cmd;
+    uint32_t parm;
+    size_t size;
+    void *buf;
+    int waiters;
+    bool done;
+    int ret;
+    struct mic_exception::error_record err;
+};
+
 host_platform::host_platform(uint32_t devid, bool init_scif)
     : _devid(devid),
     _scif_ep(0),
     _scif_inited(false),
     _scif_errno(0),
-    _scif_mic_errno(0)
+    _scif_mic_errno(0),
+    _actor(NULL),
+    _flights(NULL)
 
 {
     if (pthread_mutex_init(&_mutex, NULL) != 0)
         throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
 
+    if (pthread_mutex_init(&_flight_mutex, NULL) != 0) {
+        pthread_mutex_destroy(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
+    }
+
+    if (pthread_cond_init(&_flight_cond, NULL) != 0) {
+        pthread_mutex_destroy(&_flight_mutex);
+        pthread_mutex_destroy(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_cond_init");
+    }
+
     (void) init_scif;
 }
 
 host_platform::~host_platform()
 {
+    delete _actor;
+
     if (_scif_inited)
         scif_close(_scif_ep);
 
@@ -124,18 +163,18 @@ host_platform::~host_platform()
     if (pthread_mutex_destroy(&_mutex) == 0) {
     }
     ;
+    (void)pthread_cond_destroy(&_flight_cond);
+    (void)pthread_mutex_destroy(&_flight_mutex);
 }
 
-void host_platform::get_devices(struct mic_devices_list *device_list,
-                                uint16_t n_allocated)
+void host_platform::get_devices(std::vector<int> &devices)
 {
-    ASSERT(device_list != NULL && "list of devices cannot be null");
-    ASSERT(n_allocated != 0 && "number of alloc'ed devices cannot be 0");
     DIR *dir = NULL;
     struct dirent *entry = NULL;
-    uint16_t count = 0;
     std::string sysfs_path = get_sysfs_base_path();
 
+    devices.clear();
+
     if ((dir = opendir(MIC_MODULE.c_str())) == NULL)
         throw mic_exception(E_MIC_DRIVER_NOT_LOADED, "host driver is not loaded");
     else if (closedir(dir) < 0)
@@ -146,29 +185,22 @@ void host_platform::get_devices(struct mic_devices_list *device_list,
 
     errno = 0;
     while ((entry = readdir(dir)) != NULL) {
-        string dirname = entry->d_name;
-        size_t idx;
-        int temp;
-
-        idx = dirname.find(KSYSFS_DEVICE_PREFIX, 0);
+        size_t plen = strlen(KSYSFS_DEVICE_PREFIX);
+        const char *num = entry->d_name + plen;
+        const char *end = num + strlen(num);
+        uint64_t temp;
 
-        if (idx != 0)
+        if (strncmp(entry->d_name, KSYSFS_DEVICE_PREFIX, plen) != 0)
             continue;
 
-        idx += strlen(KSYSFS_DEVICE_PREFIX);
-
-        std::stringstream ss(dirname.substr(idx));
-
         /* If true, we found, for example, /sys/class/mic/mice. */
-        if ((ss >> temp).fail()) {
+        if (parse_uint(num, end, 10, &temp) != end || temp > INT_MAX) {
+            (void)closedir(dir);
             throw mic_exception(E_MIC_STACK, sysfs_path +
-                      ": malformed entry: " + dirname, ECANCELED);
+                      ": malformed entry: " + entry->d_name, ECANCELED);
         }
 
-        if (count < n_allocated)
-            device_list->devices[count] = temp;
-
-        count++;
+        devices.push_back(temp);
     }
 
     /* readdir returned NULL - make sure that it's an EOF condition,
@@ -186,9 +218,7 @@ void host_platform::get_devices(struct mic_devices_list *device_list,
     if (closedir(dir) < 0)
         throw mic_exception(E_MIC_SYSTEM, "closedir: " + sysfs_path);
 
-    sort(device_list->devices,
-         device_list->devices + (count < n_allocated ? count : n_allocated));
-    device_list->n_devices = count;
+    sort(devices.begin(), devices.end());
 }
 
 std::string host_platform::get_sysfs_device_path() const
@@ -280,33 +310,38 @@ void host_platform::read_property(string const &filepath, string &strval)
     strval = string(buf, ret);
 }
 
-void host_platform::read_property_token(string const &filepath,
-                                        string &token, string &strval)
+size_t host_platform::read_device_attr(const char *attr, char *buf,
+                                       size_t size) const
 {
-    FILE *fd = NULL;
-    char buf[NAME_MAX];
-    bool found = false;
-
-    if ((fd = fopen(filepath.c_str(), "r")) == NULL)
-        throw mic_exception(E_MIC_STACK, "fopen: " + filepath);
-
-    while (fgets(buf, sizeof(buf), fd) != NULL) {
-        if (strncmp(buf, token.c_str(), token.length()) == 0) {
-            found = true;
-            break;
-        }
+    char path[PATH_MAX];
+    ssize_t len;
+    char *nl;
+
+    snprintf(path, sizeof(path), "%s/mic%u/%s", SYSFS_DEVICE_PATH.c_str(),
+             _devid, attr);
+    if ((len = sysfs_read(path, buf, size)) < 0)
+        throw mic_exception(E_MIC_STACK, std::string("read: ") + path);
+
+    if ((nl = (char *)memchr(buf, '\n', len)) != NULL) {
+        *nl = '\0';
+        len = nl - buf;
     }
 
-    if (found == false) {
-        fclose(fd);
-        throw mic_exception(E_MIC_STACK,
-                            "read: " + filepath + ":" + token);
-    }
+    return len;
+}
 
-    if (fclose(fd) < 0)
-        throw mic_exception(E_MIC_STACK, "close: " + filepath);
+uint64_t host_platform::get_device_property_uint(const char *property,
+                                                 int base) const
+{
+    char buf[NAME_MAX];
+    size_t len = read_device_attr(property, buf, sizeof(buf));
+    uint64_t value;
+
+    if (parse_uint(buf, buf + len, base, &value) == NULL)
+        throw mic_exception(E_MIC_STACK, "malformed file: " +
+                            get_sysfs_attr_path(property), EINVAL);
 
-    strval = string(buf, strlen(buf) + 1);
+    return value;
 }
 
 std::string host_platform::get_device_property(string const &property)
@@ -324,7 +359,10 @@ std::string host_platform::get_device_property(string const &property)
         read_postcode_property(get_sysfs_attr_path(property), output);
     }
     else {
-        read_property(get_sysfs_attr_path(property), output);
+        char buf[NAME_MAX];
+        size_t len = read_device_attr(property.c_str(), buf, sizeof(buf));
+
+        return std::string(buf, len);
     }
 
     idx = output.find("\n", 0);
@@ -360,114 +398,82 @@ void host_platform::set_device_property(string const &property,
 
 void host_platform::get_pci_config(struct mic_pci_config &pci_config)
 {
-    std::string dirname;
-    string config_info, comp;
-    string pci_str;
+    char path[PATH_MAX];
+    char uevent[UEVENT_MAX];
+    char config_info[NAME_MAX];
+    const char *val, *end;
+    ssize_t len;
+    size_t vlen;
+    uint64_t domain, bus_no, device_no;
     uint16_t control_cap = 0;
     uint16_t link_stat = 0;
-    uint32_t dindx = 0, sindx = 0, eindx = 0;
-    string token;
 
     pci_config.access_violation = 0;
-    dirname = get_sysfs_device_path();
-    dirname += "/device";
     pci_config.domain_info_implemented = 1;
-    token = "PCI_CLASS";
-    read_property_token(dirname + "/uevent", token, comp);
-    if (comp.length() > 0) {
-        /* get busno, deviceno */
-        sindx = comp.find("=");
-        if (sindx > 0) {
-            pci_str = comp.substr(++sindx);
-            size_t terminator = pci_str.find_first_of(" \t\n\f\v\r");
-            if(terminator != std::string::npos)
-                pci_str.erase(terminator);
-            strncpy(pci_config.class_code, pci_str.c_str(), NAME_MAX);
-            pci_config.class_code[NAME_MAX] = '\0';
-        }
-    }
-    token = "PCI_SLOT_NAME";
-    read_property_token(dirname + "/uevent", token, comp);
-    /* get domain, busno, deviceno */
-    dindx = 0; sindx = 0; eindx = 0;
-    dindx = comp.find("=");
-    sindx = comp.find(":", ++dindx);
-    eindx = comp.find(":", ++sindx);
-    if (sindx > dindx) {
-        pci_str = comp.substr(dindx, (sindx - dindx));
-        errno = 0;
-        pci_config.domain = strtol(pci_str.c_str(), NULL, 16);
-        if (errno) {
-            throw mic_exception(E_MIC_SYSTEM,
-                                comp + ": domain not found",
-                                EINVAL);
-        }
-    }
-    if (eindx > sindx) {
-        pci_str = comp.substr(sindx, (eindx - sindx));
-        errno = 0;
-        pci_config.bus_no = strtol(pci_str.c_str(), NULL, 16);
-        if (errno) {
-            throw mic_exception(E_MIC_SYSTEM,
-                                comp + ": bus number not found",
-                                EINVAL);
-        }
-        /* device_no */
-        sindx = eindx + 1;
-        eindx = comp.find(".");
-        if (eindx > sindx) {
-            pci_str = comp.substr(sindx, (eindx - sindx));
-            errno = 0;
-            pci_config.device_no =
-                strtol(pci_str.c_str(), NULL, 16);
-            if (errno) {
-                throw mic_exception(
-                          E_MIC_SYSTEM,
-                          comp +
-                          ": device number not found",
-                          EINVAL);
-            }
-        }
-    }
-    read_property(dirname + "/config", config_info);
-    pci_config.vendor_id = *(reinterpret_cast < const uint16_t *>
-                             (&config_info.c_str()[pciconfig::
-                                                   VENDOR_ID_OFFS]));
-    pci_config.device_id = *(reinterpret_cast < const uint16_t *>
-                             (&config_info.c_str()[pciconfig::
-                                                   DEVICE_ID_OFFS]));
-    pci_config.revision_id = *(reinterpret_cast <const uint8_t *>
-                               (&config_info.c_str()[pciconfig::
-                                                     REVISION_ID_OFFS]));
-    pci_config.subsystem_id = *(reinterpret_cast <const uint16_t *>
-                                (&config_info.c_str()[pciconfig::
-                                                      SUBSYSTEM_ID_OFFS]));
-
-    if (config_info.length() >= pciconfig::PCI_LINK_STATS_OFFS + 2) {
-        link_stat = *(reinterpret_cast <const uint16_t *>
-                      (&config_info.
-                       c_str()[pciconfig::PCI_LINK_STATS_OFFS]));
+
+    /* One read of uevent serves every key we look up */
+    snprintf(path, sizeof(path), "%s/mic%u/device/uevent",
+             SYSFS_DEVICE_PATH.c_str(), _devid);
+    if ((len = sysfs_read(path, uevent, sizeof(uevent))) < 0)
+        throw mic_exception(E_MIC_STACK, std::string("open: ") + path);
+
+    if ((val = uevent_find(uevent, len, "PCI_CLASS", &vlen)) == NULL)
+        throw mic_exception(E_MIC_STACK,
+                            std::string("read: ") + path + ":PCI_CLASS");
+    for (end = val; end < val + vlen && !isspace(*end); end++)
+        ;
+    vlen = end - val;
+    if (vlen > NAME_MAX)
+        vlen = NAME_MAX;
+    memcpy(pci_config.class_code, val, vlen);
+    pci_config.class_code[vlen] = '\0';
+
+    /* PCI_SLOT_NAME=<domain>:<bus>:<device>.<function> */
+    if ((val = uevent_find(uevent, len, "PCI_SLOT_NAME", &vlen)) == NULL)
+        throw mic_exception(E_MIC_STACK,
+                            std::string("read: ") + path + ":PCI_SLOT_NAME");
+    end = val + vlen;
+    val = parse_uint(val, end, 16, &domain);
+    if (val == NULL || val == end || *val != ':')
+        throw mic_exception(E_MIC_SYSTEM, std::string(path) +
+                            ": domain not found", EINVAL);
+    val = parse_uint(val + 1, end, 16, &bus_no);
+    if (val == NULL || val == end || *val != ':')
+        throw mic_exception(E_MIC_SYSTEM, std::string(path) +
+                            ": bus number not found", EINVAL);
+    val = parse_uint(val + 1, end, 16, &device_no);
+    if (val == NULL || val == end || *val != '.')
+        throw mic_exception(E_MIC_SYSTEM, std::string(path) +
+                            ": device number not found", EINVAL);
+    pci_config.domain = domain;
+    pci_config.bus_no = bus_no;
+    pci_config.device_no = device_no;
+
+    snprintf(path, sizeof(path), "%s/mic%u/device/config",
+             SYSFS_DEVICE_PATH.c_str(), _devid);
+    memset(config_info, 0, sizeof(config_info));
+    if ((len = sysfs_read(path, config_info, sizeof(config_info))) < 0)
+        throw mic_exception(E_MIC_STACK, std::string("read: ") + path);
+
+    pci_config.vendor_id = config_u16(config_info, pciconfig::VENDOR_ID_OFFS);
+    pci_config.device_id = config_u16(config_info, pciconfig::DEVICE_ID_OFFS);
+    pci_config.revision_id =
+        (uint8_t)config_info[pciconfig::REVISION_ID_OFFS];
+    pci_config.subsystem_id = config_u16(config_info,
+                                         pciconfig::SUBSYSTEM_ID_OFFS);
+
+    if ((size_t)len >= pciconfig::PCI_LINK_STATS_OFFS + 2) {
+        link_stat = config_u16(config_info, pciconfig::PCI_LINK_STATS_OFFS);
         pci_config.link_speed = link_stat & 0xf;
-        link_stat = *(reinterpret_cast <const uint16_t *>(&config_info.
-                                                          c_str()[
-                                                              pciconfig
-                                                              ::
-                                                              PCI_LINK_STATS_OFFS
-                                                          ]));
         pci_config.link_width = ((link_stat >> 4) & 0x3f);
     }
-    if (config_info.length() >= pciconfig::PCI_CTRL_CAP_OFFS + 2) {
+    if ((size_t)len >= pciconfig::PCI_CTRL_CAP_OFFS + 2) {
+        control_cap = config_u16(config_info, pciconfig::PCI_CTRL_CAP_OFFS);
+
         /* max payload size */
-        control_cap = *(reinterpret_cast <const uint16_t *>
-                        (&config_info.c_str()[pciconfig::
-                                              PCI_CTRL_CAP_OFFS]));
-        control_cap &= 0xe0;
-        pci_config.payload_size = 128 * (1 << (control_cap >> 5));
+        pci_config.payload_size = 128 * (1 << ((control_cap & 0xe0) >> 5));
 
         /* Read req size */
-        control_cap = *(reinterpret_cast <const uint16_t *>
-                        (&config_info.c_str()[pciconfig::
-                                              PCI_CTRL_CAP_OFFS]));
         control_cap &= 0x7000;
         pci_config.read_req_size = 128 * (1 << (control_cap >> 12));
     }
@@ -476,6 +482,16 @@ void host_platform::get_pci_config(struct mic_pci_config &pci_config)
 }
 
 int host_platform::scif_open_conn()
+{
+    int ret = scif_open_status();
+
+    if (ret != E_MIC_SUCCESS)
+        throw mic_exception((mic_error_code)ret);
+
+    return 0;
+}
+
+int host_platform::scif_open_status() throw()
 {
     scif_epd_t ep = -1;
     struct scif_portID peer = { 0, 0 };
@@ -486,7 +502,8 @@ int host_platform::scif_open_conn()
     if (ep < 0) {
         UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_CONN_0",
                             (scif_close(ep), errno = EIO));
-        throw mic_exception(E_MIC_SCIF_ERROR, "scif_open failed", errno);
+        return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, errno, 0,
+                                           "scif_open failed");
     }
 
     if (geteuid() == 0) {
@@ -502,8 +519,10 @@ int host_platform::scif_open_conn()
     } else {
         port = scif_bind(ep, 0);
         if (port < 0) {
+            error_t saved_errno = errno;
             (void)scif_close(ep);
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif_bind failed", errno);
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, saved_errno,
+                                               0, "scif_bind failed");
         }
     }
 
@@ -515,197 +534,303 @@ int host_platform::scif_open_conn()
         (void)scif_close(ep);
 
         if (saved_errno == ECONNREFUSED)
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif connection refused",
-                                saved_errno);
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, saved_errno,
+                                               0, "scif connection refused");
         else
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif_connect failed",
-                                saved_errno);
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, saved_errno,
+                                               0, "scif_connect failed");
     }
 
     _scif_inited = true;
     _scif_ep = ep;
 
-    return 0;
+    return E_MIC_SUCCESS;
 }
 
 void host_platform::scif_request(int req_id, void *resp_buf,
                                  size_t resp_size, uint32_t parm)
+{
+    int ret = scif_request_status(req_id, resp_buf, resp_size, parm);
+
+    if (ret != E_MIC_SUCCESS)
+        throw mic_exception((mic_error_code)ret);
+}
+
+int host_platform::scif_request_status(int req_id, void *resp_buf,
+                                       size_t resp_size,
+                                       uint32_t parm) throw()
 {
     ASSERT(resp_buf != NULL && "resp_buff cannot be null");
-    struct mr_hdr init_buf = { 0, 0, 0, 0, 0 };
-    struct mr_hdr ack_buf = { 0, 0, 0, 0, 0 };
+
+    mic_exception::ts_clear_ras_errno();
+
+    if (_actor != NULL)
+        return _actor->request(req_id, resp_buf, resp_size, parm);
+
+    if (scif_actor::is_read(req_id))
+        return scif_request_shared(req_id, resp_buf, resp_size, parm);
+
+    return scif_request_locked(req_id, resp_buf, resp_size, parm);
+}
+
+int host_platform::scif_request_locked(int req_id, void *resp_buf,
+                                       size_t resp_size,
+                                       uint32_t parm) throw()
+{
     int ret;
-    int n;
-    void *msg;
 
     /* Serialize SCIF requests. */
     if (pthread_mutex_lock(&_mutex) != 0)
-        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+        return mic_exception::ts_set_error(E_MIC_SYSTEM, 0, 0,
+                                           "pthread_mutex_lock");
 
-    mic_exception::ts_clear_ras_errno();
+    ret = scif_execute(this, req_id, resp_buf, resp_size, parm);
 
-    try {
-        std::stringstream ss;
+    (void)pthread_mutex_unlock(&_mutex);
 
-        if (!_scif_inited) {
-            scif_open_conn();
-        }
+    return ret;
+}
 
-        init_buf.cmd = req_id;
-        init_buf.len = 0;
-        init_buf.parm = parm;
-        init_buf.stamp = 0;
-        init_buf.spent = 0;
+/*
+ * Joins an identical read that another thread has in flight, waiting for
+ * its answer instead of queueing on _mutex for a round trip of its own.
+ * Otherwise runs the request and hands its answer to the threads that
+ * joined it meanwhile. The leader's buffer is shared, so it only returns
+ * once every follower has copied the answer out.
+ */
+int host_platform::scif_request_shared(int req_id, void *resp_buf,
+                                       size_t resp_size,
+                                       uint32_t parm) throw()
+{
+    struct scif_flight self;
+    struct scif_flight *f;
+    struct scif_flight **link;
+    int ret;
 
-        /* send the request */
-        n = sizeof(init_buf);
-        msg = (void *)&init_buf;
-        while (n > 0) {
-            ret = scif_send(_scif_ep, msg, n, SCIF_SEND_BLOCK);
-            UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_0",
-                                (ret = -1, errno = EIO));
-            /* Re-establish the connection if the
-             *  connection was reset by peer (ECONNRESET) */
-            if (ret < 0 && errno == ECONNRESET) {
-                try {
-                    scif_open_conn();
-                    ret = scif_send(_scif_ep, msg, n, SCIF_SEND_BLOCK);
-                } catch (mic_exception const &e) {
-                    ret = -1;
-                }
-            }
-            if (ret < 0) {
-                ss << "scif_send: cmd 0x" << std::hex
-                   << req_id << ": Len 0x" << std::hex <<
-                    sizeof(init_buf);
-                throw mic_exception(E_MIC_SCIF_ERROR, ss.str());
-            }
-            msg = (void *)((char *)msg + ret);
-            n -= ret;
-        }
+    if (pthread_mutex_lock(&_flight_mutex) != 0)
+        return scif_request_locked(req_id, resp_buf, resp_size, parm);
 
-        UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_1", n = -1);
-        if (n < 0) {
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif_send: "
-                                "Internal error", EPROTO);
-        }
+    for (f = _flights; f != NULL; f = f->next) {
+        if ((f->cmd == req_id) && (f->parm == parm) &&
+            (f->size == resp_size))
+            break;
+    }
 
-        /* receive response of request. e.g. was it a valid request? */
-        n = sizeof(ack_buf);
-        msg = (void *)&ack_buf;
-        while (n > 0) {
-            ret = scif_recv(_scif_ep, msg, n, SCIF_RECV_BLOCK);
-            UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_2",
-                                (ret = -1, errno = EIO));
-            if (ret < 0) {
-                ss << "scif_recv: cmd 0x" << std::hex <<
-                    req_id << ": Len 0x" << std::hex <<
-                    sizeof(init_buf);
-
-                throw mic_exception(E_MIC_SCIF_ERROR, ss.str());
-            }
-            msg = (void *)((char *)msg + ret);
-            n -= ret;
-        }
+    if (f != NULL) {
+        struct mic_exception::error_record err;
 
-        UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_3", n = -1);
-        if (n < 0) {
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif_recv "
-                                "(header): Internal error", EPROTO);
-        }
+        f->waiters++;
+        while (!f->done)
+            (void)pthread_cond_wait(&_flight_cond, &_flight_mutex);
 
-        if (ack_buf.cmd & MR_ERROR) {
-            if ((ack_buf.cmd & MR_OP_MASK) != req_id) {
-                ss << "scif_recv: Unexpected opcode 0x" <<
-                    std::hex <<
-                    (ack_buf.cmd & MR_OP_MASK) <<
-                    ": Expected 0x" << std::hex << req_id;
-                throw mic_exception(E_MIC_SCIF_ERROR,
-                                    ss.str(), EPROTO);
-            }
+        ret = f->ret;
+        if (ret == E_MIC_SUCCESS)
+            memcpy(resp_buf, f->buf, resp_size);
+        else
+            err = f->err;
 
-            if (ack_buf.len == sizeof(struct mr_err)) {
-                struct mr_err me;
-
-                n = sizeof(me);
-                msg = (void *)&me;
-                while (n > 0) {
-                    ret = scif_recv(_scif_ep, msg, n,
-                                    SCIF_RECV_BLOCK);
-                    if (ret < 0) {
-                        ss << "scif_recv: cmd 0x" <<
-                            std::hex << req_id <<
-                            ": Failed error record: "
-                           << "Len 0x" << std::hex <<
-                            sizeof(me);
-                        throw mic_exception(
-                                  E_MIC_SCIF_ERROR,
-                                  ss.str());
-                    }
-                    msg = (void *)((char *)msg + ret);
-                    n -= ret;
-                }
-                ss << "RAS: cmd 0x" << std::hex
-                   << req_id << ": Error 0x" << std::hex << me.err
-                   << ": " << mic_exception::ras_strerror(me.err);
-                throw mic_exception(E_MIC_RAS_ERROR, ss.str(), 0, me.err);
-            } else {
-                ss << "scif_recv: cmd 0x" << std::hex
-                   << req_id << ": Unknown error: Len 0x"
-                   << std::hex << req_id;
-
-                throw mic_exception(E_MIC_SCIF_ERROR, ss.str(),
-                                    EPROTO);
-            }
-        }
+        if (--f->waiters == 0)
+            (void)pthread_cond_broadcast(&_flight_cond);
+        (void)pthread_mutex_unlock(&_flight_mutex);
 
-        if (ack_buf.len != resp_size) {
-            ss << "scif_recv: cmd 0x" << std::hex << req_id <<
-                ": Response payload len 0x" << std::hex <<
-                ack_buf.len << ": Expected 0x" << std::hex << resp_size;
+        if (ret != E_MIC_SUCCESS)
+            return mic_exception::ts_restore_error(&err);
+        return E_MIC_SUCCESS;
+    }
 
-            throw mic_exception(E_MIC_SCIF_ERROR, ss.str(),
-                                EPROTO);
-        }
+    self.cmd = req_id;
+    self.parm = parm;
+    self.size = resp_size;
+    self.buf = resp_buf;
+    self.waiters = 0;
+    self.done = false;
+    self.next = _flights;
+    _flights = &self;
+    (void)pthread_mutex_unlock(&_flight_mutex);
+
+    ret = scif_request_locked(req_id, resp_buf, resp_size, parm);
+
+    (void)pthread_mutex_lock(&_flight_mutex);
+    self.ret = ret;
+    if (ret != E_MIC_SUCCESS)
+        mic_exception::ts_save_error((mic_error_code)ret, &self.err);
+    self.done = true;
+
+    /* Later callers start a flight of their own */
+    for (link = &_flights; *link != &self; link = &(*link)->next)
+        ;
+    *link = self.next;
 
-        /* get the actual data (resp_buf) of the performed request */
-        n = resp_size;
-        msg = resp_buf;
-        while (n > 0) {
-            ret = scif_recv(_scif_ep, resp_buf, resp_size,
-                            SCIF_RECV_BLOCK);
-            if (ret < 0) {
-                ss << "scif_recv: cmd 0x" << std::hex <<
-                    req_id << ": Response failed";
-                throw mic_exception(E_MIC_SCIF_ERROR, ss.str());
-            }
+    if (self.waiters > 0) {
+        (void)pthread_cond_broadcast(&_flight_cond);
+        while (self.waiters > 0)
+            (void)pthread_cond_wait(&_flight_cond, &_flight_mutex);
+    }
+    (void)pthread_mutex_unlock(&_flight_mutex);
 
-            msg = (void *)((char *)msg + ret);
-            n -= ret;
-        }
+    return ret;
+}
 
-        if (n < 0) {
-            throw mic_exception(E_MIC_SCIF_ERROR, "scif_recv "
-                                "(data): Internal error", EPROTO);
-        }
-    } catch (mic_exception const &e) {
-        if (pthread_mutex_unlock(&_mutex) == 0) {
+/*
+ * Runs one request on the endpoint, resetting the connection on a SCIF
+ * failure; the caller either holds _mutex or is the I/O thread.
+ */
+int host_platform::scif_execute(void *arg, int req_id, void *resp_buf,
+                                size_t resp_size, uint32_t parm) throw()
+{
+    host_platform *hp = (host_platform *)arg;
+    int ret;
+
+    if (req_id == scif_actor::CONNECT)
+        return hp->_scif_inited ? E_MIC_SUCCESS : hp->scif_open_status();
+
+    mic_exception::ts_clear_ras_errno();
+
+    ret = hp->scif_transact(req_id, resp_buf, resp_size, parm);
+    if (ret == E_MIC_SCIF_ERROR) {
+        /* Reset SCIF connection. */
+        if (hp->_scif_inited)
+            (void)scif_close(hp->_scif_ep);
+        hp->_scif_inited = false;
+    }
+
+    return ret;
+}
+
+int host_platform::scif_transact(int req_id, void *resp_buf,
+                                 size_t resp_size, uint32_t parm) throw()
+{
+    struct mr_hdr init_buf = { 0, 0, 0, 0, 0 };
+    struct mr_hdr ack_buf = { 0, 0, 0, 0, 0 };
+    int ret;
+    int n;
+    void *msg;
+
+    if (!_scif_inited) {
+        ret = scif_open_status();
+        if (ret != E_MIC_SUCCESS)
+            return ret;
+    }
+
+    init_buf.cmd = req_id;
+    init_buf.len = 0;
+    init_buf.parm = parm;
+    init_buf.stamp = 0;
+    init_buf.spent = 0;
+
+    /* send the request */
+    n = sizeof(init_buf);
+    msg = (void *)&init_buf;
+    while (n > 0) {
+        ret = scif_send(_scif_ep, msg, n, SCIF_SEND_BLOCK);
+        UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_0",
+                            (ret = -1, errno = EIO));
+        /* Re-establish the connection if the
+         *  connection was reset by peer (ECONNRESET) */
+        if (ret < 0 && errno == ECONNRESET) {
+            if (scif_open_status() == E_MIC_SUCCESS)
+                ret = scif_send(_scif_ep, msg, n, SCIF_SEND_BLOCK);
+            else
+                ret = -1;
         }
-        ;
+        if (ret < 0)
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, 0, 0,
+                                               "scif_send: cmd 0x%lx: "
+                                               "Len 0x%lx", req_id,
+                                               sizeof(init_buf));
+        msg = (void *)((char *)msg + ret);
+        n -= ret;
+    }
 
-        if (e.get_mic_errno() == E_MIC_SCIF_ERROR) {
-            /* Reset SCIF connection. */
-            if (_scif_inited)
-                (void)scif_close(_scif_ep);
-            _scif_inited = false;
+    UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_1", n = -1);
+    if (n < 0)
+        return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                           "scif_send: Internal error");
+
+    /* receive response of request. e.g. was it a valid request? */
+    n = sizeof(ack_buf);
+    msg = (void *)&ack_buf;
+    while (n > 0) {
+        ret = scif_recv(_scif_ep, msg, n, SCIF_RECV_BLOCK);
+        UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_2",
+                            (ret = -1, errno = EIO));
+        if (ret < 0)
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, 0, 0,
+                                               "scif_recv: cmd 0x%lx: "
+                                               "Len 0x%lx", req_id,
+                                               sizeof(init_buf));
+        msg = (void *)((char *)msg + ret);
+        n -= ret;
+    }
+
+    UT_INSTRUMENT_EVENT("MICLIB_HOST_PLATFORM_SCIF_REQ_3", n = -1);
+    if (n < 0)
+        return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                           "scif_recv (header): "
+                                           "Internal error");
+
+    if (ack_buf.cmd & MR_ERROR) {
+        if ((ack_buf.cmd & MR_OP_MASK) != (uint32_t)req_id)
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                               "scif_recv: Unexpected "
+                                               "opcode 0x%lx: Expected 0x%lx",
+                                               ack_buf.cmd & MR_OP_MASK,
+                                               req_id);
+
+        if (ack_buf.len != sizeof(struct mr_err))
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                               "scif_recv: cmd 0x%lx: "
+                                               "Unknown error: Len 0x%lx",
+                                               req_id, ack_buf.len);
+
+        struct mr_err me;
+
+        n = sizeof(me);
+        msg = (void *)&me;
+        while (n > 0) {
+            ret = scif_recv(_scif_ep, msg, n, SCIF_RECV_BLOCK);
+            if (ret < 0)
+                return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, 0, 0,
+                                                   "scif_recv: cmd 0x%lx: "
+                                                   "Failed error record: "
+                                                   "Len 0x%lx", req_id,
+                                                   sizeof(me));
+            msg = (void *)((char *)msg + ret);
+            n -= ret;
         }
 
-        throw e;
+        return mic_exception::ts_set_error(E_MIC_RAS_ERROR, 0, me.err,
+                                           "RAS: cmd 0x%lx: Error 0x%lx",
+                                           req_id, me.err);
     }
 
-    if (pthread_mutex_unlock(&_mutex) == 0) {
+    if (ack_buf.len != resp_size)
+        return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                           "scif_recv: cmd 0x%lx: Response "
+                                           "payload len 0x%lx: Expected "
+                                           "0x%lx", req_id, ack_buf.len,
+                                           resp_size);
+
+    /* get the actual data (resp_buf) of the performed request */
+    n = resp_size;
+    msg = resp_buf;
+    while (n > 0) {
+        ret = scif_recv(_scif_ep, msg, n, SCIF_RECV_BLOCK);
+        if (ret < 0)
+            return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, 0, 0,
+                                               "scif_recv: cmd 0x%lx: "
+                                               "Response failed", req_id);
+
+        msg = (void *)((char *)msg + ret);
+        n -= ret;
     }
-    ;
+
+    if (n < 0)
+        return mic_exception::ts_set_error(E_MIC_SCIF_ERROR, EPROTO, 0,
+                                           "scif_recv (data): "
+                                           "Internal error");
+
+    return E_MIC_SUCCESS;
 }
 
 host_flash_op *host_platform::flash_init_fd(void *buf, size_t size,
@@ -789,34 +914,49 @@ std::string host_platform::get_sysfs_attribute(std::string const &attr)
     return get_device_property(attr);
 }
 
-int host_platform::is_ras_avail()
+int host_platform::connect_scif() throw()
 {
-    int ret = 0;
+    int ret;
 
-    if (!_scif_inited) {
-        if (pthread_mutex_lock(&_mutex) != 0)
-            throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+    if (_actor != NULL)
+        return _actor->request(scif_actor::CONNECT, NULL, 0, 0);
 
-        try {
-            scif_open_conn();
-        } catch (mic_exception const &e) {
-            _scif_inited = false;
+    if (pthread_mutex_lock(&_mutex) != 0)
+        return mic_exception::ts_set_error(E_MIC_SYSTEM, 0, 0,
+                                           "pthread_mutex_lock");
 
-            if (pthread_mutex_unlock(&_mutex) == 0) {
-            }
+    ret = scif_execute(this, scif_actor::CONNECT, NULL, 0, 0);
 
-            int err = e.get_sys_errno();
-            if (err == ENODEV || err == ECONNREFUSED)
-                ret = -1;
-            else
-                throw;
-        }
+    (void)pthread_mutex_unlock(&_mutex);
 
-        if (pthread_mutex_unlock(&_mutex) == 0) {
-        }
+    return ret;
+}
+
+void host_platform::start_io_thread()
+{
+    if (_actor == NULL)
+        _actor = new scif_actor(scif_execute, this);
+}
+
+void host_platform::stop_io_thread()
+{
+    delete _actor;
+    _actor = NULL;
+}
+
+int host_platform::is_ras_avail()
+{
+    int ret = 0;
+    int err = connect_scif();
+
+    if (err != E_MIC_SUCCESS) {
+        if (errno == ENODEV || errno == ECONNREFUSED)
+            ret = -1;
+        else
+            throw mic_exception((mic_error_code)err);
     }
 
-    if (_scif_inited) {
+    if (ret == 0) {
         try {
             struct mr_rsp_pver pver;
             scif_request(host_platform::PVER_CMD,
@@ -948,6 +1088,87 @@ void host_platform::flash_get_status(struct host_flash_op *desc,
     status->ext_status = fs.smc_status;
 }
 
+static uint64_t monotonic_ms()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        throw mic_exception(E_MIC_SYSTEM, "clock_gettime");
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool flash_op_in_progress(int flash_status)
+{
+    return (flash_status == FLASH_OP_IN_PROGRESS) ||
+           (flash_status == SMC_OP_IN_PROGRESS);
+}
+
+/*
+ * Wait for a flash operation to leave the in-progress states, or for
+ * timeout_ms to expire (-1 waits forever). Instead of a fixed interval
+ * the next poll is scheduled for when the driver is expected to report
+ * the next percent, based on how long the last one took; the interval
+ * backs off while nothing changes and stays short near completion. The
+ * callback sees every percent and status change, and the timeout is
+ * re-armed when the status changes, e.g. from the flash to the SMC phase.
+ */
+void host_platform::flash_wait(struct host_flash_op *desc, int timeout_ms,
+                               mic_flash_progress_cb callback, void *arg,
+                               struct mic_flash_status_info *status)
+{
+    struct mic_flash_status_info prev;
+    uint64_t interval = FLASH_WAIT_MIN_MS;
+    uint64_t now, deadline, last_change;
+
+    flash_get_status(desc, status);
+    if (callback != NULL)
+        callback(status, arg);
+
+    now = last_change = monotonic_ms();
+    deadline = now + timeout_ms;
+
+    while (flash_op_in_progress(status->flash_status)) {
+        if (timeout_ms >= 0) {
+            if (now >= deadline)
+                return;
+            if (now + interval > deadline)
+                interval = deadline - now;
+        }
+        usleep(interval * 1000);
+
+        prev = *status;
+        flash_get_status(desc, status);
+        now = monotonic_ms();
+
+        if ((status->flash_status == prev.flash_status) &&
+            (status->complete == prev.complete)) {
+            interval *= 2;
+            if (interval > FLASH_WAIT_MAX_MS)
+                interval = FLASH_WAIT_MAX_MS;
+        } else {
+            if (status->flash_status != prev.flash_status) {
+                interval = FLASH_WAIT_MIN_MS;
+                deadline = now + timeout_ms;
+            } else if (status->complete > prev.complete) {
+                interval = (now - last_change) /
+                           (status->complete - prev.complete);
+                if (interval < FLASH_WAIT_MIN_MS)
+                    interval = FLASH_WAIT_MIN_MS;
+                if (interval > FLASH_WAIT_MAX_MS)
+                    interval = FLASH_WAIT_MAX_MS;
+            }
+            last_change = now;
+            if (callback != NULL)
+                callback(status, arg);
+        }
+
+        if ((status->complete >= FLASH_WAIT_TAIL_PERCENT) &&
+            (interval > FLASH_WAIT_TAIL_MS))
+            interval = FLASH_WAIT_TAIL_MS;
+    }
+}
+
 uint32_t host_platform::get_flash_vendor()
 {
 #pragma pack(push, 1)
@@ -53,12 +53,16 @@
 #include <cstddef>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <sstream>
 #include <fstream>
 
 #include "miclib_int.h"
 #include "miclib_exception.h"
 
+class scif_actor;
+struct scif_flight;
+
 struct host_flash_op {
     MIC_FLASH_CMD_TYPE op;
     void *             buf;
@@ -72,8 +76,7 @@ public:
     virtual ~host_platform();
 
     /* class static methods */
-    static void get_devices(struct mic_devices_list *devices, uint16_t
-                            n_allocated);
+    static void get_devices(std::vector<int> &devices);
 
     static std::string get_sysfs_base_path();
     static void set_sysfs_base_path(std::string const &device_path);
@@ -84,6 +87,9 @@ public:
 
     virtual void flash_get_status(struct host_flash_op *desc, struct
                                   mic_flash_status_info *status);
+    virtual void flash_wait(struct host_flash_op *desc, int timeout_ms,
+                            mic_flash_progress_cb callback, void *arg,
+                            struct mic_flash_status_info *status);
     virtual uint32_t get_flash_vendor(void);
     virtual host_flash_op *flash_update_start(void *buf, size_t bufsize);
     virtual void flash_update_done(struct host_flash_op *desc);
@@ -93,6 +99,16 @@ public:
     std::string get_sysfs_attribute(std::string const &attr);
     virtual int is_ras_avail();
 
+    /* connects to the card now rather than on the first request; returns
+     * a mic_error_code */
+    int connect_scif() throw();
+
+    /* hands the SCIF endpoint to a dedicated I/O thread that runs all
+     * requests of this device, or takes it back; must not be called while
+     * other threads use the device */
+    void start_io_thread();
+    void stop_io_thread();
+
     /* static consts, need to be moved to protected */
     static const char *STATE_ONLINE;
     static const char *MODE_FLASH;
@@ -101,6 +117,9 @@ public:
 
     static const int SMC_SENSOR_UNAVAILABLE = 0x3;
 
+    /* uevent files are a handful of short KEY=VALUE lines */
+    static const size_t UEVENT_MAX = 4096;
+
 protected:
     std::string get_sysfs_device_path() const;
     std::string get_sysfs_attr_path(std::string const &attr) const;
@@ -119,10 +138,22 @@ protected:
     virtual void scif_request(int cmd, void *buf, size_t size, uint32_t parm =
                                   0);
     virtual int scif_open_conn();
+
+    /* Same as scif_request() and scif_open_conn(), but report failures as
+     * a mic_error_code instead of throwing; see
+     * mic_exception::ts_set_error() */
+    int scif_request_status(int cmd, void *buf, size_t size,
+                            uint32_t parm = 0) throw();
+    int scif_open_status() throw();
     virtual void read_postcode_property(std::string const &file, std::string &str);
     virtual void read_property(std::string const &file, std::string &str);
-    virtual void read_property_token(std::string const &file,
-                                     std::string &token, std::string &str);
+
+    /* reads a device attribute into a caller supplied buffer, cut at the
+     * first newline, and returns its length */
+    size_t read_device_attr(const char *attr, char *buf, size_t size) const;
+
+    /* parses a numeric device attribute in the given base */
+    uint64_t get_device_property_uint(const char *property, int base) const;
     virtual host_flash_op *flash_init_fd(void *buf, size_t size,
                                          MIC_FLASH_CMD_TYPE op);
     virtual host_flash_op *flash_init_fd(void *buf, size_t size,
@@ -142,6 +173,12 @@ protected:
     int _scif_errno;
     int _scif_mic_errno;
     pthread_mutex_t _mutex;
+    scif_actor *_actor;
+
+    /* identical reads in flight, so that concurrent callers share one */
+    pthread_mutex_t _flight_mutex;
+    pthread_cond_t _flight_cond;
+    struct scif_flight *_flights;
 
     /* static consts */
     static const char *KSYSFS_DEVICE_PREFIX;
@@ -239,7 +276,20 @@ protected:
     static const uint32_t WAIT_TIME_EAGAIN  = 20000;
     static const uint32_t WAIT_COUNT_EAGAIN = 50;
 
+    /* flash_wait() poll interval bounds, in milliseconds */
+    static const uint64_t FLASH_WAIT_MIN_MS = 10;
+    static const uint64_t FLASH_WAIT_MAX_MS = 1000;
+    static const uint64_t FLASH_WAIT_TAIL_MS = 50;
+    static const uint32_t FLASH_WAIT_TAIL_PERCENT = 95;
+
 private:
+    int scif_transact(int cmd, void *buf, size_t size, uint32_t parm) throw();
+    static int scif_execute(void *arg, int cmd, void *buf, size_t size,
+                            uint32_t parm) throw();
+    int scif_request_locked(int cmd, void *buf, size_t size,
+                            uint32_t parm) throw();
+    int scif_request_shared(int cmd, void *buf, size_t size,
+                            uint32_t parm) throw();
 
     host_platform(host_platform const &);
     host_platform &operator=(host_platform const &);
@@ -35,8 +35,11 @@
 
 #include <sstream>
 #include <string>
+#include <time.h>
+#include <unistd.h>
 
 #include "knc_device.h"
+#include "scif_actor.h"
 
 const static size_t KNC_FLASH_SIZE = 0x200000;
 const static size_t KNC_FLASH_CSS_HEADER_OFFSET = 0x28000;
@@ -52,12 +55,83 @@ const union smc_fw_ver knc_device::SMC_BOOT_LOADER_VER_SUPPORT =
 #else
 const union smc_fw_ver knc_device::SMC_BOOT_LOADER_VER_SUPPORT = { 0x901 };
 #endif
-knc_device::knc_device(uint32_t id) : mic_device(id)
+static void throw_on_error(int ret)
+{
+    if (ret != E_MIC_SUCCESS)
+        throw mic_exception((mic_error_code)ret);
+}
+
+static uint64_t monotonic_ms()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        throw mic_exception(E_MIC_SYSTEM, "clock_gettime", errno);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+namespace {
+
+class mutex_lock {
+public:
+    explicit mutex_lock(pthread_mutex_t *m) : _m(m)
+    {
+        if (pthread_mutex_lock(_m) != 0)
+            throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+    }
+    ~mutex_lock()
+    {
+        pthread_mutex_unlock(_m);
+    }
+
+private:
+    pthread_mutex_t *_m;
+};
+
+uint64_t cache_key(int cmd, uint32_t parm)
+{
+    return ((uint64_t)cmd << 32) | parm;
+}
+
+/* Per thread and feature, the age of the oldest response served since the
+ * thread last asked get_cache_age(); only the device last queried for the
+ * feature is tracked */
+struct served_age {
+    const knc_device *device;
+    uint64_t age_ms;
+};
+
+__thread struct served_age served[MIC_CACHE_NFEATURES];
+
+void note_served(const knc_device *device, int feature, uint64_t age_ms)
+{
+    struct served_age &s = served[feature];
+
+    if (s.device != device) {
+        s.device = device;
+        s.age_ms = age_ms;
+    } else if (age_ms > s.age_ms) {
+        s.age_ms = age_ms;
+    }
+}
+
+}
+
+knc_device::knc_device(uint32_t id) : mic_device(id),
+    _turbo_pending(false), _turbo_mode(0),
+    _turbo_timeout_ms(TURBO_TIMEOUT_MS), _cache_generation(0)
 {
     std::stringstream ss;
 
     ss << "mic" << id;
     _name = ss.str();
+
+    for (int i = 0; i < MIC_CACHE_NFEATURES; i++)
+        _cache_ttl_ms[i] = 0;
+
+    if (pthread_mutex_init(&_cache_mutex, NULL) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
 }
 
 void knc_device::get_device_num(uint32_t *device_num)
@@ -72,6 +146,7 @@ const char *knc_device::get_device_name()
 
 knc_device::~knc_device()
 {
+    (void)pthread_mutex_destroy(&_cache_mutex);
 }
 
 void knc_device::get_device_type(uint32_t &device_type)
@@ -81,18 +156,7 @@ void knc_device::get_device_type(uint32_t &device_type)
 
 void knc_device::flash_active_offs(off_t &active)
 {
-    std::stringstream ss, filename;
-    std::string offs_str = get_device_property(host_platform::FAIL_SAFE_OFFS);
-
-    try {
-        ss << std::hex << offs_str;
-        ss >> active;
-    } catch (...) {
-        std::string filename_str =
-            get_sysfs_attr_path(host_platform::FAIL_SAFE_OFFS);
-        throw mic_exception(E_MIC_STACK,
-                            "malformed file: " + filename_str, EINVAL);
-    }
+    active = get_device_property_uint(host_platform::FAIL_SAFE_OFFS, 16);
 }
 
 void knc_device::flash_size(size_t &size)
@@ -153,6 +217,13 @@ void knc_device::flash_get_status(struct host_flash_op *desc,
     host_platform::flash_get_status(desc, status);
 }
 
+void knc_device::flash_wait(struct host_flash_op *desc, int timeout_ms,
+                            mic_flash_progress_cb callback, void *arg,
+                            struct mic_flash_status_info *status)
+{
+    host_platform::flash_wait(desc, timeout_ms, callback, arg, status);
+}
+
 std::string knc_device::get_flash_vendor_device()
 {
     uint32_t vendor_dev;
@@ -275,20 +346,9 @@ std::string knc_device::get_flash_vendor_device()
 void knc_device::flash_version_offs(off_t &offs)
 {
     off_t fail_safe_offs;
-    std::string offs_str;
-    std::stringstream ss, filename;
-
-    offs_str = get_device_property(host_platform::FAIL_SAFE_OFFS);
 
-    try {
-        ss << std::hex << offs_str;
-        ss >> fail_safe_offs;
-    } catch (...) {
-        std::string filename_str = get_sysfs_attr_path(
-            host_platform::FAIL_SAFE_OFFS);
-        throw mic_exception(E_MIC_STACK,
-                            "malformed file: " + filename_str, EINVAL);
-    }
+    fail_safe_offs = get_device_property_uint(host_platform::FAIL_SAFE_OFFS,
+                                              16);
 
     offs = KNC_FLASH_CSS_HEADER_OFFSET + KNC_FLASH_CSS_HEADER_SIZE +
            KNC_FLASH_VERSION_OFFSET + fail_safe_offs;
@@ -296,14 +356,13 @@ void knc_device::flash_version_offs(off_t &offs)
 
 void knc_device::get_memory_info(struct mic_device_mem *mem)
 {
-    std::string str_buf;
-    std::stringstream ss;
     struct mr_rsp_gddr meminfo;
     struct mr_rsp_gfreq gddrfreq;
     struct mr_rsp_gvolt gddrvolt;
     struct mr_rsp_ecc eccinfo;
-    uint32_t mem_size = 0;
-    std::string mem_size_str;
+    uint64_t mem_size = 0;
+    char mem_size_str[NAME_MAX];
+    size_t len;
 
     memset(&meminfo, 0, sizeof(struct mr_rsp_gddr));
     memset(&gddrfreq, 0, sizeof(struct mr_rsp_gfreq));
@@ -314,12 +373,10 @@ void knc_device::get_memory_info(struct mic_device_mem *mem)
     scif_request(host_platform::GDDR_CMD, &meminfo,
                  host_platform::GDDR_SIZE);
 
-    mem_size_str = get_device_property(host_platform::MEM_SIZE);
-
-    if (!mem_size_str.empty()) {
-        ss << std::hex << mem_size_str;
-        ss >> mem_size;
-    }
+    len = read_device_attr(host_platform::MEM_SIZE, mem_size_str,
+                           sizeof(mem_size_str));
+    if (parse_uint(mem_size_str, mem_size_str + len, 16, &mem_size) == NULL)
+        mem_size = 0;
     strncpy(mem->vendor_name, (meminfo.dev + 1), (NAME_MAX));
     mem->vendor_name[NAME_MAX - 1] = '\0';
 
@@ -349,118 +406,103 @@ void knc_device::get_memory_info(struct mic_device_mem *mem)
 
 void knc_device::get_processor_info(struct mic_processor_info *processor)
 {
-    std::string str_buf;
-    std::stringstream ss;
-    uint32_t value = 0;
-
-    str_buf = get_device_property(host_platform::PROCESSOR_MODEL);
-
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->model = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_EXT_MODEL);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->model_ext = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_TYPE);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->type = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_FAMILY);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->family = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_EXT_FAMILY);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->family_ext = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_STEPPING);
-    strncpy(processor->stepping, str_buf.c_str(), NAME_MAX);
-    processor->stepping[NAME_MAX] = '\0';
-
-    str_buf = get_device_property(host_platform::PROCESSOR_STEPPING_DATA);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->stepping_data = value;
-    ss << "";
-    ss.clear();
-
-    str_buf = get_device_property(host_platform::PROCESSOR_SUBSTEPPING_DATA);
-    ss << std::hex << str_buf;
-    ss >> value;
-    processor->substepping_data = value;
-    ss << "";
-    ss.clear();
+    processor->model =
+        get_device_property_uint(host_platform::PROCESSOR_MODEL, 16);
+    processor->model_ext =
+        get_device_property_uint(host_platform::PROCESSOR_EXT_MODEL, 16);
+    processor->type =
+        get_device_property_uint(host_platform::PROCESSOR_TYPE, 16);
+    processor->family =
+        get_device_property_uint(host_platform::PROCESSOR_FAMILY, 16);
+    processor->family_ext =
+        get_device_property_uint(host_platform::PROCESSOR_EXT_FAMILY, 16);
+
+    read_device_attr(host_platform::PROCESSOR_STEPPING, processor->stepping,
+                     sizeof(processor->stepping));
+
+    processor->stepping_data =
+        get_device_property_uint(host_platform::PROCESSOR_STEPPING_DATA, 16);
+    processor->substepping_data =
+        get_device_property_uint(host_platform::PROCESSOR_SUBSTEPPING_DATA,
+                                 16);
 }
 
-void knc_device::get_cores_info(struct mic_cores_info *cores)
+int knc_device::update_cores_info(struct mic_cores_info *cores) throw()
 {
     struct mr_rsp_clst coreinfo;
     struct mr_rsp_freq corefreq;
     struct mr_rsp_volt corevolt;
+    int ret;
 
     memset(&coreinfo, 0, sizeof(struct mr_rsp_clst));
     memset(&corefreq, 0, sizeof(struct mr_rsp_freq));
     memset(&corevolt, 0, sizeof(struct mr_rsp_volt));
     /* num_cores */
-    scif_request(host_platform::CLST_CMD,
-                 &coreinfo, host_platform::CLST_SIZE);
+    ret = scif_request_status(host_platform::CLST_CMD,
+                              &coreinfo, host_platform::CLST_SIZE);
+    if (ret != E_MIC_SUCCESS)
+        return ret;
     cores->num_cores = coreinfo.count;
 
     /* cores_frequency */
-    scif_request(host_platform::CFREQ_CMD,
-                 &corefreq, host_platform::CFREQ_SIZE);
+    ret = scif_request_status(host_platform::CFREQ_CMD,
+                              &corefreq, host_platform::CFREQ_SIZE);
+    if (ret != E_MIC_SUCCESS)
+        return ret;
     cores->frequency = corefreq.cur;
 
     /* cores_voltage */
-    scif_request(host_platform::CVOLT_CMD,
-                 &corevolt, host_platform::CVOLT_SIZE);
+    ret = scif_request_status(host_platform::CVOLT_CMD,
+                              &corevolt, host_platform::CVOLT_SIZE);
+    if (ret != E_MIC_SUCCESS)
+        return ret;
     cores->voltage = corevolt.cur;
+
+    return E_MIC_SUCCESS;
 }
 
-void knc_device::get_thermal_info(struct mic_thermal_info *thermal)
+void knc_device::get_cores_info(struct mic_cores_info *cores)
+{
+    throw_on_error(update_cores_info(cores));
+}
+
+int knc_device::update_thermal_info(struct mic_thermal_info *thermal) throw()
 {
     struct mr_rsp_smc smc;
     struct mr_rsp_temp *temp = &(thermal->temp);
+    int ret;
 
     memset(&smc, 0, sizeof(struct mr_rsp_smc));
     /* TODO(eamaro): should this struct be zero'ed before calling this? */
     memset(thermal, 0, sizeof(struct mic_thermal_info));
 
     /* FW Version */
-    scif_request(host_platform::SMC_GET_CMD,
-                 &smc,
-                 host_platform::SMC_SIZE, host_platform::SMC_FW_VER);
+    ret = scif_request_status(host_platform::SMC_GET_CMD,
+                              &smc,
+                              host_platform::SMC_SIZE,
+                              host_platform::SMC_FW_VER);
+    if (ret != E_MIC_SUCCESS)
+        return ret;
     thermal->smc_version.value = smc.rtn.val;
 
     /* HW Revision */
-    scif_request(host_platform::SMC_GET_CMD,
-                 &smc,
-                 host_platform::SMC_SIZE, host_platform::SMC_HW_REV);
+    ret = scif_request_status(host_platform::SMC_GET_CMD,
+                              &smc,
+                              host_platform::SMC_SIZE,
+                              host_platform::SMC_HW_REV);
+    if (ret != E_MIC_SUCCESS)
+        return ret;
     thermal->smc_revision.value = smc.rtn.val;
 
     /* Boot loader version (get the SMC boot loader version only if it is
      * supported by the current version of the SMC) */
     if (thermal->smc_version.value >= SMC_BOOT_LOADER_VER_SUPPORT.value) {
-        scif_request(host_platform::SMC_GET_CMD,
-                     &smc,
-                     host_platform::SMC_SIZE,
-                     host_platform::SMC_BOOT_LOADER_VER);
+        ret = scif_request_status(host_platform::SMC_GET_CMD,
+                                  &smc,
+                                  host_platform::SMC_SIZE,
+                                  host_platform::SMC_BOOT_LOADER_VER);
+        if (ret != E_MIC_SUCCESS)
+            return ret;
         thermal->smc_boot_loader.value = smc.rtn.val;
         thermal->smc_boot_loader_ver_supported = true;
     } else {
@@ -472,23 +514,33 @@ void knc_device::get_thermal_info(struct mic_thermal_info *thermal)
     if (thermal->smc_revision.bits.hsink_type == 0) {
         thermal->fsc_status = 1;
         /* PWM */
-        scif_request(host_platform::SMC_GET_CMD,
-                     &smc,
-                     host_platform::SMC_SIZE,
-                     host_platform::SMC_FAN_PWM);
+        ret = scif_request_status(host_platform::SMC_GET_CMD,
+                                  &smc,
+                                  host_platform::SMC_SIZE,
+                                  host_platform::SMC_FAN_PWM);
+        if (ret != E_MIC_SUCCESS)
+            return ret;
         thermal->fan_pwm = smc.rtn.val;
 
         /* RPM */
-        scif_request(host_platform::SMC_GET_CMD,
-                     &smc,
-                     host_platform::SMC_SIZE,
-                     host_platform::SMC_FAN_RPM);
+        ret = scif_request_status(host_platform::SMC_GET_CMD,
+                                  &smc,
+                                  host_platform::SMC_SIZE,
+                                  host_platform::SMC_FAN_RPM);
+        if (ret != E_MIC_SUCCESS)
+            return ret;
         thermal->fan_rpm = smc.rtn.val;
     }
 
     /* Temperature data */
     memset(temp, 0, sizeof(struct mr_rsp_temp));
-    scif_request(host_platform::TEMP_CMD, temp, host_platform::TEMP_SIZE);
+    return scif_request_status(host_platform::TEMP_CMD, temp,
+                               host_platform::TEMP_SIZE);
+}
+
+void knc_device::get_thermal_info(struct mic_thermal_info *thermal)
+{
+    throw_on_error(update_thermal_info(thermal));
 }
 
 void knc_device::get_silicon_sku(char *sku, size_t *size)
@@ -586,13 +638,34 @@ void knc_device::in_ready_state(int *ready)
     *ready = get_state() == host_platform::STATE_READY;
 }
 
-void knc_device::get_power_utilization_info(struct mic_power_util_info *power)
+int knc_device::update_power_utilization_info(
+    struct mic_power_util_info *power) throw()
 {
     struct mr_rsp_power *pwr = &(power->pwr);
 
     memset(pwr, 0, sizeof(struct mr_rsp_power));
-    scif_request(host_platform::PWRUT_CMD,
-                 pwr, host_platform::PWRUT_SIZE);
+    return scif_request_status(host_platform::PWRUT_CMD,
+                               pwr, host_platform::PWRUT_SIZE);
+}
+
+/*
+ * Like update_power_utilization_info(), but never served from the response
+ * cache: the power sampler timestamps each reading and a cached answer
+ * would be charged to the wrong interval.
+ */
+int knc_device::sample_power_utilization_info(
+    struct mic_power_util_info *power) throw()
+{
+    struct mr_rsp_power *pwr = &(power->pwr);
+
+    memset(pwr, 0, sizeof(struct mr_rsp_power));
+    return host_platform::scif_request_status(host_platform::PWRUT_CMD,
+                                              pwr, host_platform::PWRUT_SIZE);
+}
+
+void knc_device::get_power_utilization_info(struct mic_power_util_info *power)
+{
+    throw_on_error(update_power_utilization_info(power));
 }
 
 void knc_device::get_power_limit(struct mic_power_limit *limit)
@@ -643,23 +716,34 @@ void knc_device::set_power_limit1(uint32_t power, uint32_t time_window)
         scif_request(host_platform::PWRLIM1_SET_CMD, &dummy_buf, 0, *param);
 }
 
-void knc_device::get_memory_utilization_info(
-    struct mic_memory_util_info *memory)
+int knc_device::update_memory_utilization_info(
+    struct mic_memory_util_info *memory) throw()
 {
     struct mr_rsp_mem *mem = &(memory->mem);
 
     memset(mem, 0, sizeof(struct mr_rsp_mem));
-    scif_request(host_platform::MEMUT_CMD,
-                 mem, host_platform::MEMUT_SIZE);
+    return scif_request_status(host_platform::MEMUT_CMD,
+                               mem, host_platform::MEMUT_SIZE);
 }
 
-void knc_device::get_core_util(mic_core_util *cutil)
+void knc_device::get_memory_utilization_info(
+    struct mic_memory_util_info *memory)
+{
+    throw_on_error(update_memory_utilization_info(memory));
+}
+
+int knc_device::update_core_util(mic_core_util *cutil) throw()
 {
     MrRspCutl *c_util = &(cutil->c_util);
 
     memset(c_util, 0, sizeof(MrRspCutl));
-    scif_request(host_platform::CUTIL_REQUEST, c_util,
-                 sizeof(MrRspCutl));
+    return scif_request_status(host_platform::CUTIL_REQUEST, c_util,
+                               sizeof(MrRspCutl));
+}
+
+void knc_device::get_core_util(mic_core_util *cutil)
+{
+    throw_on_error(update_core_util(cutil));
 }
 
 void knc_device::get_led_alert(uint32_t *led_alert)
@@ -686,16 +770,30 @@ void knc_device::set_led_alert(uint32_t *led_alert)
                             "invalid args: " + *led_alert, EINVAL);
 }
 
-void knc_device::get_turbo_state_info(struct mic_turbo_info *turbo)
+int knc_device::update_turbo_state_info(struct mic_turbo_info *turbo) throw()
 {
     struct mr_rsp_trbo *trbo = &(turbo->trbo);
 
     memset(trbo, 0, sizeof(struct mr_rsp_trbo));
-    scif_request(host_platform::TURBO_CMD, trbo,
-                 host_platform::TURBO_SIZE);
+    return scif_request_status(host_platform::TURBO_CMD, trbo,
+                               host_platform::TURBO_SIZE);
+}
+
+void knc_device::get_turbo_state_info(struct mic_turbo_info *turbo)
+{
+    throw_on_error(update_turbo_state_info(turbo));
 }
 
 void knc_device::set_turbo_mode(uint32_t *turbo_mode)
+{
+    write_turbo_mode(turbo_mode);
+    if (!wait_turbo_mode(_turbo_timeout_ms))
+        throw mic_exception(E_MIC_SYSTEM,
+                            "turbo mode change did not take effect",
+                            ETIMEDOUT);
+}
+
+void knc_device::write_turbo_mode(uint32_t *turbo_mode)
 {
     uint32_t size = 0;
     struct mr_rsp_trbo turbo;
@@ -703,14 +801,69 @@ void knc_device::set_turbo_mode(uint32_t *turbo_mode)
     if (*turbo_mode == 0 || *turbo_mode == 1) {
         scif_request(host_platform::TURBO_WRITE, &turbo, size,
                      *turbo_mode);
-        /* eamaro: sleep call needs to be removed */
-        sleep(2);
+        _turbo_mode = *turbo_mode;
+        _turbo_pending = true;
     } else {
         throw mic_exception(E_MIC_INVAL,
                             "invalid args: " + *turbo_mode, EINVAL);
     }
 }
 
+/*
+ * Polls TURBO_CMD until the card reports the mode last requested with
+ * write_turbo_mode() as its turbo setting, for at most timeout_ms (-1
+ * waits indefinitely, 0 checks once). Returns whether the change took
+ * effect; it returns true at once if no change is pending.
+ */
+bool knc_device::wait_turbo_mode(int timeout_ms)
+{
+    struct mic_turbo_info turbo;
+    uint64_t deadline = 0;
+
+    if (timeout_ms > 0)
+        deadline = monotonic_ms() + timeout_ms;
+
+    while (_turbo_pending) {
+        /* A cached answer would never show the change */
+        throw_on_error(host_platform::scif_request_status(
+                           host_platform::TURBO_CMD, &turbo.trbo,
+                           host_platform::TURBO_SIZE));
+        if (turbo.trbo.set == _turbo_mode) {
+            _turbo_pending = false;
+            break;
+        }
+
+        if (timeout_ms == 0)
+            return false;
+        if (timeout_ms > 0) {
+            uint64_t now = monotonic_ms();
+
+            if (now >= deadline)
+                return false;
+            if (now + TURBO_POLL_MS > deadline) {
+                usleep((deadline - now) * 1000);
+                continue;
+            }
+        }
+        usleep(TURBO_POLL_MS * 1000);
+    }
+
+    return true;
+}
+
+void knc_device::set_turbo_timeout(int timeout_ms)
+{
+    if (timeout_ms < -1)
+        throw mic_exception(E_MIC_INVAL, "invalid turbo timeout", EINVAL);
+
+    _turbo_timeout_ms = timeout_ms;
+}
+
+int knc_device::get_turbo_timeout()
+{
+    return _turbo_timeout_ms;
+}
+
 void knc_device::get_uuid(uint8_t *uuid, size_t *size)
 {
     struct mr_rsp_smc smc;
@@ -801,3 +954,210 @@ void knc_device::set_smc_persistence_flag(int persist_flag)
         scif_request(host_platform::PERSIST_FLAG_SET_CMD, &perst, size,
                      persist_flag ? 1 : 0);
 }
+
+void knc_device::scif_request(int cmd, void *buf, size_t size, uint32_t parm)
+{
+    throw_on_error(scif_request_status(cmd, buf, size, parm));
+}
+
+int knc_device::scif_request_status(int cmd, void *buf, size_t size,
+                                    uint32_t parm) throw()
+{
+    int feature = cache_feature(cmd, parm);
+    uint64_t key = cache_key(cmd, parm);
+    uint64_t age_ms, generation = 0;
+    bool storable = false;
+    int ret;
+
+    try {
+        if ((feature >= 0) && cache_lookup(feature, key, buf, size,
+                                           &age_ms, &generation)) {
+            note_served(this, feature, age_ms);
+            return E_MIC_SUCCESS;
+        }
+        storable = feature >= 0;
+    } catch (...) {
+        /* Fall back to asking the card */
+    }
+
+    ret = host_platform::scif_request_status(cmd, buf, size, parm);
+    if ((ret == E_MIC_SUCCESS) && (feature >= 0))
+        note_served(this, feature, 0);
+
+    try {
+        if (!scif_actor::is_read(cmd))
+            cache_clear();
+        else if ((ret == E_MIC_SUCCESS) && storable)
+            cache_store(feature, key, buf, size, generation);
+    } catch (...) {
+        /* The response is still good, it just is not kept */
+    }
+
+    return ret;
+}
+
+/* Index of the MIC_CACHE_* feature a read belongs to, or -1 if it is
+ * never cached */
+int knc_device::cache_feature(int cmd, uint32_t parm)
+{
+    switch (cmd) {
+    case host_platform::CLST_CMD:
+    case host_platform::CFREQ_CMD:
+    case host_platform::CVOLT_CMD:
+        return 0;
+    case host_platform::TEMP_CMD:
+        return 1;
+    case host_platform::GDDR_CMD:
+    case host_platform::GFREQ_CMD:
+    case host_platform::GVOLT_CMD:
+    case host_platform::ECC_CMD:
+        return 2;
+    case host_platform::VER_CMD:
+    case host_platform::SERNO_CMD:
+        return 3;
+    case host_platform::PWRUT_CMD:
+        return 4;
+    case host_platform::PWRLIM_CMD:
+    case host_platform::PWRLIM0_GET_CMD:
+    case host_platform::PWRLIM1_GET_CMD:
+        return 5;
+    case host_platform::MEMUT_CMD:
+        return 6;
+    case host_platform::CUTIL_REQUEST:
+        return 7;
+    case host_platform::TURBO_CMD:
+        return 8;
+    case host_platform::TTL_CMD:
+        return 9;
+    case host_platform::PMCFG_CMD:
+        return 10;
+    case host_platform::SMC_GET_CMD:
+        switch (parm) {
+        case host_platform::SMC_FAN_PWM:
+        case host_platform::SMC_FAN_RPM:
+        case host_platform::SMC_TEMP_CPU:
+            return 1;
+        case host_platform::SMC_UUID:
+        case host_platform::SMC_FW_VER:
+        case host_platform::SMC_HW_REV:
+        case host_platform::SMC_BOOT_LOADER_VER:
+            return 3;
+        }
+        return -1;
+    default:
+        return -1;
+    }
+}
+
+/* Copies a fresh enough response into buf and returns its age in
+ * *age_ms. *generation is set either way, for cache_store() to tell
+ * whether the state changed while the card was asked instead. */
+bool knc_device::cache_lookup(int feature, uint64_t key, void *buf,
+                              size_t size, uint64_t *age_ms,
+                              uint64_t *generation)
+{
+    mutex_lock lock(&_cache_mutex);
+    uint32_t ttl = _cache_ttl_ms[feature];
+    std::map<uint64_t, cached_response>::const_iterator it;
+    uint64_t age;
+
+    *generation = _cache_generation;
+
+    if (ttl == 0)
+        return false;
+
+    it = _cache.find(key);
+    if ((it == _cache.end()) || (it->second.data.size() != size))
+        return false;
+
+    age = monotonic_ms() - it->second.time_ms;
+    if ((ttl != MIC_CACHE_FOREVER) && (age >= ttl))
+        return false;
+
+    memcpy(buf, &it->second.data[0], size);
+    *age_ms = age;
+
+    return true;
+}
+
+/* Keeps a response unless the cache was cleared since generation was
+ * read, as the response may then predate the change */
+void knc_device::cache_store(int feature, uint64_t key, const void *buf,
+                             size_t size, uint64_t generation)
+{
+    mutex_lock lock(&_cache_mutex);
+
+    if ((_cache_ttl_ms[feature] == 0) || (generation != _cache_generation))
+        return;
+
+    struct cached_response &entry = _cache[key];
+
+    entry.time_ms = monotonic_ms();
+    entry.data.assign((const char *)buf, (const char *)buf + size);
+}
+
+void knc_device::cache_clear()
+{
+    mutex_lock lock(&_cache_mutex);
+
+    _cache.clear();
+    _cache_generation++;
+}
+
+/*
+ * Sets how long responses for the features in the mask are served from
+ * the cache; 0 stops caching them and drops what is held.
+ */
+void knc_device::set_cache_policy(uint32_t features, uint32_t ttl_ms)
+{
+    mutex_lock lock(&_cache_mutex);
+
+    if ((features == 0) || (features & ~MIC_CACHE_ALL))
+        throw mic_exception(E_MIC_INVAL, "invalid cache features", EINVAL);
+
+    for (int i = 0; i < MIC_CACHE_NFEATURES; i++) {
+        if (features & (1 << i))
+            _cache_ttl_ms[i] = ttl_ms;
+    }
+
+    if (ttl_ms != 0)
+        return;
+
+    std::map<uint64_t, cached_response>::iterator it = _cache.begin();
+
+    while (it != _cache.end()) {
+        int feature = cache_feature(it->first >> 32,
+                                    (uint32_t)it->first);
+
+        if ((feature >= 0) && (features & (1 << feature)))
+            _cache.erase(it++);
+        else
+            ++it;
+    }
+}
+
+/*
+ * Returns the age of the oldest response of the feature served to the
+ * calling thread by this device since the thread last asked, 0 if they
+ * all came from the card, and starts over.
+ */
+uint32_t knc_device::get_cache_age(uint32_t feature)
+{
+    uint64_t age = 0;
+    int index = -1;
+
+    for (int i = 0; i < MIC_CACHE_NFEATURES; i++) {
+        if (feature == (1U << i))
+            index = i;
+    }
+    if (index < 0)
+        throw mic_exception(E_MIC_INVAL, "invalid cache feature", EINVAL);
+
+    struct served_age &s = served[index];
+
+    if (s.device == this)
+        age = s.age_ms;
+    s.device = NULL;
+
+    return age > UINT32_MAX ? UINT32_MAX : (uint32_t)age;
+}
@@ -38,6 +38,9 @@
 
 #include <stdint.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <map>
+#include <vector>
 #include "mic_device.h"
 
 class knc_device : public mic_device
@@ -58,6 +61,9 @@ public:
     virtual void flash_version_offs(off_t &offs);
     virtual void flash_get_status(struct host_flash_op *desc, struct
                                   mic_flash_status_info *status);
+    virtual void flash_wait(struct host_flash_op *desc, int timeout_ms,
+                            mic_flash_progress_cb callback, void *arg,
+                            struct mic_flash_status_info *status);
     virtual std::string get_flash_vendor_device();
     void get_device_num(uint32_t *device_num);
     const char *get_device_name();
@@ -88,15 +94,19 @@ public:
 
     /* processor info */
     void get_cores_info(struct mic_cores_info *cores);
+    int update_cores_info(struct mic_cores_info *cores) throw();
 
     /* thermal info */
     void get_thermal_info(struct mic_thermal_info *thermal);
+    int update_thermal_info(struct mic_thermal_info *thermal) throw();
 
     /* version info */
     void get_version_info(struct mic_version_info *ver);
 
     /* power utilization info */
     void get_power_utilization_info(struct mic_power_util_info *pwr);
+    int update_power_utilization_info(struct mic_power_util_info *pwr) throw();
+    int sample_power_utilization_info(struct mic_power_util_info *pwr) throw();
 
     /* power limits */
     void get_power_limit(struct mic_power_limit *limit);
@@ -106,9 +116,12 @@ public:
 
     /* memory utilization info */
     void get_memory_utilization_info(struct mic_memory_util_info *memory);
+    int update_memory_utilization_info(struct mic_memory_util_info *memory)
+        throw();
 
     /* core utilization */
     void get_core_util(struct mic_core_util *cutil);
+    int update_core_util(struct mic_core_util *cutil) throw();
 
     /* get led alert */
     void get_led_alert(uint32_t *led_alert);
@@ -116,7 +129,17 @@ public:
 
     /* turbo mode info */
     void get_turbo_state_info(struct mic_turbo_info *turbo);
+    int update_turbo_state_info(struct mic_turbo_info *turbo) throw();
     void set_turbo_mode(uint32_t *mode);
+    /* requests the change without waiting for it to take effect */
+    void write_turbo_mode(uint32_t *mode);
+    bool wait_turbo_mode(int timeout_ms);
+    void set_turbo_timeout(int timeout_ms);
+    int get_turbo_timeout();
+
+    /* default bound on waiting for a turbo mode change to take effect */
+    static const int TURBO_TIMEOUT_MS = 2000;
+    static const uint32_t TURBO_POLL_MS = 20;
 
     /*uuid*/
     void get_uuid(uint8_t *uuid, size_t *size);
@@ -138,6 +161,10 @@ public:
     void get_smc_persistence_flag(int *persist_flag);
     void set_smc_persistence_flag(int persist_flag);
 
+    /* response cache */
+    void set_cache_policy(uint32_t features, uint32_t ttl_ms);
+    uint32_t get_cache_age(uint32_t feature);
+
     static const uint32_t FLASH_MFG_MASK = 0x0000ff;
     static const uint32_t FLASH_MFG_ATMEL = 0x1f;
     static const uint32_t FLASH_MFG_MACRONIX = 0xc2;
@@ -166,9 +193,40 @@ public:
      * from SMC FW version 1.9 */
     static const union smc_fw_ver SMC_BOOT_LOADER_VER_SUPPORT;
 
+protected:
+    /* Serve reads from the response cache while they are fresh enough,
+     * and drop the cache on any request that changes state. These hide
+     * the host_platform versions for every request knc_device makes. */
+    void scif_request(int cmd, void *buf, size_t size, uint32_t parm = 0);
+    int scif_request_status(int cmd, void *buf, size_t size,
+                            uint32_t parm = 0) throw();
+
 private:
     knc_device(knc_device const &);
     knc_device &operator=(knc_device const &);
+
+    struct cached_response {
+        uint64_t time_ms;
+        std::vector<char> data;
+    };
+
+    static int cache_feature(int cmd, uint32_t parm);
+    bool cache_lookup(int feature, uint64_t key, void *buf, size_t size,
+                      uint64_t *age_ms, uint64_t *generation);
+    void cache_store(int feature, uint64_t key, const void *buf,
+                     size_t size, uint64_t generation);
+    void cache_clear();
+
+    bool _turbo_pending;
+    uint32_t _turbo_mode;
+    int _turbo_timeout_ms;
+
+    pthread_mutex_t _cache_mutex;
+    uint32_t _cache_ttl_ms[MIC_CACHE_NFEATURES];
+    /* bumped by cache_clear() */
+    uint64_t _cache_generation;
+    /* keyed by RAS command << 32 | parameter */
+    std::map<uint64_t, cached_response> _cache;
 };
 
 #endif /* MICLIB_SRC_KNC_DEVICE_H_ */
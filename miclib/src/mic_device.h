@@ -70,6 +70,9 @@ public:
     virtual void set_ecc_mode_done(struct host_flash_op *desc) = 0;
     virtual void flash_get_status(struct host_flash_op *desc, struct
                                   mic_flash_status_info *status) = 0;
+    virtual void flash_wait(struct host_flash_op *desc, int timeout_ms,
+                            mic_flash_progress_cb callback, void *arg,
+                            struct mic_flash_status_info *status) = 0;
     virtual void flash_version_offs(off_t &offs) = 0;
     virtual std::string get_flash_vendor_device() = 0;
 
@@ -105,11 +108,35 @@ public:
     virtual void set_led_alert(uint32_t *led_alert) = 0;
     virtual void get_turbo_state_info(struct mic_turbo_info *turbo) = 0;
     virtual void set_turbo_mode(uint32_t *mode) = 0;
+    virtual void write_turbo_mode(uint32_t *mode) = 0;
+    virtual bool wait_turbo_mode(int timeout_ms) = 0;
+    virtual void set_turbo_timeout(int timeout_ms) = 0;
+    virtual int get_turbo_timeout() = 0;
     virtual void get_uuid(uint8_t *uuid, size_t *size) = 0;
     virtual void get_throttle_state_info(struct
                                          mic_throttle_state_info *ttl_state) =
         0;
     virtual void get_uos_pm_config(struct mic_uos_pm_config *pm_config) = 0;
+
+    /* Polled RAS getters that report failures as a mic_error_code instead
+     * of throwing, so an offline card costs no unwinding. The message is
+     * recorded with mic_exception::ts_set_error(). */
+    virtual int update_cores_info(struct mic_cores_info *cores) throw() = 0;
+    virtual int update_thermal_info(struct mic_thermal_info *thermal)
+        throw() = 0;
+    virtual int update_power_utilization_info(struct
+                                              mic_power_util_info *pwr)
+        throw() = 0;
+    /* Always asks the card, for callers timing their own readings */
+    virtual int sample_power_utilization_info(struct
+                                              mic_power_util_info *pwr)
+        throw() = 0;
+    virtual int update_memory_utilization_info(struct
+                                               mic_memory_util_info *memory)
+        throw() = 0;
+    virtual int update_core_util(struct mic_core_util *cutil) throw() = 0;
+    virtual int update_turbo_state_info(struct mic_turbo_info *turbo)
+        throw() = 0;
 #ifdef __linux__
     virtual void read_smc_reg(uint8_t reg, uint8_t *buffer, size_t *size)
                 = 0;
@@ -119,6 +146,10 @@ public:
     virtual void get_smc_persistence_flag(int *persist_flag) = 0;
     virtual void set_smc_persistence_flag(int persist_flag) = 0;
 
+    /* Response cache, see mic_set_cache_policy() */
+    virtual void set_cache_policy(uint32_t features, uint32_t ttl_ms) = 0;
+    virtual uint32_t get_cache_age(uint32_t feature) = 0;
+
 protected:
     std::string _name;
 
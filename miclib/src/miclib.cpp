@@ -35,17 +35,24 @@
 
 #include <new>
 #include <string>
+#include <vector>
+#include <pthread.h>
 #include <stdlib.h>
 #include "mic_device.h"
 #include "knc_device.h"
 #include "host_platform.h"
+#include "collector.h"
+#include "device_cache.h"
+#include "device_group.h"
+#include "power_sampler.h"
+#include "energy.h"
+#include "telemetry.h"
+#include "recorder.h"
 #include "miclib_exception.h"
 #include "miclib_int.h"
 #include "miclib.h"
 #include <stdlib.h>
 
-const static int N_DEVICES = 8;
-
 const char *mic_get_error_string()
 {
     return mic_exception::ts_get_error_msg();
@@ -80,44 +87,16 @@ int mic_get_devices(struct mic_devices_list **d)
     ASSERT(d != NULL);
     *d = NULL;
     try {
-        int n;
-
-        *d = (struct mic_devices_list *)
-             malloc(sizeof(struct mic_devices_list) +
-                    (N_DEVICES - 1) * sizeof((*d)->devices[0]));
-        if (*d == NULL)
-            throw mic_exception(E_MIC_NOMEM, "malloc", ENOMEM);
-
-        host_platform::get_devices(*d, N_DEVICES);
-        if ((n = (*d)->n_devices) > N_DEVICES) {
-            free((void *)*d);
-            *d = (struct mic_devices_list *)
-                 malloc(sizeof(struct mic_devices_list) +
-                        (n - 1) * sizeof((*d)->devices[0]));
-            if (*d == NULL) {
-                throw mic_exception(E_MIC_NOMEM,
-                                    "malloc", ENOMEM);
-            }
-            host_platform::get_devices(*d, n);
-
-            ASSERT((*d)->n_devices == n);
-
-            if ((*d)->n_devices != n) {
-                free((void *)*d);
-                throw mic_exception(E_MIC_INTERNAL,
-                                    "Internal error", EINVAL);
-            }
-        }
+        *d = device_cache::instance().get_devices();
         return E_MIC_SUCCESS;
     }
     catch (mic_exception const &e) {
-        if (*d != NULL)
-            free((void *)*d);
         return e.get_mic_errno();
     }
+    catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    }
     catch (...) {
-        if (*d != NULL)
-            free((void *)*d);
         ASSERT(0);
         return E_MIC_INTERNAL;
     }
@@ -137,6 +116,29 @@ int mic_get_ndevices(struct mic_devices_list *d, int *ndevices)
     return E_MIC_SUCCESS;
 }
 
+int mic_get_devices_generation(struct mic_devices_list *d,
+                               uint64_t *generation)
+{
+    ASSERT((d != NULL) && (generation != NULL));
+    *generation = d->generation;
+    return E_MIC_SUCCESS;
+}
+
+int mic_devices_changed(uint64_t generation, int *changed)
+{
+    ASSERT(changed != NULL);
+    try {
+        *changed = device_cache::instance().generation() != generation;
+        return E_MIC_SUCCESS;
+    }
+    catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    }
+    catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_device_at_index(struct mic_devices_list *d, int index, int *device)
 {
     ASSERT((d != NULL) && (device != NULL));
@@ -179,49 +181,128 @@ const char *mic_get_device_name(struct mic_device *mdh)
 		}
 }
 
-int mic_open_device(struct mic_device **device, uint32_t device_num)
+static struct mic_device *open_device(uint32_t device_num)
 {
-    ASSERT(device != NULL);
+    uint32_t device_type;
+    struct mic_device *mdh = new knc_device(device_num);
 
     try {
-        *device = NULL;
-        uint32_t device_type;
-        host_platform hp(device_num, false);         // we don't need scif conn
-        hp.get_device_type(device_type);
+        /* Ask sysfs, not the KNC class, what family the card is */
+        mdh->host_platform::get_device_type(device_type);
+    } catch (...) {
+        delete mdh;
+        throw;
+    }
 
-        if (device_type == KNC_ID) {
-            *device = new knc_device(device_num);
-        } else {
-            /* Only KNC is supported for now */
-            std::stringstream ss;
+    return mdh;
+}
 
-            ss << "Unsupported device id: '0x" << std::hex <<
-                device_type << "'";
+int mic_open_device(struct mic_device **device, uint32_t device_num)
+{
+    ASSERT(device != NULL);
 
-            throw mic_exception(E_MIC_UNSUPPORTED_DEV,
-                                ss.str(), ECANCELED);
-        }
+    try {
+        *device = NULL;
+        *device = open_device(device_num);
 
         return E_MIC_SUCCESS;
     }
     catch (mic_exception const &e) {
-        if (*device != NULL)
-            delete *device;
-
         return e.get_mic_errno();
     } catch (std::bad_alloc const &e) {
-        if (*device != NULL)
-            delete *device;
-
         return E_MIC_NOMEM;
     } catch (...) {
-        if (*device != NULL)
-            delete *device;
-
         return E_MIC_INTERNAL;
     }
 }
 
+struct open_all_job {
+    struct mic_device *mdh;
+    int status;
+    pthread_t thread;
+    bool started;
+};
+
+static void *open_all_connect(void *arg)
+{
+    struct open_all_job *job = (struct open_all_job *)arg;
+
+    job->status = job->mdh->connect_scif();
+
+    return NULL;
+}
+
+int mic_open_all_devices(struct mic_device **devices, int *status, int *n,
+                         uint32_t flags)
+{
+    ASSERT((devices != NULL) && (status != NULL) && (n != NULL));
+    struct mic_devices_list *list = NULL;
+    std::vector<struct open_all_job> jobs;
+    int ret;
+
+    if ((ret = mic_get_devices(&list)) != E_MIC_SUCCESS)
+        return ret;
+
+    if (list->n_devices > *n) {
+        *n = list->n_devices;
+        mic_free_devices(list);
+        return E_MIC_RANGE;
+    }
+
+    try {
+        jobs.resize(list->n_devices);
+    } catch (std::bad_alloc const &e) {
+        mic_free_devices(list);
+        return E_MIC_NOMEM;
+    }
+
+    *n = list->n_devices;
+    for (int i = 0; i < *n; i++) {
+        devices[i] = NULL;
+        status[i] = mic_open_device(&devices[i], list->devices[i]);
+        jobs[i].mdh = devices[i];
+        jobs[i].status = status[i];
+        jobs[i].started = false;
+    }
+    mic_free_devices(list);
+
+    if (flags & MIC_OPEN_IO_THREAD) {
+        for (int i = 0; i < *n; i++) {
+            if (jobs[i].mdh == NULL)
+                continue;
+            if ((status[i] = mic_set_io_thread(jobs[i].mdh, 1)) !=
+                E_MIC_SUCCESS) {
+                mic_close_device(jobs[i].mdh);
+                devices[i] = jobs[i].mdh = NULL;
+                jobs[i].status = status[i];
+            }
+        }
+    }
+
+    if ((flags & MIC_OPEN_SCIF) == 0)
+        return E_MIC_SUCCESS;
+
+    /* Connections are made concurrently, one thread per card, so the
+     * wait is that of the slowest card rather than the sum of them. */
+    for (int i = 0; i < *n; i++) {
+        if (jobs[i].mdh == NULL)
+            continue;
+        if (pthread_create(&jobs[i].thread, NULL, open_all_connect,
+                           &jobs[i]) == 0)
+            jobs[i].started = true;
+        else
+            open_all_connect(&jobs[i]);
+    }
+
+    for (int i = 0; i < *n; i++) {
+        if (jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+        status[i] = jobs[i].status;
+    }
+
+    return E_MIC_SUCCESS;
+}
+
 int mic_close_device(struct mic_device *device)
 {
     ASSERT(device != NULL);
@@ -229,6 +310,25 @@ int mic_close_device(struct mic_device *device)
     return E_MIC_SUCCESS;
 }
 
+int mic_set_io_thread(struct mic_device *device, int enable)
+{
+    ASSERT(device != NULL);
+
+    try {
+        if (enable)
+            device->start_io_thread();
+        else
+            device->stop_io_thread();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_device_type(struct mic_device *device, uint32_t *device_type)
 {
     ASSERT((device != NULL) && (device_type != NULL));
@@ -484,6 +584,37 @@ int mic_get_flash_status_info(struct mic_flash_op *desc,
     }
 }
 
+int mic_flash_wait(struct mic_flash_op *desc, int timeout_ms,
+                   mic_flash_progress_cb callback, void *arg,
+                   struct mic_flash_status_info **status_desc)
+{
+    ASSERT((desc != NULL) && (status_desc != NULL));
+
+    try {
+        *status_desc = NULL;
+        *status_desc = new mic_flash_status_info;
+        desc->mdh->flash_wait(desc->h_desc, timeout_ms, callback, arg,
+                              *status_desc);
+        return E_MIC_SUCCESS;
+    }
+    catch (mic_exception const &e) {
+        if (*status_desc != NULL)
+            delete(*status_desc);
+
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        if (*status_desc != NULL)
+            delete(*status_desc);
+
+        return E_MIC_NOMEM;
+    } catch (...) {
+        if (*status_desc != NULL)
+            delete(*status_desc);
+
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_free_flash_status_info(struct mic_flash_status_info *status)
 {
     ASSERT(status != NULL);
@@ -1012,6 +1143,28 @@ int mic_get_cores_info(struct mic_device *mdh, struct mic_cores_info **cores)
     }
 }
 
+int mic_alloc_cores_info(struct mic_cores_info **cores)
+{
+    ASSERT(cores != NULL);
+
+    try {
+        *cores = NULL;
+        *cores = new struct mic_cores_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_cores_info(struct mic_device *mdh, struct mic_cores_info *cores)
+{
+    ASSERT((mdh != NULL) && (cores != NULL));
+
+    return mdh->update_cores_info(cores);
+}
+
 int mic_get_cores_count(struct mic_cores_info *cores, uint32_t *num_cores)
 {
     ASSERT((cores != NULL) && (num_cores != NULL));
@@ -1069,6 +1222,29 @@ int mic_get_thermal_info(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_thermal_info(struct mic_thermal_info **thermal)
+{
+    ASSERT(thermal != NULL);
+
+    try {
+        *thermal = NULL;
+        *thermal = new struct mic_thermal_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_thermal_info(struct mic_device *mdh,
+                            struct mic_thermal_info *thermal)
+{
+    ASSERT((mdh != NULL) && (thermal != NULL));
+
+    return mdh->update_thermal_info(thermal);
+}
+
 int mic_get_fsc_status(struct mic_thermal_info *thermal, uint32_t *fsc_status)
 {
     ASSERT((thermal != NULL) && (fsc_status != NULL));
@@ -1362,6 +1538,36 @@ int mic_get_version_info(struct mic_device *mdh,
     return E_MIC_SUCCESS;
 }
 
+int mic_alloc_version_info(struct mic_version_info **version)
+{
+    ASSERT(version != NULL);
+
+    try {
+        *version = NULL;
+        *version = new struct mic_version_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_version_info(struct mic_device *mdh,
+                            struct mic_version_info *version)
+{
+    ASSERT((mdh != NULL) && (version != NULL));
+
+    try {
+        mdh->get_version_info(version);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_uos_version(struct mic_version_info *version,
                         char *uos, size_t *size)
 {
@@ -1516,6 +1722,29 @@ int mic_get_power_utilization_info(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_power_utilization_info(struct mic_power_util_info **power)
+{
+    ASSERT(power != NULL);
+
+    try {
+        *power = NULL;
+        *power = new struct mic_power_util_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_power_utilization_info(struct mic_device *mdh,
+                                      struct mic_power_util_info *power)
+{
+    ASSERT((mdh != NULL) && (power != NULL));
+
+    return mdh->update_power_utilization_info(power);
+}
+
 int mic_get_total_power_readings_w0(struct mic_power_util_info *power,
                                     uint32_t *pwr)
 {
@@ -1808,6 +2037,36 @@ int mic_get_power_limit(struct mic_device *mdh,
     return E_MIC_SUCCESS;
 }
 
+int mic_alloc_power_limit(struct mic_power_limit **limit)
+{
+    ASSERT(limit != NULL);
+
+    try {
+        *limit = NULL;
+        *limit = new struct mic_power_limit ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_power_limit(struct mic_device *mdh,
+                           struct mic_power_limit *limit)
+{
+    ASSERT((mdh != NULL) && (limit != NULL));
+
+    try {
+        mdh->get_power_limit(limit);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_power_phys_limit(struct mic_power_limit *limit,
                              uint32_t *phys_lim)
 {
@@ -1915,6 +2174,29 @@ int mic_get_memory_utilization_info(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_memory_utilization_info(struct mic_memory_util_info **memory)
+{
+    ASSERT(memory != NULL);
+
+    try {
+        *memory = NULL;
+        *memory = new struct mic_memory_util_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_memory_utilization_info(struct mic_device *mdh,
+                                       struct mic_memory_util_info *memory)
+{
+    ASSERT((mdh != NULL) && (memory != NULL));
+
+    return mdh->update_memory_utilization_info(memory);
+}
+
 int mic_get_total_memory_size(struct mic_memory_util_info *memory,
                               uint32_t *total_size)
 {
@@ -1974,15 +2256,7 @@ int mic_update_core_util(struct mic_device *mdh, struct mic_core_util *cutil)
 {
     ASSERT((mdh != NULL) && (cutil != NULL));
 
-    try {
-        mdh->get_core_util(cutil);
-    } catch (mic_exception const &e) {
-        return e.get_mic_errno();
-    } catch (...) {
-        return E_MIC_INTERNAL;
-    }
-
-    return E_MIC_SUCCESS;
+    return mdh->update_core_util(cutil);
 }
 
 int mic_get_idle_counters(struct mic_core_util *cutil, uint64_t *idle_counters)
@@ -2033,6 +2307,25 @@ int mic_get_user_counters(struct mic_core_util *cutil, uint64_t *user_counters)
     return E_MIC_SUCCESS;
 }
 
+int mic_get_core_counters_soa(struct mic_core_util *cutil,
+                              uint16_t *num_cores, uint64_t *user,
+                              uint64_t *nice, uint64_t *sys, uint64_t *idle)
+{
+    ASSERT((cutil != NULL) && (num_cores != NULL));
+    ASSERT((user == NULL) ||
+           ((nice != NULL) && (sys != NULL) && (idle != NULL)));
+
+    try {
+        core_util_counters(cutil, num_cores, user, nice, sys, idle);
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+
+    return E_MIC_SUCCESS;
+}
+
 int mic_get_idle_sum(struct mic_core_util *cutil, uint64_t *idle_sum)
 {
     ASSERT((cutil != NULL) && (idle_sum != NULL));
@@ -2106,6 +2399,26 @@ int mic_get_tick_count(struct mic_core_util *cutil,
     return E_MIC_SUCCESS;
 }
 
+int mic_get_core_util_delta(struct mic_core_util *prev,
+                            struct mic_core_util *cur, double *user,
+                            double *nice, double *sys, double *idle,
+                            double *device)
+{
+    ASSERT((prev != NULL) && (cur != NULL) && (user != NULL) &&
+           (nice != NULL) && (sys != NULL) && (idle != NULL) &&
+           (device != NULL));
+
+    try {
+        core_util_delta(prev, cur, user, nice, sys, idle, device);
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+
+    return E_MIC_SUCCESS;
+}
+
 int mic_free_core_util(struct mic_core_util *cutil)
 {
     ASSERT(cutil != NULL);
@@ -2167,6 +2480,28 @@ int mic_get_turbo_state_info(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_turbo_info(struct mic_turbo_info **turbo)
+{
+    ASSERT(turbo != NULL);
+
+    try {
+        *turbo = NULL;
+        *turbo = new struct mic_turbo_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_turbo_info(struct mic_device *mdh, struct mic_turbo_info *turbo)
+{
+    ASSERT((mdh != NULL) && (turbo != NULL));
+
+    return mdh->update_turbo_state_info(turbo);
+}
+
 int mic_get_turbo_state_valid(struct mic_turbo_info *turbo, uint32_t *valid)
 {
     ASSERT((turbo != NULL) && (valid != NULL));
@@ -2210,6 +2545,51 @@ int mic_set_turbo_mode(struct mic_device *mdh, uint32_t *state)
     }
 }
 
+int mic_set_turbo_mode_start(struct mic_device *mdh, uint32_t *mode)
+{
+    ASSERT((mdh != NULL) && (mode != NULL));
+
+    try {
+        mdh->write_turbo_mode(mode);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_turbo_mode_wait(struct mic_device *mdh, int timeout_ms, int *done)
+{
+    ASSERT((mdh != NULL) && (done != NULL));
+
+    if (timeout_ms < -1)
+        return E_MIC_INVAL;
+
+    try {
+        *done = mdh->wait_turbo_mode(timeout_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_set_turbo_timeout(struct mic_device *mdh, int timeout_ms)
+{
+    ASSERT(mdh != NULL);
+
+    try {
+        mdh->set_turbo_timeout(timeout_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_free_turbo_info(struct mic_turbo_info *turbo)
 {
     ASSERT(turbo != NULL);
@@ -2243,6 +2623,36 @@ int mic_get_throttle_state_info(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_throttle_state_info(struct mic_throttle_state_info **ttl_state)
+{
+    ASSERT(ttl_state != NULL);
+
+    try {
+        *ttl_state = NULL;
+        *ttl_state = new struct mic_throttle_state_info ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_throttle_state_info(struct mic_device *mdh,
+                                   struct mic_throttle_state_info *ttl_state)
+{
+    ASSERT((mdh != NULL) && (ttl_state != NULL));
+
+    try {
+        mdh->get_throttle_state_info(ttl_state);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_thermal_ttl_active(struct mic_throttle_state_info *ttl_state,
                                int *active)
 {
@@ -2413,6 +2823,36 @@ int mic_get_uos_pm_config(struct mic_device *mdh,
     }
 }
 
+int mic_alloc_uos_pm_config(struct mic_uos_pm_config **pm_config)
+{
+    ASSERT(pm_config != NULL);
+
+    try {
+        *pm_config = NULL;
+        *pm_config = new struct mic_uos_pm_config ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_update_uos_pm_config(struct mic_device *mdh,
+                             struct mic_uos_pm_config *pm_config)
+{
+    ASSERT((mdh != NULL) && (pm_config != NULL));
+
+    try {
+        mdh->get_uos_pm_config(pm_config);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
 int mic_get_cpufreq_mode(struct mic_uos_pm_config *pm_config, int *mode)
 {
     ASSERT((pm_config != NULL) && (mode != NULL));
@@ -2484,3 +2924,976 @@ int mic_set_smc_persistence_flag(struct mic_device *mdh,
                 return E_MIC_INTERNAL;
         }
 }
+
+/* Response cache */
+int mic_set_cache_policy(struct mic_device *mdh, uint32_t features,
+                         uint32_t ttl_ms)
+{
+    ASSERT(mdh != NULL);
+
+    try {
+        mdh->set_cache_policy(features, ttl_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_cache_age(struct mic_device *mdh, uint32_t feature,
+                      uint32_t *age_ms)
+{
+    ASSERT((mdh != NULL) && (age_ms != NULL));
+
+    try {
+        *age_ms = mdh->get_cache_age(feature);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+/* Device groups */
+int mic_device_group_create(struct mic_device **devices, int n,
+                            struct mic_device_group **group)
+{
+    ASSERT((devices != NULL) && (group != NULL));
+
+    if (n <= 0)
+        return E_MIC_INVAL;
+
+    for (int i = 0; i < n; i++) {
+        if (devices[i] == NULL)
+            return E_MIC_INVAL;
+    }
+
+    try {
+        *group = NULL;
+        *group = new struct mic_device_group(devices, n);
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_set_turbo_mode(struct mic_device_group *group,
+                                    uint32_t mode, int *status)
+{
+    struct group_op op = { group_op::TURBO_MODE, mode, 0 };
+
+    ASSERT(group != NULL);
+
+    try {
+        return group->broadcast(op, status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_set_led_alert(struct mic_device_group *group,
+                                   uint32_t led_alert, int *status)
+{
+    struct group_op op = { group_op::LED_ALERT, led_alert, 0 };
+
+    ASSERT(group != NULL);
+
+    try {
+        return group->broadcast(op, status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_set_power_limit0(struct mic_device_group *group,
+                                      uint32_t power, uint32_t time_window,
+                                      int *status)
+{
+    struct group_op op = { group_op::POWER_LIMIT0, power, time_window };
+
+    ASSERT(group != NULL);
+
+    try {
+        return group->broadcast(op, status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_set_power_limit1(struct mic_device_group *group,
+                                      uint32_t power, uint32_t time_window,
+                                      int *status)
+{
+    struct group_op op = { group_op::POWER_LIMIT1, power, time_window };
+
+    ASSERT(group != NULL);
+
+    try {
+        return group->broadcast(op, status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_set_smc_persistence_flag(struct mic_device_group *group,
+                                              int persist_flag, int *status)
+{
+    struct group_op op = { group_op::SMC_PERSISTENCE, (uint32_t)persist_flag, 0 };
+
+    ASSERT(group != NULL);
+
+    try {
+        return group->broadcast(op, status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_device_group_wait(struct mic_device_group *group, int *status)
+{
+    ASSERT(group != NULL);
+
+    try {
+        return group->wait(status);
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_free_device_group(struct mic_device_group *group)
+{
+    ASSERT(group != NULL);
+    delete group;
+    return E_MIC_SUCCESS;
+}
+
+/* Background collection */
+int mic_collector_create(struct mic_device *mdh, struct mic_collector **coll)
+{
+    ASSERT((mdh != NULL) && (coll != NULL));
+
+    try {
+        *coll = NULL;
+        *coll = new struct mic_collector(mdh);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_collector_set_period(struct mic_collector *coll, uint32_t feature,
+                             uint32_t period_ms)
+{
+    ASSERT(coll != NULL);
+
+    try {
+        coll->set_period(feature, period_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_collector_start(struct mic_collector *coll)
+{
+    ASSERT(coll != NULL);
+
+    try {
+        coll->start();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_collector_stop(struct mic_collector *coll)
+{
+    ASSERT(coll != NULL);
+
+    try {
+        coll->stop();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_collector_read(struct mic_collector *coll, struct mic_snapshot *snap)
+{
+    ASSERT((coll != NULL) && (snap != NULL));
+
+    coll->read(snap);
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_free_collector(struct mic_collector *coll)
+{
+    ASSERT(coll != NULL);
+    delete coll;
+    return E_MIC_SUCCESS;
+}
+
+int mic_alloc_snapshot(struct mic_snapshot **snap)
+{
+    ASSERT(snap != NULL);
+
+    try {
+        *snap = new struct mic_snapshot ();
+        return E_MIC_SUCCESS;
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_seq(struct mic_snapshot *snap, uint64_t *seq)
+{
+    ASSERT((snap != NULL) && (seq != NULL));
+
+    *seq = snap->seq;
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_snapshot_features(struct mic_snapshot *snap, uint32_t *features)
+{
+    ASSERT((snap != NULL) && (features != NULL));
+
+    *features = snap->features;
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_snapshot_time(struct mic_snapshot *snap, uint32_t feature,
+                          uint64_t *time_ms)
+{
+    ASSERT((snap != NULL) && (time_ms != NULL));
+
+    try {
+        snapshot_feature(snap, feature, time_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_thermal_info(struct mic_snapshot *snap,
+                                  struct mic_thermal_info **thermal)
+{
+    ASSERT((snap != NULL) && (thermal != NULL));
+
+    try {
+        *thermal = static_cast<struct mic_thermal_info *>(
+            snapshot_feature(snap, MIC_COLLECT_THERMAL, NULL));
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_power_utilization_info(struct mic_snapshot *snap,
+                                            struct mic_power_util_info **power)
+{
+    ASSERT((snap != NULL) && (power != NULL));
+
+    try {
+        *power = static_cast<struct mic_power_util_info *>(
+            snapshot_feature(snap, MIC_COLLECT_POWER, NULL));
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_memory_utilization_info(struct mic_snapshot *snap,
+                                             struct mic_memory_util_info
+                                             **memory)
+{
+    ASSERT((snap != NULL) && (memory != NULL));
+
+    try {
+        *memory = static_cast<struct mic_memory_util_info *>(
+            snapshot_feature(snap, MIC_COLLECT_MEMORY, NULL));
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_core_util(struct mic_snapshot *snap,
+                               struct mic_core_util **cutil)
+{
+    ASSERT((snap != NULL) && (cutil != NULL));
+
+    try {
+        *cutil = static_cast<struct mic_core_util *>(
+            snapshot_feature(snap, MIC_COLLECT_CORE_UTIL, NULL));
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_nfields(uint32_t *nfields)
+{
+    ASSERT(nfields != NULL);
+    *nfields = snapshot_nfields();
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_snapshot_field_info(uint32_t field, const char **name,
+                                const char **unit, uint32_t *feature)
+{
+    try {
+        snapshot_field_info(field, name, unit, feature);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_find_snapshot_field(const char *name, uint32_t *field)
+{
+    ASSERT((name != NULL) && (field != NULL));
+
+    try {
+        *field = snapshot_find_field(name);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_get_snapshot_field(struct mic_snapshot *snap, uint32_t field,
+                           int64_t *value)
+{
+    ASSERT((snap != NULL) && (value != NULL));
+
+    return snapshot_field_value(snap, field, value);
+}
+
+int mic_free_snapshot(struct mic_snapshot *snap)
+{
+    ASSERT(snap != NULL);
+    delete snap;
+    return E_MIC_SUCCESS;
+}
+
+/* Power sampling */
+int mic_power_sampler_create(struct mic_device *mdh, uint32_t capacity,
+                             struct mic_power_sampler **ps)
+{
+    ASSERT((mdh != NULL) && (ps != NULL));
+
+    try {
+        *ps = NULL;
+        *ps = new struct mic_power_sampler(mdh, capacity);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_power_sampler_set_interval(struct mic_power_sampler *ps,
+                                   uint32_t interval_us)
+{
+    ASSERT(ps != NULL);
+
+    try {
+        ps->set_interval(interval_us);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_power_sampler_start(struct mic_power_sampler *ps)
+{
+    ASSERT(ps != NULL);
+
+    try {
+        ps->start();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_power_sampler_stop(struct mic_power_sampler *ps)
+{
+    ASSERT(ps != NULL);
+
+    try {
+        ps->stop();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_power_sampler_read(struct mic_power_sampler *ps, uint64_t *times_ns,
+                           uint32_t *power, uint32_t *sts, size_t *count)
+{
+    struct power_sample buf[256];
+    size_t chunk, got, n = 0;
+
+    ASSERT((ps != NULL) && (power != NULL) && (count != NULL));
+
+    /* Drained in chunks so that polling never touches the heap */
+    for (; n < *count; n += got) {
+        chunk = *count - n;
+        if (chunk > sizeof(buf) / sizeof(buf[0]))
+            chunk = sizeof(buf) / sizeof(buf[0]);
+        if ((got = ps->read(buf, chunk)) == 0)
+            break;
+        for (size_t i = 0; i < got; i++) {
+            if (times_ns != NULL)
+                times_ns[n + i] = buf[i].time_ns;
+            power[n + i] = buf[i].inst;
+            if (sts != NULL)
+                sts[n + i] = buf[i].inst_sts;
+        }
+    }
+    *count = n;
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_power_sampler_get_dropped(struct mic_power_sampler *ps,
+                                  uint64_t *dropped)
+{
+    ASSERT((ps != NULL) && (dropped != NULL));
+
+    *dropped = ps->dropped();
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_power_sampler_get_errors(struct mic_power_sampler *ps,
+                                 uint64_t *errors)
+{
+    ASSERT((ps != NULL) && (errors != NULL));
+
+    *errors = ps->errors();
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_free_power_sampler(struct mic_power_sampler *ps)
+{
+    ASSERT(ps != NULL);
+    delete ps;
+    return E_MIC_SUCCESS;
+}
+
+/* Energy accounting */
+int mic_energy_meter_create(struct mic_device *mdh, uint32_t interval_us,
+                            struct mic_energy_meter **em)
+{
+    ASSERT((mdh != NULL) && (em != NULL));
+
+    try {
+        *em = NULL;
+        *em = new struct mic_energy_meter(mdh, interval_us);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_energy_meter_update(struct mic_energy_meter *em)
+{
+    ASSERT(em != NULL);
+
+    try {
+        em->update();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_energy_begin(struct mic_energy_meter *em, const char *job)
+{
+    ASSERT((em != NULL) && (job != NULL));
+
+    try {
+        em->begin(job);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_energy_read(struct mic_energy_meter *em, const char *job,
+                    struct mic_energy_info **info)
+{
+    ASSERT((em != NULL) && (job != NULL) && (info != NULL));
+
+    try {
+        *info = NULL;
+        *info = new struct mic_energy_info;
+        em->read(job, *info);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        delete *info;
+        *info = NULL;
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        delete *info;
+        *info = NULL;
+        return E_MIC_NOMEM;
+    } catch (...) {
+        delete *info;
+        *info = NULL;
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_energy_end(struct mic_energy_meter *em, const char *job,
+                   struct mic_energy_info **info)
+{
+    ASSERT((em != NULL) && (job != NULL));
+
+    try {
+        if (info != NULL) {
+            *info = NULL;
+            *info = new struct mic_energy_info;
+        }
+        em->end(job, info != NULL ? *info : NULL);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        if (info != NULL) {
+            delete *info;
+            *info = NULL;
+        }
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        if (info != NULL) {
+            delete *info;
+            *info = NULL;
+        }
+        return E_MIC_NOMEM;
+    } catch (...) {
+        if (info != NULL) {
+            delete *info;
+            *info = NULL;
+        }
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_free_energy_meter(struct mic_energy_meter *em)
+{
+    ASSERT(em != NULL);
+    delete em;
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_duration(struct mic_energy_info *info,
+                            uint64_t *duration_ms)
+{
+    ASSERT((info != NULL) && (duration_ms != NULL));
+    *duration_ms = info->duration_ns / 1000000;
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_consumed(struct mic_energy_info *info,
+                            uint64_t *energy_uj)
+{
+    ASSERT((info != NULL) && (energy_uj != NULL));
+    *energy_uj = (uint64_t)(info->energy_uj + 0.5);
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_avg_power(struct mic_energy_info *info, uint32_t *power)
+{
+    uint64_t measured_ns;
+
+    ASSERT((info != NULL) && (power != NULL));
+
+    /* Averaged over the time that was measured, not the whole job */
+    measured_ns = info->duration_ns - info->unmeasured_ns;
+    *power = measured_ns ?
+        (uint32_t)(info->energy_uj * 1e9 / measured_ns + 0.5) : 0;
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_peak_power(struct mic_energy_info *info, uint32_t *power)
+{
+    ASSERT((info != NULL) && (power != NULL));
+    *power = info->peak_uw;
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_unmeasured_time(struct mic_energy_info *info,
+                                   uint64_t *unmeasured_ms)
+{
+    ASSERT((info != NULL) && (unmeasured_ms != NULL));
+    *unmeasured_ms = info->unmeasured_ns / 1000000;
+    return E_MIC_SUCCESS;
+}
+
+int mic_get_energy_out_of_range(struct mic_energy_info *info,
+                                uint32_t *count)
+{
+    ASSERT((info != NULL) && (count != NULL));
+    *count = info->out_of_range;
+    return E_MIC_SUCCESS;
+}
+
+int mic_free_energy_info(struct mic_energy_info *info)
+{
+    ASSERT(info != NULL);
+    delete info;
+    return E_MIC_SUCCESS;
+}
+
+/* Shared memory telemetry */
+int mic_telemetry_create(const char *name, struct mic_devices_list *devices,
+                         struct mic_telemetry **tel)
+{
+    ASSERT((devices != NULL) && (tel != NULL));
+
+    try {
+        *tel = NULL;
+        *tel = new struct mic_telemetry(
+            (name != NULL) ? name : MIC_TELEMETRY_NAME, devices);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_telemetry_publish(struct mic_telemetry *tel, uint32_t device_num,
+                          struct mic_snapshot *snap)
+{
+    ASSERT((tel != NULL) && (snap != NULL));
+
+    try {
+        tel->publish(device_num, snap);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_telemetry_open(const char *name, struct mic_telemetry **tel)
+{
+    ASSERT(tel != NULL);
+
+    try {
+        *tel = NULL;
+        *tel = new struct mic_telemetry(
+            (name != NULL) ? name : MIC_TELEMETRY_NAME);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_telemetry_get_ndevices(struct mic_telemetry *tel, int *ndevices)
+{
+    ASSERT((tel != NULL) && (ndevices != NULL));
+    *ndevices = tel->num_devices();
+    return E_MIC_SUCCESS;
+}
+
+int mic_telemetry_get_device_at_index(struct mic_telemetry *tel, int index,
+                                      int *device)
+{
+    ASSERT((tel != NULL) && (device != NULL));
+
+    try {
+        *device = tel->device_at_index(index);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_telemetry_read(struct mic_telemetry *tel, uint32_t device_num,
+                       struct mic_snapshot *snap)
+{
+    ASSERT((tel != NULL) && (snap != NULL));
+
+    try {
+        tel->read(device_num, snap);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_telemetry_close(struct mic_telemetry *tel)
+{
+    ASSERT(tel != NULL);
+    delete tel;
+    return E_MIC_SUCCESS;
+}
+
+/* Telemetry recordings */
+int mic_recorder_open(const char *path, uint32_t block_samples,
+                      uint32_t flags, struct mic_recorder **rec)
+{
+    ASSERT((path != NULL) && (rec != NULL));
+
+    try {
+        *rec = NULL;
+        *rec = new struct mic_recorder(path, block_samples, flags);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recorder_append(struct mic_recorder *rec, uint32_t device_num,
+                        struct mic_snapshot *snap)
+{
+    ASSERT((rec != NULL) && (snap != NULL));
+
+    try {
+        rec->append(device_num, snap);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recorder_flush(struct mic_recorder *rec)
+{
+    ASSERT(rec != NULL);
+
+    try {
+        rec->flush();
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recorder_close(struct mic_recorder *rec)
+{
+    int ret = mic_recorder_flush(rec);
+
+    delete rec;
+    return ret;
+}
+
+int mic_recording_open(const char *path, struct mic_recording **rec)
+{
+    ASSERT((path != NULL) && (rec != NULL));
+
+    try {
+        *rec = NULL;
+        *rec = new struct mic_recording(path);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recording_get_nseries(struct mic_recording *rec, uint32_t *nseries)
+{
+    ASSERT((rec != NULL) && (nseries != NULL));
+    *nseries = rec->index().series.size();
+    return E_MIC_SUCCESS;
+}
+
+int mic_recording_get_series_info(struct mic_recording *rec, uint32_t series,
+                                  uint32_t *device_num, const char **name,
+                                  const char **unit)
+{
+    ASSERT(rec != NULL);
+
+    if (series >= rec->index().series.size())
+        return E_MIC_RANGE;
+
+    const struct rec_series_info &info = rec->index().series[series];
+
+    if (device_num != NULL)
+        *device_num = info.device;
+    if (name != NULL)
+        *name = info.name.c_str();
+    if (unit != NULL)
+        *unit = info.unit.c_str();
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_recording_find_series(struct mic_recording *rec, uint32_t device_num,
+                              const char *name, uint32_t *series)
+{
+    ASSERT((rec != NULL) && (name != NULL) && (series != NULL));
+
+    try {
+        *series = rec->find_series(device_num, name);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recording_get_time_range(struct mic_recording *rec,
+                                 int64_t *first_ms, int64_t *last_ms)
+{
+    ASSERT((rec != NULL) && (first_ms != NULL) && (last_ms != NULL));
+
+    try {
+        rec->time_range(first_ms, last_ms);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recording_read(struct mic_recording *rec, uint32_t series,
+                       int64_t from_ms, int64_t to_ms, int64_t *times_ms,
+                       int64_t *values, size_t *count)
+{
+    size_t n;
+
+    ASSERT((rec != NULL) && (count != NULL));
+    ASSERT((times_ms == NULL) == (values == NULL));
+
+    try {
+        n = rec->read(series, from_ms, to_ms, times_ms, values,
+                      (times_ms != NULL) ? *count : 0);
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+
+    if ((times_ms != NULL) && (n > *count)) {
+        *count = n;
+        return E_MIC_RANGE;
+    }
+    *count = n;
+
+    return E_MIC_SUCCESS;
+}
+
+int mic_recording_get_summary(struct mic_recording *rec, uint32_t series,
+                              int64_t from_ms, int64_t to_ms, size_t *count,
+                              int64_t *min, int64_t *max, double *sum)
+{
+    ASSERT((rec != NULL) && (count != NULL) && (min != NULL) &&
+           (max != NULL) && (sum != NULL));
+
+    try {
+        rec->summary(series, from_ms, to_ms, count, min, max, sum);
+        return E_MIC_SUCCESS;
+    } catch (mic_exception const &e) {
+        return e.get_mic_errno();
+    } catch (std::bad_alloc const &e) {
+        return E_MIC_NOMEM;
+    } catch (...) {
+        return E_MIC_INTERNAL;
+    }
+}
+
+int mic_recording_close(struct mic_recording *rec)
+{
+    ASSERT(rec != NULL);
+    delete rec;
+    return E_MIC_SUCCESS;
+}
@@ -35,6 +35,7 @@
 
 /// \file mic_exception.h
 
+#include <stdio.h>
 #include <string.h>
 #include "miclib_exception.h"
 #include "miclib_int.h"
@@ -43,6 +44,11 @@ const int mic_exception::ERROR_STR_MAX = 256;
 __thread char mic_exception::mic_error_str[mic_exception::ERROR_STR_MAX] =
         { '\0' };
 
+__thread const char *mic_exception::mic_error_fmt = NULL;
+__thread unsigned long mic_exception::mic_error_args[3] = { 0, 0, 0 };
+__thread int mic_exception::mic_error_code_pending = E_MIC_SUCCESS;
+__thread int mic_exception::mic_error_ras_pending = 0;
+
 const int mic_exception::MAX_RAS_ERRNO = 10;
 __thread int mic_exception::mic_ras_errno = 0;
 
@@ -79,6 +85,7 @@ mic_exception::mic_exception(mic_error_code internal_err, std::string err_msg,
 
     _ras_errno = mic_ras_errno;
 
+    mic_error_fmt = NULL;
     strncpy(mic_error_str, _error_msg.c_str(), ERROR_STR_MAX - 1);
     mic_error_str[ERROR_STR_MAX - 1] = '\0';
 #ifdef DEBUG
@@ -87,6 +94,13 @@ mic_exception::mic_exception(mic_error_code internal_err, std::string err_msg,
 #endif
 }
 
+mic_exception::mic_exception(mic_error_code internal_err) throw()
+    : _mic_errno(internal_err)
+{
+    _sys_errno = errno;
+    _ras_errno = mic_ras_errno;
+}
+
 mic_exception::~mic_exception() throw()
 {
 }
@@ -126,6 +140,21 @@ const char *mic_exception::ts_get_error_msg()
      * if you need to change the string, be sure to do the same at that
      * location.
      */
+    if (mic_error_fmt != NULL) {
+        const char *ras_msg = NULL;
+        int len;
+
+        len = snprintf(mic_error_str, ERROR_STR_MAX, mic_error_fmt,
+                       mic_error_args[0], mic_error_args[1],
+                       mic_error_args[2]);
+        if (mic_error_code_pending == E_MIC_RAS_ERROR)
+            ras_msg = ras_strerror(mic_error_ras_pending);
+        if (ras_msg != NULL && len >= 0 && len < ERROR_STR_MAX)
+            snprintf(mic_error_str + len, ERROR_STR_MAX - len, ": %s",
+                     ras_msg);
+        mic_error_fmt = NULL;
+    }
+
     if (mic_error_str[0] == '\0')
         strcpy(mic_error_str, "No error registered");
 
@@ -134,9 +163,57 @@ const char *mic_exception::ts_get_error_msg()
 
 void mic_exception::ts_clear_error_msg()
 {
+    mic_error_fmt = NULL;
     mic_error_str[0] = '\0';
 }
 
+int mic_exception::ts_set_error(mic_error_code internal_err,
+                                int sys_error_code, int ras_errno,
+                                const char *fmt, unsigned long arg0,
+                                unsigned long arg1, unsigned long arg2) throw()
+{
+    if (sys_error_code != 0)
+        errno = sys_error_code;
+
+    if (ras_errno != 0)
+        mic_ras_errno = ras_errno;
+
+    mic_error_fmt = fmt;
+    mic_error_args[0] = arg0;
+    mic_error_args[1] = arg1;
+    mic_error_args[2] = arg2;
+    mic_error_code_pending = internal_err;
+    mic_error_ras_pending = mic_ras_errno;
+
+    return internal_err;
+}
+
+void mic_exception::ts_save_error(mic_error_code internal_err,
+                                  struct error_record *rec) throw()
+{
+    rec->mic_errno = internal_err;
+    rec->sys_errno = errno;
+    rec->ras_errno = mic_ras_errno;
+    if (mic_error_fmt != NULL) {
+        rec->fmt = mic_error_fmt;
+        rec->args[0] = mic_error_args[0];
+        rec->args[1] = mic_error_args[1];
+        rec->args[2] = mic_error_args[2];
+    } else {
+        /* The message was already formatted in thread-local storage */
+        rec->fmt = "error 0x%lx";
+        rec->args[0] = internal_err;
+        rec->args[1] = 0;
+        rec->args[2] = 0;
+    }
+}
+
+int mic_exception::ts_restore_error(const struct error_record *rec) throw()
+{
+    return ts_set_error(rec->mic_errno, rec->sys_errno, rec->ras_errno,
+                        rec->fmt, rec->args[0], rec->args[1], rec->args[2]);
+}
+
 int mic_exception::ts_get_ras_errno()
 {
     return mic_ras_errno;
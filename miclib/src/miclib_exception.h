@@ -66,6 +66,11 @@ public:
     mic_exception(mic_error_code internal_err, std::string err_msg,
                   int sys_error_code = 0, int ras_errno = 0) throw();
 
+    /// \brief Construct a mic_exception for an error already recorded
+    /// with ts_set_error(), keeping its message unformatted.
+    /// \param internal_err The internal error number.
+    explicit mic_exception(mic_error_code internal_err) throw();
+
     /// \brief mic_exception destructor
     ~mic_exception() throw();
 
@@ -91,6 +96,36 @@ public:
     static const char *ts_get_error_msg();
     static void ts_clear_error_msg();
 
+    /// \brief Record an error without throwing.
+    ///
+    /// Only the printf format and its arguments are stored; the message
+    /// is built the next time ts_get_error_msg() is called. The format
+    /// must have static storage and take at most three unsigned longs.
+    /// An E_MIC_RAS_ERROR message is followed by the RAS error string.
+    /// \return internal_err, so callers may return the result directly.
+    static int ts_set_error(mic_error_code internal_err, int sys_error_code,
+                            int ras_errno, const char *fmt,
+                            unsigned long arg0 = 0, unsigned long arg1 = 0,
+                            unsigned long arg2 = 0) throw();
+
+    /// \brief An error recorded with ts_set_error(), as carried from the
+    /// thread that recorded it to the one that reports it.
+    struct error_record {
+        mic_error_code mic_errno;
+        int sys_errno;
+        int ras_errno;
+        const char *fmt;
+        unsigned long args[3];
+    };
+
+    /// \brief Save the calling thread's last recorded error.
+    static void ts_save_error(mic_error_code internal_err,
+                              struct error_record *rec) throw();
+
+    /// \brief Record a saved error in the calling thread.
+    /// \return The saved error code.
+    static int ts_restore_error(const struct error_record *rec) throw();
+
     static int ts_get_ras_errno();
     static const char *ras_strerror(int ras_errno);
     static void ts_clear_ras_errno();
@@ -101,6 +136,12 @@ private:
     // Don't use this variable directly, use ts_get_error_msg
     static __thread char mic_error_str[];
 
+    // Pending message recorded by ts_set_error, formatted on demand
+    static __thread const char *mic_error_fmt;
+    static __thread unsigned long mic_error_args[3];
+    static __thread int mic_error_code_pending;
+    static __thread int mic_error_ras_pending;
+
     // Don't use this variable directly, use ts_get_ras_errno
     static __thread int mic_ras_errno;
 
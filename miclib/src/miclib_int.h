@@ -41,6 +41,7 @@
 #include <string>
 #include <limits.h>
 #include <mic/micras_api.h>
+#include "miclib.h"
 #ifndef __linux__
 #define bzero(b, len)    (memset((b), '\0', (len)), (void)0)
 #define NAME_MAX    (1000)
@@ -55,6 +56,7 @@ extern "C" {
 #endif
 struct mic_devices_list {
     int n_devices;
+    uint64_t generation;        /* device_cache generation it came from */
     int devices[1];
 };
 
@@ -185,6 +187,24 @@ struct mic_core_util {
     MrRspCutl c_util;
 };
 
+struct mic_snapshot {
+    uint64_t                    seq;        /* Publication number */
+    uint32_t                    features;   /* MIC_COLLECT_* sampled */
+    uint64_t                    time_ms[MIC_COLLECT_NFEATURES];
+    struct mic_thermal_info     thermal;
+    struct mic_power_util_info  power;
+    struct mic_memory_util_info memory;
+    struct mic_core_util        cutil;
+};
+
+struct mic_energy_info {
+    uint64_t duration_ns;       /* Since the job began */
+    uint64_t unmeasured_ns;     /* Part of it with no usable reading */
+    double   energy_uj;
+    uint32_t peak_uw;
+    uint32_t out_of_range;      /* Readings flagged by the SMC */
+};
+
 struct mic_flash_op {
     struct mic_device *   mdh;
     struct host_flash_op *h_desc;
@@ -224,5 +244,25 @@ enum mic_device_modes {
 
 #ifdef __cplusplus
 }
+
+void core_util_delta(const struct mic_core_util *prev,
+                     const struct mic_core_util *cur, double *user,
+                     double *nice, double *sys, double *idle, double *device);
+void core_util_counters(const struct mic_core_util *cutil,
+                        uint16_t *num_cores, uint64_t *user, uint64_t *nice,
+                        uint64_t *sys, uint64_t *idle);
+void *snapshot_feature(struct mic_snapshot *snap, uint32_t feature,
+                       uint64_t *time_ms);
+uint32_t snapshot_nfields();
+void snapshot_field_info(uint32_t field, const char **name, const char **unit,
+                         uint32_t *feature);
+uint32_t snapshot_find_field(const char *name);
+int snapshot_field_value(const struct mic_snapshot *snap, uint32_t field,
+                         int64_t *value) throw();
+ssize_t sysfs_read(const char *path, char *buf, size_t size);
+const char *parse_uint(const char *first, const char *last, int base,
+                       uint64_t *value);
+const char *uevent_find(const char *buf, size_t len, const char *key,
+                        size_t *vlen);
 #endif
 #endif /* MICLIB_SRC_MICLIB_INT_H_ */
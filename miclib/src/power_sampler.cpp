@@ -0,0 +1,337 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file power_sampler.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include <string>
+#include "power_sampler.h"
+#include "host_platform.h"
+#include "mic_device.h"
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+namespace {
+
+/* Ring size when the caller leaves it to us, and the largest accepted */
+const uint32_t POWER_RING_DEFAULT = 4096;
+const uint32_t POWER_RING_MAX = 1U << 24;
+
+/* Pause after a failed request so that a card going away is not hammered */
+const uint64_t POWER_ERROR_BACKOFF_NS = 100000000ULL;
+
+uint64_t clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Adds a sysfs cpu list such as "0-7,16-23" to set */
+void parse_cpulist(const char *list, cpu_set_t *set)
+{
+    char *end;
+    unsigned long first, last;
+
+    while (*list != '\0' && *list != '\n') {
+        first = strtoul(list, &end, 10);
+        if (end == list)
+            return;
+        last = first;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtoul(list, &end, 10);
+            if (end == list)
+                return;
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++)
+            CPU_SET(first, set);
+        list = end;
+        if (*list == ',')
+            list++;
+    }
+}
+
+}
+
+mic_power_sampler::mic_power_sampler(struct mic_device *mdh,
+                                     uint32_t capacity) :
+    _mdh(mdh), _running(false), _stopping(false), _interval_ns(0),
+    _next_ns(0), _pinned(false), _ring(NULL), _mask(0), _head(0),
+    _dropped(0), _errors(0), _tail(0)
+{
+    pthread_condattr_t attr;
+    uint32_t size = 1;
+
+    if (capacity == 0)
+        capacity = POWER_RING_DEFAULT;
+    if (capacity > POWER_RING_MAX)
+        throw mic_exception(E_MIC_RANGE, "power sampler ring too large");
+    while (size < capacity)
+        size <<= 1;
+
+    memset(&_power, 0, sizeof(_power));
+    local_cpus();
+
+    _ring = new struct power_sample[size];
+    _mask = size - 1;
+
+    if (pthread_mutex_init(&_mutex, NULL) != 0) {
+        delete [] _ring;
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_init");
+    }
+
+    if ((pthread_condattr_init(&attr) != 0) ||
+        (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+        (pthread_cond_init(&_cond, &attr) != 0)) {
+        pthread_mutex_destroy(&_mutex);
+        delete [] _ring;
+        throw mic_exception(E_MIC_SYSTEM, "pthread_cond_init");
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+mic_power_sampler::~mic_power_sampler()
+{
+    try {
+        stop();
+    } catch (...) {
+    }
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+    delete [] _ring;
+}
+
+/*
+ * Works out which CPUs the sampling thread should run on: those the
+ * kernel lists as local to the card's PCI slot, less any this process
+ * may not use. Pinning is best effort; without the list the thread is
+ * left wherever the scheduler puts it.
+ */
+void mic_power_sampler::local_cpus()
+{
+    char path[PATH_MAX];
+    char list[4096];
+    uint32_t device_num;
+    cpu_set_t allowed;
+
+    CPU_ZERO(&_cpus);
+    _mdh->get_device_num(&device_num);
+    snprintf(path, sizeof(path), "%s/mic%u/device/local_cpulist",
+             host_platform::get_sysfs_base_path().c_str(), device_num);
+
+    if (sysfs_read(path, list, sizeof(list)) <= 0)
+        return;
+    parse_cpulist(list, &_cpus);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        CPU_AND(&_cpus, &_cpus, &allowed);
+    _pinned = CPU_COUNT(&_cpus) > 0;
+}
+
+void mic_power_sampler::set_interval(uint32_t interval_us)
+{
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    _interval_ns = (uint64_t)interval_us * 1000;
+    _next_ns = 0;
+    pthread_cond_signal(&_cond);
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+}
+
+void mic_power_sampler::start()
+{
+    pthread_attr_t attr;
+    int err;
+
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    if (_running) {
+        pthread_mutex_unlock(&_mutex);
+        throw mic_exception(E_MIC_INVAL, "power sampler already running");
+    }
+
+    if ((err = pthread_attr_init(&attr)) != 0) {
+        pthread_mutex_unlock(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_attr_init", err);
+    }
+    if (_pinned)
+        pthread_attr_setaffinity_np(&attr, sizeof(_cpus), &_cpus);
+
+    _stopping = false;
+    _next_ns = 0;
+    err = pthread_create(&_thread, &attr, run, this);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pthread_mutex_unlock(&_mutex);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_create", err);
+    }
+    _running = true;
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+}
+
+void mic_power_sampler::stop()
+{
+    if (pthread_mutex_lock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_lock");
+
+    if (!_running) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    _stopping = true;
+    pthread_cond_signal(&_cond);
+
+    if (pthread_mutex_unlock(&_mutex) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "pthread_mutex_unlock");
+
+    pthread_join(_thread, NULL);
+    _running = false;
+}
+
+/*
+ * Copies out and releases up to count of the oldest readings. Only one
+ * thread may read a given sampler at a time.
+ */
+size_t mic_power_sampler::read(struct power_sample *samples, size_t count)
+{
+    uint64_t tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+    size_t n;
+
+    if (count > head - tail)
+        count = head - tail;
+
+    for (n = 0; n < count; n++)
+        samples[n] = _ring[(tail + n) & _mask];
+
+    __atomic_store_n(&_tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+uint64_t mic_power_sampler::dropped() const
+{
+    return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+uint64_t mic_power_sampler::errors() const
+{
+    return __atomic_load_n(&_errors, __ATOMIC_RELAXED);
+}
+
+void *mic_power_sampler::run(void *arg)
+{
+    static_cast<mic_power_sampler *>(arg)->sample_loop();
+    return NULL;
+}
+
+void mic_power_sampler::sample_loop()
+{
+    uint64_t now;
+    struct timespec ts;
+    bool ok;
+
+    pthread_mutex_lock(&_mutex);
+    while (!_stopping) {
+        now = clock_ns();
+        if (_next_ns > now) {
+            ts.tv_sec = _next_ns / 1000000000ULL;
+            ts.tv_nsec = _next_ns % 1000000000ULL;
+            pthread_cond_timedwait(&_cond, &_mutex, &ts);
+            continue;
+        }
+
+        if (_interval_ns != 0) {
+            /* Keep to the schedule, but skip ticks that were missed */
+            _next_ns = (_next_ns == 0 ? now : _next_ns) + _interval_ns;
+            if (_next_ns <= now)
+                _next_ns = now + _interval_ns;
+        }
+
+        pthread_mutex_unlock(&_mutex);
+        ok = sample();
+        pthread_mutex_lock(&_mutex);
+
+        if (!ok && _next_ns < now + POWER_ERROR_BACKOFF_NS)
+            _next_ns = now + POWER_ERROR_BACKOFF_NS;
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool mic_power_sampler::sample()
+{
+    struct power_sample s;
+    uint64_t sent, head;
+
+    sent = clock_ns();
+    if (_mdh->sample_power_utilization_info(&_power) != E_MIC_SUCCESS) {
+        __atomic_add_fetch(&_errors, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    s.time_ns = sent + (clock_ns() - sent) / 2;
+
+    s.inst = _power.pwr.inst.prr;
+    s.inst_sts = _power.pwr.inst.p_val;
+    s.tot0 = _power.pwr.tot0.prr;
+    s.tot0_sts = _power.pwr.tot0.p_val;
+    s.tot1 = _power.pwr.tot1.prr;
+    s.tot1_sts = _power.pwr.tot1.p_val;
+
+    head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE) > _mask) {
+        __atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    _ring[head & _mask] = s;
+    __atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file power_sampler.h
+/// \brief High rate sampling of card power into a single reader ring.
+
+#ifndef MICLIB_SRC_POWER_SAMPLER_H_
+#define MICLIB_SRC_POWER_SAMPLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+#include "miclib_int.h"
+
+/// \brief One power utilization reply, as stored in the ring.
+struct power_sample {
+    uint64_t time_ns;   /* CLOCK_MONOTONIC, middle of the request */
+    uint32_t inst;      /* Instantaneous power, uW */
+    uint32_t tot0;      /* Average over time window 0, uW */
+    uint32_t tot1;      /* Average over time window 1, uW */
+    uint8_t  inst_sts;  /* Sensor status of each reading */
+    uint8_t  tot0_sts;
+    uint8_t  tot1_sts;
+};
+
+/// \brief Polls a device for power only, as fast as asked, on its own thread.
+///
+/// The sampling thread reuses one reply buffer, issues nothing but the
+/// power utilization request and runs on the host CPUs local to the
+/// card's PCI slot when the kernel reports them. Readings are pushed into
+/// a power of two sized ring with one producer and one consumer: neither
+/// side locks, and when the consumer falls behind new readings are
+/// dropped and counted rather than overwriting ones it may be copying.
+struct mic_power_sampler {
+public:
+    mic_power_sampler(struct mic_device *mdh, uint32_t capacity);
+    ~mic_power_sampler();
+
+    void set_interval(uint32_t interval_us);
+    void start();
+    void stop();
+    size_t read(struct power_sample *samples, size_t count);
+    uint64_t dropped() const;
+    uint64_t errors() const;
+
+private:
+    mic_power_sampler(const mic_power_sampler &);
+    mic_power_sampler &operator=(const mic_power_sampler &);
+
+    static void *run(void *arg);
+    void local_cpus();
+    void sample_loop();
+    bool sample();
+
+    struct mic_device *_mdh;
+    pthread_t _thread;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    bool _running;
+    bool _stopping;
+    uint64_t _interval_ns;
+    uint64_t _next_ns;
+    bool _pinned;
+    cpu_set_t _cpus;
+    struct mic_power_util_info _power;
+    struct power_sample *_ring;
+    uint64_t _mask;
+    /* _head is only written by the sampling thread and _tail only by the
+     * reader; the padding keeps them off each other's cache line. */
+    uint64_t _head;
+    uint64_t _dropped;
+    uint64_t _errors;
+    char _pad[64];
+    uint64_t _tail;
+};
+
+#endif /* MICLIB_SRC_POWER_SAMPLER_H_ */
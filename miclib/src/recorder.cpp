@@ -0,0 +1,1041 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file recorder.cpp
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <limits>
+#include "recorder.h"
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+namespace {
+
+const uint32_t DEFAULT_BLOCK_SAMPLES = 600;
+const uint32_t MAX_BLOCK_SAMPLES = 65536;
+
+const char *const CORE_COUNTERS[MIC_CUTIL_NSTATS] = {
+    "user", "nice", "sys", "idle"
+};
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+uint64_t zigzag(uint64_t v)
+{
+    return (v << 1) ^ (uint64_t)((int64_t)v >> 63);
+}
+
+uint64_t unzigzag(uint64_t v)
+{
+    return (v >> 1) ^ (uint64_t)-(int64_t)(v & 1);
+}
+
+/// \brief Packs bit fields most significant bit first.
+class bit_writer {
+public:
+    bit_writer(std::vector<uint8_t> &out) : _out(out), _bit(0) {}
+
+    void put(uint64_t v, unsigned n)
+    {
+        while (n > 0) {
+            unsigned room = 8 - _bit;
+            unsigned take = (n < room) ? n : room;
+
+            if (_bit == 0)
+                _out.push_back(0);
+            _out.back() |= ((v >> (n - take)) & ((1U << take) - 1)) <<
+                           (room - take);
+            _bit = (_bit + take) & 7;
+            n -= take;
+        }
+    }
+
+private:
+    std::vector<uint8_t> &_out;
+    unsigned _bit;
+};
+
+class bit_reader {
+public:
+    bit_reader(const uint8_t *data, size_t size) :
+        _data(data), _size(size), _pos(0), _bit(0) {}
+
+    uint64_t get(unsigned n)
+    {
+        uint64_t v = 0;
+
+        while (n > 0) {
+            unsigned room = 8 - _bit;
+            unsigned take = (n < room) ? n : room;
+
+            if (_pos >= _size)
+                throw mic_exception(E_MIC_INVAL, "recording block corrupt");
+            v = (v << take) |
+                ((_data[_pos] >> (room - take)) & ((1U << take) - 1));
+            _bit += take;
+            if (_bit == 8) {
+                _bit = 0;
+                _pos++;
+            }
+            n -= take;
+        }
+
+        return v;
+    }
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _pos;
+    unsigned _bit;
+};
+
+/*
+ * Delta-of-delta coding: samples taken at a steady rate, and counters
+ * that grow at a steady rate, cost one bit each. The prefix selects how
+ * many bits of zigzagged difference follow.
+ */
+void put_dod(bit_writer &w, uint64_t dod)
+{
+    uint64_t zz = zigzag(dod);
+
+    if (zz == 0) {
+        w.put(0, 1);
+    } else if (zz < (1U << 7)) {
+        w.put(0x2, 2);
+        w.put(zz, 7);
+    } else if (zz < (1U << 9)) {
+        w.put(0x6, 3);
+        w.put(zz, 9);
+    } else if (zz < (1U << 12)) {
+        w.put(0xe, 4);
+        w.put(zz, 12);
+    } else if (zz < (1ULL << 32)) {
+        w.put(0x1e, 5);
+        w.put(zz, 32);
+    } else {
+        w.put(0x1f, 5);
+        w.put(zz, 64);
+    }
+}
+
+uint64_t get_dod(bit_reader &r)
+{
+    static const unsigned bits[] = { 7, 9, 12, 32 };
+
+    if (r.get(1) == 0)
+        return 0;
+    for (size_t i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+        if (r.get(1) == 0)
+            return unzigzag(r.get(bits[i]));
+    }
+    return unzigzag(r.get(64));
+}
+
+/* Differences wrap around in unsigned arithmetic, and so decode exactly */
+void encode_dod(bit_writer &w, const std::vector<int64_t> &v)
+{
+    uint64_t delta = 0;
+
+    for (size_t i = 1; i < v.size(); i++) {
+        uint64_t d = (uint64_t)v[i] - (uint64_t)v[i - 1];
+
+        put_dod(w, d - delta);
+        delta = d;
+    }
+}
+
+void decode_dod(bit_reader &r, int64_t first, size_t n,
+                std::vector<int64_t> &v)
+{
+    uint64_t cur = first;
+    uint64_t delta = 0;
+
+    v.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) {
+            delta += get_dod(r);
+            cur += delta;
+        }
+        v[i] = (int64_t)cur;
+    }
+}
+
+/*
+ * XOR coding: a value equal to the previous one costs one bit; otherwise
+ * only the bits that differ are stored, reusing the previous window of
+ * leading and trailing zeros when the difference fits in it.
+ */
+void encode_xor(bit_writer &w, const std::vector<int64_t> &v)
+{
+    unsigned lead = 0, trail = 0;
+    bool window = false;
+
+    for (size_t i = 1; i < v.size(); i++) {
+        uint64_t x = (uint64_t)v[i] ^ (uint64_t)v[i - 1];
+        unsigned lz, tz;
+
+        if (x == 0) {
+            w.put(0, 1);
+            continue;
+        }
+        lz = __builtin_clzll(x);
+        tz = __builtin_ctzll(x);
+        if (window && (lz >= lead) && (tz >= trail)) {
+            w.put(0x2, 2);
+            w.put(x >> trail, 64 - lead - trail);
+        } else {
+            w.put(0x3, 2);
+            w.put(lz, 6);
+            w.put(63 - lz - tz, 6);
+            w.put(x >> tz, 64 - lz - tz);
+            lead = lz;
+            trail = tz;
+            window = true;
+        }
+    }
+}
+
+void decode_xor(bit_reader &r, size_t n, std::vector<int64_t> &v)
+{
+    unsigned lead = 0, trail = 0;
+
+    v.resize(n);
+    for (size_t i = 1; i < n; i++) {
+        uint64_t x = 0;
+
+        if (r.get(1) != 0) {
+            if (r.get(1) != 0) {
+                lead = r.get(6);
+                trail = 63 - lead - r.get(6);
+                if (trail > 63)
+                    throw mic_exception(E_MIC_INVAL,
+                                        "recording block corrupt");
+            }
+            x = r.get(64 - lead - trail) << trail;
+        }
+        v[i] = (int64_t)((uint64_t)v[i - 1] ^ x);
+    }
+}
+
+/// \brief Stores whichever coding is smaller for this block of values,
+/// and summarizes them.
+void encode_column(std::vector<uint8_t> &out, uint32_t series,
+                   const std::vector<int64_t> &values,
+                   const std::vector<uint8_t> &present,
+                   struct rec_series_stats *stats)
+{
+    std::vector<int64_t> v;
+    std::vector<uint8_t> bitmap((present.size() + 7) / 8, 0);
+    std::vector<uint8_t> xs, ds;
+    bit_writer xw(xs), dw(ds);
+    const std::vector<uint8_t> *best;
+    struct rec_column col;
+
+    stats->series = series;
+    stats->min = std::numeric_limits<int64_t>::max();
+    stats->max = std::numeric_limits<int64_t>::min();
+    stats->sum = 0;
+    for (size_t i = 0; i < present.size(); i++) {
+        if (present[i]) {
+            v.push_back(values[i]);
+            bitmap[i / 8] |= 0x80 >> (i % 8);
+            stats->min = std::min(stats->min, values[i]);
+            stats->max = std::max(stats->max, values[i]);
+            stats->sum += values[i];
+        }
+    }
+    stats->count = v.size();
+
+    xw.put(v[0], 64);
+    encode_xor(xw, v);
+    dw.put(v[0], 64);
+    encode_dod(dw, v);
+    best = (ds.size() < xs.size()) ? &ds : &xs;
+
+    memset(&col, 0, sizeof(col));
+    col.series = series;
+    col.mode = (best == &ds) ? REC_COL_DELTA : REC_COL_XOR;
+    col.nbytes = best->size();
+    if (v.size() < present.size()) {
+        col.mode |= REC_COL_SPARSE;
+        col.nbytes += bitmap.size();
+    }
+
+    out.insert(out.end(), (const uint8_t *)&col,
+               (const uint8_t *)(&col + 1));
+    if (col.mode & REC_COL_SPARSE)
+        out.insert(out.end(), bitmap.begin(), bitmap.end());
+    out.insert(out.end(), best->begin(), best->end());
+}
+
+int64_t clock_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool block_before(const struct rec_block_info &blk, size_t offset)
+{
+    return blk.offset < offset;
+}
+
+/* Orders indices into rec_index::blocks by the blocks' t_first */
+struct starts_before {
+    const std::vector<struct rec_block_info> *blocks;
+
+    bool operator()(size_t a, size_t b) const
+    {
+        return (*blocks)[a].t_first < (*blocks)[b].t_first;
+    }
+};
+
+/* Finds the first block that reaches a time, given indices sorted by
+ * t_first */
+struct reach_before {
+    const std::vector<struct rec_block_info> *blocks;
+
+    bool operator()(size_t i, int64_t t) const
+    {
+        return (*blocks)[i].t_reach < t;
+    }
+};
+
+mic_error_code file_error(int err)
+{
+    switch (err) {
+    case ENOENT:
+        return E_MIC_NOENT;
+    case EACCES:
+    case EPERM:
+    case EWOULDBLOCK:
+        return E_MIC_ACCESS;
+    case ENOMEM:
+        return E_MIC_NOMEM;
+    default:
+        return E_MIC_SYSTEM;
+    }
+}
+
+}
+
+void rec_index::scan(const char *base, size_t size)
+{
+    const struct rec_file_header *fh =
+        reinterpret_cast<const struct rec_file_header *>(base);
+    size_t off;
+
+    if ((size < sizeof(*fh)) || (fh->magic != REC_MAGIC))
+        throw mic_exception(E_MIC_INVAL, "not a telemetry recording");
+    if ((fh->version != REC_VERSION) || (fh->header_size < sizeof(*fh)) ||
+        (fh->header_size % 8) || (fh->header_size > size))
+        throw mic_exception(E_MIC_INVAL, "recording version mismatch");
+
+    series.clear();
+    blocks.clear();
+    device_blocks.clear();
+
+    /* Stop at the first record that is torn or does not make sense */
+    for (off = fh->header_size; size - off >= sizeof(struct rec_record);
+         off += reinterpret_cast<const struct rec_record *>(base + off)->size) {
+        const struct rec_record *rec =
+            reinterpret_cast<const struct rec_record *>(base + off);
+
+        if ((rec->size < sizeof(*rec)) || (rec->size % 8) ||
+            (rec->size > size - off))
+            break;
+
+        if (rec->type == REC_TYPE_SERIES) {
+            const struct rec_series *s =
+                reinterpret_cast<const struct rec_series *>(rec);
+            const char *name = (const char *)(s + 1);
+            const char *end = base + off + rec->size;
+            const char *unit;
+            struct rec_series_info info;
+
+            if ((rec->size < sizeof(*s)) || (s->id != series.size()))
+                break;
+            unit = (const char *)memchr(name, '\0', end - name);
+            if ((unit == NULL) || (++unit == end) ||
+                (memchr(unit, '\0', end - unit) == NULL))
+                break;
+
+            info.device = s->device;
+            info.name = name;
+            info.unit = unit;
+            series.push_back(info);
+        } else if (rec->type == REC_TYPE_BLOCK) {
+            const struct rec_block *b =
+                reinterpret_cast<const struct rec_block *>(rec);
+            struct rec_block_info info;
+
+            if ((rec->size < sizeof(*b)) || (b->nsamples == 0) ||
+                (b->ts_bytes > rec->size - sizeof(*b)))
+                break;
+
+            info.offset = off;
+            info.device = b->device;
+            info.nsamples = b->nsamples;
+            info.t_first = b->t_first;
+            info.t_last = b->t_last;
+            info.t_reach = b->t_last;
+            info.indexed = false;
+            info.first_stat = 0;
+            info.nstats = 0;
+            device_blocks[info.device].push_back(blocks.size());
+            blocks.push_back(info);
+        } else if (rec->type == REC_TYPE_INDEX) {
+            const struct rec_block_index *ix =
+                reinterpret_cast<const struct rec_block_index *>(rec);
+
+            if ((rec->size < sizeof(*ix)) ||
+                ((uint64_t)ix->nblocks * sizeof(struct rec_index_entry) +
+                 (uint64_t)ix->nstats * sizeof(struct rec_series_stats) >
+                 rec->size - sizeof(*ix)))
+                break;
+            add_index(ix);
+        }
+        /* Other record types are skipped */
+    }
+
+    end = off;
+    sort_device_blocks();
+}
+
+/// \brief Orders each device's blocks by time and works out how far each
+/// prefix of them reaches, so queries can binary search for a range.
+void rec_index::sort_device_blocks()
+{
+    std::map<uint32_t, std::vector<size_t> >::iterator it;
+    struct starts_before cmp = { &blocks };
+
+    for (it = device_blocks.begin(); it != device_blocks.end(); ++it) {
+        std::vector<size_t> &list = it->second;
+        int64_t reach = std::numeric_limits<int64_t>::min();
+
+        /* Already in order unless the clock was stepped back while
+         * recording */
+        std::stable_sort(list.begin(), list.end(), cmp);
+        for (size_t i = 0; i < list.size(); i++) {
+            reach = std::max(reach, blocks[list[i]].t_last);
+            blocks[list[i]].t_reach = reach;
+        }
+    }
+}
+
+/// \brief Returns the first block in list that may hold samples at or
+/// after from_ms; every earlier one ends before it.
+std::vector<size_t>::const_iterator rec_index::first_block(
+    const std::vector<size_t> &list, int64_t from_ms) const
+{
+    struct reach_before cmp = { &blocks };
+
+    return std::lower_bound(list.begin(), list.end(), from_ms, cmp);
+}
+
+/// \brief Attaches the summaries of an index record to its blocks.
+void rec_index::add_index(const struct rec_block_index *ix)
+{
+    const struct rec_index_entry *e =
+        reinterpret_cast<const struct rec_index_entry *>(ix + 1);
+    const struct rec_series_stats *st =
+        reinterpret_cast<const struct rec_series_stats *>(e + ix->nblocks);
+
+    for (uint32_t i = 0; i < ix->nblocks; i++) {
+        std::vector<struct rec_block_info>::iterator blk =
+            std::lower_bound(blocks.begin(), blocks.end(), e[i].offset,
+                             block_before);
+
+        if ((blk == blocks.end()) || (blk->offset != e[i].offset) ||
+            (e[i].first_stat > ix->nstats) ||
+            (e[i].nstats > ix->nstats - e[i].first_stat))
+            continue;
+
+        blk->indexed = true;
+        blk->first_stat = stats.size();
+        blk->nstats = e[i].nstats;
+        stats.insert(stats.end(), st + e[i].first_stat,
+                     st + e[i].first_stat + e[i].nstats);
+    }
+}
+
+mic_recorder::mic_recorder(const char *path, uint32_t block_samples,
+                           uint32_t flags) :
+    _fd(-1), _end(0),
+    _block_samples(block_samples ? block_samples : DEFAULT_BLOCK_SAMPLES),
+    _flags(flags), _nseries(0)
+{
+    struct stat st;
+
+    if (_block_samples > MAX_BLOCK_SAMPLES)
+        throw mic_exception(E_MIC_RANGE, "block holds too many samples",
+                            ERANGE);
+
+    if ((_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+        throw mic_exception(file_error(errno), "open", errno);
+
+    try {
+        /* Two recorders appending to one file would interleave blocks */
+        if (flock(_fd, LOCK_EX | LOCK_NB) < 0)
+            throw mic_exception(file_error(errno), "recording in use",
+                                errno);
+
+        if (fstat(_fd, &st) < 0)
+            throw mic_exception(E_MIC_SYSTEM, "fstat", errno);
+
+        if (st.st_size == 0) {
+            struct rec_file_header fh;
+
+            memset(&fh, 0, sizeof(fh));
+            fh.magic = REC_MAGIC;
+            fh.version = REC_VERSION;
+            fh.header_size = sizeof(fh);
+            fh.created_ms = clock_ms();
+            write_all(&fh, sizeof(fh));
+        } else {
+            resume(st.st_size);
+        }
+    } catch (...) {
+        close(_fd);
+        throw;
+    }
+}
+
+mic_recorder::~mic_recorder()
+{
+    try {
+        flush();
+    } catch (...) {
+    }
+    close(_fd);
+}
+
+/// \brief Picks up the series of an existing recording and drops any
+/// record torn by a recorder that died while writing it.
+void mic_recorder::resume(size_t size)
+{
+    struct rec_index index;
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, _fd, 0);
+
+    if (addr == MAP_FAILED)
+        throw mic_exception(file_error(errno), "mmap", errno);
+
+    try {
+        index.scan(static_cast<const char *>(addr), size);
+    } catch (...) {
+        munmap(addr, size);
+        throw;
+    }
+    munmap(addr, size);
+
+    for (size_t i = 0; i < index.series.size(); i++) {
+        const struct rec_series_info &s = index.series[i];
+
+        _series[std::make_pair(s.device, s.name)] = i;
+    }
+    _nseries = index.series.size();
+    _end = index.end;
+
+    if ((_end < size) && (ftruncate(_fd, _end) < 0))
+        throw mic_exception(E_MIC_SYSTEM, "ftruncate", errno);
+}
+
+void mic_recorder::write_all(const void *data, size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = pwrite(_fd, p + done, size - done, _end + done);
+
+        if (n < 0) {
+            int err = errno;
+
+            if (err == EINTR)
+                continue;
+            /* Leave no torn record behind for readers to stop at */
+            if (ftruncate(_fd, _end) < 0) {
+            }
+            throw mic_exception(file_error(err), "write", err);
+        }
+        done += n;
+    }
+    _end += size;
+}
+
+uint32_t mic_recorder::series_id(uint32_t device, const char *name,
+                                 const char *unit)
+{
+    std::pair<uint32_t, std::string> key(device, name);
+    std::map<std::pair<uint32_t, std::string>, uint32_t>::iterator it =
+        _series.find(key);
+    std::vector<char> rec;
+    struct rec_series s;
+    size_t len;
+
+    if (it != _series.end())
+        return it->second;
+
+    len = strlen(name) + 1 + strlen(unit) + 1;
+    rec.resize(align8(sizeof(s) + len), 0);
+
+    memset(&s, 0, sizeof(s));
+    s.hdr.type = REC_TYPE_SERIES;
+    s.hdr.size = rec.size();
+    s.id = _nseries;
+    s.device = device;
+    memcpy(&rec[0], &s, sizeof(s));
+    strcpy(&rec[sizeof(s)], name);
+    strcpy(&rec[sizeof(s) + strlen(name) + 1], unit);
+
+    write_all(&rec[0], rec.size());
+    _series[key] = _nseries;
+    return _nseries++;
+}
+
+void mic_recorder::record(struct device_buffer &buf, uint32_t device,
+                          const char *name, const char *unit, int64_t value)
+{
+    struct column &col = buf.columns[series_id(device, name, unit)];
+    size_t n = buf.times.size();
+
+    /* A series first seen mid-block is missing from the earlier samples */
+    col.values.resize(n - 1, 0);
+    col.present.resize(n - 1, 0);
+    col.values.push_back(value);
+    col.present.push_back(1);
+}
+
+void mic_recorder::append(uint32_t device, const struct mic_snapshot *snap)
+{
+    struct device_buffer &buf = _devices[device];
+    int64_t t = 0;
+    int64_t value;
+    char name[64];
+
+    for (uint32_t i = 0; i < MIC_COLLECT_NFEATURES; i++) {
+        if ((snap->features & (1U << i)) && ((int64_t)snap->time_ms[i] > t))
+            t = snap->time_ms[i];
+    }
+
+    /* Nothing sampled since the last append */
+    if ((t == 0) || (!buf.times.empty() && (t <= buf.times.back())))
+        return;
+
+    buf.times.push_back(t);
+
+    for (uint32_t f = 0; f < snapshot_nfields(); f++) {
+        const char *fname, *unit;
+
+        if (snapshot_field_value(snap, f, &value) != E_MIC_SUCCESS)
+            continue;
+        snapshot_field_info(f, &fname, &unit, NULL);
+        record(buf, device, fname, unit, value);
+    }
+
+    if ((_flags & MIC_RECORD_PER_CORE) &&
+        (snap->features & MIC_COLLECT_CORE_UTIL)) {
+        uint16_t ncores = 0;
+
+        core_util_counters(&snap->cutil, &ncores, NULL, NULL, NULL, NULL);
+        if (ncores > 0) {
+            std::vector<uint64_t> c(MIC_CUTIL_NSTATS * ncores);
+
+            core_util_counters(&snap->cutil, &ncores, &c[0], &c[ncores],
+                               &c[2 * ncores], &c[3 * ncores]);
+            for (uint16_t core = 0; core < ncores; core++) {
+                for (int s = 0; s < MIC_CUTIL_NSTATS; s++) {
+                    snprintf(name, sizeof(name), "core_util.cpu%u.%s",
+                             core, CORE_COUNTERS[s]);
+                    record(buf, device, name, "jiffies",
+                           (int64_t)c[s * ncores + core]);
+                }
+            }
+        }
+    }
+
+    for (std::map<uint32_t, column>::iterator it = buf.columns.begin();
+         it != buf.columns.end(); ++it) {
+        it->second.values.resize(buf.times.size(), 0);
+        it->second.present.resize(buf.times.size(), 0);
+    }
+
+    if (buf.times.size() >= _block_samples)
+        write_block(device, buf);
+}
+
+void mic_recorder::write_block(uint32_t device, struct device_buffer &buf)
+{
+    std::vector<uint8_t> out(sizeof(struct rec_block), 0);
+    struct rec_block b;
+    struct rec_index_entry entry;
+    bit_writer w(out);
+
+    memset(&b, 0, sizeof(b));
+    b.hdr.type = REC_TYPE_BLOCK;
+    b.device = device;
+    b.nsamples = buf.times.size();
+    b.t_first = buf.times.front();
+    b.t_last = buf.times.back();
+
+    encode_dod(w, buf.times);
+    b.ts_bytes = out.size() - sizeof(b);
+
+    for (std::map<uint32_t, column>::iterator it = buf.columns.begin();
+         it != buf.columns.end(); ++it) {
+        struct rec_series_stats stats;
+
+        encode_column(out, it->first, it->second.values,
+                      it->second.present, &stats);
+        _stats.push_back(stats);
+        b.nseries++;
+    }
+
+    out.resize(align8(out.size()), 0);
+    b.hdr.size = out.size();
+    memcpy(&out[0], &b, sizeof(b));
+
+    entry.offset = _end;
+    entry.first_stat = _stats.size() - b.nseries;
+    entry.nstats = b.nseries;
+    try {
+        write_all(&out[0], out.size());
+    } catch (...) {
+        _stats.resize(entry.first_stat);
+        throw;
+    }
+    _entries.push_back(entry);
+    buf.times.clear();
+    buf.columns.clear();
+
+    if (_entries.size() >= REC_INDEX_BLOCKS)
+        write_index();
+}
+
+void mic_recorder::write_index()
+{
+    std::vector<uint8_t> out;
+    struct rec_block_index ix;
+
+    if (_entries.empty())
+        return;
+
+    memset(&ix, 0, sizeof(ix));
+    ix.hdr.type = REC_TYPE_INDEX;
+    ix.hdr.size = sizeof(ix) + _entries.size() * sizeof(_entries[0]) +
+                  _stats.size() * sizeof(_stats[0]);
+    ix.nblocks = _entries.size();
+    ix.nstats = _stats.size();
+
+    out.insert(out.end(), (const uint8_t *)&ix, (const uint8_t *)(&ix + 1));
+    out.insert(out.end(), (const uint8_t *)&_entries[0],
+               (const uint8_t *)(&_entries[0] + _entries.size()));
+    out.insert(out.end(), (const uint8_t *)&_stats[0],
+               (const uint8_t *)(&_stats[0] + _stats.size()));
+
+    write_all(&out[0], out.size());
+    _entries.clear();
+    _stats.clear();
+}
+
+void mic_recorder::flush()
+{
+    for (std::map<uint32_t, device_buffer>::iterator it = _devices.begin();
+         it != _devices.end(); ++it) {
+        if (!it->second.times.empty())
+            write_block(it->first, it->second);
+    }
+    write_index();
+
+    if (fdatasync(_fd) < 0)
+        throw mic_exception(E_MIC_SYSTEM, "fdatasync", errno);
+}
+
+mic_recording::mic_recording(const char *path) : _map(NULL), _size(0)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        throw mic_exception(file_error(errno), "open", errno);
+
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+
+        close(fd);
+        throw mic_exception(E_MIC_SYSTEM, "fstat", err);
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        throw mic_exception(E_MIC_INVAL, "not a telemetry recording");
+    }
+
+    /* Blocks appended after this are not seen; reopen to pick them up */
+    _map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_map == MAP_FAILED)
+        throw mic_exception(file_error(errno), "mmap", errno);
+    _size = st.st_size;
+
+    try {
+        _index.scan(static_cast<const char *>(_map), _size);
+    } catch (...) {
+        munmap(_map, _size);
+        throw;
+    }
+}
+
+mic_recording::~mic_recording()
+{
+    munmap(_map, _size);
+}
+
+uint32_t mic_recording::find_series(uint32_t device, const char *name) const
+{
+    for (size_t i = 0; i < _index.series.size(); i++) {
+        if ((_index.series[i].device == device) &&
+            (_index.series[i].name == name))
+            return i;
+    }
+
+    throw mic_exception(E_MIC_NOENT, "series not in recording", ENOENT);
+}
+
+void mic_recording::time_range(int64_t *first_ms, int64_t *last_ms) const
+{
+    if (_index.blocks.empty())
+        throw mic_exception(E_MIC_NOENT, "recording is empty", ENOENT);
+
+    *first_ms = _index.blocks[0].t_first;
+    *last_ms = _index.blocks[0].t_last;
+    for (size_t i = 1; i < _index.blocks.size(); i++) {
+        if (_index.blocks[i].t_first < *first_ms)
+            *first_ms = _index.blocks[i].t_first;
+        if (_index.blocks[i].t_last > *last_ms)
+            *last_ms = _index.blocks[i].t_last;
+    }
+}
+
+/// \brief Decodes one series of one block into times and values.
+///
+/// Returns false if the block holds no values of the series.
+bool mic_recording::decode(const struct rec_block_info &blk, uint32_t series,
+                           std::vector<int64_t> &times,
+                           std::vector<int64_t> &values) const
+{
+    const char *base = static_cast<const char *>(_map) + blk.offset;
+    const struct rec_block *b = reinterpret_cast<const struct rec_block *>(
+        base);
+    const uint8_t *p = (const uint8_t *)(b + 1) + b->ts_bytes;
+    const uint8_t *end = (const uint8_t *)base + b->hdr.size;
+    std::vector<int64_t> t;
+
+    for (uint32_t i = 0; i < b->nseries; i++) {
+        struct rec_column col;
+        const uint8_t *data;
+        size_t nbytes, n = b->nsamples;
+
+        if ((size_t)(end - p) < sizeof(col))
+            break;
+        memcpy(&col, p, sizeof(col));
+        data = p + sizeof(col);
+        if (col.nbytes > (size_t)(end - data))
+            break;
+        p = data + col.nbytes;
+        if (col.series != series)
+            continue;
+
+        nbytes = col.nbytes;
+        if (col.mode & REC_COL_SPARSE) {
+            size_t bitmap = (b->nsamples + 7) / 8;
+
+            if (nbytes < bitmap)
+                break;
+            n = 0;
+            for (uint32_t j = 0; j < b->nsamples; j++)
+                n += (data[j / 8] >> (7 - j % 8)) & 1;
+            data += bitmap;
+            nbytes -= bitmap;
+        }
+        if (n == 0)
+            return false;
+
+        bit_reader tr((const uint8_t *)(b + 1), b->ts_bytes);
+        bit_reader vr(data, nbytes);
+
+        decode_dod(tr, b->t_first, b->nsamples, t);
+        if ((col.mode & ~REC_COL_SPARSE) == REC_COL_DELTA) {
+            decode_dod(vr, (int64_t)vr.get(64), n, values);
+        } else {
+            values.resize(1);
+            values[0] = (int64_t)vr.get(64);
+            decode_xor(vr, n, values);
+        }
+
+        if (col.mode & REC_COL_SPARSE) {
+            const uint8_t *bitmap = data - (b->nsamples + 7) / 8;
+
+            times.clear();
+            for (uint32_t j = 0; j < b->nsamples; j++) {
+                if ((bitmap[j / 8] >> (7 - j % 8)) & 1)
+                    times.push_back(t[j]);
+            }
+        } else {
+            times.swap(t);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+size_t mic_recording::read(uint32_t series, int64_t from_ms, int64_t to_ms,
+                           int64_t *times, int64_t *values, size_t max) const
+{
+    std::map<uint32_t, std::vector<size_t> >::const_iterator dev;
+    std::vector<size_t>::const_iterator it;
+    std::vector<int64_t> t, v;
+    size_t count = 0;
+
+    if (series >= _index.series.size())
+        throw mic_exception(E_MIC_RANGE, "Incorrect series", ERANGE);
+    dev = _index.device_blocks.find(_index.series[series].device);
+    if (dev == _index.device_blocks.end())
+        return 0;
+
+    for (it = _index.first_block(dev->second, from_ms);
+         it != dev->second.end(); ++it) {
+        const struct rec_block_info &blk = _index.blocks[*it];
+
+        if (blk.t_first > to_ms)
+            break;
+        if (blk.t_last < from_ms)
+            continue;
+        if (!decode(blk, series, t, v))
+            continue;
+
+        for (size_t j = 0; j < t.size(); j++) {
+            if ((t[j] < from_ms) || (t[j] > to_ms))
+                continue;
+            if ((times != NULL) && (count < max)) {
+                times[count] = t[j];
+                values[count] = v[j];
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void mic_recording::summary(uint32_t series, int64_t from_ms, int64_t to_ms,
+                            size_t *count, int64_t *min, int64_t *max,
+                            double *sum) const
+{
+    std::map<uint32_t, std::vector<size_t> >::const_iterator dev;
+    std::vector<size_t>::const_iterator it;
+    std::vector<int64_t> t, v;
+
+    if (series >= _index.series.size())
+        throw mic_exception(E_MIC_RANGE, "Incorrect series", ERANGE);
+
+    *count = 0;
+    *min = std::numeric_limits<int64_t>::max();
+    *max = std::numeric_limits<int64_t>::min();
+    *sum = 0;
+
+    dev = _index.device_blocks.find(_index.series[series].device);
+    if (dev == _index.device_blocks.end()) {
+        *min = *max = 0;
+        return;
+    }
+
+    for (it = _index.first_block(dev->second, from_ms);
+         it != dev->second.end(); ++it) {
+        const struct rec_block_info &blk = _index.blocks[*it];
+
+        if (blk.t_first > to_ms)
+            break;
+        if (blk.t_last < from_ms)
+            continue;
+
+        /* A block wholly in the range is answered by its summary */
+        if (blk.indexed && (blk.t_first >= from_ms) && (blk.t_last <= to_ms)) {
+            for (size_t j = blk.first_stat; j < blk.first_stat + blk.nstats;
+                 j++) {
+                const struct rec_series_stats &st = _index.stats[j];
+
+                if ((st.series != series) || (st.count == 0))
+                    continue;
+                *count += st.count;
+                *min = std::min(*min, st.min);
+                *max = std::max(*max, st.max);
+                *sum += st.sum;
+                break;
+            }
+            continue;
+        }
+
+        if (!decode(blk, series, t, v))
+            continue;
+        for (size_t j = 0; j < t.size(); j++) {
+            if ((t[j] < from_ms) || (t[j] > to_ms))
+                continue;
+            (*count)++;
+            *min = std::min(*min, v[j]);
+            *max = std::max(*max, v[j]);
+            *sum += v[j];
+        }
+    }
+
+    if (*count == 0)
+        *min = *max = 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file recorder.h
+/// \brief Compact append-only recordings of snapshot history.
+
+#ifndef MICLIB_SRC_RECORDER_H_
+#define MICLIB_SRC_RECORDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "miclib_int.h"
+
+/*
+ * A recording is a file header followed by records, each starting with a
+ * struct rec_record and padded to 8 bytes. Series records name a series
+ * before any block uses it; block records hold up to block_samples
+ * samples of every series of one device; index records summarize each
+ * series of the blocks written since the previous index record, so that
+ * queries can skip blocks or answer from the summary alone. Index records
+ * are written every REC_INDEX_BLOCKS blocks and whenever the recorder is
+ * flushed, which leaves one at the end of a file that was closed cleanly.
+ * Records are only ever appended, so a reader that maps the file sees a
+ * consistent prefix of it, and a record torn by a crash is dropped the
+ * next time the file is opened for recording. All values are in host byte
+ * order.
+ */
+#define REC_MAGIC           (0x003143455243494dULL)    /* "MICREC1" */
+#define REC_VERSION         (1)
+#define REC_TYPE_SERIES     (0x53524553U)               /* "SERS" */
+#define REC_TYPE_BLOCK      (0x4b434c42U)               /* "BLCK" */
+#define REC_TYPE_INDEX      (0x58444e49U)               /* "INDX" */
+#define REC_INDEX_BLOCKS    (64)
+
+struct rec_file_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int64_t  created_ms;
+    uint64_t reserved;
+};
+
+struct rec_record {
+    uint32_t type;
+    uint32_t size;              /* Including this header and padding */
+};
+
+/* Followed by the NUL-terminated name and unit */
+struct rec_series {
+    struct rec_record hdr;
+    uint32_t          id;
+    uint32_t          device;
+};
+
+/*
+ * Followed by ts_bytes of timestamp stream, then nseries columns. The
+ * first timestamp is t_first; the rest are delta-of-delta coded.
+ */
+struct rec_block {
+    struct rec_record hdr;
+    uint32_t          device;
+    uint32_t          nsamples;
+    int64_t           t_first;
+    int64_t           t_last;
+    uint32_t          nseries;
+    uint32_t          ts_bytes;
+};
+
+#define REC_COL_XOR         (0x00)     /* Values XOR coded */
+#define REC_COL_DELTA       (0x01)     /* Values delta-of-delta coded */
+#define REC_COL_SPARSE      (0x80)     /* Presence bitmap precedes values */
+
+/* Followed by nbytes of optional bitmap and value stream */
+struct rec_column {
+    uint32_t series;
+    uint8_t  mode;
+    uint8_t  reserved[3];
+    uint32_t nbytes;
+};
+
+/* Followed by nblocks entries, then nstats series summaries */
+struct rec_block_index {
+    struct rec_record hdr;
+    uint32_t          nblocks;
+    uint32_t          nstats;
+};
+
+struct rec_index_entry {
+    uint64_t offset;            /* Of the block record in the file */
+    uint32_t first_stat;        /* Into the summaries of this record */
+    uint32_t nstats;
+};
+
+struct rec_series_stats {
+    uint32_t series;
+    uint32_t count;
+    int64_t  min;
+    int64_t  max;
+    double   sum;
+};
+
+struct rec_series_info {
+    uint32_t    device;
+    std::string name;
+    std::string unit;
+};
+
+struct rec_block_info {
+    size_t   offset;
+    uint32_t device;
+    uint32_t nsamples;
+    int64_t  t_first;
+    int64_t  t_last;
+    int64_t  t_reach;           /* Latest t_last of the device's blocks
+                                 * up to this one */
+    bool     indexed;
+    size_t   first_stat;        /* Into rec_index::stats, if indexed */
+    size_t   nstats;
+};
+
+/// \brief The series and blocks found in a recording, and where it ends.
+struct rec_index {
+    std::vector<struct rec_series_info> series;
+    std::vector<struct rec_block_info> blocks;
+    /* Per device, into blocks and sorted by t_first */
+    std::map<uint32_t, std::vector<size_t> > device_blocks;
+    std::vector<struct rec_series_stats> stats;
+    size_t end;
+
+    void scan(const char *base, size_t size);
+    std::vector<size_t>::const_iterator first_block(
+        const std::vector<size_t> &list, int64_t from_ms) const;
+
+private:
+    void add_index(const struct rec_block_index *ix);
+    void sort_device_blocks();
+};
+
+/// \brief Appends snapshots to a recording, a block per device at a time.
+struct mic_recorder {
+public:
+    mic_recorder(const char *path, uint32_t block_samples, uint32_t flags);
+    ~mic_recorder();
+
+    void append(uint32_t device, const struct mic_snapshot *snap);
+    void flush();
+
+private:
+    mic_recorder(const mic_recorder &);
+    mic_recorder &operator=(const mic_recorder &);
+
+    struct column {
+        std::vector<int64_t> values;
+        std::vector<uint8_t> present;
+    };
+
+    struct device_buffer {
+        std::vector<int64_t> times;
+        std::map<uint32_t, column> columns;
+    };
+
+    void resume(size_t size);
+    uint32_t series_id(uint32_t device, const char *name, const char *unit);
+    void record(struct device_buffer &buf, uint32_t device, const char *name,
+                const char *unit, int64_t value);
+    void write_block(uint32_t device, struct device_buffer &buf);
+    void write_index();
+    void write_all(const void *data, size_t size);
+
+    int _fd;
+    size_t _end;
+    uint32_t _block_samples;
+    uint32_t _flags;
+    uint32_t _nseries;
+    std::map<std::pair<uint32_t, std::string>, uint32_t> _series;
+    std::map<uint32_t, device_buffer> _devices;
+    /* Blocks written since the last index record, and their summaries */
+    std::vector<struct rec_index_entry> _entries;
+    std::vector<struct rec_series_stats> _stats;
+};
+
+/// \brief A recording mapped for reading.
+struct mic_recording {
+public:
+    mic_recording(const char *path);
+    ~mic_recording();
+
+    const struct rec_index &index() const { return _index; }
+    uint32_t find_series(uint32_t device, const char *name) const;
+    void time_range(int64_t *first_ms, int64_t *last_ms) const;
+    size_t read(uint32_t series, int64_t from_ms, int64_t to_ms,
+                int64_t *times, int64_t *values, size_t max) const;
+    void summary(uint32_t series, int64_t from_ms, int64_t to_ms,
+                 size_t *count, int64_t *min, int64_t *max,
+                 double *sum) const;
+
+private:
+    mic_recording(const mic_recording &);
+    mic_recording &operator=(const mic_recording &);
+
+    bool decode(const struct rec_block_info &blk, uint32_t series,
+                std::vector<int64_t> &times,
+                std::vector<int64_t> &values) const;
+
+    void *_map;
+    size_t _size;
+    struct rec_index _index;
+};
+
+#endif /* MICLIB_SRC_RECORDER_H_ */
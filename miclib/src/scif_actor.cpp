@@ -0,0 +1,227 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file scif_actor.cpp
+
+#include <errno.h>
+#include <string.h>
+#include <mic/micras_api.h>
+#include "scif_actor.h"
+
+namespace {
+
+bool same_request(const struct scif_job *a, const struct scif_job *b)
+{
+    return (a->cmd == b->cmd) && (a->parm == b->parm) &&
+           (a->size == b->size);
+}
+
+}
+
+/* Whether a command only reads state, so that identical requests made
+ * at the same time may share one answer. Anything not listed, including
+ * CONNECT, is treated as changing state. */
+bool scif_actor::is_read(int cmd)
+{
+    switch (cmd) {
+    case MR_REQ_CLST:
+    case MR_REQ_CFREQ:
+    case MR_REQ_CVOLT:
+    case MR_REQ_GDDR:
+    case MR_REQ_GFREQ:
+    case MR_REQ_GVOLT:
+    case MR_REQ_ECC:
+    case MR_REQ_VERS:
+    case MR_REQ_PVER:
+    case MR_REQ_HWINF:
+    case MR_REQ_TEMP:
+    case MR_REQ_PWR:
+    case MR_REQ_PLIM:
+    case MR_REQ_PROCHOT:
+    case MR_REQ_PWRALT:
+    case MR_REQ_GPUHOT:
+    case MR_REQ_MEM:
+    case MR_REQ_CUTL:
+    case MR_REQ_TRBO:
+    case MR_REQ_TTL:
+    case MR_REQ_PMCFG:
+    case MR_REQ_LED:
+    case MR_REQ_PERST:
+    case MR_GET_SMC:
+        return true;
+    default:
+        return false;
+    }
+}
+
+scif_actor::scif_actor(execute_fn execute, void *arg) :
+    _execute(execute), _arg(arg), _head(NULL), _stopping(false)
+{
+    int err;
+
+    if (sem_init(&_queued, 0, 0) != 0)
+        throw mic_exception(E_MIC_SYSTEM, "sem_init");
+
+    if ((err = pthread_create(&_thread, NULL, run, this)) != 0) {
+        sem_destroy(&_queued);
+        throw mic_exception(E_MIC_SYSTEM, "pthread_create", err);
+    }
+}
+
+/* Jobs submitted before the destructor runs are still carried out */
+scif_actor::~scif_actor()
+{
+    __atomic_store_n(&_stopping, true, __ATOMIC_RELEASE);
+    sem_post(&_queued);
+    pthread_join(_thread, NULL);
+    sem_destroy(&_queued);
+}
+
+void scif_actor::submit(struct scif_job *job) throw()
+{
+    struct scif_job *head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+    sem_init(&job->done, 0, 0);
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&_head, &head, job, true,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+    sem_post(&_queued);
+}
+
+/*
+ * Returns the job's mic_error_code once the I/O thread is done with it.
+ * A failure is recorded in the calling thread as if it had run the
+ * request itself.
+ */
+int scif_actor::wait(struct scif_job *job) throw()
+{
+    while (sem_wait(&job->done) != 0 && errno == EINTR)
+        ;
+    sem_destroy(&job->done);
+
+    if (job->ret != E_MIC_SUCCESS)
+        return mic_exception::ts_restore_error(&job->err);
+
+    return E_MIC_SUCCESS;
+}
+
+int scif_actor::request(int cmd, void *buf, size_t size,
+                        uint32_t parm) throw()
+{
+    struct scif_job job;
+
+    job.cmd = cmd;
+    job.buf = buf;
+    job.size = size;
+    job.parm = parm;
+    submit(&job);
+
+    return wait(&job);
+}
+
+void *scif_actor::run(void *arg)
+{
+    ((scif_actor *)arg)->loop();
+
+    return NULL;
+}
+
+void scif_actor::loop()
+{
+    for (;;) {
+        while (sem_wait(&_queued) != 0 && errno == EINTR)
+            ;
+
+        struct scif_job *list = __atomic_exchange_n(&_head, NULL,
+                                                    __ATOMIC_ACQUIRE);
+        struct scif_job *first = NULL;
+
+        /* The stack holds the newest job first */
+        while (list != NULL) {
+            struct scif_job *next = list->next;
+
+            list->next = first;
+            first = list;
+            list = next;
+        }
+
+        if (first != NULL)
+            execute_batch(first);
+        else if (__atomic_load_n(&_stopping, __ATOMIC_ACQUIRE))
+            break;
+    }
+}
+
+void scif_actor::complete(struct scif_job *job, int ret)
+{
+    job->ret = ret;
+    if (ret != E_MIC_SUCCESS)
+        mic_exception::ts_save_error((mic_error_code)ret, &job->err);
+    sem_post(&job->done);
+}
+
+/*
+ * Runs the batch in order. A read is answered for every identical read
+ * queued after it, up to the next request that changes state.
+ */
+void scif_actor::execute_batch(struct scif_job *first)
+{
+    while (first != NULL) {
+        struct scif_job *job = first;
+        int ret;
+
+        first = job->next;
+        ret = _execute(_arg, job->cmd, job->buf, job->size, job->parm);
+
+        if (is_read(job->cmd)) {
+            struct scif_job **link = &first;
+            struct scif_job *other;
+
+            while ((other = *link) != NULL && is_read(other->cmd)) {
+                if (!same_request(job, other)) {
+                    link = &other->next;
+                    continue;
+                }
+                *link = other->next;
+                if (ret == E_MIC_SUCCESS)
+                    memcpy(other->buf, job->buf, job->size);
+                complete(other, ret);
+            }
+        }
+        complete(job, ret);
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file scif_actor.h
+/// \brief Per-device I/O thread that owns the SCIF endpoint.
+
+#ifndef MICLIB_SRC_SCIF_ACTOR_H_
+#define MICLIB_SRC_SCIF_ACTOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "miclib_exception.h"
+
+/// \brief A SCIF request and, once done, its result.
+///
+/// The job is the future of the request: the submitting thread owns it,
+/// typically on its stack, and waits on it with scif_actor::wait().
+struct scif_job {
+    struct scif_job *next;
+    int cmd;
+    void *buf;
+    size_t size;
+    uint32_t parm;
+    int ret;
+    struct mic_exception::error_record err;
+    sem_t done;
+};
+
+/// \brief Runs the SCIF requests of one device on a thread of its own.
+///
+/// Callers push jobs on a lock-free stack and sleep on the job's own
+/// semaphore, so they never contend with each other or with the I/O
+/// thread on a mutex; a slow request only delays the requests queued
+/// behind it. The I/O thread takes everything queued at once and runs it
+/// in submission order, answering identical reads queued together with a
+/// single round trip.
+class scif_actor {
+public:
+    /* Runs one request on the I/O thread; returns a mic_error_code */
+    typedef int (*execute_fn)(void *arg, int cmd, void *buf, size_t size,
+                              uint32_t parm);
+
+    /* Job command that only makes sure the endpoint is connected */
+    static const int CONNECT = -1;
+
+    scif_actor(execute_fn execute, void *arg);
+    ~scif_actor();
+
+    void submit(struct scif_job *job) throw();
+    int wait(struct scif_job *job) throw();
+    int request(int cmd, void *buf, size_t size, uint32_t parm) throw();
+
+    static bool is_read(int cmd);
+
+private:
+    scif_actor(const scif_actor &);
+    scif_actor &operator=(const scif_actor &);
+
+    static void *run(void *arg);
+    void loop();
+    void execute_batch(struct scif_job *first);
+    void complete(struct scif_job *job, int ret);
+
+    execute_fn _execute;
+    void *_arg;
+    pthread_t _thread;
+    sem_t _queued;
+    struct scif_job *_head;
+    bool _stopping;
+};
+
+#endif /* MICLIB_SRC_SCIF_ACTOR_H_ */
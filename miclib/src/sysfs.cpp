@@ -0,0 +1,156 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/// \file sysfs.cpp
+/// \brief Allocation-free helpers for reading and parsing sysfs files.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "miclib_int.h"
+
+namespace {
+
+int digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return 99;
+}
+
+bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+           c == '\v';
+}
+
+}
+
+ssize_t sysfs_read(const char *path, char *buf, size_t size)
+{
+    ssize_t len = 0;
+    ssize_t ret;
+    int fd;
+
+    if (size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+
+    /* sysfs hands out the whole attribute on the first read, but a
+     * regular file (or a synthetic tree) may not. */
+    while ((size_t)len < size - 1) {
+        ret = read(fd, buf + len, size - 1 - len);
+        if (ret < 0) {
+            int save = errno;
+
+            (void)close(fd);
+            errno = save;
+            return -1;
+        }
+        if (ret == 0)
+            break;
+        len += ret;
+    }
+
+    if (close(fd) < 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+const char *parse_uint(const char *first, const char *last, int base,
+                       uint64_t *value)
+{
+    const char *p = first;
+    uint64_t v = 0;
+    int d;
+
+    while (p < last && is_blank(*p))
+        p++;
+
+    if (base == 16 && last - p > 2 && p[0] == '0' &&
+        (p[1] == 'x' || p[1] == 'X') && digit_value(p[2]) < 16)
+        p += 2;
+
+    first = p;
+    while (p < last && (d = digit_value(*p)) < base) {
+        if (v > (UINT64_MAX - d) / base)
+            return NULL;
+        v = v * base + d;
+        p++;
+    }
+
+    if (p == first)
+        return NULL;
+
+    *value = v;
+    return p;
+}
+
+const char *uevent_find(const char *buf, size_t len, const char *key,
+                        size_t *vlen)
+{
+    const char *end = buf + len;
+    size_t klen = strlen(key);
+    const char *line = buf;
+
+    while (line < end) {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+
+        if (eol == NULL)
+            eol = end;
+
+        if ((size_t)(eol - line) > klen && line[klen] == '=' &&
+            memcmp(line, key, klen) == 0) {
+            *vlen = eol - (line + klen + 1);
+            return line + klen + 1;
+        }
+
+        line = eol + 1;
+    }
+
+    return NULL;
+}
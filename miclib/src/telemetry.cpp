@@ -0,0 +1,296 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file telemetry.cpp
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "telemetry.h"
+#include "miclib_exception.h"
+#include "miclib_int.h"
+
+namespace {
+
+/* A reader spins this many times on a record being written before it
+ * starts yielding, and gives up after TELEMETRY_READ_TRIES in all. A
+ * record is only left half-written if the publisher died writing it. */
+const int TELEMETRY_READ_SPINS = 100;
+const int TELEMETRY_READ_TRIES = 10000;
+
+/* How often a reader checks that the publisher is still running. A
+ * publisher that is killed never gets to mark the segment closed. */
+const uint64_t TELEMETRY_ALIVE_CHECK_MS = 1000;
+
+uint64_t monotonic_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+mic_error_code shm_error(int err)
+{
+    switch (err) {
+    case ENOENT:
+        return E_MIC_NOENT;
+    case EACCES:
+    case EPERM:
+        return E_MIC_ACCESS;
+    case ENOMEM:
+        return E_MIC_NOMEM;
+    default:
+        return E_MIC_SYSTEM;
+    }
+}
+
+}
+
+mic_telemetry::mic_telemetry(const char *name,
+                             const struct mic_devices_list *devices) :
+    _name(name), _publisher(true), _size(0), _hdr(NULL), _rec(NULL),
+    _alive_ms(0)
+{
+    int fd, err;
+    size_t size = sizeof(struct telemetry_header) +
+                  devices->n_devices * sizeof(struct telemetry_record);
+
+    /*
+     * A segment left behind by a publisher that died is replaced, not
+     * reused: readers still mapping it keep a stale but consistent copy.
+     */
+    if ((shm_unlink(name) < 0) && (errno != ENOENT))
+        throw mic_exception(shm_error(errno), "shm_unlink", errno);
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0)
+        throw mic_exception(shm_error(errno), "shm_open", errno);
+
+    /* Readable by every user, whatever the umask */
+    if ((fchmod(fd, 0644) < 0) || (ftruncate(fd, size) < 0)) {
+        err = errno;
+        close(fd);
+        shm_unlink(name);
+        throw mic_exception(shm_error(err), "ftruncate", err);
+    }
+
+    try {
+        map(fd, size, PROT_READ | PROT_WRITE);
+    } catch (...) {
+        close(fd);
+        shm_unlink(name);
+        throw;
+    }
+    close(fd);
+
+    for (int i = 0; i < devices->n_devices; i++)
+        _rec[i].device_num = devices->devices[i];
+
+    _hdr->version = TELEMETRY_VERSION;
+    _hdr->record_size = sizeof(struct telemetry_record);
+    _hdr->num_records = devices->n_devices;
+    _hdr->publisher = getpid();
+    /* Readers check the magic first, so it goes in last */
+    __atomic_store_n(&_hdr->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+}
+
+mic_telemetry::mic_telemetry(const char *name) :
+    _name(name), _publisher(false), _size(0), _hdr(NULL), _rec(NULL),
+    _alive_ms(0)
+{
+    int fd;
+    struct stat st;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        throw mic_exception(shm_error(errno), "shm_open", errno);
+
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+
+        close(fd);
+        throw mic_exception(E_MIC_SYSTEM, "fstat", err);
+    }
+
+    /* The publisher may not have sized the segment yet */
+    if ((size_t)st.st_size < sizeof(struct telemetry_header)) {
+        close(fd);
+        throw mic_exception(E_MIC_NOENT, "telemetry segment not ready",
+                            ENOENT);
+    }
+
+    try {
+        map(fd, st.st_size, PROT_READ);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    try {
+        if (__atomic_load_n(&_hdr->magic, __ATOMIC_ACQUIRE) !=
+            TELEMETRY_MAGIC)
+            throw mic_exception(E_MIC_NOENT, "telemetry segment not ready",
+                                ENOENT);
+
+        if ((_hdr->version != TELEMETRY_VERSION) ||
+            (_hdr->record_size != sizeof(struct telemetry_record)))
+            throw mic_exception(E_MIC_INVAL,
+                                "telemetry segment version mismatch");
+
+        if (_size < sizeof(struct telemetry_header) +
+            _hdr->num_records * sizeof(struct telemetry_record))
+            throw mic_exception(E_MIC_INVAL, "telemetry segment truncated");
+
+        check_publisher();
+    } catch (...) {
+        munmap(_hdr, _size);
+        throw;
+    }
+}
+
+mic_telemetry::~mic_telemetry()
+{
+    if (_publisher) {
+        __atomic_store_n(&_hdr->closed, 1, __ATOMIC_RELEASE);
+        shm_unlink(_name.c_str());
+    }
+    munmap(_hdr, _size);
+}
+
+void mic_telemetry::map(int fd, size_t size, int prot)
+{
+    void *addr = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED)
+        throw mic_exception(shm_error(errno), "mmap", errno);
+
+    _size = size;
+    _hdr = static_cast<struct telemetry_header *>(addr);
+    _rec = reinterpret_cast<struct telemetry_record *>(_hdr + 1);
+}
+
+struct telemetry_record *mic_telemetry::find(uint32_t device_num) const
+{
+    for (uint32_t i = 0; i < _hdr->num_records; i++) {
+        if (_rec[i].device_num == device_num)
+            return &_rec[i];
+    }
+
+    throw mic_exception(E_MIC_NOENT, "device not in telemetry segment",
+                        ENOENT);
+}
+
+int mic_telemetry::num_devices() const
+{
+    return _hdr->num_records;
+}
+
+int mic_telemetry::device_at_index(int index) const
+{
+    if ((index < 0) || ((uint32_t)index >= _hdr->num_records))
+        throw mic_exception(E_MIC_RANGE, "Incorrect device number", ERANGE);
+
+    return _rec[index].device_num;
+}
+
+void mic_telemetry::publish(uint32_t device_num,
+                            const struct mic_snapshot *snap)
+{
+    struct telemetry_record *rec = find(device_num);
+    uint64_t seq = rec->seq;
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(&rec->snap, snap, sizeof(rec->snap));
+
+    __atomic_store_n(&rec->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Throws E_MIC_NOENT if the publisher closed the segment or is no longer
+ * running. The process is only looked for once every
+ * TELEMETRY_ALIVE_CHECK_MS, so most reads make no system call.
+ */
+void mic_telemetry::check_publisher() const
+{
+    uint64_t now, alive;
+
+    if (__atomic_load_n(&_hdr->closed, __ATOMIC_ACQUIRE))
+        throw mic_exception(E_MIC_NOENT, "telemetry publisher has exited",
+                            ENOENT);
+
+    now = monotonic_ms();
+    alive = __atomic_load_n(&_alive_ms, __ATOMIC_RELAXED);
+    if ((alive != 0) && (now - alive < TELEMETRY_ALIVE_CHECK_MS))
+        return;
+
+    /* EPERM still means the process exists */
+    if ((kill((pid_t)_hdr->publisher, 0) < 0) && (errno == ESRCH))
+        throw mic_exception(E_MIC_NOENT, "telemetry publisher has exited",
+                            ENOENT);
+
+    __atomic_store_n(&_alive_ms, now, __ATOMIC_RELAXED);
+}
+
+void mic_telemetry::read(uint32_t device_num, struct mic_snapshot *snap) const
+{
+    struct telemetry_record *rec;
+    uint64_t seq;
+
+    check_publisher();
+
+    rec = find(device_num);
+    for (int tries = 0; tries < TELEMETRY_READ_TRIES; tries++) {
+        seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            memcpy(snap, &rec->snap, sizeof(*snap));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == seq)
+                return;
+        }
+        if (tries >= TELEMETRY_READ_SPINS)
+            sched_yield();
+    }
+
+    throw mic_exception(E_MIC_ACCESS, "telemetry record busy", EBUSY);
+}
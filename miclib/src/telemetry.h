@@ -0,0 +1,107 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 2.1.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Disclaimer: The codes contained in these modules may be specific
+ * to the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+
+/// \file telemetry.h
+/// \brief Host-wide telemetry published through POSIX shared memory.
+
+#ifndef MICLIB_SRC_TELEMETRY_H_
+#define MICLIB_SRC_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "miclib_int.h"
+
+#define TELEMETRY_MAGIC      (0x5443494dU)    /* "MICT" */
+#define TELEMETRY_VERSION    (1)
+
+/*
+ * The segment is a header followed by one record per device. Readers
+ * refuse a segment whose version or record size differs from their
+ * own, so any change to these structures or to struct mic_snapshot
+ * must bump TELEMETRY_VERSION.
+ */
+struct telemetry_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_records;
+    uint32_t closed;            /* Set once the publisher has gone */
+    uint32_t publisher;         /* Process ID of the publisher */
+} __attribute__((aligned(64)));
+
+struct telemetry_record {
+    uint64_t           seq;     /* Odd while the record is being written */
+    uint32_t           device_num;
+    uint32_t           reserved;
+    struct mic_snapshot snap;
+} __attribute__((aligned(64)));
+
+/// \brief A mapping of the telemetry segment, as publisher or reader.
+///
+/// There is a single publisher per segment, which owns it and removes it
+/// when destroyed. Each record is guarded by its own sequence counter,
+/// so a reader copies one device's snapshot with plain loads and retries
+/// only if that record was rewritten meanwhile.
+struct mic_telemetry {
+public:
+    mic_telemetry(const char *name, const struct mic_devices_list *devices);
+    mic_telemetry(const char *name);
+    ~mic_telemetry();
+
+    int num_devices() const;
+    int device_at_index(int index) const;
+    void publish(uint32_t device_num, const struct mic_snapshot *snap);
+    void read(uint32_t device_num, struct mic_snapshot *snap) const;
+
+private:
+    mic_telemetry(const mic_telemetry &);
+    mic_telemetry &operator=(const mic_telemetry &);
+
+    void map(int fd, size_t size, int prot);
+    struct telemetry_record *find(uint32_t device_num) const;
+    void check_publisher() const;
+
+    std::string _name;
+    bool _publisher;
+    size_t _size;
+    struct telemetry_header *_hdr;
+    struct telemetry_record *_rec;
+    /* When a reader last found the publisher running */
+    mutable uint64_t _alive_ms;
+};
+
+#endif /* MICLIB_SRC_TELEMETRY_H_ */
@@ -180,6 +180,7 @@ FEATURES["mic_get_idle_counters"] = COREUTIL
 FEATURES["mic_get_nice_counters"] = COREUTIL
 FEATURES["mic_get_sys_counters"] = COREUTIL
 FEATURES["mic_get_user_counters"] = COREUTIL
+FEATURES["mic_get_core_counters_soa"] = COREUTIL
 FEATURES["mic_get_idle_sum"] = COREUTIL
 FEATURES["mic_get_sys_sum"] = COREUTIL
 FEATURES["mic_get_nice_sum"] = COREUTIL
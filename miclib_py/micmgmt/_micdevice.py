@@ -958,6 +958,27 @@ class MicDevice():
             user_list.append(user_v)
         return user_list
     
+    def mic_get_core_counters_soa(self):
+        """Returns a tuple (user, nice, sys, idle) of ctypes arrays of
+        c_uint64, one entry per core, filled in a single library call.
+        The arrays support the buffer protocol, so they can be handed to
+        numpy.frombuffer() or numpy.ctypeslib.as_array() without a copy.
+        
+        See mic_update_core_util().
+        
+        """
+        func, struct = self._get_func()
+        num_cores = ctypes.c_ushort()
+        #A NULL user array only queries num_cores
+        ret_code = func(struct, ctypes.byref(num_cores), None, None, None,
+                        None)
+        self._check_success(ret_code)
+        counters = tuple((ctypes.c_uint64 * num_cores.value)()
+                         for i in range(4))
+        ret_code = func(struct, ctypes.byref(num_cores), *counters)
+        self._check_success(ret_code)
+        return counters
+    
     def mic_get_idle_sum(self):
         """Returns sum of idle time for all the cores.
         